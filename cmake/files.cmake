@@ -1,5 +1,24 @@
 get_filename_component(ramfs_DIR ${CMAKE_CURRENT_LIST_DIR}/.. ABSOLUTE CACHE)
 
+set(libramfs_common_SRC
+    ${ramfs_DIR}/src/alloc.c
+    ${ramfs_DIR}/src/dcache.c
+    ${ramfs_DIR}/src/extent.c
+    ${ramfs_DIR}/src/image.c
+    ${ramfs_DIR}/src/journal.c
+    ${ramfs_DIR}/src/ramfs.c
+    ${ramfs_DIR}/src/slab.c
+)
+
+set(libramfs_hash_SRC
+    ${ramfs_DIR}/src/ramfs_hash.c
+)
+
+set(libramfs_hybrid_SRC
+    ${ramfs_DIR}/src/ramfs_hybrid.c
+    ${ramfs_DIR}/src/rbtree.c
+)
+
 set(libramfs_rbtree_SRC
     ${ramfs_DIR}/src/ramfs_rbtree.c
     ${ramfs_DIR}/src/rbtree.c
@@ -10,9 +29,19 @@ set(libramfs_vector_SRC
 )
 
 if(CONFIG_RAMFS_USE_RBTREE STREQUAL "y")
-    set(libramfs_SRC ${libramfs_rbtree_SRC})
+    set(libramfs_SRC ${libramfs_common_SRC} ${libramfs_rbtree_SRC})
+elseif(CONFIG_RAMFS_USE_HASH STREQUAL "y")
+    set(libramfs_SRC ${libramfs_common_SRC} ${libramfs_hash_SRC})
+elseif(CONFIG_RAMFS_USE_HYBRID STREQUAL "y")
+    set(libramfs_SRC ${libramfs_common_SRC} ${libramfs_hybrid_SRC})
 else()
-    set(libramfs_SRC ${libramfs_vector_SRC})
+    set(libramfs_SRC ${libramfs_common_SRC} ${libramfs_vector_SRC})
+endif()
+
+if(CONFIG_RAMFS_RCU STREQUAL "y")
+    list(APPEND libramfs_SRC
+        ${ramfs_DIR}/src/epoch.c
+    )
 endif()
 
 set(libramfs_INC
@@ -24,3 +53,14 @@ if(ESP_PLATFORM)
         ${ramfs_DIR}/src/vfs.c
     )
 endif()
+
+# the VFS interface builds on the host against a stand-in for the ESP-IDF VFS
+set(libramfs_vfs_shim_SRC
+    ${ramfs_DIR}/src/vfs.c
+    ${ramfs_DIR}/tests/esp/vfs_shim.c
+)
+
+set(libramfs_vfs_shim_INC
+    ${ramfs_DIR}/src
+    ${ramfs_DIR}/tests/esp
+)
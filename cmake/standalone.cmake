@@ -11,6 +11,11 @@ PUBLIC
     ${libramfs_INC}
 )
 
+if(CONFIG_RAMFS_LOCK_PTHREAD STREQUAL "y")
+    find_package(Threads REQUIRED)
+    target_link_libraries(ramfs PUBLIC Threads::Threads)
+endif()
+
 get_cmake_property(_vars VARIABLES)
 list(SORT _vars)
 foreach(_var ${_vars})
@@ -25,3 +30,28 @@ foreach(_var ${_vars})
         target_compile_definitions(ramfs PUBLIC "${_var}=${${_var}}")
     endif()
 endforeach()
+
+option(RAMFS_VFS_TESTS "Build the VFS interface test and benchmark on the host" OFF)
+
+if(RAMFS_VFS_TESTS)
+    foreach(_name pass_vfs_test bench_vfs)
+        add_executable(${_name}
+            ${ramfs_DIR}/tests/${_name}.c
+            ${libramfs_vfs_shim_SRC}
+        )
+        target_include_directories(${_name} PRIVATE ${libramfs_vfs_shim_INC})
+        target_compile_definitions(${_name} PRIVATE CONFIG_RAMFS_VFS_SUPPORT_DIR=1)
+        target_link_libraries(${_name} PRIVATE ramfs)
+    endforeach()
+    add_test(NAME pass_vfs COMMAND pass_vfs_test)
+
+    # stands in for the ESP-IDF VFS itself, so it goes without the shim
+    add_executable(pass_vfs_fd_test
+        ${ramfs_DIR}/tests/pass_vfs_fd_test.c
+        ${ramfs_DIR}/src/vfs.c
+    )
+    target_include_directories(pass_vfs_fd_test PRIVATE ${libramfs_vfs_shim_INC})
+    target_compile_definitions(pass_vfs_fd_test PRIVATE CONFIG_RAMFS_VFS_SUPPORT_DIR=1)
+    target_link_libraries(pass_vfs_fd_test PRIVATE ramfs)
+    add_test(NAME pass_vfs_fd COMMAND pass_vfs_fd_test)
+endif()
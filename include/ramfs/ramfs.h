@@ -10,6 +10,7 @@ extern "C" {
 
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 
 /**
@@ -35,9 +36,138 @@ typedef struct ramfs_entry_t ramfs_entry_t;
  */
 typedef struct ramfs_stat_t {
     ramfs_entry_type_t type; /**< entry type */
-    size_t size; /**< file size */
+    size_t size; /**< file size, or number of entries in a directory */
 } ramfs_stat_t;
 
+/**
+ * \brief       Contiguous piece of file data returned by \a ramfs_read_view
+ */
+typedef struct ramfs_span_t {
+    const void *buf; /**< start of the data */
+    size_t len; /**< length of the data */
+} ramfs_span_t;
+
+/**
+ * \brief       Flags for \a ramfs_create_from_buffer
+ */
+typedef enum ramfs_buffer_flags_t {
+    RAMFS_BUFFER_REF = 0, /**< reference memory that is never written or
+                               freed, such as flash or .rodata */
+    RAMFS_BUFFER_OWN = 1, /**< take over a buffer from the filesystem
+                               allocator, freed with the file */
+} ramfs_buffer_flags_t;
+
+/**
+ * \brief       Directory record filled by \a ramfs_readdir_batch
+ */
+typedef struct ramfs_dirent_t {
+    const char *name; /**< entry name, see \a ramfs_get_name_ref */
+    size_t name_len; /**< length of \a name */
+    ramfs_entry_type_t type; /**< entry type */
+    size_t size; /**< file size, or number of entries in a directory */
+} ramfs_dirent_t;
+
+/**
+ * \brief       Object caches kept by a filesystem
+ */
+typedef enum ramfs_slab_type_t {
+    RAMFS_SLAB_DIR, /**< directory entries */
+    RAMFS_SLAB_FILE, /**< file entries */
+    RAMFS_SLAB_FH, /**< file handles */
+    RAMFS_SLAB_DH, /**< directory handles */
+    RAMFS_SLAB_MAX,
+} ramfs_slab_type_t;
+
+/**
+ * \brief       Structure filled by the \a ramfs_slab_stats function
+ */
+typedef struct ramfs_slab_stats_t {
+    size_t obj_size; /**< size of each object */
+    size_t pages; /**< pages allocated, 0 without \a CONFIG_RAMFS_USE_SLAB */
+    size_t capacity; /**< object slots across all pages */
+    size_t in_use; /**< objects in use */
+} ramfs_slab_stats_t;
+
+/**
+ * \brief       Structure filled by the \a ramfs_dcache_stats function
+ */
+typedef struct ramfs_dcache_stats_t {
+    size_t size; /**< paths the cache can hold, 0 if disabled */
+    size_t used; /**< paths currently cached */
+    size_t hits; /**< lookups answered from the cache */
+    size_t misses; /**< lookups that walked the tree */
+} ramfs_dcache_stats_t;
+
+/**
+ * \brief       \a dcache_size of a filesystem without a dentry cache
+ */
+#define RAMFS_DCACHE_OFF ((size_t) -1)
+
+/**
+ * \brief       Memory allocator interface
+ *
+ * All memory owned by a filesystem is obtained through its allocator.
+ */
+typedef struct ramfs_allocator_t {
+    void *(*malloc)(void *ctx, size_t size); /**< allocate memory */
+    void *(*realloc)(void *ctx, void *ptr, size_t size); /**< resize memory */
+    void (*free)(void *ctx, void *ptr); /**< free memory */
+    void (*release)(void *ctx); /**< optional, free all memory at once */
+    void *ctx; /**< allocator context passed to every function */
+} ramfs_allocator_t;
+
+/**
+ * \brief       Function receiving image data from \a ramfs_save_image
+ *
+ * Called with consecutive pieces of the image, in order.
+ *
+ * \param[in]   ctx     context passed to \a ramfs_save_image
+ * \param[in]   buf     next piece of the image
+ * \param[in]   len     length of \a buf
+ * \return              0 on success, -1 on error to abort the save
+ */
+typedef int (*ramfs_image_write_t)(void *ctx, const void *buf, size_t len);
+
+/**
+ * \brief       Backing store interface for the journal
+ *
+ * A store is an array of bytes addressed by offset, such as a file or a
+ * flash partition. The journal only ever appends to it, and overwrites a
+ * torn tail left by a crash.
+ */
+typedef struct ramfs_store_t {
+    ssize_t (*read)(void *ctx, off_t offset, void *buf,
+            size_t len); /**< read up to \a len bytes, 0 past the end, -1
+                              on error */
+    int (*write)(void *ctx, off_t offset, const void *buf,
+            size_t len); /**< write all of \a buf, 0 on success, -1 on
+                              error */
+    int (*sync)(void *ctx); /**< optional, make what was written durable,
+                                 0 on success, -1 on error */
+    void *ctx; /**< store context passed to every function */
+} ramfs_store_t;
+
+/**
+ * \brief       Configuration structure for the \a ramfs_init_ex function
+ */
+typedef struct ramfs_config_t {
+    const ramfs_allocator_t *allocator; /**< allocator, or \a NULL for the C
+                                             library heap */
+    size_t small_dir_max; /**< hybrid index: entries a directory holds
+                               before it converts to a tree, 0 for the
+                               default */
+    size_t small_dir_min; /**< hybrid index: entries at which a tree
+                               converts back, below \a small_dir_max, 0 for
+                               the default */
+    size_t dcache_size; /**< paths kept in the dentry cache, 0 for the
+                             default or \a RAMFS_DCACHE_OFF for none */
+    const ramfs_store_t *journal; /**< store to replay and record changes
+                                       to, or \a NULL for none. Images
+                                       cannot be journaled. */
+    size_t journal_buffer; /**< bytes of journal records batched before
+                                they are written, 0 for the default */
+} ramfs_config_t;
+
 #if defined(__DOXYGEN__) || !defined(RAMFS_PRIVATE_STRUCTS)
 /**
  * \brief       A ramfs directory handle
@@ -62,12 +192,229 @@ typedef struct ramfs_fh_t {
  */
 ramfs_fs_t *ramfs_init(void);
 
+/**
+ * \brief       Initialize filesystem with a configuration and return pointer
+ * \param[in]   config  \a ramfs_config_t pointer, copied by this function
+ * \return              \a ramfs_fs_t pointer or \a NULL on error, with
+ *                      \a errno set to \a EINVAL if the journal does not
+ *                      replay
+ */
+ramfs_fs_t *ramfs_init_ex(const ramfs_config_t *config);
+
+/**
+ * \brief       Set up a bump allocator over a memory region
+ *
+ * Memory freed back to an arena is only reclaimed if it was the most recent
+ * allocation; everything else is reclaimed at once when the filesystem using
+ * it is torn down with \a ramfs_deinit().
+ *
+ * \param[out]  allocator   \a ramfs_allocator_t to fill in
+ * \param[in]   region      memory to allocate from, or \a NULL to allocate
+ *                          chunks of \a size bytes from the C library heap
+ *                          on demand
+ * \param[in]   size        size of \a region, or chunk size
+ * \return                  0 on success, -1 on error
+ */
+int ramfs_arena_init(ramfs_allocator_t *allocator, void *region, size_t size);
+
 /**
  * \brief       Tear down a filesystem
+ *
+ * If the allocator has a \a release function, all memory is returned in one
+ * call instead of freeing each entry.
+ *
  * \param[in]   fs      \a ramfs_fs_t pointer
  */
 void ramfs_deinit(ramfs_fs_t *fs);
 
+/**
+ * \brief       Write out batched journal records and sync the store
+ *
+ * With a \a journal store configured, the filesystem is rebuilt from it by
+ * \a ramfs_init_ex(), and every create, write, truncate, rename and
+ * removal after that is recorded to it. Records are batched in memory and
+ * written when \a CONFIG_RAMFS_JOURNAL_BUFFER bytes of them have built up,
+ * so the changes since the last call can be lost in a crash, never the
+ * ones before it. A record torn by a crash ends the journal when it is
+ * replayed.
+ *
+ * Once a record could not be written, nothing more is recorded and every
+ * call fails.
+ *
+ * \param[in]   fs      \a ramfs_fs_t pointer
+ * \return              0 on success or without a journal, -1 on error
+ */
+int ramfs_sync(ramfs_fs_t *fs);
+
+/**
+ * \brief       Set up a journal store over a local file
+ * \param[out]  store   \a ramfs_store_t to fill in
+ * \param[in]   path    file to use, created if it does not exist
+ * \return              0 on success, -1 on error
+ */
+int ramfs_store_file_init(ramfs_store_t *store, const char *path);
+
+/**
+ * \brief       Close a store set up with \a ramfs_store_file_init()
+ * \param[in]   store   \a ramfs_store_t pointer
+ */
+void ramfs_store_file_deinit(ramfs_store_t *store);
+
+/**
+ * \brief       Write the whole filesystem out as a single image
+ *
+ * The image holds every directory and file with its data, and is restored
+ * with \a ramfs_load_image(). Directories and files are locked against
+ * changes while it is written, so it is a consistent snapshot. Images are
+ * in the byte order of the machine that saved them and at most 4 GiB.
+ *
+ * \param[in]   fs      \a ramfs_fs_t pointer
+ * \param[in]   write   called with the image, piece by piece
+ * \param[in]   ctx     passed to \a write
+ * \return              image size in bytes, or -1 on error
+ */
+ssize_t ramfs_save_image(ramfs_fs_t *fs, ramfs_image_write_t write,
+        void *ctx);
+
+/**
+ * \brief       Create a filesystem from an image
+ *
+ * The tree is rebuilt in one pass over the image, with each directory
+ * filled from its already sorted entries at once. File data is copied, so
+ * the image can be freed afterwards.
+ *
+ * \param[in]   image   image from \a ramfs_save_image(), 4-byte aligned
+ * \param[in]   len     image length
+ * \param[in]   config  \a ramfs_config_t pointer, or \a NULL for defaults
+ * \return              \a ramfs_fs_t pointer or \a NULL with \a errno set
+ *                      to \a EINVAL if the image is damaged
+ */
+ramfs_fs_t *ramfs_load_image(const void *image, size_t len,
+        const ramfs_config_t *config);
+
+/**
+ * \brief       Mount an image read-only, in place
+ *
+ * Nothing is copied up front: only the root exists at first, and every
+ * directory is read in from the image the first time it is looked into.
+ * Names and file data are used where they are in the image, so the image
+ * (a mapped file or flash partition) must stay mapped and unchanged until
+ * \a ramfs_deinit(). Anything that would change the filesystem fails with
+ * \a EROFS.
+ *
+ * A damaged image is found out directory by directory, as they are read
+ * in. Looking into a damaged directory fails with \a errno set to
+ * \a EINVAL.
+ *
+ * \param[in]   image   image from \a ramfs_save_image(), 4-byte aligned
+ * \param[in]   len     image length
+ * \param[in]   config  \a ramfs_config_t pointer, or \a NULL for defaults
+ * \return              \a ramfs_fs_t pointer or \a NULL with \a errno set
+ *                      to \a EINVAL if the image header is damaged
+ */
+ramfs_fs_t *ramfs_mount_image(const void *image, size_t len,
+        const ramfs_config_t *config);
+
+/**
+ * \brief       Mount an image in place, with changes kept in memory
+ *
+ * Like \a ramfs_mount_image(), but the filesystem can be changed. The image
+ * itself is never written: a directory is copied into memory when it is
+ * first looked into, with its entries still pointing at their names and
+ * data in the image, and a write copies only the extents it touches.
+ * Removed entries are dropped from the copied directory, so they do not
+ * show through from the image again. Memory use grows with the
+ * directories looked into and the data changed, not with the image.
+ *
+ * \param[in]   image   image from \a ramfs_save_image(), 4-byte aligned
+ * \param[in]   len     image length
+ * \param[in]   config  \a ramfs_config_t pointer, or \a NULL for defaults
+ * \return              \a ramfs_fs_t pointer or \a NULL with \a errno set
+ *                      to \a EINVAL if the image header is damaged
+ */
+ramfs_fs_t *ramfs_overlay_image(const void *image, size_t len,
+        const ramfs_config_t *config);
+
+/**
+ * \brief       Write out what changed since the last checkpoint
+ *
+ * A checkpoint holds the new entry list of every directory that gained,
+ * lost or renamed an entry, and for every file written or truncated the
+ * new size and the extents written, so its size follows the changes rather
+ * than the filesystem. It applies with \a ramfs_apply_checkpoint() on top
+ * of the base the filesystem started from, and the checkpoints taken
+ * before it. The base is an empty filesystem, the image it was loaded from
+ * or mounted over, or the image the last \a ramfs_compact() wrote.
+ * Everything is locked while it is written, as for \a ramfs_save_image().
+ * If it fails, the changes are kept for the next one.
+ *
+ * \param[in]   fs      \a ramfs_fs_t pointer
+ * \param[in]   write   called with the checkpoint, piece by piece
+ * \param[in]   ctx     passed to \a write
+ * \return              checkpoint size in bytes, or -1 on error with
+ *                      \a errno set to \a EINVAL if \a fs has a journal
+ */
+ssize_t ramfs_checkpoint(ramfs_fs_t *fs, ramfs_image_write_t write,
+        void *ctx);
+
+/**
+ * \brief       Write the whole filesystem out as a new base image
+ *
+ * Like \a ramfs_save_image(), and once the image is written it is the base
+ * for the checkpoints that follow, which then start over from an empty
+ * one. Compact when the checkpoints since the last base add up to more
+ * than a new base would take to load.
+ *
+ * \param[in]   fs      \a ramfs_fs_t pointer
+ * \param[in]   write   called with the image, piece by piece
+ * \param[in]   ctx     passed to \a write
+ * \return              image size in bytes, or -1 on error with \a errno
+ *                      set to \a EINVAL if \a fs has a journal
+ */
+ssize_t ramfs_compact(ramfs_fs_t *fs, ramfs_image_write_t write, void *ctx);
+
+/**
+ * \brief       Apply the next checkpoint to a filesystem
+ *
+ * \a fs is the base of the checkpoints with those before this one applied,
+ * and is not otherwise changed while they are applied. Afterwards it can
+ * take checkpoints of its own that continue the sequence.
+ *
+ * \param[in]   fs      \a ramfs_fs_t pointer
+ * \param[in]   buf     checkpoint from \a ramfs_checkpoint()
+ * \param[in]   len     checkpoint length
+ * \return              0 on success, -1 on error with \a errno set to
+ *                      \a EINVAL if the checkpoint is damaged, out of
+ *                      sequence or does not match the tree, in which case
+ *                      \a fs may be partly changed, or to \a EROFS if
+ *                      \a fs is a read-only mount
+ */
+int ramfs_apply_checkpoint(ramfs_fs_t *fs, const void *buf, size_t len);
+
+/**
+ * \brief       Get occupancy of one of the filesystem's object caches
+ * \param[in]   fs      \a ramfs_fs_t pointer
+ * \param[in]   type    cache to query
+ * \param[out]  stats   \a ramfs_slab_stats_t structure
+ */
+void ramfs_slab_stats(ramfs_fs_t *fs, ramfs_slab_type_t type,
+        ramfs_slab_stats_t *stats);
+
+/**
+ * \brief       Get dentry cache statistics
+ *
+ * \a ramfs_get_entry() remembers which entry a full path resolved to, or
+ * that it did not resolve, so repeated lookups of the same path skip the
+ * walk. The cache holds \a CONFIG_RAMFS_DCACHE_SIZE paths unless the
+ * \a dcache_size configuration member says otherwise, and is disabled when
+ * the result is 0 or \a RAMFS_DCACHE_OFF. The slots are allocated as entries
+ * are created, not up front.
+ *
+ * \param[in]   fs      \a ramfs_fs_t pointer
+ * \param[out]  stats   \a ramfs_dcache_stats_t structure
+ */
+void ramfs_dcache_stats(ramfs_fs_t *fs, ramfs_dcache_stats_t *stats);
+
 /**
  * \brief       Get parent entry of path
  * \param[in]   fs      \a ramfs_fs_t pointer
@@ -85,6 +432,20 @@ ramfs_entry_t *ramfs_get_parent(ramfs_fs_t *fs, const char *path);
  */
 ramfs_entry_t *ramfs_get_entry(ramfs_fs_t *fs, const char *path);
 
+/**
+ * \brief       Get ramfs entry for a path relative to a directory
+ *
+ * The \a *_at() functions resolve \a path starting at \a dir instead of the
+ * root, so working inside one directory does not walk down to it every time.
+ * A \a path that starts with a slash is resolved from the root, like with
+ * the POSIX functions of the same names.
+ *
+ * \param[in]   dir     directory entry
+ * \param[in]   path    name or relative path
+ * \return              \a ramfs_entry_t or \a NULL if path was not found
+ */
+ramfs_entry_t *ramfs_get_entry_at(ramfs_entry_t *dir, const char *path);
+
 /**
  * \brief       Return entry name component
  * \param[in]   entry   \a ramfs_entry_t pointer
@@ -92,6 +453,18 @@ ramfs_entry_t *ramfs_get_entry(ramfs_fs_t *fs, const char *path);
  */
 char *ramfs_get_name(const ramfs_entry_t *entry);
 
+/**
+ * \brief       Return the entry name without copying it
+ *
+ * The name belongs to the entry and stays valid until the entry is renamed
+ * or removed.
+ *
+ * \param[in]   entry   \a ramfs_entry_t pointer
+ * \param[out]  len     set to the name length if not \a NULL
+ * \return              NUL terminated name, empty for the root directory
+ */
+const char *ramfs_get_name_ref(const ramfs_entry_t *entry, size_t *len);
+
 /**
  * \brief       Get path for ramfs entry
  * \param[in]   entry   \a ramfs_entry_t pointer
@@ -131,6 +504,36 @@ void ramfs_stat(ramfs_fs_t *fs, const ramfs_entry_t *entry, ramfs_stat_t *st);
  */
 ramfs_entry_t *ramfs_create(ramfs_fs_t *fs, const char *path, int flags);
 
+/**
+ * \brief       Create a file whose contents are an existing buffer
+ *
+ * The buffer is used as is, without copying. Referenced memory is copied
+ * piece by piece the first time each piece is written, and is never freed.
+ * An owned buffer is written in place and freed once the file no longer
+ * uses it; it must come from the filesystem allocator. Referenced memory
+ * must outlive the file.
+ *
+ * \param[in]   fs      \a ramfs_fs_t pointer
+ * \param[in]   path    full path to file
+ * \param[in]   buf     file contents
+ * \param[in]   len     length of \a buf
+ * \param[in]   flags   \a RAMFS_BUFFER_REF or \a RAMFS_BUFFER_OWN
+ * \return              created entry or \a NULL on error, in which case an
+ *                      owned buffer is still the caller's
+ */
+ramfs_entry_t *ramfs_create_from_buffer(ramfs_fs_t *fs, const char *path,
+        const void *buf, size_t len, int flags);
+
+/**
+ * \brief       Create an empty file relative to a directory
+ * \param[in]   dir     directory entry
+ * \param[in]   path    name or relative path to file
+ * \param[in]   flags   flags to pass to \a ramfs_open()
+ * \return              created entry or \a NULL on error
+ */
+ramfs_entry_t *ramfs_create_at(ramfs_entry_t *dir, const char *path,
+        int flags);
+
 /**
  * \brief       Truncate an existing file
  * \param[in]   fs      \a ramfs_fs_t pointer
@@ -175,6 +578,89 @@ ssize_t ramfs_read(ramfs_fh_t *fh, char *buf, size_t len);
  */
 ssize_t ramfs_write(ramfs_fh_t *fh, const char *buf, size_t len);
 
+/**
+ * \brief       Read data from an open file at a given offset
+ *
+ * The file position is neither used nor updated.
+ *
+ * \param[in]   fh      \a ramfs_fh_t handle
+ * \param[out]  buf     buffer to read into
+ * \param[in]   len     maximum number of bytes to read
+ * \param[in]   offset  file offset to read from
+ * \return              actual number of bytes read, zero if the end of file
+ *                      reached, or < 0 on error
+ */
+ssize_t ramfs_pread(ramfs_fh_t *fh, char *buf, size_t len, off_t offset);
+
+/**
+ * \brief       Write data to an open file at a given offset
+ *
+ * The file position is neither used nor updated.
+ *
+ * \param[in]   fh      \a ramfs_fh_t handle
+ * \param[in]   buf     buffer to write from
+ * \param[in]   len     number of bytes to write
+ * \param[in]   offset  file offset to write to
+ * \return              number of bytes written, or < 0 on error
+ */
+ssize_t ramfs_pwrite(ramfs_fh_t *fh, const char *buf, size_t len,
+        off_t offset);
+
+/**
+ * \brief       Read data from an open file into several buffers
+ * \param[in]   fh      \a ramfs_fh_t handle
+ * \param[in]   iov     buffers to fill, in order
+ * \param[in]   iovcnt  number of buffers in \a iov
+ * \return              actual number of bytes read, zero if the end of file
+ *                      reached, or < 0 on error
+ */
+ssize_t ramfs_readv(ramfs_fh_t *fh, const struct iovec *iov, int iovcnt);
+
+/**
+ * \brief       Write data to an open file from several buffers
+ *
+ * The buffers are written back to back as one write. If the file grows, it
+ * grows once for the total length.
+ *
+ * \param[in]   fh      \a ramfs_fh_t handle
+ * \param[in]   iov     buffers to write from, in order
+ * \param[in]   iovcnt  number of buffers in \a iov
+ * \return              number of bytes written, or < 0 on error
+ */
+ssize_t ramfs_writev(ramfs_fh_t *fh, const struct iovec *iov, int iovcnt);
+
+/**
+ * \brief       Get memory in the file to write to directly
+ *
+ * Returns space in the file storage at the current position, to be filled
+ * in place and then accounted for with \a ramfs_write_commit(). The space
+ * ends at the end of the extent holding the position, so it can be shorter
+ * than asked for; reserve again after committing for the rest. A handle has
+ * at most one reservation at a time. Only the committed bytes should be
+ * written, bytes written past them stay changed where they overlap existing
+ * data.
+ *
+ * \param[in]   fh      \a ramfs_fh_t handle
+ * \param[in]   len     maximum number of bytes wanted
+ * \param[out]  buf     set to the memory to write to
+ * \return              number of bytes available at \a buf, or -1 on error
+ */
+ssize_t ramfs_write_reserve(ramfs_fh_t *fh, size_t len, void **buf);
+
+/**
+ * \brief       Finish a write started with \a ramfs_write_reserve()
+ *
+ * Extends the file if needed and advances the file position by the number
+ * of bytes committed. Committing 0 bytes cancels the reservation. If a
+ * truncate shrank the file in between, the truncate wins: the bytes are
+ * dropped, 0 is returned and the position stays where it was.
+ *
+ * \param[in]   fh      \a ramfs_fh_t handle
+ * \param[in]   used    number of bytes written, at most what was reserved
+ * \return              number of bytes committed, or -1 on error
+ */
+ssize_t ramfs_write_commit(ramfs_fh_t *fh, size_t used);
+
 /**
  * \brief       Seek to a position within a file
  * \param[in]   fh      \a ramfs_fh_t handle
@@ -192,13 +678,58 @@ ssize_t ramfs_seek(ramfs_fh_t *fh, off_t offset, int mode);
 size_t ramfs_tell(const ramfs_fh_t *fh);
 
 /**
- * \brief       Get raw memory for file
+ * \brief       Get raw memory for the start of a file
+ *
+ * File data is stored in fixed-size extents, so only the first extent is
+ * returned, along with the extents that follow it in memory. This is the
+ * whole file when it fits in a single extent, or was adopted from a buffer
+ * or mounted from an image and not written to since; use
+ * \a ramfs_access_extent() to walk other files.
+ *
  * \param[in]   fh      \a ramfs_fh_t handle
  * \param[out]  buf     pointer pointer to buf
  * \return              length of raw data
  */
 size_t ramfs_access(const ramfs_fh_t *fh, const void **buf);
 
+/**
+ * \brief       Get raw memory for the extent containing an offset
+ * \param[in]   fh      \a ramfs_fh_t handle
+ * \param[in]   offset  byte offset within the file
+ * \param[out]  buf     pointer pointer to buf, set to the data at \a offset
+ * \return              length of contiguous data at \a buf, 0 at end of file
+ */
+size_t ramfs_access_extent(const ramfs_fh_t *fh, size_t offset,
+        const void **buf);
+
+/**
+ * \brief       Get the data in a range of a file without copying it
+ *
+ * The range is returned as one span per extent it touches. Holes point at
+ * shared zeros. The memory stays valid until \a ramfs_release_view(), even
+ * if the file is truncated meanwhile, but writes to the range and truncates
+ * that cut into it still show through, like a shared mapping. The file
+ * position is neither used nor updated.
+ *
+ * \param[in]   fh      \a ramfs_fh_t handle
+ * \param[in]   offset  file offset the view starts at
+ * \param[in]   len     maximum number of bytes in the view
+ * \param[out]  spans   set to an array of spans, \a NULL if there are none
+ * \return              number of spans, zero at end of file, or -1 on error
+ */
+ssize_t ramfs_read_view(ramfs_fh_t *fh, off_t offset, size_t len,
+        ramfs_span_t **spans);
+
+/**
+ * \brief       Release a view returned by \a ramfs_read_view()
+ *
+ * Must be called before the handle is closed.
+ *
+ * \param[in]   fh      \a ramfs_fh_t handle the view was taken from
+ * \param[in]   spans   span array, may be \a NULL
+ */
+void ramfs_release_view(ramfs_fh_t *fh, ramfs_span_t *spans);
+
 /**
  * \brief       Free and delete a file on the filesystem
  * \param[in]   entry   \a ramfs_entry_t pointer
@@ -206,6 +737,14 @@ size_t ramfs_access(const ramfs_fh_t *fh, const void **buf);
 */
 int ramfs_unlink(ramfs_entry_t *entry);
 
+/**
+ * \brief       Delete a file relative to a directory
+ * \param[in]   dir     directory entry
+ * \param[in]   path    name or relative path to file
+ * \return              0 on success, -1 on error
+ */
+int ramfs_unlink_at(ramfs_entry_t *dir, const char *path);
+
 /**
  * \brief       Rename a file
  * \param[in]   fs      \a ramfs_fs_t pointer
@@ -215,6 +754,17 @@ int ramfs_unlink(ramfs_entry_t *entry);
  */
 int ramfs_rename(ramfs_fs_t *fs, const char *src, const char *dst);
 
+/**
+ * \brief       Rename a file relative to directories
+ * \param[in]   src_dir directory \a src is relative to
+ * \param[in]   src     source name or relative path
+ * \param[in]   dst_dir directory \a dst is relative to
+ * \param[in]   dst     destination name or relative path
+ * \return              0 on success, -1 on error
+ */
+int ramfs_rename_at(ramfs_entry_t *src_dir, const char *src,
+        ramfs_entry_t *dst_dir, const char *dst);
+
 /**
  * \brief       Open a directory
  * \param[in]   fs      \a ramfs_fs_t pointer
@@ -236,17 +786,37 @@ void ramfs_closedir(ramfs_dh_t *dh);
  */
 const ramfs_entry_t *ramfs_readdir(ramfs_dh_t *dh);
 
+/**
+ * \brief       Read several entries from an open directory handle at once
+ *
+ * Equivalent to calling \a ramfs_readdir() up to \a count times and
+ * stating each entry, but without allocating and with the directory locked
+ * once per call.
+ *
+ * \param[in]   dh      \a ramfs_dh_t directory handle
+ * \param[out]  ents    records to fill
+ * \param[in]   count   number of records in \a ents
+ * \return              number of records filled, 0 on end
+ */
+size_t ramfs_readdir_batch(ramfs_dh_t *dh, ramfs_dirent_t *ents, size_t count);
+
 /**
  * \brief       Seek to a given directory location
  * \param[in]   dh      \a ramfs_dh_t directory handle
- * \param[in]   loc     entry index to seek to
+ * \param[in]   loc     location returned by \a ramfs_telldir(), or 0 to
+ *                      rewind
  */
 void ramfs_seekdir(ramfs_dh_t *dh, long loc);
 
 /**
- * \brief       Return the current entry index
+ * \brief       Return the current directory location
+ *
+ * With the vector and rbtree implementations this is the index of the next
+ * entry. With the hash implementation it is an opaque cookie that stays valid
+ * while entries are added and removed.
+ *
  * \param[in]   dh      \a ramfs_dh_t directory handle
- * \return              current directory index
+ * \return              current directory location
  */
 long ramfs_telldir(ramfs_dh_t *dh);
 
@@ -258,6 +828,29 @@ long ramfs_telldir(ramfs_dh_t *dh);
  */
 ramfs_entry_t *ramfs_mkdir(ramfs_fs_t *fs, const char *name);
 
+/**
+ * \brief       Make a directory with room for a number of entries
+ *
+ * Useful when the size of a directory is known ahead of time, for example
+ * when unpacking an archive: the first \a capacity entries created in it do
+ * not grow its index.
+ *
+ * \param[in]   fs          \a ramfs_fs_t pointer
+ * \param[in]   path        directory path
+ * \param[in]   capacity    number of entries to make room for
+ * \return                  newly created entry handle
+ */
+ramfs_entry_t *ramfs_mkdir_ex(ramfs_fs_t *fs, const char *path,
+        size_t capacity);
+
+/**
+ * \brief       Make a directory relative to a directory
+ * \param[in]   dir     directory entry
+ * \param[in]   path    name or relative path of the new directory
+ * \return              newly created entry handle
+ */
+ramfs_entry_t *ramfs_mkdir_at(ramfs_entry_t *dir, const char *path);
+
 /**
  * \brief       Remove a directory. Directory must be empty
  * \param       entry   directory entry handle
@@ -19,17 +19,31 @@ extern "C" {
 typedef struct ramfs_vfs_conf_t {
     const char *base_path; /**< vfs path to mount the filesystem */
     ramfs_fs_t *fs; /**< the ramfs instance */
-    size_t max_files; /**< maximum open files */
+    size_t max_files; /**< open files to make room for up front, the
+                           descriptor table doubles when they run out */
 } ramfs_vfs_conf_t;
 
 /**
  * \brief      Mount an ramfs fs handle under a vfs path
  * \param[in]  conf vfs configuration
  * \return     ESP_OK if successful, ESP_ERR_NO_MEM if too many VFSes are
- *             registered
+ *             registered, ESP_ERR_INVALID_ARG if the base path is longer
+ *             than ESP_VFS_PATH_MAX
  */
 esp_err_t ramfs_vfs_register(const ramfs_vfs_conf_t *conf);
 
+/**
+ * \brief      Unmount a vfs path mounted by \a ramfs_vfs_register
+ *
+ * Files still open under the path are closed. The ramfs instance itself is
+ * left alone.
+ *
+ * \param[in]  base_path   path given to \a ramfs_vfs_register
+ * \return     ESP_OK if successful, ESP_ERR_INVALID_STATE if nothing is
+ *             mounted there
+ */
+esp_err_t ramfs_vfs_unregister(const char *base_path);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
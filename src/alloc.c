@@ -0,0 +1,261 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ramfs/ramfs.h"
+#include "alloc.h"
+
+
+#define ALIGN sizeof(max_align_t)
+#define ALIGN_UP(x) (((x) + ALIGN - 1) & ~(ALIGN - 1))
+
+/* Every arena allocation is preceded by a header holding its size */
+#define HDR_SIZE ALIGN_UP(sizeof(size_t))
+
+typedef struct arena_chunk_t {
+    struct arena_chunk_t *next;
+    size_t size;
+    size_t used;
+    int owned;
+} arena_chunk_t;
+
+typedef struct arena_t {
+    arena_chunk_t *chunk;
+    size_t chunk_size;
+    void *last;
+} arena_t;
+
+static void *heap_malloc(void *ctx, size_t size)
+{
+    return malloc(size);
+}
+
+static void *heap_realloc(void *ctx, void *ptr, size_t size)
+{
+    return realloc(ptr, size);
+}
+
+static void heap_free(void *ctx, void *ptr)
+{
+    free(ptr);
+}
+
+const ramfs_allocator_t ramfs_heap_allocator = {
+    .malloc = heap_malloc,
+    .realloc = heap_realloc,
+    .free = heap_free,
+};
+
+void *ramfs_malloc(const ramfs_allocator_t *alloc, size_t size)
+{
+    void *p = alloc->malloc(alloc->ctx, size);
+    if (p == NULL) {
+        errno = ENOMEM;
+    }
+    return p;
+}
+
+void *ramfs_zalloc(const ramfs_allocator_t *alloc, size_t size)
+{
+    void *p = ramfs_malloc(alloc, size);
+    if (p != NULL) {
+        memset(p, 0, size);
+    }
+    return p;
+}
+
+void *ramfs_realloc(const ramfs_allocator_t *alloc, void *ptr, size_t size)
+{
+    void *p = alloc->realloc(alloc->ctx, ptr, size);
+    if (p == NULL && size != 0) {
+        errno = ENOMEM;
+    }
+    return p;
+}
+
+void ramfs_free(const ramfs_allocator_t *alloc, void *ptr)
+{
+    if (ptr != NULL) {
+        alloc->free(alloc->ctx, ptr);
+    }
+}
+
+char *ramfs_strndup(const ramfs_allocator_t *alloc, const char *s,
+        size_t len)
+{
+    len = strnlen(s, len);
+
+    char *p = ramfs_malloc(alloc, len + 1);
+    if (p == NULL) {
+        return NULL;
+    }
+    memcpy(p, s, len);
+    p[len] = '\0';
+    return p;
+}
+
+static unsigned char *chunk_data(arena_chunk_t *chunk)
+{
+    return (unsigned char *) chunk + ALIGN_UP(sizeof(*chunk));
+}
+
+static void *arena_malloc(void *ctx, size_t size)
+{
+    arena_t *arena = ctx;
+    arena_chunk_t *chunk = arena->chunk;
+
+    if (size > SIZE_MAX - HDR_SIZE - ALIGN) {
+        return NULL;
+    }
+    size_t need = HDR_SIZE + ALIGN_UP(size);
+
+    if (chunk->size - chunk->used < need) {
+        if (arena->chunk_size == 0) {
+            return NULL;
+        }
+
+        size_t chunk_size = arena->chunk_size;
+        if (chunk_size < need) {
+            chunk_size = need;
+        }
+
+        chunk = malloc(ALIGN_UP(sizeof(*chunk)) + chunk_size);
+        if (chunk == NULL) {
+            return NULL;
+        }
+        chunk->next = arena->chunk;
+        chunk->size = chunk_size;
+        chunk->used = 0;
+        chunk->owned = 1;
+        arena->chunk = chunk;
+    }
+
+    unsigned char *p = chunk_data(chunk) + chunk->used;
+    *(size_t *) p = size;
+    chunk->used += need;
+    arena->last = p + HDR_SIZE;
+    return arena->last;
+}
+
+static size_t arena_size(void *ptr)
+{
+    return *(size_t *) ((unsigned char *) ptr - HDR_SIZE);
+}
+
+static void arena_free(void *ctx, void *ptr)
+{
+    arena_t *arena = ctx;
+
+    /* only the most recent allocation can be handed back */
+    if (ptr == arena->last) {
+        arena->chunk->used -= HDR_SIZE + ALIGN_UP(arena_size(ptr));
+        arena->last = NULL;
+    }
+}
+
+static void *arena_realloc(void *ctx, void *ptr, size_t size)
+{
+    arena_t *arena = ctx;
+
+    if (ptr == NULL) {
+        return arena_malloc(ctx, size);
+    }
+
+    if (size == 0) {
+        arena_free(ctx, ptr);
+        return NULL;
+    }
+
+    size_t old_size = arena_size(ptr);
+    size_t *hdr = (size_t *) ((unsigned char *) ptr - HDR_SIZE);
+
+    if (ALIGN_UP(size) <= ALIGN_UP(old_size)) {
+        *hdr = size;
+        return ptr;
+    }
+
+    if (ptr == arena->last) {
+        arena_chunk_t *chunk = arena->chunk;
+        size_t grow = ALIGN_UP(size) - ALIGN_UP(old_size);
+        if (size <= SIZE_MAX - ALIGN && chunk->size - chunk->used >= grow) {
+            chunk->used += grow;
+            *hdr = size;
+            return ptr;
+        }
+    }
+
+    void *p = arena_malloc(ctx, size);
+    if (p == NULL) {
+        return NULL;
+    }
+    memcpy(p, ptr, old_size);
+    return p;
+}
+
+static void arena_release(void *ctx)
+{
+    arena_t *arena = ctx;
+    arena_chunk_t *chunk = arena->chunk;
+
+    while (chunk != NULL) {
+        arena_chunk_t *next = chunk->next;
+        if (chunk->owned) {
+            free(chunk);
+        }
+        chunk = next;
+    }
+}
+
+int ramfs_arena_init(ramfs_allocator_t *allocator, void *region, size_t size)
+{
+    size_t overhead = ALIGN_UP(sizeof(arena_t)) +
+            ALIGN_UP(sizeof(arena_chunk_t));
+
+    if (allocator == NULL || size <= overhead + ALIGN) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int owned = 0;
+    if (region == NULL) {
+        region = malloc(size);
+        if (region == NULL) {
+            errno = ENOMEM;
+            return -1;
+        }
+        owned = 1;
+    }
+
+    /* the arena bookkeeping lives at the start of its own first chunk */
+    uintptr_t start = ALIGN_UP((uintptr_t) region);
+    size_t skew = start - (uintptr_t) region;
+    if (size < overhead + skew + ALIGN) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    arena_chunk_t *chunk = (arena_chunk_t *) start;
+    chunk->next = NULL;
+    chunk->size = size - skew - ALIGN_UP(sizeof(*chunk));
+    chunk->used = 0;
+    chunk->owned = owned;
+
+    arena_t *arena = (arena_t *) chunk_data(chunk);
+    chunk->used = ALIGN_UP(sizeof(*arena));
+    arena->chunk = chunk;
+    arena->chunk_size = owned ? size : 0;
+    arena->last = NULL;
+
+    memset(allocator, 0, sizeof(*allocator));
+    allocator->malloc = arena_malloc;
+    allocator->realloc = arena_realloc;
+    allocator->free = arena_free;
+    allocator->release = arena_release;
+    allocator->ctx = arena;
+    return 0;
+}
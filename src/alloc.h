@@ -0,0 +1,58 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <stddef.h>
+
+
+typedef struct ramfs_allocator_t ramfs_allocator_t;
+
+/**
+ * \brief       Allocator backed by the C library heap
+ */
+extern const ramfs_allocator_t ramfs_heap_allocator;
+
+/**
+ * \brief       Allocate memory
+ * \param[in]   alloc   \a ramfs_allocator_t pointer
+ * \param[in]   size    number of bytes
+ * \return              memory or \a NULL on error
+ */
+void *ramfs_malloc(const ramfs_allocator_t *alloc, size_t size);
+
+/**
+ * \brief       Allocate zeroed memory
+ * \param[in]   alloc   \a ramfs_allocator_t pointer
+ * \param[in]   size    number of bytes
+ * \return              memory or \a NULL on error
+ */
+void *ramfs_zalloc(const ramfs_allocator_t *alloc, size_t size);
+
+/**
+ * \brief       Resize memory
+ * \param[in]   alloc   \a ramfs_allocator_t pointer
+ * \param[in]   ptr     memory to resize, may be \a NULL
+ * \param[in]   size    new number of bytes
+ * \return              resized memory or \a NULL on error, in which case
+ *                      \a ptr is untouched
+ */
+void *ramfs_realloc(const ramfs_allocator_t *alloc, void *ptr, size_t size);
+
+/**
+ * \brief       Free memory
+ * \param[in]   alloc   \a ramfs_allocator_t pointer
+ * \param[in]   ptr     memory to free, may be \a NULL
+ */
+void ramfs_free(const ramfs_allocator_t *alloc, void *ptr);
+
+/**
+ * \brief       Duplicate at most \a len bytes of a string
+ * \param[in]   alloc   \a ramfs_allocator_t pointer
+ * \param[in]   s       string
+ * \param[in]   len     maximum length
+ * \return              NUL terminated copy or \a NULL on error
+ */
+char *ramfs_strndup(const ramfs_allocator_t *alloc, const char *s,
+        size_t len);
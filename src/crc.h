@@ -0,0 +1,39 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/**
+ * \brief       Add bytes to a CRC-32 (IEEE), four bits at a time
+ *
+ * Start from 0xffffffff and invert the result, as usual for CRC-32.
+ *
+ * \param[in]   crc     CRC so far
+ * \param[in]   buf     bytes to add
+ * \param[in]   len     length of \a buf
+ * \return              updated CRC
+ */
+static inline uint32_t ramfs_crc_update(uint32_t crc, const void *buf,
+        size_t len)
+{
+    static const uint32_t table[16] = {
+        0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac,
+        0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+        0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+        0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+    };
+    const unsigned char *p = buf;
+
+    for (size_t i = 0; i < len; i++) {
+        crc ^= p[i];
+        crc = (crc >> 4) ^ table[crc & 15];
+        crc = (crc >> 4) ^ table[crc & 15];
+    }
+
+    return crc;
+}
@@ -0,0 +1,312 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <errno.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "dcache.h"
+#include "ramfs_priv.h"
+
+
+static void lru_unlink(ramfs_dcache_node_t *node)
+{
+    node->lru_prev->lru_next = node->lru_next;
+    node->lru_next->lru_prev = node->lru_prev;
+}
+
+static void lru_push(ramfs_dcache_t *dcache, ramfs_dcache_node_t *node)
+{
+    node->lru_prev = &dcache->lru;
+    node->lru_next = dcache->lru.lru_next;
+    dcache->lru.lru_next->lru_prev = node;
+    dcache->lru.lru_next = node;
+}
+
+static ramfs_dcache_node_t **bucket(ramfs_dcache_t *dcache, uint32_t hash)
+{
+    return &dcache->buckets[hash & (dcache->buckets_len - 1)];
+}
+
+static ramfs_dcache_node_t **entry_bucket(ramfs_dcache_t *dcache,
+        const ramfs_entry_t *entry)
+{
+    /* entries are aligned, the low bits say nothing */
+    uint32_t hash = (uint32_t) ((uintptr_t) entry >> 4) * 2654435761u;
+    return &dcache->entry_buckets[hash & (dcache->buckets_len - 1)];
+}
+
+static void link_node(ramfs_dcache_t *dcache, ramfs_dcache_node_t *node)
+{
+    ramfs_dcache_node_t **head = bucket(dcache, node->hash);
+    node->next = *head;
+    *head = node;
+
+    if (node->entry != NULL) {
+        head = entry_bucket(dcache, node->entry);
+        node->entry_next = *head;
+        *head = node;
+    }
+}
+
+static void drop(ramfs_dcache_t *dcache, ramfs_dcache_node_t *node)
+{
+    ramfs_dcache_node_t **link = bucket(dcache, node->hash);
+
+    while (*link != node) {
+        link = &(*link)->next;
+    }
+    *link = node->next;
+
+    if (node->entry != NULL) {
+        link = entry_bucket(dcache, node->entry);
+        while (*link != node) {
+            link = &(*link)->entry_next;
+        }
+        *link = node->entry_next;
+    }
+    lru_unlink(node);
+
+    node->entry = NULL;
+    node->next = dcache->free_list;
+    dcache->free_list = node;
+    dcache->used--;
+}
+
+ramfs_dcache_t *ramfs_dcache_new(const ramfs_allocator_t *alloc, size_t size)
+{
+    ramfs_dcache_t *dcache = ramfs_zalloc(alloc, sizeof(*dcache));
+    if (dcache == NULL) {
+        return NULL;
+    }
+    if (ramfs_mutex_init(&dcache->lock) < 0) {
+        ramfs_free(alloc, dcache);
+        return NULL;
+    }
+
+    dcache->alloc = alloc;
+    dcache->size = size;
+    dcache->lru.lru_prev = &dcache->lru;
+    dcache->lru.lru_next = &dcache->lru;
+    return dcache;
+}
+
+void ramfs_dcache_destroy(const ramfs_allocator_t *alloc,
+        ramfs_dcache_t *dcache)
+{
+    if (dcache == NULL) {
+        return;
+    }
+
+    ramfs_dcache_node_t *node = dcache->lru.lru_next;
+    while (node != &dcache->lru) {
+        ramfs_dcache_node_t *next = node->lru_next;
+        ramfs_free(alloc, node);
+        node = next;
+    }
+    while (dcache->free_list != NULL) {
+        node = dcache->free_list;
+        dcache->free_list = node->next;
+        ramfs_free(alloc, node);
+    }
+    ramfs_free(alloc, dcache->buckets);
+    ramfs_mutex_destroy(&dcache->lock);
+    ramfs_free(alloc, dcache);
+}
+
+/* The old buckets stay if there is no memory for more */
+static void rehash(ramfs_dcache_t *dcache, size_t len)
+{
+    /* both tables share one allocation */
+    ramfs_dcache_node_t **buckets = ramfs_zalloc(dcache->alloc,
+            sizeof(*buckets) * len * 2);
+    if (buckets == NULL) {
+        return;
+    }
+
+    ramfs_free(dcache->alloc, dcache->buckets);
+    dcache->buckets = buckets;
+    dcache->entry_buckets = buckets + len;
+    dcache->buckets_len = len;
+    for (ramfs_dcache_node_t *node = dcache->lru.lru_next;
+            node != &dcache->lru; node = node->lru_next) {
+        link_node(dcache, node);
+    }
+}
+
+void ramfs_dcache_grow(ramfs_dcache_t *dcache)
+{
+    if (dcache == NULL) {
+        return;
+    }
+
+    /* best effort, errno stays as the create left it */
+    int error = errno;
+    ramfs_mutex_lock(&dcache->lock);
+    if (dcache->nodes < dcache->size) {
+        /* keep chains short, two buckets per node */
+        if (dcache->buckets_len < (dcache->nodes + 1) * 2) {
+            rehash(dcache, dcache->buckets_len != 0 ?
+                    dcache->buckets_len * 2 : 8);
+        }
+        ramfs_dcache_node_t *node = NULL;
+        if (dcache->buckets_len != 0) {
+            node = ramfs_malloc(dcache->alloc, sizeof(*node));
+        }
+        if (node != NULL) {
+            node->entry = NULL;
+            node->next = dcache->free_list;
+            dcache->free_list = node;
+            dcache->nodes++;
+        }
+    }
+    ramfs_mutex_unlock(&dcache->lock);
+    errno = error;
+}
+
+static ramfs_dcache_node_t *find(ramfs_dcache_t *dcache,
+        const ramfs_name_t *path, uint32_t hash)
+{
+    if (dcache->buckets_len == 0) {
+        return NULL;
+    }
+
+    ramfs_dcache_node_t *node = *bucket(dcache, hash);
+
+    while (node != NULL && (node->hash != hash || node->len != path->len ||
+            memcmp(node->path, path->str, path->len) != 0)) {
+        node = node->next;
+    }
+
+    return node;
+}
+
+/* The counter whose change makes a cached result stale. A path stops
+ * resolving to its entry only when a component on the way is removed or
+ * renamed; forget() drops the entry's own paths, the ones through a moved
+ * directory go with the counter. A missing path can only appear through a
+ * create, while a path that ran into a file is also freed by its removal. */
+static unsigned int stale_with(ramfs_dcache_t *dcache,
+        const ramfs_entry_t *entry, int error)
+{
+    if (entry != NULL) {
+        return dcache->moved;
+    }
+    return error == ENOENT ? dcache->created : dcache->gen;
+}
+
+int ramfs_dcache_lookup(ramfs_dcache_t *dcache, const ramfs_name_t *path,
+        ramfs_entry_t **entry, unsigned int *gen)
+{
+    if (dcache == NULL) {
+        return 0;
+    }
+
+    ramfs_mutex_lock(&dcache->lock);
+    *gen = dcache->gen;
+    ramfs_dcache_node_t *node = find(dcache, path, ramfs_name_hash(path));
+    if (node != NULL && node->gen != stale_with(dcache, node->entry,
+            node->error)) {
+        drop(dcache, node);
+        node = NULL;
+    }
+
+    if (node == NULL) {
+        dcache->misses++;
+        ramfs_mutex_unlock(&dcache->lock);
+        return 0;
+    }
+
+    lru_unlink(node);
+    lru_push(dcache, node);
+    dcache->hits++;
+
+    *entry = node->entry;
+    int error = node->error;
+    ramfs_mutex_unlock(&dcache->lock);
+
+    if (*entry == NULL) {
+        errno = error;
+    }
+    return 1;
+}
+
+void ramfs_dcache_insert(ramfs_dcache_t *dcache, const ramfs_name_t *path,
+        ramfs_entry_t *entry, int error, unsigned int gen)
+{
+    if (dcache == NULL || path->len > sizeof(dcache->lru.path)) {
+        return;
+    }
+
+    uint32_t hash = ramfs_name_hash(path);
+
+    ramfs_mutex_lock(&dcache->lock);
+    if (dcache->gen != gen) {
+        ramfs_mutex_unlock(&dcache->lock);
+        return;
+    }
+
+    /* concurrent readers can miss on the same path */
+    ramfs_dcache_node_t *node = find(dcache, path, hash);
+    if (node != NULL) {
+        drop(dcache, node);
+    }
+
+    if (dcache->free_list == NULL) {
+        if (dcache->used == 0) {
+            ramfs_mutex_unlock(&dcache->lock);
+            return;
+        }
+        drop(dcache, dcache->lru.lru_prev);
+    }
+    node = dcache->free_list;
+    dcache->free_list = node->next;
+    dcache->used++;
+
+    memcpy(node->path, path->str, path->len);
+    node->len = path->len;
+    node->hash = hash;
+    node->entry = entry;
+    node->error = error;
+    node->gen = stale_with(dcache, entry, error);
+    link_node(dcache, node);
+    lru_push(dcache, node);
+
+    ramfs_mutex_unlock(&dcache->lock);
+}
+
+void ramfs_dcache_forget(ramfs_dcache_t *dcache, const ramfs_entry_t *entry,
+        int subtree)
+{
+    if (dcache == NULL) {
+        return;
+    }
+
+    ramfs_mutex_lock(&dcache->lock);
+    if (dcache->buckets_len != 0) {
+        ramfs_dcache_node_t *node = *entry_bucket(dcache, entry);
+        while (node != NULL) {
+            ramfs_dcache_node_t *next = node->entry_next;
+            if (node->entry == entry) {
+                drop(dcache, node);
+            }
+            node = next;
+        }
+    }
+    if (subtree) {
+        dcache->moved++;
+    }
+    dcache->gen++;
+    ramfs_mutex_unlock(&dcache->lock);
+}
+
+void ramfs_dcache_created(ramfs_dcache_t *dcache)
+{
+    if (dcache != NULL) {
+        ramfs_mutex_lock(&dcache->lock);
+        dcache->created++;
+        dcache->gen++;
+        ramfs_mutex_unlock(&dcache->lock);
+    }
+}
@@ -0,0 +1,142 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lock.h"
+#include "name.h"
+
+
+#ifndef CONFIG_RAMFS_DCACHE_PATH_MAX
+# define CONFIG_RAMFS_DCACHE_PATH_MAX 64
+#endif
+
+typedef struct ramfs_allocator_t ramfs_allocator_t;
+typedef struct ramfs_entry_t ramfs_entry_t;
+
+typedef struct ramfs_dcache_node_t {
+    struct ramfs_dcache_node_t *next; /**< hash chain or free list */
+    struct ramfs_dcache_node_t *entry_next; /**< entry hash chain */
+    struct ramfs_dcache_node_t *lru_prev; /**< more recently used */
+    struct ramfs_dcache_node_t *lru_next; /**< less recently used */
+    uint32_t hash; /**< path hash */
+    ramfs_entry_t *entry; /**< entry, \a NULL for a negative entry */
+    int error; /**< \a errno of a negative entry */
+    unsigned int gen; /**< cache counter the entry goes stale with */
+    size_t len; /**< path length */
+    char path[CONFIG_RAMFS_DCACHE_PATH_MAX]; /**< path, not terminated */
+} ramfs_dcache_node_t;
+
+/**
+ * \brief       Cache of full path lookups
+ *
+ * Positive entries map a path to the entry it resolved to. They are also
+ * hashed by that entry, so removing or renaming it drops them directly, and
+ * they all go stale at once when a directory is renamed or a tree removed.
+ * Negative entries remember that a path did not resolve. Those that failed
+ * with \a ENOENT go stale as soon as anything is created, those that failed
+ * with \a ENOTDIR as soon as anything changes. Lookups drop the stale entries
+ * they find. The least recently used entry is evicted when the cache is
+ * full. Paths are stored in the nodes, so neither lookups nor inserts
+ * allocate, and longer paths than \a CONFIG_RAMFS_DCACHE_PATH_MAX are never
+ * cached. Nodes are added one per entry the filesystem creates, up to the
+ * cache size, so the cache only takes memory as the tree grows into it. A
+ * filesystem without a cache has a \a NULL pointer, which every
+ * function accepts.
+ */
+typedef struct ramfs_dcache_t {
+    const ramfs_allocator_t *alloc; /**< allocator nodes come from */
+    size_t size; /**< most nodes to allocate */
+    size_t nodes; /**< nodes allocated */
+    ramfs_dcache_node_t **buckets; /**< hash buckets, or \a NULL */
+    ramfs_dcache_node_t **entry_buckets; /**< buckets by entry, as many */
+    size_t buckets_len; /**< power of two, 0 without buckets */
+    ramfs_dcache_node_t *free_list; /**< unused nodes */
+    ramfs_dcache_node_t lru; /**< list head, most recently used first */
+    size_t used; /**< nodes in use */
+    unsigned int gen; /**< bumped on every create and forget */
+    unsigned int created; /**< bumped on every create */
+    unsigned int moved; /**< bumped when a subtree is forgotten */
+    size_t hits; /**< lookups answered */
+    size_t misses; /**< lookups not answered */
+    ramfs_mutex_t lock; /**< lookups of concurrent readers still update it */
+} ramfs_dcache_t;
+
+/**
+ * \brief       Allocate an empty cache
+ * \param[in]   alloc   \a ramfs_allocator_t pointer, used for the nodes too
+ * \param[in]   size    most paths to keep, not 0
+ * \return              \a ramfs_dcache_t pointer or \a NULL on error
+ */
+ramfs_dcache_t *ramfs_dcache_new(const ramfs_allocator_t *alloc, size_t size);
+
+/**
+ * \brief       Free a cache
+ * \param[in]   alloc   \a ramfs_allocator_t pointer
+ * \param[in]   dcache  \a ramfs_dcache_t pointer
+ */
+void ramfs_dcache_destroy(const ramfs_allocator_t *alloc,
+        ramfs_dcache_t *dcache);
+
+/**
+ * \brief       Add a node for an entry that was created
+ *
+ * Does nothing once the cache has all its nodes, or if there is no memory
+ * for another one.
+ *
+ * \param[in]   dcache  \a ramfs_dcache_t pointer
+ */
+void ramfs_dcache_grow(ramfs_dcache_t *dcache);
+
+/**
+ * \brief       Look up a path
+ * \param[in]   dcache  \a ramfs_dcache_t pointer
+ * \param[in]   path    path with leading slashes skipped
+ * \param[out]  entry   set to the cached entry, \a NULL with \a errno set
+ *                      for a negative entry
+ * \param[out]  gen     set to the cache generation, to pass on to
+ *                      \a ramfs_dcache_insert() after a miss
+ * \return              1 on a hit, 0 on a miss
+ */
+int ramfs_dcache_lookup(ramfs_dcache_t *dcache, const ramfs_name_t *path,
+        ramfs_entry_t **entry, unsigned int *gen);
+
+/**
+ * \brief       Remember the result of a lookup
+ *
+ * Nothing is remembered if the tree changed since the lookup missed, as the
+ * walk in between may have raced with the change.
+ *
+ * \param[in]   dcache  \a ramfs_dcache_t pointer
+ * \param[in]   path    path with leading slashes skipped
+ * \param[in]   entry   entry the path resolved to, or \a NULL
+ * \param[in]   error   \a errno if \a entry is \a NULL
+ * \param[in]   gen     generation from \a ramfs_dcache_lookup()
+ */
+void ramfs_dcache_insert(ramfs_dcache_t *dcache, const ramfs_name_t *path,
+        ramfs_entry_t *entry, int error, unsigned int gen);
+
+/**
+ * \brief       Drop the paths that resolve to an entry
+ *
+ * Must be called while the entry is still linked into the tree. Only the
+ * paths of the entry itself are looked up; those of its descendants go stale
+ * together with every other positive entry, so the cost does not grow with
+ * the cache.
+ *
+ * \param[in]   dcache  \a ramfs_dcache_t pointer
+ * \param[in]   entry   entry about to be removed or renamed
+ * \param[in]   subtree also drop paths that resolve to its descendants
+ */
+void ramfs_dcache_forget(ramfs_dcache_t *dcache, const ramfs_entry_t *entry,
+        int subtree);
+
+/**
+ * \brief       Invalidate all negative entries after something was created
+ * \param[in]   dcache  \a ramfs_dcache_t pointer
+ */
+void ramfs_dcache_created(ramfs_dcache_t *dcache);
@@ -0,0 +1,177 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "epoch.h"
+#include "ramfs_priv.h"
+
+
+#define CACHE_LINE 64
+
+/* One slot per reading thread, each on its own cache line, so entering and
+ * leaving a read section only ever writes memory no other reader touches. */
+typedef union epoch_slot_t {
+    struct {
+        unsigned long epoch; /* epoch entered in, 0 outside read sections */
+        int used;
+    };
+    char pad[CACHE_LINE];
+} epoch_slot_t;
+
+static unsigned long s_epoch = 1;
+static epoch_slot_t s_slots[CONFIG_RAMFS_RCU_READERS]
+        __attribute__((aligned(CACHE_LINE)));
+static __thread epoch_slot_t *t_slot;
+static pthread_key_t s_key;
+static pthread_once_t s_key_once = PTHREAD_ONCE_INIT;
+
+static void release_slot(void *arg)
+{
+    epoch_slot_t *slot = arg;
+
+    __atomic_store_n(&slot->used, 0, __ATOMIC_RELEASE);
+}
+
+static void create_key(void)
+{
+    pthread_key_create(&s_key, release_slot);
+}
+
+static epoch_slot_t *claim_slot(void)
+{
+    pthread_once(&s_key_once, create_key);
+
+    for (size_t i = 0; i < CONFIG_RAMFS_RCU_READERS; i++) {
+        int unused = 0;
+        if (__atomic_compare_exchange_n(&s_slots[i].used, &unused, 1, 0,
+                __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            /* the slot goes back when the thread exits */
+            if (pthread_setspecific(s_key, &s_slots[i]) != 0) {
+                release_slot(&s_slots[i]);
+                return NULL;
+            }
+            t_slot = &s_slots[i];
+            return t_slot;
+        }
+    }
+
+    return NULL;
+}
+
+int ramfs_rcu_read_lock(void)
+{
+    epoch_slot_t *slot = t_slot;
+
+    if (slot == NULL && (slot = claim_slot()) == NULL) {
+        return -1;
+    }
+
+    __atomic_store_n(&slot->epoch, __atomic_load_n(&s_epoch,
+            __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+    /* the announcement must be visible before anything is read, pairs with
+     * the fence in try_advance() */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return 0;
+}
+
+void ramfs_rcu_read_unlock(void)
+{
+    __atomic_store_n(&t_slot->epoch, 0, __ATOMIC_RELEASE);
+}
+
+/* Moves the global epoch on if every reader has seen the current one and
+ * returns the epoch it is at afterwards. */
+static unsigned long try_advance(void)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    unsigned long epoch = __atomic_load_n(&s_epoch, __ATOMIC_ACQUIRE);
+
+    for (size_t i = 0; i < CONFIG_RAMFS_RCU_READERS; i++) {
+        unsigned long seen = __atomic_load_n(&s_slots[i].epoch,
+                __ATOMIC_ACQUIRE);
+        if (seen != 0 && seen != epoch) {
+            return epoch;
+        }
+    }
+
+    /* losing the race means someone else advanced it */
+    __atomic_compare_exchange_n(&s_epoch, &epoch, epoch + 1, 0,
+            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    return __atomic_load_n(&s_epoch, __ATOMIC_ACQUIRE);
+}
+
+int ramfs_epoch_init(ramfs_epoch_t *epoch)
+{
+    epoch->retired = NULL;
+    return ramfs_mutex_init(&epoch->lock);
+}
+
+static void run(ramfs_fs_t *fs, ramfs_rcu_head_t *head)
+{
+    while (head != NULL) {
+        ramfs_rcu_head_t *next = head->next;
+        head->fn(fs, head);
+        head = next;
+    }
+}
+
+void ramfs_epoch_destroy(ramfs_fs_t *fs)
+{
+    run(fs, fs->epoch.retired);
+    fs->epoch.retired = NULL;
+    ramfs_mutex_destroy(&fs->epoch.lock);
+}
+
+void ramfs_rcu_retire(ramfs_fs_t *fs, ramfs_rcu_head_t *head,
+        void (*fn)(ramfs_fs_t *fs, ramfs_rcu_head_t *head))
+{
+    ramfs_epoch_t *epoch = &fs->epoch;
+
+    head->fn = fn;
+    /* tagged after it was unlinked, so readers that can still see it
+     * entered in this epoch or before */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    head->epoch = __atomic_load_n(&s_epoch, __ATOMIC_ACQUIRE);
+
+    ramfs_mutex_lock(&epoch->lock);
+    head->next = epoch->retired;
+    epoch->retired = head;
+    ramfs_mutex_unlock(&epoch->lock);
+}
+
+void ramfs_rcu_reclaim(ramfs_fs_t *fs)
+{
+    ramfs_epoch_t *epoch = &fs->epoch;
+    ramfs_rcu_head_t *done = NULL;
+
+    /* twice, so without readers around what was just retired goes now */
+    try_advance();
+    unsigned long now = try_advance();
+
+    ramfs_mutex_lock(&epoch->lock);
+    for (ramfs_rcu_head_t **link = &epoch->retired; *link != NULL;) {
+        ramfs_rcu_head_t *node = *link;
+        if (node->epoch + 2 <= now) {
+            *link = node->next;
+            node->next = done;
+            done = node;
+        } else {
+            link = &node->next;
+        }
+    }
+    ramfs_mutex_unlock(&epoch->lock);
+
+    run(fs, done);
+}
+
+void ramfs_rcu_synchronize(void)
+{
+    unsigned long target = __atomic_load_n(&s_epoch, __ATOMIC_ACQUIRE) + 2;
+
+    while (try_advance() < target) {
+        sched_yield();
+    }
+}
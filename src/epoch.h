@@ -0,0 +1,145 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <stddef.h>
+
+#ifdef ESP_PLATFORM
+# include "sdkconfig.h"
+#endif
+
+#include "lock.h"
+
+
+#ifndef CONFIG_RAMFS_RCU_READERS
+# define CONFIG_RAMFS_RCU_READERS 16
+#endif
+
+typedef struct ramfs_fs_t ramfs_fs_t;
+
+/* Epoch-based reclamation for lock-free path lookups. Without
+ * CONFIG_RAMFS_RCU there are no lock-free readers, every read section fails
+ * to start and there is never anything to wait for. */
+
+#ifdef CONFIG_RAMFS_RCU
+
+/**
+ * \brief       Link for an object waiting to be freed
+ *
+ * Embedded in every object that lock-free readers can still be looking at
+ * after it was unlinked.
+ */
+typedef struct ramfs_rcu_head_t {
+    struct ramfs_rcu_head_t *next; /**< retired list */
+    unsigned long epoch; /**< global epoch when retired */
+    void (*fn)(ramfs_fs_t *fs, struct ramfs_rcu_head_t *head); /**< frees */
+} ramfs_rcu_head_t;
+
+/**
+ * \brief       Objects of a filesystem waiting for a grace period
+ *
+ * Readers announce the global epoch they entered in. The epoch only moves
+ * on once every reader inside a read section has seen the current one, so
+ * an object retired in epoch \a e is unreachable to all readers once the
+ * epoch reaches \a e + 2.
+ */
+typedef struct ramfs_epoch_t {
+    ramfs_rcu_head_t *retired; /**< newest first */
+    ramfs_mutex_t lock; /**< taken last, after every other lock */
+} ramfs_epoch_t;
+
+/**
+ * \brief       Initialize a retired list
+ * \param[out]  epoch   \a ramfs_epoch_t pointer
+ * \return              0 on success, -1 on error
+ */
+int ramfs_epoch_init(ramfs_epoch_t *epoch);
+
+/**
+ * \brief       Free everything still retired, without waiting
+ *
+ * Only for a filesystem that no other thread uses anymore.
+ *
+ * \param[in]   fs      \a ramfs_fs_t pointer
+ */
+void ramfs_epoch_destroy(ramfs_fs_t *fs);
+
+/**
+ * \brief       Enter a read section
+ *
+ * Objects reachable at this point are not freed until
+ * \a ramfs_rcu_read_unlock(). Read sections do not nest and must not call
+ * anything that takes a lock.
+ *
+ * \return              0 on success, -1 if all \a CONFIG_RAMFS_RCU_READERS
+ *                      reader slots are taken by other threads
+ */
+int ramfs_rcu_read_lock(void);
+
+/**
+ * \brief       Leave a read section
+ */
+void ramfs_rcu_read_unlock(void);
+
+/**
+ * \brief       Queue an object to be freed once no reader can see it anymore
+ *
+ * The object must already be unreachable for new readers. Nothing is freed
+ * here, so it is safe to call with locks held.
+ *
+ * \param[in]   fs      \a ramfs_fs_t pointer
+ * \param[in]   head    link embedded in the object
+ * \param[in]   fn      called with \a head to free the object
+ */
+void ramfs_rcu_retire(ramfs_fs_t *fs, ramfs_rcu_head_t *head,
+        void (*fn)(ramfs_fs_t *fs, ramfs_rcu_head_t *head));
+
+/**
+ * \brief       Free the queued objects whose grace period has passed
+ *
+ * Freeing takes locks of its own, so no locks may be held by the caller.
+ *
+ * \param[in]   fs      \a ramfs_fs_t pointer
+ */
+void ramfs_rcu_reclaim(ramfs_fs_t *fs);
+
+/**
+ * \brief       Wait until every read section in progress has ended
+ */
+void ramfs_rcu_synchronize(void);
+
+#else
+
+typedef struct ramfs_epoch_t {
+    char unused;
+} ramfs_epoch_t;
+
+static inline int ramfs_epoch_init(ramfs_epoch_t *epoch)
+{
+    return 0;
+}
+
+static inline void ramfs_epoch_destroy(ramfs_fs_t *fs)
+{
+}
+
+static inline int ramfs_rcu_read_lock(void)
+{
+    return -1;
+}
+
+static inline void ramfs_rcu_read_unlock(void)
+{
+}
+
+static inline void ramfs_rcu_reclaim(ramfs_fs_t *fs)
+{
+}
+
+static inline void ramfs_rcu_synchronize(void)
+{
+}
+
+#endif
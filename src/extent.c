@@ -0,0 +1,498 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "extent.h"
+
+
+static const unsigned char zero_extent[RAMFS_EXTENT_SIZE];
+
+static size_t extents_for(size_t size)
+{
+    return (size + RAMFS_EXTENT_SIZE - 1) / RAMFS_EXTENT_SIZE;
+}
+
+static int reserve(const ramfs_allocator_t *alloc, ramfs_extents_t *ext,
+        size_t len)
+{
+    if (len <= ext->cap) {
+        return 0;
+    }
+
+    size_t cap = ext->cap ? ext->cap : 4;
+    while (cap < len) {
+        cap *= 2;
+    }
+
+    unsigned char **table = ramfs_realloc(alloc, ext->table,
+            sizeof(*table) * cap + (cap + 7) / 8);
+    if (table == NULL) {
+        return -1;
+    }
+    /* the dirty bits move up past the new slots */
+    size_t bytes = (ext->cap + 7) / 8;
+    memmove(&table[cap], &table[ext->cap], bytes);
+    memset((unsigned char *) &table[cap] + bytes, 0, (cap + 7) / 8 - bytes);
+    memset(&table[ext->cap], 0, sizeof(*table) * (cap - ext->cap));
+
+    ext->table = table;
+    ext->cap = cap;
+    return 0;
+}
+
+/* a bit per slot, kept after the pointer table */
+static unsigned char *dirty_bits(const ramfs_extents_t *ext)
+{
+    return (unsigned char *) &ext->table[ext->cap];
+}
+
+static void mark(ramfs_extents_t *ext, size_t i)
+{
+    dirty_bits(ext)[i / 8] |= 1 << i % 8;
+}
+
+/* slot i still points into the adopted buffer */
+static int borrowed(const ramfs_extents_t *ext, size_t i)
+{
+    return ext->buffer != NULL && i * RAMFS_EXTENT_SIZE < ext->buffer_len &&
+            ext->table[i] == ext->buffer + i * RAMFS_EXTENT_SIZE;
+}
+
+/* owned buffers can be written in place, except for a partial last extent
+ * that the buffer does not fully back */
+static int writable(const ramfs_extents_t *ext, size_t i)
+{
+    return !borrowed(ext, i) || (ext->buffer_owned &&
+            (i + 1) * RAMFS_EXTENT_SIZE <= ext->buffer_len);
+}
+
+/* replaces a borrowed extent with a private copy */
+static int copy_extent(const ramfs_allocator_t *alloc, ramfs_extents_t *ext,
+        size_t i)
+{
+    unsigned char *p = ramfs_zalloc(alloc, RAMFS_EXTENT_SIZE);
+    if (p == NULL) {
+        return -1;
+    }
+
+    size_t start = i * RAMFS_EXTENT_SIZE;
+    size_t end = ext->buffer_len < ext->size ? ext->buffer_len : ext->size;
+    size_t n = end - start < RAMFS_EXTENT_SIZE ? end - start :
+            RAMFS_EXTENT_SIZE;
+    memcpy(p, ext->table[i], n);
+    ext->table[i] = p;
+    return 0;
+}
+
+/* The extent holding a mid-extent end of data gets the bytes past the end
+ * zeroed or exposed, which memory that is not ours may not allow. */
+static int own_tail(const ramfs_allocator_t *alloc, ramfs_extents_t *ext,
+        size_t end)
+{
+    size_t i = end / RAMFS_EXTENT_SIZE;
+
+    if (end % RAMFS_EXTENT_SIZE == 0 || i >= ext->len ||
+            ext->table[i] == NULL || writable(ext, i)) {
+        return 0;
+    }
+
+    return copy_extent(alloc, ext, i);
+}
+
+static void forget_buffer(const ramfs_allocator_t *alloc,
+        ramfs_extents_t *ext)
+{
+    if (ext->buffer_owned) {
+        ramfs_free(alloc, ext->buffer);
+    }
+    ext->buffer = NULL;
+    ext->buffer_len = 0;
+    ext->buffer_owned = 0;
+}
+
+/* moves the extents from slot len on out of the table, into held, along
+ * with an owned buffer nothing is left pointing into */
+static int hold(const ramfs_allocator_t *alloc, ramfs_extents_t *ext,
+        size_t len)
+{
+    int buffer = len == 0 && ext->buffer_owned;
+    size_t count = buffer;
+    for (size_t i = len; i < ext->len; i++) {
+        count += ext->table[i] != NULL && !borrowed(ext, i);
+    }
+
+    unsigned char **held = NULL;
+    if (count > 0) {
+        held = ramfs_realloc(alloc, ext->held,
+                sizeof(*held) * (ext->held_len + count));
+        if (held == NULL) {
+            return -1;
+        }
+        ext->held = held;
+    }
+
+    for (size_t i = len; i < ext->len; i++) {
+        if (ext->table[i] != NULL && !borrowed(ext, i)) {
+            held[ext->held_len++] = ext->table[i];
+        }
+        ext->table[i] = NULL;
+    }
+
+    if (buffer) {
+        held[ext->held_len++] = ext->buffer;
+        ext->buffer_owned = 0;
+    }
+
+    return 0;
+}
+
+static void release_held(const ramfs_allocator_t *alloc, ramfs_extents_t *ext)
+{
+    for (size_t i = 0; i < ext->held_len; i++) {
+        ramfs_free(alloc, ext->held[i]);
+    }
+    ramfs_free(alloc, ext->held);
+    ext->held = NULL;
+    ext->held_len = 0;
+}
+
+int ramfs_extents_adopt(const ramfs_allocator_t *alloc, ramfs_extents_t *ext,
+        void *buf, size_t len, int owned)
+{
+    size_t count = extents_for(len);
+
+    if (reserve(alloc, ext, count) < 0) {
+        return -1;
+    }
+
+    ext->buffer = buf;
+    ext->buffer_len = len;
+    ext->buffer_owned = owned;
+    for (size_t i = 0; i < count; i++) {
+        ext->table[i] = ext->buffer + i * RAMFS_EXTENT_SIZE;
+    }
+    ext->len = count;
+    ext->size = len;
+    return 0;
+}
+
+int ramfs_extents_truncate(const ramfs_allocator_t *alloc,
+        ramfs_extents_t *ext, size_t size)
+{
+    size_t len = extents_for(size);
+
+    if (reserve(alloc, ext, len) < 0) {
+        return -1;
+    }
+
+    if (size != ext->size && own_tail(alloc, ext,
+            size < ext->size ? size : ext->size) < 0) {
+        return -1;
+    }
+
+    if (__atomic_load_n(&ext->pins, __ATOMIC_ACQUIRE) > 0 && len < ext->len &&
+            hold(alloc, ext, len) < 0) {
+        return -1;
+    }
+
+    for (size_t i = len; i < ext->len; i++) {
+        if (!borrowed(ext, i)) {
+            ramfs_free(alloc, ext->table[i]);
+        }
+        ext->table[i] = NULL;
+        dirty_bits(ext)[i / 8] &= ~(1 << i % 8);
+    }
+
+    if (size < ext->size && size % RAMFS_EXTENT_SIZE != 0 &&
+            ext->table[len - 1] != NULL) {
+        size_t off = size % RAMFS_EXTENT_SIZE;
+        memset(ext->table[len - 1] + off, 0, RAMFS_EXTENT_SIZE - off);
+    }
+
+    ext->len = len;
+    if (size < ext->size) {
+        ext->cuts++;
+    }
+    ext->size = size;
+    if (size < ext->low) {
+        ext->low = size;
+    }
+
+    if (ext->len == 0) {
+        ramfs_free(alloc, ext->table);
+        ext->table = NULL;
+        ext->cap = 0;
+        forget_buffer(alloc, ext);
+    }
+
+    return 0;
+}
+
+size_t ramfs_extents_read(const ramfs_extents_t *ext, size_t pos, void *buf,
+        size_t len)
+{
+    unsigned char *p = buf;
+
+    if (pos >= ext->size) {
+        return 0;
+    }
+
+    if (len > ext->size - pos) {
+        len = ext->size - pos;
+    }
+
+    size_t done = 0;
+    while (done < len) {
+        const void *span;
+        size_t n = ramfs_extents_span(ext, pos + done, &span);
+        if (n > len - done) {
+            n = len - done;
+        }
+        memcpy(p + done, span, n);
+        done += n;
+    }
+
+    return done;
+}
+
+ssize_t ramfs_extents_write(const ramfs_allocator_t *alloc,
+        ramfs_extents_t *ext, size_t pos, const void *buf, size_t len)
+{
+    struct iovec iov = {
+        .iov_base = (void *) buf,
+        .iov_len = len,
+    };
+
+    return ramfs_extents_writev(alloc, ext, pos, &iov, 1);
+}
+
+ssize_t ramfs_extents_writev(const ramfs_allocator_t *alloc,
+        ramfs_extents_t *ext, size_t pos, const struct iovec *iov, int iovcnt)
+{
+    size_t len = 0;
+
+    for (int i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len > SSIZE_MAX - len) {
+            errno = EINVAL;
+            return -1;
+        }
+        len += iov[i].iov_len;
+    }
+
+    if (len == 0) {
+        return 0;
+    }
+
+    if (pos > SIZE_MAX - len) {
+        errno = EFBIG;
+        return -1;
+    }
+
+    /* the table grows once for the whole write, not once per buffer */
+    size_t end_len = extents_for(pos + len);
+    if (reserve(alloc, ext, end_len) < 0) {
+        return -1;
+    }
+
+    if (pos + len > ext->size && own_tail(alloc, ext, ext->size) < 0) {
+        return -1;
+    }
+
+    size_t done = 0;
+    for (int v = 0; v < iovcnt && done < len; v++) {
+        const unsigned char *p = iov[v].iov_base;
+        size_t copied = 0;
+
+        while (copied < iov[v].iov_len) {
+            size_t i = (pos + done) / RAMFS_EXTENT_SIZE;
+            size_t off = (pos + done) % RAMFS_EXTENT_SIZE;
+            size_t n = RAMFS_EXTENT_SIZE - off;
+            if (n > iov[v].iov_len - copied) {
+                n = iov[v].iov_len - copied;
+            }
+
+            if (ext->table[i] == NULL) {
+                ext->table[i] = ramfs_zalloc(alloc, RAMFS_EXTENT_SIZE);
+                if (ext->table[i] == NULL) {
+                    break;
+                }
+            } else if (!writable(ext, i) && copy_extent(alloc, ext, i) < 0) {
+                break;
+            }
+
+            memcpy(ext->table[i] + off, p + copied, n);
+            mark(ext, i);
+            copied += n;
+            done += n;
+        }
+
+        if (copied < iov[v].iov_len) {
+            break;
+        }
+    }
+
+    if (pos + done > ext->size) {
+        ext->size = pos + done;
+    }
+    if (extents_for(ext->size) > ext->len) {
+        ext->len = extents_for(ext->size);
+    }
+
+    if (done == 0) {
+        return -1;
+    }
+
+    return done;
+}
+
+ssize_t ramfs_extents_prepare(const ramfs_allocator_t *alloc,
+        ramfs_extents_t *ext, size_t pos, void **buf)
+{
+    if (pos > SSIZE_MAX - RAMFS_EXTENT_SIZE) {
+        errno = EFBIG;
+        return -1;
+    }
+
+    size_t i = pos / RAMFS_EXTENT_SIZE;
+    if (reserve(alloc, ext, i + 1) < 0) {
+        return -1;
+    }
+
+    if ((i + 1) * RAMFS_EXTENT_SIZE > ext->size &&
+            own_tail(alloc, ext, ext->size) < 0) {
+        return -1;
+    }
+
+    if (ext->table[i] == NULL) {
+        ext->table[i] = ramfs_zalloc(alloc, RAMFS_EXTENT_SIZE);
+        if (ext->table[i] == NULL) {
+            return -1;
+        }
+    } else if (!writable(ext, i) && copy_extent(alloc, ext, i) < 0) {
+        return -1;
+    }
+
+    /* in use from now on, so truncates and frees see it */
+    if (i >= ext->len) {
+        ext->len = i + 1;
+    }
+
+    size_t off = pos % RAMFS_EXTENT_SIZE;
+    *buf = ext->table[i] + off;
+    return RAMFS_EXTENT_SIZE - off;
+}
+
+size_t ramfs_extents_commit(ramfs_extents_t *ext, size_t pos, const void *buf,
+        size_t len, size_t used, unsigned int cuts)
+{
+    size_t i = pos / RAMFS_EXTENT_SIZE;
+
+    /* truncated in between, which wins as if it came later; even a cut
+     * within the extent zeroed what was written past the new size */
+    if (ext->cuts != cuts || i >= ext->len ||
+            ext->table[i] + pos % RAMFS_EXTENT_SIZE != buf) {
+        return 0;
+    }
+
+    if (used > 0) {
+        mark(ext, i);
+    }
+    if (pos + used > ext->size) {
+        ext->size = pos + used;
+    }
+
+    if (pos + len > ext->size) {
+        size_t from = pos + used > ext->size ? pos + used : ext->size;
+        memset(ext->table[i] + (from - i * RAMFS_EXTENT_SIZE), 0,
+                pos + len - from);
+    }
+
+    return used;
+}
+
+size_t ramfs_extents_span(const ramfs_extents_t *ext, size_t pos,
+        const void **buf)
+{
+    if (pos >= ext->size) {
+        *buf = NULL;
+        return 0;
+    }
+
+    size_t i = pos / RAMFS_EXTENT_SIZE;
+    size_t off = pos % RAMFS_EXTENT_SIZE;
+    size_t n = RAMFS_EXTENT_SIZE - off;
+    if (n > ext->size - pos) {
+        n = ext->size - pos;
+    }
+
+    if (ext->table[i] != NULL) {
+        *buf = ext->table[i] + off;
+    } else {
+        *buf = zero_extent + off;
+    }
+
+    return n;
+}
+
+size_t ramfs_extents_run(const ramfs_extents_t *ext, size_t pos,
+        const void **buf)
+{
+    size_t n = ramfs_extents_span(ext, pos, buf);
+
+    while (n > 0 && pos + n < ext->size) {
+        size_t i = (pos + n) / RAMFS_EXTENT_SIZE;
+        if (ext->table[i] != (const unsigned char *) *buf + n) {
+            break;
+        }
+        n += ext->size - (pos + n) < RAMFS_EXTENT_SIZE ?
+                ext->size - (pos + n) : RAMFS_EXTENT_SIZE;
+    }
+
+    return n;
+}
+
+void ramfs_extents_pin(ramfs_extents_t *ext)
+{
+    __atomic_add_fetch(&ext->pins, 1, __ATOMIC_ACQ_REL);
+}
+
+void ramfs_extents_unpin(const ramfs_allocator_t *alloc,
+        ramfs_extents_t *ext)
+{
+    if (__atomic_sub_fetch(&ext->pins, 1, __ATOMIC_ACQ_REL) == 0) {
+        release_held(alloc, ext);
+    }
+}
+
+void ramfs_extents_clean(ramfs_extents_t *ext)
+{
+    if (ext->table != NULL) {
+        memset(dirty_bits(ext), 0, (ext->cap + 7) / 8);
+    }
+    ext->low = ext->size;
+}
+
+int ramfs_extents_is_dirty(const ramfs_extents_t *ext, size_t i)
+{
+    return i < ext->cap && dirty_bits(ext)[i / 8] & 1 << i % 8;
+}
+
+void ramfs_extents_free(const ramfs_allocator_t *alloc, ramfs_extents_t *ext)
+{
+    for (size_t i = 0; i < ext->len; i++) {
+        if (!borrowed(ext, i)) {
+            ramfs_free(alloc, ext->table[i]);
+        }
+    }
+    ramfs_free(alloc, ext->table);
+    release_held(alloc, ext);
+    forget_buffer(alloc, ext);
+    memset(ext, 0, sizeof(*ext));
+}
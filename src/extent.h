@@ -0,0 +1,222 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#ifdef ESP_PLATFORM
+# include "sdkconfig.h"
+#endif
+
+
+#ifndef CONFIG_RAMFS_EXTENT_SIZE
+# define CONFIG_RAMFS_EXTENT_SIZE 512
+#endif
+
+/**
+ * \brief       Size of a single file data extent in bytes
+ */
+#define RAMFS_EXTENT_SIZE ((size_t) CONFIG_RAMFS_EXTENT_SIZE)
+
+typedef struct ramfs_allocator_t ramfs_allocator_t;
+
+/**
+ * \brief       File data stored as a table of fixed-size extents
+ *
+ * Extents are never moved once allocated, so growing a file only ever grows
+ * the pointer table. A \a NULL slot is a hole and reads back as zeros. Bytes
+ * past \a size in the last extent are always kept zeroed.
+ *
+ * While \a pins is non-zero, extents cut off by a truncate are moved to
+ * \a held instead of being freed, so memory handed out in views stays valid.
+ *
+ * Slots can also point into an adopted \a buffer. Those are copied before
+ * they are first written, unless the buffer is owned and backs the whole
+ * extent, and are never freed on their own.
+ *
+ * Writes set a dirty bit for each extent they touch, kept after the slots
+ * of \a table, and \a low keeps the smallest size truncated to, until
+ * \a ramfs_extents_clean().
+ */
+typedef struct ramfs_extents_t {
+    unsigned char **table; /**< extent pointer table */
+    size_t len; /**< number of slots in use */
+    size_t cap; /**< number of slots allocated */
+    size_t size; /**< data size in bytes */
+    unsigned char **held; /**< extents truncated away while pinned */
+    size_t held_len; /**< number of extents in \a held */
+    size_t pins; /**< outstanding views */
+    unsigned char *buffer; /**< adopted buffer, or \a NULL */
+    size_t buffer_len; /**< length of \a buffer */
+    int buffer_owned; /**< \a buffer is freed with the extents */
+    unsigned int cuts; /**< bumped by every truncate that shrinks the data */
+    size_t low; /**< smallest size since the last clean */
+} ramfs_extents_t;
+
+/**
+ * \brief       Use a buffer as the data of empty extents without copying it
+ * \param[in]   alloc   \a ramfs_allocator_t pointer
+ * \param[in]   ext     \a ramfs_extents_t pointer, empty
+ * \param[in]   buf     buffer to adopt
+ * \param[in]   len     length of \a buf
+ * \param[in]   owned   non-zero to write \a buf in place and free it with
+ *                      \a alloc once it is not used anymore, zero to never
+ *                      write or free it
+ * \return              0 on success, -1 on error
+ */
+int ramfs_extents_adopt(const ramfs_allocator_t *alloc, ramfs_extents_t *ext,
+        void *buf, size_t len, int owned);
+
+/**
+ * \brief       Grow or shrink extent data to \a size bytes
+ * \param[in]   alloc   \a ramfs_allocator_t pointer
+ * \param[in]   ext     \a ramfs_extents_t pointer
+ * \param[in]   size    new data size
+ * \return              0 on success, -1 on error
+ */
+int ramfs_extents_truncate(const ramfs_allocator_t *alloc,
+        ramfs_extents_t *ext, size_t size);
+
+/**
+ * \brief       Copy data out of the extents
+ * \param[in]   ext     \a ramfs_extents_t pointer
+ * \param[in]   pos     byte offset to read from
+ * \param[out]  buf     destination buffer
+ * \param[in]   len     maximum number of bytes to read
+ * \return              number of bytes read
+ */
+size_t ramfs_extents_read(const ramfs_extents_t *ext, size_t pos, void *buf,
+        size_t len);
+
+/**
+ * \brief       Copy data into the extents, growing them as needed
+ * \param[in]   alloc   \a ramfs_allocator_t pointer
+ * \param[in]   ext     \a ramfs_extents_t pointer
+ * \param[in]   pos     byte offset to write to
+ * \param[in]   buf     source buffer
+ * \param[in]   len     number of bytes to write
+ * \return              number of bytes written, or -1 if nothing could be
+ *                      written
+ */
+ssize_t ramfs_extents_write(const ramfs_allocator_t *alloc,
+        ramfs_extents_t *ext, size_t pos, const void *buf, size_t len);
+
+/**
+ * \brief       Copy data from several buffers into the extents back to back
+ *
+ * The extent table is grown once for the whole write, however many buffers
+ * there are.
+ *
+ * \param[in]   alloc   \a ramfs_allocator_t pointer
+ * \param[in]   ext     \a ramfs_extents_t pointer
+ * \param[in]   pos     byte offset to write to
+ * \param[in]   iov     source buffers
+ * \param[in]   iovcnt  number of buffers in \a iov
+ * \return              number of bytes written, or -1 if nothing could be
+ *                      written
+ */
+ssize_t ramfs_extents_writev(const ramfs_allocator_t *alloc,
+        ramfs_extents_t *ext, size_t pos, const struct iovec *iov, int iovcnt);
+
+/**
+ * \brief       Get writable memory at \a pos without changing the data size
+ *
+ * The extent holding \a pos is allocated if it is a hole. Pin the extents
+ * to keep it from being freed until \a ramfs_extents_commit().
+ *
+ * \param[in]   alloc   \a ramfs_allocator_t pointer
+ * \param[in]   ext     \a ramfs_extents_t pointer
+ * \param[in]   pos     byte offset to write to
+ * \param[out]  buf     set to the memory at \a pos
+ * \return              bytes available at \a buf, up to the end of the
+ *                      extent, or -1 on error
+ */
+ssize_t ramfs_extents_prepare(const ramfs_allocator_t *alloc,
+        ramfs_extents_t *ext, size_t pos, void **buf);
+
+/**
+ * \brief       Account for data written to memory from
+ *              \a ramfs_extents_prepare()
+ *
+ * Unused bytes past the end of data are zeroed again. Nothing changes if a
+ * truncate shrank the data in between, as it may have zeroed or freed the
+ * memory.
+ *
+ * \param[in]   ext     \a ramfs_extents_t pointer
+ * \param[in]   pos     byte offset passed to \a ramfs_extents_prepare()
+ * \param[in]   buf     memory returned by \a ramfs_extents_prepare()
+ * \param[in]   len     bytes of \a buf handed out
+ * \param[in]   used    bytes of \a buf actually written
+ * \param[in]   cuts    \a cuts of \a ext when the memory was prepared
+ * \return              \a used, or 0 if a truncate came in between
+ */
+size_t ramfs_extents_commit(ramfs_extents_t *ext, size_t pos, const void *buf,
+        size_t len, size_t used, unsigned int cuts);
+
+/**
+ * \brief       Get the contiguous span of data starting at \a pos
+ * \param[in]   ext     \a ramfs_extents_t pointer
+ * \param[in]   pos     byte offset
+ * \param[out]  buf     set to the start of the span
+ * \return              span length, 0 at or past the end of data
+ */
+size_t ramfs_extents_span(const ramfs_extents_t *ext, size_t pos,
+        const void **buf);
+
+/**
+ * \brief       Get the span of data starting at \a pos, continued over the
+ *              extents that follow it in memory
+ *
+ * The extents of an adopted buffer nothing was written to yet are all one
+ * run.
+ *
+ * \param[in]   ext     \a ramfs_extents_t pointer
+ * \param[in]   pos     byte offset
+ * \param[out]  buf     set to the start of the run
+ * \return              run length, 0 at or past the end of data
+ */
+size_t ramfs_extents_run(const ramfs_extents_t *ext, size_t pos,
+        const void **buf);
+
+/**
+ * \brief       Keep extent memory from being freed
+ *
+ * Only needs to exclude \a ramfs_extents_unpin() and truncates, so may be
+ * called concurrently with readers.
+ *
+ * \param[in]   ext     \a ramfs_extents_t pointer
+ */
+void ramfs_extents_pin(ramfs_extents_t *ext);
+
+/**
+ * \brief       Drop a pin, freeing held extents with the last one
+ * \param[in]   alloc   \a ramfs_allocator_t pointer
+ * \param[in]   ext     \a ramfs_extents_t pointer
+ */
+void ramfs_extents_unpin(const ramfs_allocator_t *alloc,
+        ramfs_extents_t *ext);
+
+/**
+ * \brief       Forget what was written and truncated so far
+ * \param[in]   ext     \a ramfs_extents_t pointer
+ */
+void ramfs_extents_clean(ramfs_extents_t *ext);
+
+/**
+ * \brief       Check if an extent was written since the last clean
+ * \param[in]   ext     \a ramfs_extents_t pointer
+ * \param[in]   i       extent index
+ * \return              non-zero if extent \a i was written
+ */
+int ramfs_extents_is_dirty(const ramfs_extents_t *ext, size_t i);
+
+/**
+ * \brief       Free all extents
+ * \param[in]   alloc   \a ramfs_allocator_t pointer
+ * \param[in]   ext     \a ramfs_extents_t pointer
+ */
+void ramfs_extents_free(const ramfs_allocator_t *alloc, ramfs_extents_t *ext);
@@ -0,0 +1,1357 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "crc.h"
+#include "image.h"
+#include "ramfs_priv.h"
+
+
+#define OUT_BUF 512
+
+/* batches the many small pieces of an image into fewer writes */
+typedef struct out_t {
+    ramfs_image_write_t write;
+    void *ctx;
+    size_t len;
+    size_t total; /* bytes put so far */
+    int checked; /* keep crc */
+    uint32_t crc; /* CRC-32 of everything put, not yet inverted */
+    unsigned char buf[OUT_BUF];
+} out_t;
+
+static out_t *out_new(ramfs_fs_t *fs, ramfs_image_write_t write, void *ctx,
+        int checked)
+{
+    out_t *out = ramfs_malloc(&fs->alloc, sizeof(*out));
+    if (out == NULL) {
+        return NULL;
+    }
+
+    out->write = write;
+    out->ctx = ctx;
+    out->len = 0;
+    out->total = 0;
+    out->checked = checked;
+    out->crc = 0xffffffff;
+    return out;
+}
+
+static int out_flush(out_t *out)
+{
+    if (out->len > 0 && out->write(out->ctx, out->buf, out->len) < 0) {
+        return -1;
+    }
+
+    out->len = 0;
+    return 0;
+}
+
+static int out_put(out_t *out, const void *buf, size_t len)
+{
+    if (out->checked) {
+        out->crc = ramfs_crc_update(out->crc, buf, len);
+    }
+    out->total += len;
+
+    if (out->len + len > OUT_BUF) {
+        if (out_flush(out) < 0) {
+            return -1;
+        }
+        if (len > OUT_BUF) {
+            return out->write(out->ctx, buf, len);
+        }
+    }
+
+    memcpy(out->buf + out->len, buf, len);
+    out->len += len;
+    return 0;
+}
+
+static int out_zero(out_t *out, size_t len)
+{
+    static const unsigned char zero[RAMFS_IMAGE_ALIGN];
+
+    assert(len <= sizeof(zero));
+    return out_put(out, zero, len);
+}
+
+/* file data from pos up to end, a span at a time straight from the
+ * extents */
+static int out_data(out_t *out, const ramfs_extents_t *ext, size_t pos,
+        size_t end)
+{
+    const void *span;
+    size_t n;
+
+    while (pos < end && (n = ramfs_extents_span(ext, pos, &span)) > 0) {
+        if (n > end - pos) {
+            n = end - pos;
+        }
+        if (out_put(out, span, n) < 0) {
+            return -1;
+        }
+        pos += n;
+    }
+
+    return 0;
+}
+
+static size_t align(size_t n)
+{
+    return (n + RAMFS_IMAGE_ALIGN - 1) & ~((size_t) RAMFS_IMAGE_ALIGN - 1);
+}
+
+static int cmp_entries(const void *a, const void *b)
+{
+    return ramfs_name_cmp(&(*(ramfs_entry_t * const *) a)->name,
+            &(*(ramfs_entry_t * const *) b)->name);
+}
+
+/* the entries of an image being saved, in image order */
+typedef struct snapshot_t {
+    ramfs_entry_t **entries;
+    ramfs_image_entry_t *records;
+    size_t len;
+    size_t cap;
+    size_t dirs_locked; /* directories before this are locked */
+    size_t files_locked; /* files before this are locked */
+} snapshot_t;
+
+static int snapshot_grow(ramfs_fs_t *fs, snapshot_t *snap, size_t count)
+{
+    if (snap->len + count <= snap->cap) {
+        return 0;
+    }
+
+    size_t cap = snap->cap ? snap->cap : 16;
+    while (cap < snap->len + count) {
+        cap *= 2;
+    }
+
+    ramfs_entry_t **entries = ramfs_realloc(&fs->alloc, snap->entries,
+            sizeof(*entries) * cap);
+    if (entries == NULL) {
+        return -1;
+    }
+    snap->entries = entries;
+
+    ramfs_image_entry_t *records = ramfs_realloc(&fs->alloc, snap->records,
+            sizeof(*records) * cap);
+    if (records == NULL) {
+        return -1;
+    }
+    snap->records = records;
+    snap->cap = cap;
+    return 0;
+}
+
+/* Children go before their parents. Unlinking a file only waits for its
+ * directory, so a file is freed as soon as the directory is let go of. */
+static void snapshot_unlock(ramfs_fs_t *fs, snapshot_t *snap)
+{
+    for (size_t i = snap->len; i-- > 0; ) {
+        ramfs_entry_t *entry = snap->entries[i];
+        if (ramfs_is_dir(entry) && i < snap->dirs_locked) {
+            ramfs_rwlock_unlock(&((ramfs_dir_t *) entry)->lock);
+        } else if (!ramfs_is_dir(entry) && i < snap->files_locked) {
+            ramfs_rwlock_unlock(&((ramfs_file_t *) entry)->lock);
+        }
+    }
+
+    ramfs_free(&fs->alloc, snap->entries);
+    ramfs_free(&fs->alloc, snap->records);
+}
+
+/* Collects every entry breadth first, sorting each directory by name. All
+ * directories stay locked, ancestors first, so nothing moves until the
+ * image is written. Files are locked after all directories, as the lock
+ * order wants. Without populate, directories of a mounted image not read
+ * in yet are left out with everything in them. */
+static int snapshot_take(ramfs_fs_t *fs, snapshot_t *snap, int populate,
+        size_t *names_len, size_t *data_len)
+{
+    if (snapshot_grow(fs, snap, 1) < 0) {
+        return -1;
+    }
+    snap->entries[0] = &fs->root.entry;
+    snap->len = 1;
+    *names_len = 1;
+
+    for (size_t i = 0; i < snap->len; i++) {
+        ramfs_entry_t *entry = snap->entries[i];
+        ramfs_image_entry_t *record = &snap->records[i];
+
+        if (i == 0) {
+            record->name_off = 0;
+            record->name_len = 0;
+            record->parent = 0;
+        }
+        record->type = entry->type;
+        record->start = 0;
+        record->len = 0;
+
+        if (!ramfs_is_dir(entry)) {
+            continue;
+        }
+
+        ramfs_dir_t *dir = (ramfs_dir_t *) entry;
+        if (populate && ramfs_image_populate(dir) < 0) {
+            return -1;
+        }
+        ramfs_rwlock_rdlock(&dir->lock);
+        snap->dirs_locked = i + 1;
+        /* filling it in takes this lock, so it stays unread */
+        if (__atomic_load_n(&dir->image, __ATOMIC_ACQUIRE) != NULL) {
+            continue;
+        }
+
+        size_t count = ramfs_index_count(dir);
+        if (snapshot_grow(fs, snap, count) < 0) {
+            return -1;
+        }
+        /* grown above, so the record moved */
+        record = &snap->records[i];
+
+        ramfs_index_cursor_t cursor;
+        ramfs_index_seek(dir, &cursor, 0);
+        size_t first = snap->len;
+        for (size_t j = 0; j < count; j++) {
+            snap->entries[first + j] = ramfs_index_next(dir, &cursor);
+        }
+        qsort(&snap->entries[first], count, sizeof(*snap->entries),
+                cmp_entries);
+
+        record->start = first;
+        record->len = count;
+        for (size_t j = first; j < first + count; j++) {
+            ramfs_image_entry_t *child = &snap->records[j];
+            child->name_off = *names_len;
+            child->name_len = snap->entries[j]->name.len;
+            child->parent = i;
+            *names_len += snap->entries[j]->name.len + 1;
+        }
+        snap->len += count;
+    }
+
+    for (size_t i = 0; i < snap->len; i++) {
+        ramfs_entry_t *entry = snap->entries[i];
+        ramfs_image_entry_t *record = &snap->records[i];
+
+        if (ramfs_is_dir(entry)) {
+            continue;
+        }
+
+        ramfs_file_t *file = (ramfs_file_t *) entry;
+        ramfs_rwlock_rdlock(&file->lock);
+        snap->files_locked = i + 1;
+        record->start = *data_len;
+        record->len = file->data.size;
+        *data_len = align(*data_len + file->data.size);
+    }
+
+    return 0;
+}
+
+/* With compact, entries are renumbered to their index in the image once
+ * it is written, and count as unchanged from then on. */
+static ssize_t save(ramfs_fs_t *fs, ramfs_image_write_t write, void *ctx,
+        int compact)
+{
+    snapshot_t snap = {0};
+    size_t names_len = 0, data_len = 0;
+    ssize_t ret = -1;
+
+    out_t *out = out_new(fs, write, ctx, 0);
+    if (out == NULL) {
+        return -1;
+    }
+
+    if (compact) {
+        ramfs_mutex_lock(&fs->checkpoint_lock);
+    }
+    /* keeps renames and rmdir out, which do not stop at directory locks */
+    ramfs_rwlock_rdlock(&fs->topology);
+    if (snapshot_take(fs, &snap, 1, &names_len, &data_len) < 0) {
+        goto done;
+    }
+
+    ramfs_image_header_t header = {
+        .version = RAMFS_IMAGE_VERSION,
+        .header_size = sizeof(header),
+        .entries = snap.len,
+        .entries_off = sizeof(header),
+    };
+    size_t names_off = sizeof(header) + sizeof(*snap.records) * snap.len;
+    size_t data_off = align(names_off + names_len);
+    if (snap.len > UINT32_MAX || data_len > UINT32_MAX ||
+            data_off > UINT32_MAX - data_len) {
+        errno = EFBIG;
+        goto done;
+    }
+    memcpy(header.magic, RAMFS_IMAGE_MAGIC, sizeof(header.magic));
+    header.names_off = names_off;
+    header.names_len = names_len;
+    header.data_off = data_off;
+    header.data_len = data_len;
+
+    if (out_put(out, &header, sizeof(header)) < 0 ||
+            out_put(out, snap.records,
+            sizeof(*snap.records) * snap.len) < 0) {
+        goto done;
+    }
+
+    /* the root has an empty name */
+    if (out_zero(out, 1) < 0) {
+        goto done;
+    }
+    for (size_t i = 1; i < snap.len; i++) {
+        const ramfs_name_t *name = &snap.entries[i]->name;
+        if (out_put(out, name->str, name->len + 1) < 0) {
+            goto done;
+        }
+    }
+    if (out_zero(out, data_off - names_off - names_len) < 0) {
+        goto done;
+    }
+
+    for (size_t i = 0; i < snap.len; i++) {
+        if (ramfs_is_dir(snap.entries[i])) {
+            continue;
+        }
+
+        const ramfs_extents_t *ext = &((ramfs_file_t *) snap.entries[i])->data;
+        if (out_data(out, ext, 0, ext->size) < 0 ||
+                out_zero(out, align(ext->size) - ext->size) < 0) {
+            goto done;
+        }
+    }
+
+    if (out_flush(out) < 0) {
+        goto done;
+    }
+    ret = data_off + data_len;
+
+    /* everything is locked, so nothing changes in between */
+    if (compact) {
+        for (size_t i = 0; i < snap.len; i++) {
+            ramfs_entry_t *entry = snap.entries[i];
+            entry->id = i;
+            entry->dirty = 0;
+            if (!ramfs_is_dir(entry)) {
+                ramfs_extents_clean(&((ramfs_file_t *) entry)->data);
+            }
+        }
+        __atomic_store_n(&fs->next_id, snap.len - 1, __ATOMIC_RELAXED);
+        fs->checkpoint_seq = 0;
+    }
+
+done:
+    snapshot_unlock(fs, &snap);
+    ramfs_rwlock_unlock(&fs->topology);
+    if (compact) {
+        ramfs_mutex_unlock(&fs->checkpoint_lock);
+    }
+    ramfs_free(&fs->alloc, out);
+    return ret;
+}
+
+ssize_t ramfs_save_image(ramfs_fs_t *fs, ramfs_image_write_t write,
+        void *ctx)
+{
+    assert(fs != NULL);
+    assert(write != NULL);
+
+    return save(fs, write, ctx, 0);
+}
+
+ssize_t ramfs_compact(ramfs_fs_t *fs, ramfs_image_write_t write, void *ctx)
+{
+    assert(fs != NULL);
+    assert(write != NULL);
+
+    /* the journal names entries by the ids this renumbers */
+    if (fs->journal != NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return save(fs, write, ctx, 1);
+}
+
+/* where the tables of an image are */
+typedef struct image_t {
+    const ramfs_image_header_t *header;
+    const ramfs_image_entry_t *records;
+    const char *names;
+    const unsigned char *data;
+} image_t;
+
+static void image_open(image_t *img, const void *image)
+{
+    img->header = image;
+    img->records = (const ramfs_image_entry_t *) ((const char *) image +
+            img->header->entries_off);
+    img->names = (const char *) image + img->header->names_off;
+    img->data = (const unsigned char *) image + img->header->data_off;
+}
+
+/* Checks that the tables lie within the image. The entries are checked a
+ * directory at a time, by check_dir(). */
+static int check_header(image_t *img, const void *image, size_t len)
+{
+    const ramfs_image_header_t *header = image;
+
+    if (len < sizeof(*header) || (uintptr_t) image % sizeof(uint32_t) != 0 ||
+            memcmp(header->magic, RAMFS_IMAGE_MAGIC,
+            sizeof(header->magic)) != 0 ||
+            header->version != RAMFS_IMAGE_VERSION ||
+            header->header_size != sizeof(*header) || header->entries == 0 ||
+            header->entries_off % sizeof(uint32_t) != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* 64-bit sums, the fields are 32-bit */
+    if ((uint64_t) header->entries_off + (uint64_t) header->entries *
+            sizeof(ramfs_image_entry_t) > len ||
+            (uint64_t) header->names_off + header->names_len > len ||
+            (uint64_t) header->data_off + header->data_len > len ||
+            header->names_len == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    image_open(img, image);
+    if (img->records[0].type != RAMFS_ENTRY_TYPE_DIR) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Checks the children of directory i for everything reading them in relies
+ * on, so a damaged image fails cleanly instead of being read out of
+ * bounds. */
+static int check_dir(const image_t *img, uint32_t i)
+{
+    const ramfs_image_header_t *header = img->header;
+    const ramfs_image_entry_t *record = &img->records[i];
+
+    /* children come after their parent, which rules out cycles */
+    if (record->len > 0 && (record->start <= i ||
+            (uint64_t) record->start + record->len > header->entries)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (uint32_t j = record->start; j < record->start + record->len; j++) {
+        const ramfs_image_entry_t *child = &img->records[j];
+        const char *name = img->names + child->name_off;
+
+        if (child->parent != i || child->name_len == 0 ||
+                (uint64_t) child->name_off + child->name_len >=
+                header->names_len || name[child->name_len] != '\0' ||
+                memchr(name, '/', child->name_len) != NULL ||
+                memchr(name, '\0', child->name_len) != NULL) {
+            errno = EINVAL;
+            return -1;
+        }
+
+        if (child->type == RAMFS_ENTRY_TYPE_FILE) {
+            if ((uint64_t) child->start + child->len > header->data_len) {
+                errno = EINVAL;
+                return -1;
+            }
+        } else if (child->type != RAMFS_ENTRY_TYPE_DIR) {
+            errno = EINVAL;
+            return -1;
+        }
+
+        if (j == record->start) {
+            continue;
+        }
+        ramfs_name_t prev = {
+            img->names + img->records[j - 1].name_off,
+            img->records[j - 1].name_len
+        };
+        ramfs_name_t cur = {name, child->name_len};
+        if (ramfs_name_cmp(&prev, &cur) >= 0) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Fills dir, which is entry i of the image, with its children. children
+ * has room for them all. With dirs the subdirectories are entered there by
+ * image index and file data is copied. Without, names and file data are
+ * used in place and subdirectories are left to be read in later. */
+static int read_dir(ramfs_fs_t *fs, const image_t *img, uint32_t i,
+        ramfs_dir_t *dir, ramfs_entry_t **children, ramfs_dir_t **dirs)
+{
+    const ramfs_image_entry_t *record = &img->records[i];
+
+    if (check_dir(img, i) < 0) {
+        return -1;
+    }
+
+    size_t n;
+    for (n = 0; n < record->len; n++) {
+        uint32_t j = record->start + n;
+        const ramfs_image_entry_t *child = &img->records[j];
+        ramfs_name_t name = {
+            img->names + child->name_off, child->name_len
+        };
+
+        if (child->type == RAMFS_ENTRY_TYPE_DIR) {
+            ramfs_dir_t *sub = ramfs_dir_new(fs, &name);
+            if (sub == NULL) {
+                break;
+            }
+            sub->entry.id = j;
+            children[n] = &sub->entry;
+            if (dirs != NULL) {
+                dirs[j] = sub;
+            } else {
+                sub->image = child;
+            }
+            continue;
+        }
+
+        ramfs_file_t *file = ramfs_file_new(fs, &name);
+        if (file == NULL) {
+            break;
+        }
+        file->entry.id = j;
+        file->entry.dirty = 0;
+        children[n] = &file->entry;
+        if (child->len == 0) {
+            continue;
+        }
+
+        const unsigned char *data = img->data + child->start;
+        if (dirs != NULL ? ramfs_extents_write(&fs->alloc, &file->data, 0,
+                data, child->len) != (ssize_t) child->len :
+                ramfs_extents_adopt(&fs->alloc, &file->data, (void *) data,
+                child->len, 0) < 0) {
+            n++;
+            break;
+        }
+        ramfs_extents_clean(&file->data);
+#ifdef CONFIG_RAMFS_RCU
+        file->size = file->data.size;
+#endif
+    }
+
+    if (n < record->len || ramfs_index_load(fs, dir, children, n) < 0) {
+        while (n > 0) {
+            ramfs_entry_free(fs, children[--n]);
+        }
+        return -1;
+    }
+
+    return 0;
+}
+
+ramfs_fs_t *ramfs_load_image(const void *image, size_t len,
+        const ramfs_config_t *config)
+{
+    assert(image != NULL);
+
+    /* a journal is replayed onto an empty tree, not an image */
+    if (config != NULL && config->journal != NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    image_t img;
+    if (check_header(&img, image, len) < 0) {
+        return NULL;
+    }
+    uint32_t entries = img.header->entries;
+
+    ramfs_fs_t *fs = ramfs_init_ex(config);
+    if (fs == NULL) {
+        return NULL;
+    }
+    int err;
+
+    /* directories by image index, filled in as they are created */
+    ramfs_dir_t **dirs = ramfs_zalloc(&fs->alloc, sizeof(*dirs) * entries);
+    /* longer runs do not pass check_dir() */
+    size_t max_children = 0;
+    for (uint32_t i = 0; i < entries; i++) {
+        if (img.records[i].type == RAMFS_ENTRY_TYPE_DIR &&
+                img.records[i].len > max_children &&
+                img.records[i].len <= entries) {
+            max_children = img.records[i].len;
+        }
+    }
+    ramfs_entry_t **children = ramfs_malloc(&fs->alloc,
+            sizeof(*children) * (max_children ? max_children : 1));
+    if (dirs == NULL || children == NULL) {
+        goto fail;
+    }
+    dirs[0] = &fs->root;
+
+    /* the fs is not shared yet, so nothing is locked. Entries no directory
+     * lists are skipped. */
+    for (uint32_t i = 0; i < entries; i++) {
+        if (img.records[i].type == RAMFS_ENTRY_TYPE_DIR && dirs[i] != NULL &&
+                read_dir(fs, &img, i, dirs[i], children, dirs) < 0) {
+            goto fail;
+        }
+    }
+
+    ramfs_free(&fs->alloc, children);
+    ramfs_free(&fs->alloc, dirs);
+    /* entries are named by their index from here on, see image.h */
+    fs->next_id = entries - 1;
+    return fs;
+
+fail:
+    err = errno;
+    ramfs_free(&fs->alloc, children);
+    ramfs_free(&fs->alloc, dirs);
+    ramfs_deinit(fs);
+    errno = err;
+    return NULL;
+}
+
+static ramfs_fs_t *mount(const void *image, size_t len,
+        const ramfs_config_t *config, int readonly)
+{
+    /* a journal is replayed onto an empty tree, not an image */
+    if (config != NULL && config->journal != NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    image_t img;
+    if (check_header(&img, image, len) < 0) {
+        return NULL;
+    }
+
+    ramfs_fs_t *fs = ramfs_init_ex(config);
+    if (fs == NULL) {
+        return NULL;
+    }
+
+    fs->image = image;
+    fs->image_len = len;
+    fs->readonly = readonly;
+    fs->root.image = img.records;
+    fs->next_id = img.header->entries - 1;
+    return fs;
+}
+
+ramfs_fs_t *ramfs_mount_image(const void *image, size_t len,
+        const ramfs_config_t *config)
+{
+    assert(image != NULL);
+
+    return mount(image, len, config, 1);
+}
+
+ramfs_fs_t *ramfs_overlay_image(const void *image, size_t len,
+        const ramfs_config_t *config)
+{
+    assert(image != NULL);
+
+    return mount(image, len, config, 0);
+}
+
+/* Readers only look at the index once image is cleared, so it is filled
+ * without the directory lock. image_lock keeps two from filling it. */
+int ramfs_image_populate(ramfs_dir_t *dir)
+{
+    if (__atomic_load_n(&dir->image, __ATOMIC_ACQUIRE) == NULL) {
+        return 0;
+    }
+
+    ramfs_fs_t *fs = dir->fs;
+    int ret = 0;
+
+    ramfs_mutex_lock(&fs->image_lock);
+    const ramfs_image_entry_t *record = dir->image;
+    if (record != NULL) {
+        image_t img;
+        image_open(&img, fs->image);
+
+        ramfs_entry_t **children = NULL;
+        if (record->len > 0 && record->len <= img.header->entries) {
+            children = ramfs_malloc(&fs->alloc,
+                    sizeof(*children) * record->len);
+            if (children == NULL) {
+                ret = -1;
+            }
+        }
+
+        if (ret == 0) {
+            ret = read_dir(fs, &img, record - img.records, dir, children,
+                    NULL);
+        }
+        if (children != NULL) {
+            ramfs_free(&fs->alloc, children);
+        }
+        if (ret == 0) {
+            __atomic_store_n(&dir->image, NULL, __ATOMIC_RELEASE);
+        }
+    }
+    ramfs_mutex_unlock(&fs->image_lock);
+    return ret;
+}
+
+static int put_record(out_t *out, uint32_t op, uint32_t id, uint64_t offset,
+        uint64_t len)
+{
+    ramfs_checkpoint_record_t record = {
+        .op = op,
+        .id = id,
+        .offset = offset,
+        .len = len,
+    };
+
+    return out_put(out, &record, sizeof(record));
+}
+
+/* the current children of directory i of the snapshot */
+static int put_dir(out_t *out, const snapshot_t *snap, size_t i)
+{
+    const ramfs_image_entry_t *record = &snap->records[i];
+    size_t len = 0;
+
+    for (size_t j = record->start; j < record->start + record->len; j++) {
+        len += sizeof(ramfs_checkpoint_child_t) + snap->entries[j]->name.len;
+    }
+    if (put_record(out, RAMFS_CHECKPOINT_DIR, snap->entries[i]->id,
+            record->len, len) < 0) {
+        return -1;
+    }
+
+    for (size_t j = record->start; j < record->start + record->len; j++) {
+        const ramfs_entry_t *entry = snap->entries[j];
+        ramfs_checkpoint_child_t child = {
+            .id = entry->id,
+            .type = entry->type,
+            .name_len = entry->name.len,
+        };
+        if (out_put(out, &child, sizeof(child)) < 0 ||
+                out_put(out, entry->name.str, entry->name.len) < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* A new file goes out whole, holes aside. Otherwise the data after the
+ * smallest size since the last checkpoint is cut off and the extents
+ * written to are sent again. */
+static int put_file(out_t *out, const ramfs_file_t *file)
+{
+    const ramfs_extents_t *ext = &file->data;
+    int all = file->entry.dirty & RAMFS_DIRTY_NEW;
+    uint32_t id = file->entry.id;
+
+    if (!all && ext->low < ext->size &&
+            put_record(out, RAMFS_CHECKPOINT_TRUNCATE, id, ext->low, 0) < 0) {
+        return -1;
+    }
+    if (put_record(out, RAMFS_CHECKPOINT_TRUNCATE, id, ext->size, 0) < 0) {
+        return -1;
+    }
+
+    size_t count = (ext->size + RAMFS_EXTENT_SIZE - 1) / RAMFS_EXTENT_SIZE;
+    size_t i = 0;
+    while (i < count) {
+        if (all ? ext->table[i] == NULL : !ramfs_extents_is_dirty(ext, i)) {
+            i++;
+            continue;
+        }
+
+        /* runs of extents go out as one record */
+        size_t j = i + 1;
+        while (j < count && (all ? ext->table[j] != NULL :
+                ramfs_extents_is_dirty(ext, j))) {
+            j++;
+        }
+        size_t start = i * RAMFS_EXTENT_SIZE;
+        size_t end = j * RAMFS_EXTENT_SIZE;
+        if (end > ext->size) {
+            end = ext->size;
+        }
+        if (put_record(out, RAMFS_CHECKPOINT_WRITE, id, start,
+                end - start) < 0 || out_data(out, ext, start, end) < 0) {
+            return -1;
+        }
+        i = j;
+    }
+
+    return 0;
+}
+
+ssize_t ramfs_checkpoint(ramfs_fs_t *fs, ramfs_image_write_t write,
+        void *ctx)
+{
+    assert(fs != NULL);
+    assert(write != NULL);
+
+    /* a journal already keeps the changes, and is replayed onto an empty
+     * tree */
+    if (fs->journal != NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    snapshot_t snap = {0};
+    size_t names_len = 0, data_len = 0;
+    ssize_t ret = -1;
+
+    out_t *out = out_new(fs, write, ctx, 1);
+    if (out == NULL) {
+        return -1;
+    }
+
+    ramfs_mutex_lock(&fs->checkpoint_lock);
+    ramfs_rwlock_rdlock(&fs->topology);
+    /* nothing changed in directories not read in from the image yet */
+    if (snapshot_take(fs, &snap, 0, &names_len, &data_len) < 0) {
+        goto done;
+    }
+
+    ramfs_checkpoint_header_t header = {
+        .version = RAMFS_CHECKPOINT_VERSION,
+        .header_size = sizeof(header),
+        .seq = fs->checkpoint_seq + 1,
+        .next_id = __atomic_load_n(&fs->next_id, __ATOMIC_RELAXED),
+    };
+    memcpy(header.magic, RAMFS_CHECKPOINT_MAGIC, sizeof(header.magic));
+    if (out_put(out, &header, sizeof(header)) < 0) {
+        goto done;
+    }
+
+    /* breadth first, so a directory is there before it is filled */
+    for (size_t i = 0; i < snap.len; i++) {
+        ramfs_entry_t *entry = snap.entries[i];
+        if (ramfs_is_dir(entry) && entry->dirty & RAMFS_DIRTY_CHILDREN &&
+                put_dir(out, &snap, i) < 0) {
+            goto done;
+        }
+    }
+    for (size_t i = 0; i < snap.len; i++) {
+        ramfs_entry_t *entry = snap.entries[i];
+        if (!ramfs_is_dir(entry) && entry->dirty != 0 &&
+                put_file(out, (ramfs_file_t *) entry) < 0) {
+            goto done;
+        }
+    }
+
+    uint32_t crc = ~out->crc;
+    if (out_put(out, &crc, sizeof(crc)) < 0 || out_flush(out) < 0) {
+        goto done;
+    }
+    ret = out->total;
+
+    for (size_t i = 0; i < snap.len; i++) {
+        ramfs_entry_t *entry = snap.entries[i];
+        entry->dirty = 0;
+        if (!ramfs_is_dir(entry)) {
+            ramfs_extents_clean(&((ramfs_file_t *) entry)->data);
+        }
+    }
+    fs->checkpoint_seq++;
+
+done:
+    snapshot_unlock(fs, &snap);
+    ramfs_rwlock_unlock(&fs->topology);
+    ramfs_mutex_unlock(&fs->checkpoint_lock);
+    ramfs_free(&fs->alloc, out);
+    return ret;
+}
+
+static int valid_name(const char *name, size_t len)
+{
+    return len > 0 && memchr(name, '/', len) == NULL &&
+            memchr(name, '\0', len) == NULL;
+}
+
+/* Checks the CRC and that every record and child lies within the
+ * checkpoint, so applying it never reads out of bounds. Whether it fits the
+ * tree is checked as it is applied. */
+static int check_checkpoint(const unsigned char *buf, size_t len,
+        ramfs_checkpoint_header_t *header)
+{
+    uint32_t crc;
+
+    if (len < sizeof(*header) + sizeof(crc)) {
+        errno = EINVAL;
+        return -1;
+    }
+    memcpy(header, buf, sizeof(*header));
+    memcpy(&crc, buf + len - sizeof(crc), sizeof(crc));
+    len -= sizeof(crc);
+    if (memcmp(header->magic, RAMFS_CHECKPOINT_MAGIC,
+            sizeof(header->magic)) != 0 ||
+            header->version != RAMFS_CHECKPOINT_VERSION ||
+            header->header_size != sizeof(*header) ||
+            ~ramfs_crc_update(0xffffffff, buf, len) != crc) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (size_t pos = sizeof(*header); pos < len; ) {
+        ramfs_checkpoint_record_t record;
+        if (len - pos < sizeof(record)) {
+            errno = EINVAL;
+            return -1;
+        }
+        memcpy(&record, buf + pos, sizeof(record));
+        pos += sizeof(record);
+        if (record.len > len - pos || record.id > header->next_id) {
+            errno = EINVAL;
+            return -1;
+        }
+
+        if (record.op == RAMFS_CHECKPOINT_DIR) {
+            size_t end = pos + record.len;
+            for (uint64_t n = 0; n < record.offset; n++) {
+                ramfs_checkpoint_child_t child;
+                if (end - pos < sizeof(child)) {
+                    errno = EINVAL;
+                    return -1;
+                }
+                memcpy(&child, buf + pos, sizeof(child));
+                pos += sizeof(child);
+                if (child.name_len > end - pos || child.id == 0 ||
+                        child.id > header->next_id ||
+                        (child.type != RAMFS_ENTRY_TYPE_FILE &&
+                        child.type != RAMFS_ENTRY_TYPE_DIR) ||
+                        !valid_name((const char *) buf + pos,
+                        child.name_len)) {
+                    errno = EINVAL;
+                    return -1;
+                }
+                pos += child.name_len;
+            }
+            if (pos != end) {
+                errno = EINVAL;
+                return -1;
+            }
+        } else if ((record.op == RAMFS_CHECKPOINT_TRUNCATE &&
+                record.len == 0 && record.offset <= SIZE_MAX) ||
+                (record.op == RAMFS_CHECKPOINT_WRITE &&
+                record.offset <= SIZE_MAX - record.len)) {
+            pos += record.len;
+        } else {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* a growing list of entries */
+typedef struct list_t {
+    ramfs_entry_t **entries;
+    size_t len;
+    size_t cap;
+} list_t;
+
+static int list_push(ramfs_fs_t *fs, list_t *list, ramfs_entry_t *entry)
+{
+    if (list->len == list->cap) {
+        size_t cap = list->cap ? list->cap * 2 : 16;
+        ramfs_entry_t **entries = ramfs_realloc(&fs->alloc, list->entries,
+                sizeof(*entries) * cap);
+        if (entries == NULL) {
+            return -1;
+        }
+        list->entries = entries;
+        list->cap = cap;
+    }
+
+    list->entries[list->len++] = entry;
+    return 0;
+}
+
+/* state of ramfs_apply_checkpoint() */
+typedef struct apply_t {
+    ramfs_fs_t *fs;
+    ramfs_entry_t **ids; /* entries by id */
+    unsigned char *listed; /* by id, in a directory record already */
+    size_t ids_len;
+    list_t removed; /* taken out of their directory, freed at the end
+                       unless they were put back */
+} apply_t;
+
+/* every entry by id, the whole tree read in */
+static int map_tree(apply_t *ap)
+{
+    ramfs_fs_t *fs = ap->fs;
+    list_t dirs = {0};
+    int ret = 0;
+
+    ap->ids[0] = &fs->root.entry;
+    if (list_push(fs, &dirs, &fs->root.entry) < 0) {
+        return -1;
+    }
+
+    while (ret == 0 && dirs.len > 0) {
+        ramfs_dir_t *dir = (ramfs_dir_t *) dirs.entries[--dirs.len];
+        if (ramfs_image_populate(dir) < 0) {
+            ret = -1;
+            break;
+        }
+
+        ramfs_rwlock_rdlock(&dir->lock);
+        ramfs_index_cursor_t cursor;
+        ramfs_index_seek(dir, &cursor, 0);
+        ramfs_entry_t *entry;
+        while ((entry = ramfs_index_next(dir, &cursor)) != NULL) {
+            /* newer than the checkpoint */
+            if (entry->id >= ap->ids_len) {
+                errno = EINVAL;
+                ret = -1;
+                break;
+            }
+            ap->ids[entry->id] = entry;
+            if (ramfs_is_dir(entry) && list_push(fs, &dirs, entry) < 0) {
+                ret = -1;
+                break;
+            }
+        }
+        ramfs_rwlock_unlock(&dir->lock);
+    }
+
+    ramfs_free(&fs->alloc, dirs.entries);
+    return ret;
+}
+
+static ramfs_entry_t *lookup(apply_t *ap, uint32_t id, int type)
+{
+    ramfs_entry_t *entry = ap->ids[id];
+
+    if (entry == NULL || entry->type != type) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return entry;
+}
+
+/* takes entry out of its directory, to be put back or freed */
+static int detach(apply_t *ap, ramfs_entry_t *entry)
+{
+    ramfs_fs_t *fs = ap->fs;
+
+    if (list_push(fs, &ap->removed, entry) < 0) {
+        return -1;
+    }
+
+    ramfs_dcache_forget(fs->dcache, entry, ramfs_is_dir(entry));
+    ramfs_index_remove(fs, entry);
+    return 0;
+}
+
+/* Empties a directory that a record lists anew. Entries are taken out last
+ * first, which keeps vector indexes from moving the rest. */
+static int empty_dir(apply_t *ap, ramfs_dir_t *dir)
+{
+    ramfs_fs_t *fs = ap->fs;
+    size_t first = ap->removed.len;
+    int ret = 0;
+
+    ramfs_rwlock_wrlock(&dir->lock);
+    ramfs_index_cursor_t cursor;
+    ramfs_index_seek(dir, &cursor, 0);
+    ramfs_entry_t *entry;
+    while ((entry = ramfs_index_next(dir, &cursor)) != NULL) {
+        if (list_push(fs, &ap->removed, entry) < 0) {
+            ret = -1;
+            break;
+        }
+    }
+    for (size_t i = ap->removed.len; i > first; i--) {
+        entry = ap->removed.entries[i - 1];
+        ramfs_dcache_forget(fs->dcache, entry, ramfs_is_dir(entry));
+        ramfs_index_remove(fs, entry);
+    }
+    ramfs_rwlock_unlock(&dir->lock);
+    return ret;
+}
+
+/* dir is entry or below it */
+static int is_within(const ramfs_dir_t *dir, const ramfs_entry_t *entry)
+{
+    for (; dir != NULL; dir = dir->entry.parent) {
+        if (&dir->entry == entry) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Fills a directory emptied by empty_dir() from its record. Entries that
+ * exist are moved there from wherever they are now and renamed, the others
+ * are created. */
+static int fill_dir(apply_t *ap, const ramfs_checkpoint_record_t *record,
+        const unsigned char *payload)
+{
+    ramfs_fs_t *fs = ap->fs;
+    ramfs_dir_t *dir = (ramfs_dir_t *) lookup(ap, record->id,
+            RAMFS_ENTRY_TYPE_DIR);
+    if (dir == NULL) {
+        return -1;
+    }
+
+    /* first everything is found or made, without the directory locked */
+    int moved = 0;
+    const unsigned char *p = payload;
+    for (uint64_t n = 0; n < record->offset; n++) {
+        ramfs_checkpoint_child_t child;
+        memcpy(&child, p, sizeof(child));
+        ramfs_name_t name = {(const char *) p + sizeof(child),
+                child.name_len};
+        p += sizeof(child) + child.name_len;
+
+        if (ap->listed[child.id]) {
+            errno = EINVAL;
+            return -1;
+        }
+        ap->listed[child.id] = 1;
+
+        ramfs_entry_t *entry = ap->ids[child.id];
+        if (entry == NULL) {
+            entry = child.type == RAMFS_ENTRY_TYPE_DIR ?
+                    (ramfs_entry_t *) ramfs_dir_new(fs, &name) :
+                    (ramfs_entry_t *) ramfs_file_new(fs, &name);
+            if (entry == NULL) {
+                return -1;
+            }
+            entry->id = child.id;
+            entry->dirty = 0;
+            ap->ids[child.id] = entry;
+            if (list_push(fs, &ap->removed, entry) < 0) {
+                ramfs_entry_free(fs, entry);
+                ap->ids[child.id] = NULL;
+                return -1;
+            }
+            continue;
+        }
+
+        if (entry->type != child.type || is_within(dir, entry)) {
+            errno = EINVAL;
+            return -1;
+        }
+        ramfs_dir_t *parent = entry->parent;
+        if (parent != NULL) {
+            ramfs_rwlock_wrlock(&parent->lock);
+            int ret = detach(ap, entry);
+            ramfs_rwlock_unlock(&parent->lock);
+            if (ret < 0) {
+                return -1;
+            }
+            moved = 1;
+        }
+    }
+    /* lock-free lookups compare names unlocked, as in rename */
+    if (moved) {
+        ramfs_rcu_synchronize();
+    }
+
+    int ret = 0;
+    ramfs_rwlock_wrlock(&dir->lock);
+    if (ramfs_index_reserve(fs, dir, record->offset) < 0) {
+        ret = -1;
+    }
+    p = payload;
+    for (uint64_t n = 0; ret == 0 && n < record->offset; n++) {
+        ramfs_checkpoint_child_t child;
+        memcpy(&child, p, sizeof(child));
+        ramfs_name_t name = {(const char *) p + sizeof(child),
+                child.name_len};
+        p += sizeof(child) + child.name_len;
+
+        ramfs_entry_t *entry = ap->ids[child.id];
+        if (ramfs_name_cmp(&entry->name, &name) != 0 &&
+                ramfs_entry_set_name(fs, entry, &name) < 0) {
+            ret = -1;
+        } else if (ramfs_index_find(dir, &name) != NULL) {
+            errno = EINVAL;
+            ret = -1;
+        } else {
+            ramfs_index_insert(fs, dir, entry);
+        }
+    }
+    ramfs_rwlock_unlock(&dir->lock);
+    ramfs_dcache_created(fs->dcache);
+    return ret;
+}
+
+static int apply_data(apply_t *ap, const ramfs_checkpoint_record_t *record,
+        const unsigned char *payload)
+{
+    ramfs_fs_t *fs = ap->fs;
+    ramfs_file_t *file = (ramfs_file_t *) lookup(ap, record->id,
+            RAMFS_ENTRY_TYPE_FILE);
+    if (file == NULL) {
+        return -1;
+    }
+
+    int ret = 0;
+    ramfs_rwlock_wrlock(&file->lock);
+    if (record->op == RAMFS_CHECKPOINT_TRUNCATE) {
+        ret = ramfs_extents_truncate(&fs->alloc, &file->data,
+                record->offset);
+    } else if (record->len > 0 && ramfs_extents_write(&fs->alloc,
+            &file->data, record->offset, payload, record->len) !=
+            (ssize_t) record->len) {
+        ret = -1;
+    }
+#ifdef CONFIG_RAMFS_RCU
+    __atomic_store_n(&file->size, file->data.size, __ATOMIC_RELAXED);
+#endif
+    ramfs_rwlock_unlock(&file->lock);
+    return ret;
+}
+
+/* applied changes are where the next checkpoint starts from */
+static void clean_file(apply_t *ap, uint32_t id)
+{
+    ramfs_file_t *file = (ramfs_file_t *) ap->ids[id];
+
+    ramfs_rwlock_wrlock(&file->lock);
+    file->entry.dirty = 0;
+    ramfs_extents_clean(&file->data);
+    ramfs_rwlock_unlock(&file->lock);
+}
+
+/* Directory records empty their directories first, so entries can move
+ * between them in any order, then records are applied as they come. */
+static int apply(apply_t *ap, const unsigned char *buf, size_t len)
+{
+    const unsigned char *end = buf + len - sizeof(uint32_t);
+    const unsigned char *p;
+    ramfs_checkpoint_record_t record;
+
+    p = buf + sizeof(ramfs_checkpoint_header_t);
+    while (p < end) {
+        memcpy(&record, p, sizeof(record));
+        p += sizeof(record);
+        /* directories made by an earlier record start out empty */
+        if (record.op == RAMFS_CHECKPOINT_DIR &&
+                ap->ids[record.id] != NULL) {
+            ramfs_dir_t *dir = (ramfs_dir_t *) lookup(ap, record.id,
+                    RAMFS_ENTRY_TYPE_DIR);
+            if (dir == NULL || empty_dir(ap, dir) < 0) {
+                return -1;
+            }
+        }
+        p += record.len;
+    }
+    ramfs_rcu_synchronize();
+
+    p = buf + sizeof(ramfs_checkpoint_header_t);
+    while (p < end) {
+        memcpy(&record, p, sizeof(record));
+        p += sizeof(record);
+        if ((record.op == RAMFS_CHECKPOINT_DIR ? fill_dir(ap, &record, p) :
+                apply_data(ap, &record, p)) < 0) {
+            return -1;
+        }
+        p += record.len;
+    }
+
+    p = buf + sizeof(ramfs_checkpoint_header_t);
+    while (p < end) {
+        memcpy(&record, p, sizeof(record));
+        p += sizeof(record);
+        if (record.op != RAMFS_CHECKPOINT_DIR) {
+            clean_file(ap, record.id);
+        }
+        p += record.len;
+    }
+
+    return 0;
+}
+
+int ramfs_apply_checkpoint(ramfs_fs_t *fs, const void *buf, size_t len)
+{
+    assert(fs != NULL);
+    assert(buf != NULL);
+
+    ramfs_checkpoint_header_t header;
+    if (check_checkpoint(buf, len, &header) < 0) {
+        return -1;
+    }
+
+    if (fs->readonly) {
+        errno = EROFS;
+        return -1;
+    }
+    /* the journal would not see these changes */
+    if (fs->journal != NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    ramfs_mutex_lock(&fs->checkpoint_lock);
+    if (header.seq != fs->checkpoint_seq + 1) {
+        ramfs_mutex_unlock(&fs->checkpoint_lock);
+        errno = EINVAL;
+        return -1;
+    }
+
+    apply_t ap = {
+        .fs = fs,
+        .ids_len = (size_t) header.next_id + 1,
+    };
+    int ret = -1;
+
+    ramfs_rwlock_wrlock(&fs->topology);
+    ap.ids = ramfs_zalloc(&fs->alloc, sizeof(*ap.ids) * ap.ids_len);
+    ap.listed = ramfs_zalloc(&fs->alloc, ap.ids_len);
+    if (ap.ids != NULL && ap.listed != NULL && map_tree(&ap) == 0 &&
+            apply(&ap, buf, len) == 0) {
+        if (header.next_id > fs->next_id) {
+            __atomic_store_n(&fs->next_id, header.next_id,
+                    __ATOMIC_RELAXED);
+        }
+        fs->checkpoint_seq = header.seq;
+        ret = 0;
+    }
+    ramfs_rwlock_unlock(&fs->topology);
+    int err = errno;
+
+    /* what no record put back is gone */
+    size_t n = 0;
+    for (size_t i = 0; i < ap.removed.len; i++) {
+        if (ap.removed.entries[i]->parent == NULL) {
+            ap.removed.entries[n++] = ap.removed.entries[i];
+        }
+    }
+    for (size_t i = 0; i < n; i++) {
+        ramfs_entry_release(fs, ap.removed.entries[i]);
+    }
+    ramfs_mutex_unlock(&fs->checkpoint_lock);
+
+    ramfs_free(&fs->alloc, ap.removed.entries);
+    ramfs_free(&fs->alloc, ap.listed);
+    ramfs_free(&fs->alloc, ap.ids);
+    errno = err;
+    return ret;
+}
@@ -0,0 +1,87 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/* A filesystem image is laid out as
+ *
+ *   header | entry table | name table | data
+ *
+ * with every offset relative to the start of the image and every field in
+ * the byte order of the machine that saved it. Entry 0 is the root. Entries
+ * are stored breadth first, so the children of a directory are a run of
+ * the table, sorted by name. Names are NUL terminated. File data is aligned
+ * to RAMFS_IMAGE_ALIGN bytes. */
+
+#define RAMFS_IMAGE_MAGIC "RMFS"
+#define RAMFS_IMAGE_VERSION 1
+#define RAMFS_IMAGE_ALIGN 8
+
+typedef struct ramfs_image_header_t {
+    char magic[4]; /* RAMFS_IMAGE_MAGIC */
+    uint16_t version; /* RAMFS_IMAGE_VERSION */
+    uint16_t header_size; /* sizeof(ramfs_image_header_t) */
+    uint32_t entries; /* number of entries */
+    uint32_t entries_off; /* entry table */
+    uint32_t names_off; /* name table */
+    uint32_t names_len;
+    uint32_t data_off; /* data region */
+    uint32_t data_len;
+} ramfs_image_header_t;
+
+typedef struct ramfs_image_entry_t {
+    uint32_t name_off; /* into the name table */
+    uint32_t name_len; /* without the NUL */
+    uint32_t parent; /* index of the parent, 0 for the root itself */
+    uint32_t type; /* ramfs_entry_type_t */
+    uint32_t start; /* directory: first child, file: offset into data */
+    uint32_t len; /* directory: number of children, file: size */
+} ramfs_image_entry_t;
+
+/* A checkpoint is laid out as
+ *
+ *   header | records | CRC-32 of everything before it
+ *
+ * in the byte order of the machine that took it, without any alignment.
+ * Entries are named by id as in the journal: the root is 0, entries of the
+ * image a filesystem was loaded from or compacted to are their index in
+ * it, and every entry created later gets the next id. Each record is a
+ * ramfs_checkpoint_record_t followed by len bytes of payload. Directory
+ * records come first, parents before their children, then the data. */
+
+#define RAMFS_CHECKPOINT_MAGIC "RMFC"
+#define RAMFS_CHECKPOINT_VERSION 1
+
+typedef struct ramfs_checkpoint_header_t {
+    char magic[4]; /* RAMFS_CHECKPOINT_MAGIC */
+    uint16_t version; /* RAMFS_CHECKPOINT_VERSION */
+    uint16_t header_size; /* sizeof(ramfs_checkpoint_header_t) */
+    uint32_t seq; /* 1 after the base image, then one more each time */
+    uint32_t next_id; /* last entry id handed out */
+} ramfs_checkpoint_header_t;
+
+typedef enum ramfs_checkpoint_op_t {
+    RAMFS_CHECKPOINT_DIR = 1, /* directory id now holds offset entries,
+                                 payload is a ramfs_checkpoint_child_t and
+                                 the name for each */
+    RAMFS_CHECKPOINT_TRUNCATE, /* file id truncated to offset bytes */
+    RAMFS_CHECKPOINT_WRITE, /* payload written to file id at offset */
+} ramfs_checkpoint_op_t;
+
+typedef struct ramfs_checkpoint_record_t {
+    uint32_t op; /* ramfs_checkpoint_op_t */
+    uint32_t id;
+    uint64_t offset;
+    uint64_t len; /* payload length */
+} ramfs_checkpoint_record_t;
+
+typedef struct ramfs_checkpoint_child_t {
+    uint32_t id;
+    uint32_t type; /* ramfs_entry_type_t */
+    uint32_t name_len; /* name follows, without a NUL */
+} ramfs_checkpoint_child_t;
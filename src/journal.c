@@ -0,0 +1,686 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "alloc.h"
+#include "crc.h"
+#include "journal.h"
+#include "ramfs_priv.h"
+
+
+/* payloads up to this long are read in once, longer ones are checked in
+ * pieces before they are read again to be replayed */
+#define CHUNK 4096
+
+struct ramfs_journal_t {
+    ramfs_store_t store;
+    off_t end; /* where the batched records go */
+    unsigned char *buf; /* records batched for the next write */
+    size_t len;
+    size_t cap;
+    uint32_t crc; /* of the last record */
+    int error; /* errno of a failed write, nothing is recorded after it */
+    ramfs_mutex_t lock; /* all of the above */
+};
+
+/* The CRC starts after the crc field, and carries on from the CRC of the
+ * record before. Records left past the end of the journal by a crash are
+ * not written over all at once, and this keeps any that are whole from
+ * passing for records that follow the new ones. */
+static uint32_t crc_header(const ramfs_journal_record_t *record,
+        uint32_t prev)
+{
+    size_t skip = offsetof(ramfs_journal_record_t, op);
+
+    return ramfs_crc_update(~prev, (const char *) record + skip,
+            sizeof(*record) - skip);
+}
+
+static int store_write(ramfs_journal_t *journal, const void *buf, size_t len)
+{
+    if (len > 0 && journal->store.write(journal->store.ctx, journal->end,
+            buf, len) < 0) {
+        return -1;
+    }
+
+    journal->end += len;
+    return 0;
+}
+
+static int flush(ramfs_journal_t *journal)
+{
+    if (store_write(journal, journal->buf, journal->len) < 0) {
+        return -1;
+    }
+
+    journal->len = 0;
+    return 0;
+}
+
+/* Batches a record, or writes it straight out if it is larger than the
+ * batch. A failed write leaves a torn record that ends the journal, so
+ * nothing is recorded after it. */
+static void append(ramfs_journal_t *journal, ramfs_journal_record_t *record,
+        const struct iovec *iov, int iovcnt, size_t len)
+{
+    record->magic = RAMFS_JOURNAL_MAGIC;
+    record->len = len;
+
+    ramfs_mutex_lock(&journal->lock);
+    if (journal->error != 0) {
+        ramfs_mutex_unlock(&journal->lock);
+        return;
+    }
+
+    uint32_t crc = crc_header(record, journal->crc);
+    size_t left = len;
+    for (int i = 0; i < iovcnt && left > 0; i++) {
+        size_t n = iov[i].iov_len < left ? iov[i].iov_len : left;
+        crc = ramfs_crc_update(crc, iov[i].iov_base, n);
+        left -= n;
+    }
+    record->crc = ~crc;
+    journal->crc = record->crc;
+
+    size_t total = sizeof(*record) + len;
+    if (journal->len + total > journal->cap && flush(journal) < 0) {
+        goto fail;
+    }
+
+    if (total > journal->cap) {
+        if (store_write(journal, record, sizeof(*record)) < 0) {
+            goto fail;
+        }
+        left = len;
+        for (int i = 0; i < iovcnt && left > 0; i++) {
+            size_t n = iov[i].iov_len < left ? iov[i].iov_len : left;
+            if (store_write(journal, iov[i].iov_base, n) < 0) {
+                goto fail;
+            }
+            left -= n;
+        }
+        ramfs_mutex_unlock(&journal->lock);
+        return;
+    }
+
+    memcpy(journal->buf + journal->len, record, sizeof(*record));
+    journal->len += sizeof(*record);
+    left = len;
+    for (int i = 0; i < iovcnt && left > 0; i++) {
+        size_t n = iov[i].iov_len < left ? iov[i].iov_len : left;
+        memcpy(journal->buf + journal->len, iov[i].iov_base, n);
+        journal->len += n;
+        left -= n;
+    }
+    ramfs_mutex_unlock(&journal->lock);
+    return;
+
+fail:
+    journal->error = errno != 0 ? errno : EIO;
+    ramfs_mutex_unlock(&journal->lock);
+}
+
+void ramfs_journal_link(ramfs_fs_t *fs, ramfs_journal_op_t op,
+        const ramfs_dir_t *parent, const ramfs_entry_t *entry)
+{
+    if (fs->journal == NULL) {
+        return;
+    }
+
+    ramfs_journal_record_t record = {
+        .op = op,
+        .id = entry->id,
+        .parent = parent->entry.id,
+    };
+    struct iovec iov = {
+        .iov_base = (void *) entry->name.str,
+        .iov_len = entry->name.len,
+    };
+    append(fs->journal, &record, &iov, 1, entry->name.len);
+}
+
+void ramfs_journal_write(ramfs_fs_t *fs, const ramfs_entry_t *entry,
+        size_t offset, const struct iovec *iov, int iovcnt, size_t len)
+{
+    if (fs->journal == NULL || len == 0) {
+        return;
+    }
+
+    ramfs_journal_record_t record = {
+        .op = RAMFS_JOURNAL_WRITE,
+        .id = entry->id,
+        .offset = offset,
+    };
+    append(fs->journal, &record, iov, iovcnt, len);
+}
+
+void ramfs_journal_change(ramfs_fs_t *fs, ramfs_journal_op_t op,
+        const ramfs_entry_t *entry, size_t size)
+{
+    if (fs->journal == NULL) {
+        return;
+    }
+
+    ramfs_journal_record_t record = {
+        .op = op,
+        .id = entry->id,
+        .offset = size,
+    };
+    append(fs->journal, &record, NULL, 0, 0);
+}
+
+int ramfs_sync(ramfs_fs_t *fs)
+{
+    assert(fs != NULL);
+
+    ramfs_journal_t *journal = fs->journal;
+    if (journal == NULL) {
+        return 0;
+    }
+
+    ramfs_mutex_lock(&journal->lock);
+    if (journal->error == 0 && (flush(journal) < 0 ||
+            (journal->store.sync != NULL &&
+            journal->store.sync(journal->store.ctx) < 0))) {
+        journal->error = errno != 0 ? errno : EIO;
+    }
+    int error = journal->error;
+    ramfs_mutex_unlock(&journal->lock);
+
+    if (error != 0) {
+        errno = error;
+        return -1;
+    }
+
+    return 0;
+}
+
+/* state of a replay, the filesystem is not shared yet so nothing is
+ * locked */
+typedef struct replay_t {
+    ramfs_fs_t *fs;
+    const ramfs_store_t *store;
+    ramfs_entry_t **ids; /* entries by id */
+    size_t ids_len;
+    uint32_t max_id; /* highest id created so far */
+    uint32_t crc; /* of the last record */
+    unsigned char *chunk; /* CHUNK bytes */
+} replay_t;
+
+/* 0 if all of buf was read, 1 if the store ended first, -1 on error */
+static int store_read(const ramfs_store_t *store, off_t offset, void *buf,
+        size_t len)
+{
+    size_t done = 0;
+
+    while (done < len) {
+        ssize_t n = store->read(store->ctx, offset + done,
+                (char *) buf + done, len - done);
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            return 1;
+        }
+        done += n;
+    }
+
+    return 0;
+}
+
+static ramfs_entry_t *lookup(replay_t *rp, uint32_t id, int type)
+{
+    if (id >= rp->ids_len || rp->ids[id] == NULL ||
+            (type != 0 && rp->ids[id]->type != type)) {
+        return NULL;
+    }
+
+    return rp->ids[id];
+}
+
+/* Entries can be changed after the directory they are in is removed. The
+ * removal is recorded under the lock of its parent, not theirs, so records
+ * of those changes can come after it and are skipped. */
+static int gone(replay_t *rp, uint32_t id)
+{
+    return id != 0 && id <= rp->max_id &&
+            (id >= rp->ids_len || rp->ids[id] == NULL);
+}
+
+static int set_id(replay_t *rp, uint32_t id, ramfs_entry_t *entry)
+{
+    if (id >= rp->ids_len) {
+        size_t len = rp->ids_len ? rp->ids_len : 64;
+        while (len <= id) {
+            len *= 2;
+        }
+        ramfs_entry_t **ids = ramfs_realloc(&rp->fs->alloc, rp->ids,
+                sizeof(*ids) * len);
+        if (ids == NULL) {
+            return -1;
+        }
+        memset(ids + rp->ids_len, 0, sizeof(*ids) * (len - rp->ids_len));
+        rp->ids = ids;
+        rp->ids_len = len;
+    }
+
+    rp->ids[id] = entry;
+    return 0;
+}
+
+/* drops the ids of everything in a directory about to be freed */
+static void forget_children(replay_t *rp, ramfs_dir_t *dir)
+{
+    ramfs_index_cursor_t cursor;
+    ramfs_entry_t *entry;
+
+    ramfs_index_seek(dir, &cursor, 0);
+    while ((entry = ramfs_index_next(dir, &cursor)) != NULL) {
+        rp->ids[entry->id] = NULL;
+        if (ramfs_is_dir(entry)) {
+            forget_children(rp, (ramfs_dir_t *) entry);
+        }
+    }
+}
+
+static int valid_name(const ramfs_name_t *name)
+{
+    return name->len > 0 && memchr(name->str, '/', name->len) == NULL &&
+            memchr(name->str, '\0', name->len) == NULL;
+}
+
+static void set_size(ramfs_file_t *file)
+{
+#ifdef CONFIG_RAMFS_RCU
+    file->size = file->data.size;
+#endif
+}
+
+static int replay_create(replay_t *rp, const ramfs_journal_record_t *record,
+        const ramfs_name_t *name)
+{
+    ramfs_fs_t *fs = rp->fs;
+    ramfs_dir_t *parent = (ramfs_dir_t *) lookup(rp, record->parent,
+            RAMFS_ENTRY_TYPE_DIR);
+
+    if (record->id == 0 || lookup(rp, record->id, 0) != NULL ||
+            !valid_name(name)) {
+        errno = EINVAL;
+        return -1;
+    }
+    /* ids are handed out as entries are created, and recorded in the
+     * order their parents are locked in */
+    if (record->id > rp->max_id) {
+        rp->max_id = record->id;
+    }
+    if (parent == NULL && gone(rp, record->parent)) {
+        return 0;
+    }
+    if (parent == NULL || ramfs_index_find(parent, name) != NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    ramfs_entry_t *entry;
+    if (record->op == RAMFS_JOURNAL_CREATE) {
+        ramfs_file_t *file = ramfs_file_new(fs, name);
+        entry = file != NULL ? &file->entry : NULL;
+    } else {
+        ramfs_dir_t *dir = ramfs_dir_new(fs, name);
+        entry = dir != NULL ? &dir->entry : NULL;
+    }
+    if (entry == NULL) {
+        return -1;
+    }
+    entry->id = record->id;
+
+    if (set_id(rp, record->id, entry) < 0 ||
+            ramfs_index_insert(fs, parent, entry) < 0) {
+        if (record->id < rp->ids_len) {
+            rp->ids[record->id] = NULL;
+        }
+        ramfs_entry_free(fs, entry);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int replay_rename(replay_t *rp, const ramfs_journal_record_t *record,
+        const ramfs_name_t *name)
+{
+    ramfs_fs_t *fs = rp->fs;
+    ramfs_entry_t *entry = lookup(rp, record->id, 0);
+    ramfs_dir_t *parent = (ramfs_dir_t *) lookup(rp, record->parent,
+            RAMFS_ENTRY_TYPE_DIR);
+
+    if (entry == NULL && gone(rp, record->id)) {
+        return 0;
+    }
+    if (entry == NULL || record->id == 0 || parent == NULL ||
+            !valid_name(name) || ramfs_index_find(parent, name) != NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    char *str = ramfs_strndup(&fs->alloc, name->str, name->len);
+    if (str == NULL) {
+        return -1;
+    }
+    if (ramfs_index_reserve(fs, parent, 1) < 0) {
+        ramfs_free(&fs->alloc, str);
+        return -1;
+    }
+
+    ramfs_index_remove(fs, entry);
+    ramfs_free(&fs->alloc, (void *) entry->name.str);
+    entry->name.str = str;
+    entry->name.len = name->len;
+    ramfs_index_insert(fs, parent, entry);
+    return 0;
+}
+
+static int replay_write(replay_t *rp, const ramfs_journal_record_t *record,
+        off_t offset, const void *payload)
+{
+    ramfs_file_t *file = (ramfs_file_t *) lookup(rp, record->id,
+            RAMFS_ENTRY_TYPE_FILE);
+
+    if (file == NULL) {
+        if (gone(rp, record->id)) {
+            return 0;
+        }
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* long payloads are read again a chunk at a time */
+    size_t done = 0;
+    while (done < record->len) {
+        size_t n = record->len - done;
+        const void *buf = payload;
+        if (payload == NULL) {
+            n = n < CHUNK ? n : CHUNK;
+            if (store_read(rp->store, offset + done, rp->chunk, n) != 0) {
+                errno = EIO;
+                return -1;
+            }
+            buf = rp->chunk;
+        }
+        if (ramfs_extents_write(&rp->fs->alloc, &file->data,
+                record->offset + done, buf, n) != (ssize_t) n) {
+            return -1;
+        }
+        done += n;
+    }
+
+    set_size(file);
+    return 0;
+}
+
+static int replay_change(replay_t *rp, const ramfs_journal_record_t *record)
+{
+    ramfs_fs_t *fs = rp->fs;
+
+    if (record->op == RAMFS_JOURNAL_TRUNCATE) {
+        ramfs_file_t *file = (ramfs_file_t *) lookup(rp, record->id,
+                RAMFS_ENTRY_TYPE_FILE);
+        if (file == NULL) {
+            if (gone(rp, record->id)) {
+                return 0;
+            }
+            errno = EINVAL;
+            return -1;
+        }
+        if (ramfs_extents_truncate(&fs->alloc, &file->data,
+                record->offset) < 0) {
+            return -1;
+        }
+        set_size(file);
+        return 0;
+    }
+
+    ramfs_entry_t *entry = lookup(rp, record->id, 0);
+    if (entry == NULL) {
+        if (gone(rp, record->id)) {
+            return 0;
+        }
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (ramfs_is_dir(entry)) {
+        forget_children(rp, (ramfs_dir_t *) entry);
+    }
+    /* the root is emptied, not removed */
+    if (record->id != 0) {
+        ramfs_index_remove(fs, entry);
+        rp->ids[record->id] = NULL;
+    }
+    ramfs_entry_free(fs, entry);
+    return 0;
+}
+
+/* Checks and applies the record whose payload starts at offset. Returns 0
+ * if it was applied, 1 if it is where the journal ends, -1 on error. */
+static int replay_record(replay_t *rp, const ramfs_journal_record_t *record,
+        off_t offset)
+{
+    uint32_t crc = crc_header(record, rp->crc);
+    const void *payload = NULL;
+    int ret;
+
+    if (record->len <= CHUNK) {
+        ret = store_read(rp->store, offset, rp->chunk, record->len);
+        if (ret != 0) {
+            return ret;
+        }
+        crc = ramfs_crc_update(crc, rp->chunk, record->len);
+        payload = rp->chunk;
+    } else {
+        for (size_t done = 0; done < record->len; done += CHUNK) {
+            size_t n = record->len - done < CHUNK ? record->len - done :
+                    CHUNK;
+            ret = store_read(rp->store, offset + done, rp->chunk, n);
+            if (ret != 0) {
+                return ret;
+            }
+            crc = ramfs_crc_update(crc, rp->chunk, n);
+        }
+    }
+    if (~crc != record->crc) {
+        return 1;
+    }
+    rp->crc = record->crc;
+
+    switch (record->op) {
+    case RAMFS_JOURNAL_CREATE:
+    case RAMFS_JOURNAL_MKDIR:
+    case RAMFS_JOURNAL_RENAME: {
+        /* names longer than a chunk are rare enough to allocate for */
+        void *buf = NULL;
+        if (payload == NULL) {
+            buf = ramfs_malloc(&rp->fs->alloc, record->len);
+            if (buf == NULL) {
+                return -1;
+            }
+            if (store_read(rp->store, offset, buf, record->len) != 0) {
+                ramfs_free(&rp->fs->alloc, buf);
+                errno = EIO;
+                return -1;
+            }
+            payload = buf;
+        }
+        ramfs_name_t name = {payload, record->len};
+        ret = record->op == RAMFS_JOURNAL_RENAME ?
+                replay_rename(rp, record, &name) :
+                replay_create(rp, record, &name);
+        ramfs_free(&rp->fs->alloc, buf);
+        return ret;
+    }
+
+    case RAMFS_JOURNAL_WRITE:
+        return replay_write(rp, record, offset, payload);
+
+    case RAMFS_JOURNAL_TRUNCATE:
+    case RAMFS_JOURNAL_UNLINK:
+        return replay_change(rp, record);
+    }
+
+    errno = EINVAL;
+    return -1;
+}
+
+/* rebuilds the tree, and finds where new records go */
+static int replay(ramfs_fs_t *fs, ramfs_journal_t *journal)
+{
+    replay_t rp = {
+        .fs = fs,
+        .store = &journal->store,
+    };
+    off_t offset = 0;
+    int ret = -1;
+
+    rp.chunk = ramfs_malloc(&fs->alloc, CHUNK);
+    if (rp.chunk == NULL || set_id(&rp, 0, &fs->root.entry) < 0) {
+        goto done;
+    }
+
+    while (1) {
+        ramfs_journal_record_t record;
+        int r = store_read(rp.store, offset, &record, sizeof(record));
+        if (r < 0) {
+            goto done;
+        }
+        if (r > 0 || record.magic != RAMFS_JOURNAL_MAGIC) {
+            break;
+        }
+
+        r = replay_record(&rp, &record, offset + sizeof(record));
+        if (r < 0) {
+            goto done;
+        }
+        if (r > 0) {
+            break;
+        }
+        offset += sizeof(record) + record.len;
+    }
+
+    /* anything after is torn, and written over */
+    journal->end = offset;
+    journal->crc = rp.crc;
+    /* new entries carry on from the last id handed out */
+    fs->next_id = rp.max_id;
+    ret = 0;
+
+done:
+    ramfs_free(&fs->alloc, rp.chunk);
+    ramfs_free(&fs->alloc, rp.ids);
+    return ret;
+}
+
+int ramfs_journal_open(ramfs_fs_t *fs, const ramfs_store_t *store,
+        size_t buffer)
+{
+    ramfs_journal_t *journal = ramfs_zalloc(&fs->alloc, sizeof(*journal));
+    if (journal == NULL) {
+        return -1;
+    }
+
+    journal->store = *store;
+    journal->cap = buffer;
+    journal->buf = ramfs_malloc(&fs->alloc, buffer);
+    if (journal->buf == NULL) {
+        ramfs_free(&fs->alloc, journal);
+        return -1;
+    }
+    if (ramfs_mutex_init(&journal->lock) < 0) {
+        ramfs_free(&fs->alloc, journal->buf);
+        ramfs_free(&fs->alloc, journal);
+        return -1;
+    }
+
+    if (replay(fs, journal) < 0) {
+        ramfs_mutex_destroy(&journal->lock);
+        ramfs_free(&fs->alloc, journal->buf);
+        ramfs_free(&fs->alloc, journal);
+        return -1;
+    }
+
+    fs->journal = journal;
+    return 0;
+}
+
+void ramfs_journal_close(ramfs_fs_t *fs)
+{
+    ramfs_journal_t *journal = fs->journal;
+
+    if (journal == NULL) {
+        return;
+    }
+
+    ramfs_sync(fs);
+    fs->journal = NULL;
+    ramfs_mutex_destroy(&journal->lock);
+    ramfs_free(&fs->alloc, journal->buf);
+    ramfs_free(&fs->alloc, journal);
+}
+
+static ssize_t file_read(void *ctx, off_t offset, void *buf, size_t len)
+{
+    return pread((int) (intptr_t) ctx, buf, len, offset);
+}
+
+static int file_write(void *ctx, off_t offset, const void *buf, size_t len)
+{
+    size_t done = 0;
+
+    while (done < len) {
+        ssize_t n = pwrite((int) (intptr_t) ctx, (const char *) buf + done,
+                len - done, offset + done);
+        if (n < 0) {
+            return -1;
+        }
+        done += n;
+    }
+
+    return 0;
+}
+
+static int file_sync(void *ctx)
+{
+    return fsync((int) (intptr_t) ctx);
+}
+
+int ramfs_store_file_init(ramfs_store_t *store, const char *path)
+{
+    assert(store != NULL);
+    assert(path != NULL);
+
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+
+    *store = (ramfs_store_t) {
+        .read = file_read,
+        .write = file_write,
+        .sync = file_sync,
+        .ctx = (void *) (intptr_t) fd,
+    };
+    return 0;
+}
+
+void ramfs_store_file_deinit(ramfs_store_t *store)
+{
+    assert(store != NULL);
+
+    close((int) (intptr_t) store->ctx);
+}
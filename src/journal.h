@@ -0,0 +1,119 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#ifdef ESP_PLATFORM
+# include "sdkconfig.h"
+#endif
+
+
+#ifndef CONFIG_RAMFS_JOURNAL_BUFFER
+# define CONFIG_RAMFS_JOURNAL_BUFFER 4096
+#endif
+
+/* A journal is a run of records, each a header followed by its payload, in
+ * the byte order of the machine that wrote it. Entries are named by id, the
+ * root is 0 and every entry created gets the next one. A record that is cut
+ * short or fails its CRC ends the journal, which is where a crash in the
+ * middle of a write leaves it. */
+
+#define RAMFS_JOURNAL_MAGIC 0x4a534652 /* "RFSJ" */
+
+typedef enum ramfs_journal_op_t {
+    RAMFS_JOURNAL_CREATE = 1, /* file id created in parent, payload is
+                                 the name */
+    RAMFS_JOURNAL_MKDIR, /* directory id created in parent, payload is the
+                            name */
+    RAMFS_JOURNAL_WRITE, /* payload written to id at offset */
+    RAMFS_JOURNAL_TRUNCATE, /* id truncated to offset bytes */
+    RAMFS_JOURNAL_RENAME, /* id moved to parent, payload is the new name */
+    RAMFS_JOURNAL_UNLINK, /* id removed with everything in it, or
+                             everything in the root removed for id 0 */
+} ramfs_journal_op_t;
+
+typedef struct ramfs_journal_record_t {
+    uint32_t magic; /* RAMFS_JOURNAL_MAGIC */
+    uint32_t crc; /* CRC-32 of the rest of the header and the payload,
+                     continued from the crc of the record before */
+    uint32_t op; /* ramfs_journal_op_t */
+    uint32_t id;
+    uint32_t parent;
+    uint32_t len; /* payload length */
+    uint64_t offset;
+} ramfs_journal_record_t;
+
+typedef struct ramfs_journal_t ramfs_journal_t;
+typedef struct ramfs_fs_t ramfs_fs_t;
+typedef struct ramfs_dir_t ramfs_dir_t;
+typedef struct ramfs_entry_t ramfs_entry_t;
+typedef struct ramfs_store_t ramfs_store_t;
+
+/**
+ * \brief       Replay a journal into an empty filesystem and keep
+ *              appending to it
+ * \param[in]   fs      \a ramfs_fs_t pointer
+ * \param[in]   store   \a ramfs_store_t pointer, copied
+ * \param[in]   buffer  bytes of records batched before they are written
+ * \return              0 on success, -1 on error with \a errno set to
+ *                      \a EINVAL if the journal does not match the tree
+ *                      it builds
+ */
+int ramfs_journal_open(ramfs_fs_t *fs, const ramfs_store_t *store,
+        size_t buffer);
+
+/**
+ * \brief       Write out what is batched and stop journaling
+ * \param[in]   fs      \a ramfs_fs_t pointer
+ */
+void ramfs_journal_close(ramfs_fs_t *fs);
+
+/**
+ * \brief       Record an entry that is created or moved
+ *
+ * Called with its new parent locked, once inserting it cannot fail and
+ * before it is inserted, so that nothing done to it is recorded first.
+ *
+ * \param[in]   fs      \a ramfs_fs_t pointer
+ * \param[in]   op      \a RAMFS_JOURNAL_CREATE, \a RAMFS_JOURNAL_MKDIR or
+ *                      \a RAMFS_JOURNAL_RENAME
+ * \param[in]   parent  \a ramfs_dir_t pointer to the new parent
+ * \param[in]   entry   \a ramfs_entry_t pointer, with its new name
+ */
+void ramfs_journal_link(ramfs_fs_t *fs, ramfs_journal_op_t op,
+        const ramfs_dir_t *parent, const ramfs_entry_t *entry);
+
+/**
+ * \brief       Record data written to a file
+ *
+ * Called with the file locked for writing.
+ *
+ * \param[in]   fs      \a ramfs_fs_t pointer
+ * \param[in]   entry   \a ramfs_entry_t pointer
+ * \param[in]   offset  byte offset the data went to
+ * \param[in]   iov     the data
+ * \param[in]   iovcnt  number of buffers in \a iov
+ * \param[in]   len     bytes of \a iov that were written
+ */
+void ramfs_journal_write(ramfs_fs_t *fs, const ramfs_entry_t *entry,
+        size_t offset, const struct iovec *iov, int iovcnt, size_t len);
+
+/**
+ * \brief       Record a truncate or a removal
+ *
+ * Called with the file, or the parent of the removed entry, locked for
+ * writing.
+ *
+ * \param[in]   fs      \a ramfs_fs_t pointer
+ * \param[in]   op      \a RAMFS_JOURNAL_TRUNCATE or \a RAMFS_JOURNAL_UNLINK
+ * \param[in]   entry   \a ramfs_entry_t pointer
+ * \param[in]   size    new size for \a RAMFS_JOURNAL_TRUNCATE
+ */
+void ramfs_journal_change(ramfs_fs_t *fs, ramfs_journal_op_t op,
+        const ramfs_entry_t *entry, size_t size);
@@ -0,0 +1,218 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#ifdef ESP_PLATFORM
+# include "sdkconfig.h"
+#endif
+
+#if defined(CONFIG_RAMFS_LOCK_PTHREAD)
+# include <pthread.h>
+#elif defined(CONFIG_RAMFS_LOCK_FREERTOS)
+# include "freertos/FreeRTOS.h"
+# include "freertos/semphr.h"
+#endif
+
+
+/* Locking primitives, chosen at build time. Without CONFIG_RAMFS_LOCK_PTHREAD
+ * or CONFIG_RAMFS_LOCK_FREERTOS every function is a no-op and callers must
+ * serialize access to a filesystem themselves. */
+
+#if defined(CONFIG_RAMFS_LOCK_PTHREAD)
+
+#define RAMFS_LOCKING 1
+
+typedef pthread_mutex_t ramfs_mutex_t;
+typedef pthread_rwlock_t ramfs_rwlock_t;
+
+static inline int ramfs_mutex_init(ramfs_mutex_t *mutex)
+{
+    return pthread_mutex_init(mutex, NULL) == 0 ? 0 : -1;
+}
+
+static inline void ramfs_mutex_destroy(ramfs_mutex_t *mutex)
+{
+    pthread_mutex_destroy(mutex);
+}
+
+static inline void ramfs_mutex_lock(ramfs_mutex_t *mutex)
+{
+    pthread_mutex_lock(mutex);
+}
+
+static inline void ramfs_mutex_unlock(ramfs_mutex_t *mutex)
+{
+    pthread_mutex_unlock(mutex);
+}
+
+static inline int ramfs_rwlock_init(ramfs_rwlock_t *lock)
+{
+    return pthread_rwlock_init(lock, NULL) == 0 ? 0 : -1;
+}
+
+static inline void ramfs_rwlock_destroy(ramfs_rwlock_t *lock)
+{
+    pthread_rwlock_destroy(lock);
+}
+
+static inline void ramfs_rwlock_rdlock(ramfs_rwlock_t *lock)
+{
+    pthread_rwlock_rdlock(lock);
+}
+
+static inline void ramfs_rwlock_wrlock(ramfs_rwlock_t *lock)
+{
+    pthread_rwlock_wrlock(lock);
+}
+
+static inline void ramfs_rwlock_unlock(ramfs_rwlock_t *lock)
+{
+    pthread_rwlock_unlock(lock);
+}
+
+#elif defined(CONFIG_RAMFS_LOCK_FREERTOS)
+
+#define RAMFS_LOCKING 1
+
+typedef struct ramfs_mutex_t {
+    SemaphoreHandle_t handle;
+    StaticSemaphore_t buf;
+} ramfs_mutex_t;
+
+/* FreeRTOS has no reader/writer lock. The first reader in takes the writer
+ * semaphore on behalf of all readers and the last one out gives it back, so
+ * it has to be a binary semaphore rather than a mutex. */
+typedef struct ramfs_rwlock_t {
+    ramfs_mutex_t readers_mutex;
+    SemaphoreHandle_t write;
+    StaticSemaphore_t write_buf;
+    unsigned int readers;
+    int writing;
+} ramfs_rwlock_t;
+
+static inline int ramfs_mutex_init(ramfs_mutex_t *mutex)
+{
+    mutex->handle = xSemaphoreCreateMutexStatic(&mutex->buf);
+    return mutex->handle != NULL ? 0 : -1;
+}
+
+static inline void ramfs_mutex_destroy(ramfs_mutex_t *mutex)
+{
+    vSemaphoreDelete(mutex->handle);
+}
+
+static inline void ramfs_mutex_lock(ramfs_mutex_t *mutex)
+{
+    xSemaphoreTake(mutex->handle, portMAX_DELAY);
+}
+
+static inline void ramfs_mutex_unlock(ramfs_mutex_t *mutex)
+{
+    xSemaphoreGive(mutex->handle);
+}
+
+static inline int ramfs_rwlock_init(ramfs_rwlock_t *lock)
+{
+    if (ramfs_mutex_init(&lock->readers_mutex) < 0) {
+        return -1;
+    }
+    lock->write = xSemaphoreCreateBinaryStatic(&lock->write_buf);
+    if (lock->write == NULL) {
+        ramfs_mutex_destroy(&lock->readers_mutex);
+        return -1;
+    }
+    xSemaphoreGive(lock->write);
+    lock->readers = 0;
+    lock->writing = 0;
+    return 0;
+}
+
+static inline void ramfs_rwlock_destroy(ramfs_rwlock_t *lock)
+{
+    vSemaphoreDelete(lock->write);
+    ramfs_mutex_destroy(&lock->readers_mutex);
+}
+
+static inline void ramfs_rwlock_rdlock(ramfs_rwlock_t *lock)
+{
+    ramfs_mutex_lock(&lock->readers_mutex);
+    if (lock->readers++ == 0) {
+        xSemaphoreTake(lock->write, portMAX_DELAY);
+    }
+    ramfs_mutex_unlock(&lock->readers_mutex);
+}
+
+static inline void ramfs_rwlock_wrlock(ramfs_rwlock_t *lock)
+{
+    xSemaphoreTake(lock->write, portMAX_DELAY);
+    lock->writing = 1;
+}
+
+static inline void ramfs_rwlock_unlock(ramfs_rwlock_t *lock)
+{
+    if (lock->writing) {
+        lock->writing = 0;
+        xSemaphoreGive(lock->write);
+        return;
+    }
+
+    ramfs_mutex_lock(&lock->readers_mutex);
+    if (--lock->readers == 0) {
+        xSemaphoreGive(lock->write);
+    }
+    ramfs_mutex_unlock(&lock->readers_mutex);
+}
+
+#else
+
+#define RAMFS_LOCKING 0
+
+typedef struct ramfs_mutex_t {
+    char unused;
+} ramfs_mutex_t;
+
+typedef struct ramfs_rwlock_t {
+    char unused;
+} ramfs_rwlock_t;
+
+static inline int ramfs_mutex_init(ramfs_mutex_t *mutex)
+{
+    return 0;
+}
+
+static inline void ramfs_mutex_destroy(ramfs_mutex_t *mutex)
+{
+}
+
+static inline void ramfs_mutex_lock(ramfs_mutex_t *mutex)
+{
+}
+
+static inline void ramfs_mutex_unlock(ramfs_mutex_t *mutex)
+{
+}
+
+static inline int ramfs_rwlock_init(ramfs_rwlock_t *lock)
+{
+    return 0;
+}
+
+static inline void ramfs_rwlock_destroy(ramfs_rwlock_t *lock)
+{
+}
+
+static inline void ramfs_rwlock_rdlock(ramfs_rwlock_t *lock)
+{
+}
+
+static inline void ramfs_rwlock_wrlock(ramfs_rwlock_t *lock)
+{
+}
+
+static inline void ramfs_rwlock_unlock(ramfs_rwlock_t *lock)
+{
+}
+
+#endif
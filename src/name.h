@@ -0,0 +1,73 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+
+/**
+ * \brief       Length-delimited name
+ *
+ * Path components are looked up in place, so a name is not necessarily NUL
+ * terminated. Names owned by entries always are.
+ */
+typedef struct ramfs_name_t {
+    const char *str; /**< name characters */
+    size_t len; /**< name length */
+} ramfs_name_t;
+
+/**
+ * \brief       Compare two names, ordered like \a strcmp
+ * \param[in]   a       first name
+ * \param[in]   b       second name
+ * \return              <0, 0 or >0
+ */
+static inline int ramfs_name_cmp(const ramfs_name_t *a, const ramfs_name_t *b)
+{
+    int cmp = memcmp(a->str, b->str, a->len < b->len ? a->len : b->len);
+    if (cmp != 0) {
+        return cmp;
+    }
+
+    return (a->len > b->len) - (a->len < b->len);
+}
+
+/**
+ * \brief       Hash a name (32-bit FNV-1a)
+ * \param[in]   name    name to hash
+ * \return              hash value
+ */
+static inline uint32_t ramfs_name_hash(const ramfs_name_t *name)
+{
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < name->len; i++) {
+        hash ^= (unsigned char) name->str[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+/**
+ * \brief       Split the last component off a path
+ * \param[in]   path    path with leading slashes already skipped
+ * \param[out]  name    set to the last component, empty if \a path ends in a
+ *                      slash
+ */
+static inline void ramfs_name_basename(const char *path, ramfs_name_t *name)
+{
+    size_t len = strlen(path);
+    const char *p = path + len;
+
+    while (p > path && *(p - 1) != '/') {
+        p--;
+    }
+
+    name->str = p;
+    name->len = len - (p - path);
+}
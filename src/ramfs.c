@@ -0,0 +1,1804 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc.h"
+#include "image.h"
+#include "ramfs_priv.h"
+
+
+static ramfs_fs_t *entry_fs(const ramfs_entry_t *entry)
+{
+    if (entry->parent == NULL) {
+        return ((ramfs_dir_t *) entry)->fs;
+    }
+
+    return entry->parent->fs;
+}
+
+/* Custom allocators are not expected to be thread safe, so with locking
+ * enabled they are wrapped in a mutex. The C library heap is left alone. */
+typedef struct locked_alloc_t {
+    ramfs_allocator_t backing;
+    ramfs_mutex_t lock;
+} locked_alloc_t;
+
+static void *locked_malloc(void *ctx, size_t size)
+{
+    locked_alloc_t *locked = ctx;
+
+    ramfs_mutex_lock(&locked->lock);
+    void *p = locked->backing.malloc(locked->backing.ctx, size);
+    ramfs_mutex_unlock(&locked->lock);
+    return p;
+}
+
+static void *locked_realloc(void *ctx, void *ptr, size_t size)
+{
+    locked_alloc_t *locked = ctx;
+
+    ramfs_mutex_lock(&locked->lock);
+    void *p = locked->backing.realloc(locked->backing.ctx, ptr, size);
+    ramfs_mutex_unlock(&locked->lock);
+    return p;
+}
+
+static void locked_free(void *ctx, void *ptr)
+{
+    locked_alloc_t *locked = ctx;
+
+    ramfs_mutex_lock(&locked->lock);
+    locked->backing.free(locked->backing.ctx, ptr);
+    ramfs_mutex_unlock(&locked->lock);
+}
+
+static int lock_allocator(ramfs_allocator_t *alloc)
+{
+    if (!RAMFS_LOCKING || alloc->malloc == ramfs_heap_allocator.malloc) {
+        return 0;
+    }
+
+    locked_alloc_t *locked = ramfs_malloc(alloc, sizeof(*locked));
+    if (locked == NULL) {
+        return -1;
+    }
+    if (ramfs_mutex_init(&locked->lock) < 0) {
+        ramfs_free(alloc, locked);
+        return -1;
+    }
+
+    locked->backing = *alloc;
+    *alloc = (ramfs_allocator_t) {
+        .malloc = locked_malloc,
+        .realloc = locked_realloc,
+        .free = locked_free,
+        .release = alloc->release,
+        .ctx = locked,
+    };
+    return 0;
+}
+
+static ramfs_allocator_t unlock_allocator(const ramfs_allocator_t *alloc)
+{
+    if (alloc->malloc != locked_malloc) {
+        return *alloc;
+    }
+
+    locked_alloc_t *locked = alloc->ctx;
+    ramfs_allocator_t backing = locked->backing;
+    ramfs_mutex_destroy(&locked->lock);
+    ramfs_free(&backing, locked);
+    return backing;
+}
+
+static void *slab_alloc(ramfs_fs_t *fs, ramfs_slab_type_t type)
+{
+    ramfs_mutex_lock(&fs->slab_lock);
+    void *obj = ramfs_slab_alloc(&fs->alloc, &fs->slab[type]);
+    ramfs_mutex_unlock(&fs->slab_lock);
+    return obj;
+}
+
+static void slab_free(ramfs_fs_t *fs, ramfs_slab_type_t type, void *obj)
+{
+    ramfs_mutex_lock(&fs->slab_lock);
+    ramfs_slab_free(&fs->alloc, &fs->slab[type], obj);
+    ramfs_mutex_unlock(&fs->slab_lock);
+}
+
+/* names of entries from a mounted image are used where they are */
+static int in_image(const ramfs_fs_t *fs, const char *str)
+{
+    return fs->image != NULL && str >= fs->image &&
+            str < fs->image + fs->image_len;
+}
+
+static const char *keep_name(ramfs_fs_t *fs, const ramfs_name_t *name)
+{
+    if (in_image(fs, name->str) && in_image(fs, name->str + name->len) &&
+            name->str[name->len] == '\0') {
+        return name->str;
+    }
+
+    return ramfs_strndup(&fs->alloc, name->str, name->len);
+}
+
+static void drop_name(ramfs_fs_t *fs, const char *str)
+{
+    if (!in_image(fs, str)) {
+        ramfs_free(&fs->alloc, (void *) str);
+    }
+}
+
+int ramfs_entry_set_name(ramfs_fs_t *fs, ramfs_entry_t *entry,
+        const ramfs_name_t *name)
+{
+    const char *str = keep_name(fs, name);
+    if (str == NULL) {
+        return -1;
+    }
+
+    drop_name(fs, entry->name.str);
+    entry->name.str = str;
+    entry->name.len = name->len;
+    return 0;
+}
+
+/* Directories are locked on the way down, which waits out path walks still
+ * inside them. */
+void ramfs_entry_free(ramfs_fs_t *fs, ramfs_entry_t *entry)
+{
+    ramfs_allocator_t *alloc = &fs->alloc;
+
+    if (ramfs_is_dir(entry)) {
+        ramfs_dir_t *dir = (ramfs_dir_t *) entry;
+        ramfs_rwlock_wrlock(&dir->lock);
+        ramfs_index_drain(fs, dir, ramfs_entry_free);
+        ramfs_index_destroy(fs, dir);
+        ramfs_rwlock_unlock(&dir->lock);
+        if (entry == &fs->root.entry) {
+            return;
+        }
+        ramfs_rwlock_destroy(&dir->lock);
+    } else {
+        ramfs_file_t *file = (ramfs_file_t *) entry;
+        ramfs_extents_free(alloc, &file->data);
+        ramfs_rwlock_destroy(&file->lock);
+    }
+
+    drop_name(fs, entry->name.str);
+    slab_free(fs, ramfs_is_dir(entry) ? RAMFS_SLAB_DIR : RAMFS_SLAB_FILE,
+            entry);
+}
+
+#ifdef CONFIG_RAMFS_RCU
+static void free_retired(ramfs_fs_t *fs, ramfs_rcu_head_t *head)
+{
+    ramfs_entry_free(fs, (ramfs_entry_t *) ((char *) head -
+            offsetof(ramfs_entry_t, rcu)));
+}
+#endif
+
+/* once lock-free lookups that might have found it are done */
+void ramfs_entry_release(ramfs_fs_t *fs, ramfs_entry_t *entry)
+{
+#ifdef CONFIG_RAMFS_RCU
+    ramfs_rcu_retire(fs, &entry->rcu, free_retired);
+    ramfs_rcu_reclaim(fs);
+#else
+    ramfs_entry_free(fs, entry);
+#endif
+}
+
+/* images mounted with ramfs_mount_image() are read-only */
+static int check_writable(const ramfs_fs_t *fs)
+{
+    if (fs->readonly) {
+        errno = EROFS;
+        return -1;
+    }
+
+    return 0;
+}
+
+/* stat reads the size of a file without its lock with CONFIG_RAMFS_RCU, so
+ * it is published after every change, with the lock held */
+static void publish_size(ramfs_file_t *file)
+{
+#ifdef CONFIG_RAMFS_RCU
+    __atomic_store_n(&file->size, file->data.size, __ATOMIC_RELAXED);
+#endif
+}
+
+ramfs_file_t *ramfs_file_new(ramfs_fs_t *fs, const ramfs_name_t *name)
+{
+    ramfs_file_t *file = slab_alloc(fs, RAMFS_SLAB_FILE);
+    if (file == NULL) {
+        return NULL;
+    }
+
+    file->entry.name.str = keep_name(fs, name);
+    file->entry.name.len = name->len;
+    if (file->entry.name.str == NULL) {
+        slab_free(fs, RAMFS_SLAB_FILE, file);
+        return NULL;
+    }
+    file->entry.parent = NULL;
+    file->entry.type = RAMFS_ENTRY_TYPE_FILE;
+    file->entry.dirty = RAMFS_DIRTY_NEW;
+    file->entry.id = __atomic_add_fetch(&fs->next_id, 1, __ATOMIC_RELAXED);
+
+    if (ramfs_rwlock_init(&file->lock) < 0) {
+        drop_name(fs, file->entry.name.str);
+        slab_free(fs, RAMFS_SLAB_FILE, file);
+        return NULL;
+    }
+    ramfs_dcache_grow(fs->dcache);
+
+    return file;
+}
+
+ramfs_dir_t *ramfs_dir_new(ramfs_fs_t *fs, const ramfs_name_t *name)
+{
+    ramfs_dir_t *dir = slab_alloc(fs, RAMFS_SLAB_DIR);
+    if (dir == NULL) {
+        return NULL;
+    }
+
+    dir->entry.name.str = keep_name(fs, name);
+    dir->entry.name.len = name->len;
+    if (dir->entry.name.str == NULL) {
+        slab_free(fs, RAMFS_SLAB_DIR, dir);
+        return NULL;
+    }
+    dir->entry.parent = NULL;
+    dir->entry.type = RAMFS_ENTRY_TYPE_DIR;
+    dir->entry.dirty = 0;
+    dir->entry.id = __atomic_add_fetch(&fs->next_id, 1, __ATOMIC_RELAXED);
+    dir->fs = fs;
+    dir->image = NULL;
+    ramfs_index_init(dir);
+
+    if (ramfs_rwlock_init(&dir->lock) < 0) {
+        drop_name(fs, dir->entry.name.str);
+        slab_free(fs, RAMFS_SLAB_DIR, dir);
+        return NULL;
+    }
+    ramfs_dcache_grow(fs->dcache);
+
+    return dir;
+}
+
+ramfs_fs_t *ramfs_init(void)
+{
+    return ramfs_init_ex(NULL);
+}
+
+ramfs_fs_t *ramfs_init_ex(const ramfs_config_t *config)
+{
+    const ramfs_allocator_t *alloc = &ramfs_heap_allocator;
+    size_t small_dir_max = CONFIG_RAMFS_SMALL_DIR_MAX;
+    size_t small_dir_min = CONFIG_RAMFS_SMALL_DIR_MIN;
+    size_t dcache_size = CONFIG_RAMFS_DCACHE_SIZE;
+    const ramfs_store_t *journal = NULL;
+    size_t journal_buffer = CONFIG_RAMFS_JOURNAL_BUFFER;
+
+    if (config != NULL) {
+        if (config->allocator != NULL) {
+            alloc = config->allocator;
+        }
+        if (config->small_dir_max != 0) {
+            small_dir_max = config->small_dir_max;
+        }
+        if (config->small_dir_min != 0) {
+            small_dir_min = config->small_dir_min;
+        }
+        if (config->dcache_size != 0) {
+            dcache_size = config->dcache_size;
+        }
+        journal = config->journal;
+        if (config->journal_buffer != 0) {
+            journal_buffer = config->journal_buffer;
+        }
+    }
+
+    if (dcache_size == RAMFS_DCACHE_OFF) {
+        dcache_size = 0;
+    }
+#ifdef CONFIG_RAMFS_RCU
+    /* lookups take no locks, a cache in front of them would add one */
+    dcache_size = 0;
+#endif
+
+    if (small_dir_min >= small_dir_max) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    ramfs_fs_t *fs = ramfs_zalloc(alloc, sizeof(*fs));
+    if (fs == NULL) {
+        return NULL;
+    }
+
+    fs->alloc = *alloc;
+    fs->small_dir_max = small_dir_max;
+    fs->small_dir_min = small_dir_min;
+
+    int locks = 0;
+    if (ramfs_rwlock_init(&fs->root.lock) == 0 && ++locks &&
+            ramfs_rwlock_init(&fs->topology) == 0 && ++locks &&
+            ramfs_mutex_init(&fs->slab_lock) == 0 && ++locks &&
+            lock_allocator(&fs->alloc) == 0 && ++locks &&
+            ramfs_epoch_init(&fs->epoch) == 0 && ++locks &&
+            ramfs_mutex_init(&fs->image_lock) == 0 && ++locks &&
+            ramfs_mutex_init(&fs->checkpoint_lock) == 0 && ++locks &&
+            (dcache_size == 0 || (fs->dcache = ramfs_dcache_new(&fs->alloc,
+            dcache_size)) != NULL)) {
+        ramfs_slab_init(&fs->slab[RAMFS_SLAB_DIR], sizeof(ramfs_dir_t));
+        ramfs_slab_init(&fs->slab[RAMFS_SLAB_FILE], sizeof(ramfs_file_t));
+        ramfs_slab_init(&fs->slab[RAMFS_SLAB_FH], sizeof(ramfs_fh_t));
+        ramfs_slab_init(&fs->slab[RAMFS_SLAB_DH], sizeof(ramfs_dh_t));
+        fs->root.fs = fs;
+        fs->root.entry.type = RAMFS_ENTRY_TYPE_DIR;
+        ramfs_index_init(&fs->root);
+        if (journal != NULL &&
+                ramfs_journal_open(fs, journal, journal_buffer) < 0) {
+            int error = errno;
+            ramfs_deinit(fs);
+            errno = error;
+            return NULL;
+        }
+        return fs;
+    }
+
+    switch (locks) {
+    case 7:
+        ramfs_mutex_destroy(&fs->checkpoint_lock);
+        /* fall through */
+    case 6:
+        ramfs_mutex_destroy(&fs->image_lock);
+        /* fall through */
+    case 5:
+        ramfs_epoch_destroy(fs);
+        /* fall through */
+    case 4:
+        unlock_allocator(&fs->alloc);
+        /* fall through */
+    case 3:
+        ramfs_mutex_destroy(&fs->slab_lock);
+        /* fall through */
+    case 2:
+        ramfs_rwlock_destroy(&fs->topology);
+        /* fall through */
+    case 1:
+        ramfs_rwlock_destroy(&fs->root.lock);
+    }
+    ramfs_free(alloc, fs);
+    return NULL;
+}
+
+void ramfs_deinit(ramfs_fs_t *fs)
+{
+    assert(fs != NULL);
+
+    ramfs_journal_close(fs);
+
+    if (fs->alloc.release == NULL) {
+        ramfs_epoch_destroy(fs);
+        ramfs_entry_free(fs, &fs->root.entry);
+        ramfs_dcache_destroy(&fs->alloc, fs->dcache);
+        for (int i = 0; i < RAMFS_SLAB_MAX; i++) {
+            ramfs_slab_destroy(&fs->alloc, &fs->slab[i]);
+        }
+    }
+
+    ramfs_rwlock_destroy(&fs->root.lock);
+    ramfs_rwlock_destroy(&fs->topology);
+    ramfs_mutex_destroy(&fs->slab_lock);
+    ramfs_mutex_destroy(&fs->image_lock);
+    ramfs_mutex_destroy(&fs->checkpoint_lock);
+
+    ramfs_allocator_t alloc = unlock_allocator(&fs->alloc);
+    if (alloc.release != NULL) {
+        alloc.release(alloc.ctx);
+        return;
+    }
+    ramfs_free(&alloc, fs);
+}
+
+void ramfs_slab_stats(ramfs_fs_t *fs, ramfs_slab_type_t type,
+        ramfs_slab_stats_t *stats)
+{
+    assert(fs != NULL);
+    assert(type < RAMFS_SLAB_MAX);
+    assert(stats != NULL);
+
+    ramfs_slab_t *slab = &fs->slab[type];
+
+    ramfs_mutex_lock(&fs->slab_lock);
+    stats->obj_size = slab->obj_size;
+    stats->pages = slab->pages_len;
+    stats->capacity = slab->pages_len * slab->per_page;
+    stats->in_use = slab->in_use;
+    ramfs_mutex_unlock(&fs->slab_lock);
+}
+
+void ramfs_dcache_stats(ramfs_fs_t *fs, ramfs_dcache_stats_t *stats)
+{
+    assert(fs != NULL);
+    assert(stats != NULL);
+
+    if (fs->dcache == NULL) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+
+    ramfs_mutex_lock(&fs->dcache->lock);
+    stats->size = fs->dcache->size;
+    stats->used = fs->dcache->used;
+    stats->hits = fs->dcache->hits;
+    stats->misses = fs->dcache->misses;
+    ramfs_mutex_unlock(&fs->dcache->lock);
+}
+
+/* absolute paths start over at the root, like the POSIX *at() calls */
+static ramfs_dir_t *start_dir(ramfs_dir_t *dir, const char **path)
+{
+    if (**path == '/') {
+        dir = &dir->fs->root;
+        while (**path == '/') {
+            (*path)++;
+        }
+    }
+
+    return dir;
+}
+
+static void lock_dir(ramfs_dir_t *dir, int write)
+{
+    if (write) {
+        ramfs_rwlock_wrlock(&dir->lock);
+    } else {
+        ramfs_rwlock_rdlock(&dir->lock);
+    }
+}
+
+/* Walks to the directory holding the last component of path, hand over hand:
+ * the next directory is locked before the previous one is let go. Returns it
+ * locked for writing if write is set, for reading otherwise. */
+static ramfs_dir_t *lock_parent(ramfs_dir_t *dir, const char *path, int write)
+{
+    dir = start_dir(dir, &path);
+
+    const char *end = strchr(path, '/');
+    if (ramfs_image_populate(dir) < 0) {
+        return NULL;
+    }
+    lock_dir(dir, write && end == NULL);
+    while (end != NULL) {
+        ramfs_name_t key = {
+            .str = path,
+            .len = end - path,
+        };
+        ramfs_entry_t *entry = ramfs_index_find(dir, &key);
+        if (entry == NULL) {
+            ramfs_rwlock_unlock(&dir->lock);
+            return NULL;
+        }
+        if (!ramfs_is_dir(entry)) {
+            ramfs_rwlock_unlock(&dir->lock);
+            errno = ENOTDIR;
+            return NULL;
+        }
+        path = end + 1;
+        while (*path == '/') {
+            path++;
+        }
+        end = strchr(path, '/');
+
+        ramfs_dir_t *next = (ramfs_dir_t *) entry;
+        if (ramfs_image_populate(next) < 0) {
+            ramfs_rwlock_unlock(&dir->lock);
+            return NULL;
+        }
+        lock_dir(next, write && end == NULL);
+        ramfs_rwlock_unlock(&dir->lock);
+        dir = next;
+    }
+
+    return dir;
+}
+
+ramfs_entry_t *ramfs_get_parent(ramfs_fs_t *fs, const char *path)
+{
+    assert(fs != NULL);
+    assert(path != NULL);
+
+    ramfs_dir_t *dir = lock_parent(&fs->root, path, 0);
+    if (dir == NULL) {
+        return NULL;
+    }
+
+    ramfs_rwlock_unlock(&dir->lock);
+    return &dir->entry;
+}
+
+#ifdef CONFIG_RAMFS_RCU
+/* Walks without taking a single lock, in a read section. Returns -1 when a
+ * directory on the way kept changing, to walk again with locks. */
+static int walk_rcu(ramfs_dir_t *dir, const char *path, ramfs_entry_t **entry)
+{
+    dir = start_dir(dir, &path);
+
+    while (1) {
+        const char *end = strchr(path, '/');
+        ramfs_name_t key = {
+            .str = path,
+            .len = end != NULL ? (size_t) (end - path) : strlen(path),
+        };
+        /* reading a directory in from an image takes locks */
+        if (__atomic_load_n(&dir->image, __ATOMIC_ACQUIRE) != NULL ||
+                ramfs_index_find_rcu(dir, &key, entry) < 0) {
+            return -1;
+        }
+        if (*entry == NULL) {
+            errno = ENOENT;
+            return 0;
+        }
+        if (end == NULL) {
+            return 0;
+        }
+        if (!ramfs_is_dir(*entry)) {
+            *entry = NULL;
+            errno = ENOTDIR;
+            return 0;
+        }
+
+        dir = (ramfs_dir_t *) *entry;
+        path = end + 1;
+        while (*path == '/') {
+            path++;
+        }
+    }
+}
+#endif
+
+static ramfs_entry_t *walk(ramfs_dir_t *dir, const char *path)
+{
+    ramfs_name_t key;
+    ramfs_name_basename(path, &key);
+    if (key.len == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+#ifdef CONFIG_RAMFS_RCU
+    if (ramfs_rcu_read_lock() == 0) {
+        ramfs_entry_t *entry;
+        int ret = walk_rcu(dir, path, &entry);
+        ramfs_rcu_read_unlock();
+        if (ret == 0) {
+            return entry;
+        }
+    }
+#endif
+
+    ramfs_dir_t *parent = lock_parent(dir, path, 0);
+    if (parent == NULL) {
+        return NULL;
+    }
+
+    ramfs_entry_t *entry = ramfs_index_find(parent, &key);
+    ramfs_rwlock_unlock(&parent->lock);
+    return entry;
+}
+
+static ramfs_entry_t *get_entry(ramfs_fs_t *fs, const char *path)
+{
+    while (*path == '/') {
+        path++;
+    }
+
+    ramfs_name_t full = {
+        .str = path,
+        .len = strlen(path),
+    };
+    ramfs_entry_t *entry;
+    unsigned int gen = 0;
+    if (ramfs_dcache_lookup(fs->dcache, &full, &entry, &gen)) {
+        return entry;
+    }
+
+    entry = walk(&fs->root, path);
+    int error = errno;
+    if (entry != NULL || error == ENOENT || error == ENOTDIR) {
+        ramfs_dcache_insert(fs->dcache, &full, entry, error, gen);
+        errno = error;
+    }
+    return entry;
+}
+
+ramfs_entry_t *ramfs_get_entry(ramfs_fs_t *fs, const char *path)
+{
+    assert(fs != NULL);
+    assert(path != NULL);
+
+    return get_entry(fs, path);
+}
+
+ramfs_entry_t *ramfs_get_entry_at(ramfs_entry_t *dir, const char *path)
+{
+    assert(dir != NULL);
+    assert(path != NULL);
+
+    if (!ramfs_is_dir(dir)) {
+        errno = ENOTDIR;
+        return NULL;
+    }
+
+    ramfs_dir_t *start = start_dir((ramfs_dir_t *) dir, &path);
+
+    /* only paths from the root are kept in the dentry cache */
+    if (start == &start->fs->root) {
+        return get_entry(start->fs, path);
+    }
+
+    return walk(start, path);
+}
+
+char *ramfs_get_name(const ramfs_entry_t *entry)
+{
+    assert(entry != NULL);
+
+    ramfs_fs_t *fs = entry_fs(entry);
+
+    ramfs_rwlock_rdlock(&fs->topology);
+    char *name = strdup(entry->name.str);
+    ramfs_rwlock_unlock(&fs->topology);
+    return name;
+}
+
+const char *ramfs_get_name_ref(const ramfs_entry_t *entry, size_t *len)
+{
+    assert(entry != NULL);
+
+    if (len != NULL) {
+        *len = entry->name.len;
+    }
+
+    return entry->name.str != NULL ? entry->name.str : "";
+}
+
+static char *get_path(const ramfs_entry_t *entry)
+{
+    size_t len = 0;
+    const ramfs_entry_t *node;
+
+    for (node = entry; node->parent != NULL; node = &node->parent->entry) {
+        len += node->name.len + 1;
+    }
+
+    if (len == 0) {
+        return strdup("/");
+    }
+
+    char *path = malloc(len + 1);
+    if (path == NULL) {
+        return NULL;
+    }
+    path[len] = '\0';
+
+    for (node = entry; node->parent != NULL; node = &node->parent->entry) {
+        len -= node->name.len;
+        memcpy(path + len, node->name.str, node->name.len);
+        path[--len] = '/';
+    }
+
+    return path;
+}
+
+char *ramfs_get_path(const ramfs_entry_t *entry)
+{
+    assert(entry != NULL);
+
+    ramfs_fs_t *fs = entry_fs(entry);
+
+    ramfs_rwlock_rdlock(&fs->topology);
+    char *path = get_path(entry);
+    ramfs_rwlock_unlock(&fs->topology);
+    return path;
+}
+
+int ramfs_is_dir(const ramfs_entry_t *entry)
+{
+    assert(entry != NULL);
+
+    return entry->type == RAMFS_ENTRY_TYPE_DIR;
+}
+
+int ramfs_is_file(const ramfs_entry_t *entry)
+{
+    assert(entry != NULL);
+
+    return entry->type == RAMFS_ENTRY_TYPE_FILE;
+}
+
+/* directories not read in from an image yet are counted in the image */
+static size_t dir_count(const ramfs_dir_t *dir)
+{
+    const ramfs_image_entry_t *record = __atomic_load_n(&dir->image,
+            __ATOMIC_ACQUIRE);
+
+    return record != NULL ? record->len : ramfs_index_count(dir);
+}
+
+void ramfs_stat(ramfs_fs_t *fs, const ramfs_entry_t *entry, ramfs_stat_t *st)
+{
+    assert(fs != NULL);
+    assert(entry != NULL);
+    assert(st != NULL);
+
+    memset(st, 0, sizeof(*st));
+    st->type = entry->type;
+    if (entry->type == RAMFS_ENTRY_TYPE_FILE) {
+        ramfs_file_t *file = (ramfs_file_t *) entry;
+#ifdef CONFIG_RAMFS_RCU
+        st->size = __atomic_load_n(&file->size, __ATOMIC_RELAXED);
+#else
+        ramfs_rwlock_rdlock(&file->lock);
+        st->size = file->data.size;
+        ramfs_rwlock_unlock(&file->lock);
+#endif
+    } else {
+        ramfs_dir_t *dir = (ramfs_dir_t *) entry;
+        if (ramfs_rcu_read_lock() == 0) {
+            st->size = dir_count(dir);
+            ramfs_rcu_read_unlock();
+        } else {
+            ramfs_rwlock_rdlock(&dir->lock);
+            st->size = dir_count(dir);
+            ramfs_rwlock_unlock(&dir->lock);
+        }
+    }
+}
+
+/* parent is locked for writing */
+/* creates a file, with buf adopted as its data unless it is NULL */
+static ramfs_entry_t *create_in(ramfs_fs_t *fs, ramfs_dir_t *parent,
+        const char *path, const void *buf, size_t len, int flags)
+{
+    ramfs_file_t *file;
+
+    ramfs_name_t name;
+    ramfs_name_basename(path, &name);
+    if (name.len == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (ramfs_index_find(parent, &name) != NULL) {
+        errno = EEXIST;
+        return NULL;
+    }
+
+    file = ramfs_file_new(fs, &name);
+    if (file == NULL) {
+        return NULL;
+    }
+
+    if (buf != NULL) {
+        if (ramfs_extents_adopt(&fs->alloc, &file->data, (void *) buf, len,
+                flags & RAMFS_BUFFER_OWN) < 0) {
+            ramfs_entry_free(fs, &file->entry);
+            return NULL;
+        }
+        publish_size(file);
+    }
+
+    /* recorded before it can be found, so nothing done to it is recorded
+     * first */
+    if (fs->journal != NULL) {
+        if (ramfs_index_reserve(fs, parent, 1) < 0) {
+            file->data.buffer_owned = 0;
+            ramfs_entry_free(fs, &file->entry);
+            return NULL;
+        }
+        ramfs_journal_link(fs, RAMFS_JOURNAL_CREATE, parent, &file->entry);
+        struct iovec iov = {(void *) buf, len};
+        ramfs_journal_write(fs, &file->entry, 0, &iov, 1, len);
+    }
+
+    if (ramfs_index_insert(fs, parent, &file->entry) < 0) {
+        /* the buffer stays the caller's on failure */
+        file->data.buffer_owned = 0;
+        ramfs_entry_free(fs, &file->entry);
+        return NULL;
+    }
+    parent->entry.dirty |= RAMFS_DIRTY_CHILDREN;
+
+    ramfs_dcache_created(fs->dcache);
+    return &file->entry;
+}
+
+static ramfs_entry_t *create_at(ramfs_fs_t *fs, ramfs_dir_t *dir,
+        const char *path, const void *buf, size_t len, int flags)
+{
+    if (check_writable(fs) < 0) {
+        return NULL;
+    }
+
+    ramfs_dir_t *parent = lock_parent(dir, path, 1);
+    if (parent == NULL) {
+        return NULL;
+    }
+
+    ramfs_entry_t *entry = create_in(fs, parent, path, buf, len, flags);
+    ramfs_rwlock_unlock(&parent->lock);
+    return entry;
+}
+
+ramfs_entry_t *ramfs_create(ramfs_fs_t *fs, const char *path, int flags)
+{
+    assert(fs != NULL);
+    assert(path != NULL);
+
+    return create_at(fs, &fs->root, path, NULL, 0, 0);
+}
+
+ramfs_entry_t *ramfs_create_from_buffer(ramfs_fs_t *fs, const char *path,
+        const void *buf, size_t len, int flags)
+{
+    assert(fs != NULL);
+    assert(path != NULL);
+    assert(buf != NULL);
+
+    return create_at(fs, &fs->root, path, buf, len, flags);
+}
+
+ramfs_entry_t *ramfs_create_at(ramfs_entry_t *dir, const char *path,
+        int flags)
+{
+    assert(dir != NULL);
+    assert(path != NULL);
+
+    if (!ramfs_is_dir(dir)) {
+        errno = ENOTDIR;
+        return NULL;
+    }
+
+    ramfs_dir_t *parent = (ramfs_dir_t *) dir;
+    return create_at(parent->fs, parent, path, NULL, 0, 0);
+}
+
+int ramfs_truncate(ramfs_fs_t *fs, ramfs_entry_t *entry, size_t size)
+{
+    assert(fs != NULL);
+    assert(entry != NULL);
+
+    if (entry->type != RAMFS_ENTRY_TYPE_FILE || check_writable(fs) < 0) {
+        return -1;
+    }
+
+    ramfs_file_t *file = (ramfs_file_t *) entry;
+
+    ramfs_rwlock_wrlock(&file->lock);
+    int ret = ramfs_extents_truncate(&fs->alloc, &file->data, size);
+    publish_size(file);
+    if (ret == 0) {
+        entry->dirty |= RAMFS_DIRTY_DATA;
+        ramfs_journal_change(fs, RAMFS_JOURNAL_TRUNCATE, entry, size);
+    }
+    ramfs_rwlock_unlock(&file->lock);
+    return ret;
+}
+
+ramfs_fh_t *ramfs_open(ramfs_fs_t *fs, const ramfs_entry_t *entry,
+        unsigned int flags)
+{
+    assert(fs != NULL);
+    assert(entry != NULL);
+
+    if (entry->type != RAMFS_ENTRY_TYPE_FILE) {
+        return NULL;
+    }
+
+    if (flags & (O_WRONLY | O_RDWR | O_TRUNC) && check_writable(fs) < 0) {
+        return NULL;
+    }
+
+    ramfs_file_t *file = (ramfs_file_t *) entry;
+
+    ramfs_fh_t *fh = slab_alloc(fs, RAMFS_SLAB_FH);
+    if (fh == NULL) {
+        return NULL;
+    }
+
+    ramfs_rwlock_wrlock(&file->lock);
+    if (flags & O_TRUNC) {
+        /* not freed outright, views may still pin the extents */
+        if (ramfs_extents_truncate(&fs->alloc, &file->data, 0) < 0) {
+            ramfs_rwlock_unlock(&file->lock);
+            slab_free(fs, RAMFS_SLAB_FH, fh);
+            return NULL;
+        }
+        publish_size(file);
+        file->entry.dirty |= RAMFS_DIRTY_DATA;
+        ramfs_journal_change(fs, RAMFS_JOURNAL_TRUNCATE, entry, 0);
+    }
+    if (flags & O_APPEND) {
+        fh->pos = file->data.size;
+    }
+    ramfs_rwlock_unlock(&file->lock);
+
+    fh->fs = fs;
+    fh->file = file;
+    fh->flags = flags;
+    return fh;
+}
+
+void ramfs_close(ramfs_fh_t *fh)
+{
+    assert(fh != NULL);
+
+    if (fh->reserved != NULL) {
+        ramfs_write_commit(fh, 0);
+    }
+
+    slab_free(fh->fs, RAMFS_SLAB_FH, fh);
+}
+
+ssize_t ramfs_read(ramfs_fh_t *fh, char *buf, size_t len)
+{
+    assert(fh != NULL);
+    assert(buf != NULL);
+
+    ramfs_rwlock_rdlock(&fh->file->lock);
+    size_t n = ramfs_extents_read(&fh->file->data, fh->pos, buf, len);
+    ramfs_rwlock_unlock(&fh->file->lock);
+    fh->pos += n;
+    return n;
+}
+
+ssize_t ramfs_write(ramfs_fh_t *fh, const char *buf, size_t len)
+{
+    assert(fh != NULL);
+    assert(buf != NULL);
+
+    if (!(fh->flags & O_WRONLY || fh->flags & O_RDWR)) {
+        errno = EBADF;
+        return -1;
+    }
+
+    ramfs_rwlock_wrlock(&fh->file->lock);
+    ssize_t n = ramfs_extents_write(&fh->fs->alloc, &fh->file->data, fh->pos,
+            buf, len);
+    publish_size(fh->file);
+    if (n > 0) {
+        fh->file->entry.dirty |= RAMFS_DIRTY_DATA;
+        struct iovec iov = {(void *) buf, n};
+        ramfs_journal_write(fh->fs, &fh->file->entry, fh->pos, &iov, 1, n);
+    }
+    ramfs_rwlock_unlock(&fh->file->lock);
+    if (n < 0) {
+        return -1;
+    }
+    fh->pos += n;
+    return n;
+}
+
+ssize_t ramfs_pread(ramfs_fh_t *fh, char *buf, size_t len, off_t offset)
+{
+    assert(fh != NULL);
+    assert(buf != NULL);
+
+    if (offset < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    ramfs_rwlock_rdlock(&fh->file->lock);
+    size_t n = ramfs_extents_read(&fh->file->data, offset, buf, len);
+    ramfs_rwlock_unlock(&fh->file->lock);
+    return n;
+}
+
+ssize_t ramfs_pwrite(ramfs_fh_t *fh, const char *buf, size_t len,
+        off_t offset)
+{
+    assert(fh != NULL);
+    assert(buf != NULL);
+
+    if (!(fh->flags & O_WRONLY || fh->flags & O_RDWR)) {
+        errno = EBADF;
+        return -1;
+    }
+
+    if (offset < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    ramfs_rwlock_wrlock(&fh->file->lock);
+    ssize_t n = ramfs_extents_write(&fh->fs->alloc, &fh->file->data, offset,
+            buf, len);
+    publish_size(fh->file);
+    if (n > 0) {
+        fh->file->entry.dirty |= RAMFS_DIRTY_DATA;
+        struct iovec iov = {(void *) buf, n};
+        ramfs_journal_write(fh->fs, &fh->file->entry, offset, &iov, 1, n);
+    }
+    ramfs_rwlock_unlock(&fh->file->lock);
+    return n;
+}
+
+ssize_t ramfs_readv(ramfs_fh_t *fh, const struct iovec *iov, int iovcnt)
+{
+    assert(fh != NULL);
+    assert(iov != NULL || iovcnt == 0);
+
+    if (iovcnt < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len > SSIZE_MAX - total) {
+            errno = EINVAL;
+            return -1;
+        }
+        total += iov[i].iov_len;
+    }
+
+    size_t done = 0;
+    ramfs_rwlock_rdlock(&fh->file->lock);
+    for (int i = 0; i < iovcnt; i++) {
+        size_t n = ramfs_extents_read(&fh->file->data, fh->pos + done,
+                iov[i].iov_base, iov[i].iov_len);
+        done += n;
+        if (n < iov[i].iov_len) {
+            break;
+        }
+    }
+    ramfs_rwlock_unlock(&fh->file->lock);
+    fh->pos += done;
+    return done;
+}
+
+ssize_t ramfs_writev(ramfs_fh_t *fh, const struct iovec *iov, int iovcnt)
+{
+    assert(fh != NULL);
+    assert(iov != NULL || iovcnt == 0);
+
+    if (!(fh->flags & O_WRONLY || fh->flags & O_RDWR)) {
+        errno = EBADF;
+        return -1;
+    }
+
+    if (iovcnt < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    ramfs_rwlock_wrlock(&fh->file->lock);
+    ssize_t n = ramfs_extents_writev(&fh->fs->alloc, &fh->file->data, fh->pos,
+            iov, iovcnt);
+    publish_size(fh->file);
+    if (n > 0) {
+        fh->file->entry.dirty |= RAMFS_DIRTY_DATA;
+        ramfs_journal_write(fh->fs, &fh->file->entry, fh->pos, iov, iovcnt,
+                n);
+    }
+    ramfs_rwlock_unlock(&fh->file->lock);
+    if (n < 0) {
+        return -1;
+    }
+    fh->pos += n;
+    return n;
+}
+
+ssize_t ramfs_write_reserve(ramfs_fh_t *fh, size_t len, void **buf)
+{
+    assert(fh != NULL);
+    assert(buf != NULL);
+
+    if (!(fh->flags & O_WRONLY || fh->flags & O_RDWR)) {
+        errno = EBADF;
+        return -1;
+    }
+
+    if (fh->reserved != NULL) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    *buf = NULL;
+    if (len == 0) {
+        return 0;
+    }
+
+    ramfs_rwlock_wrlock(&fh->file->lock);
+    ssize_t n = ramfs_extents_prepare(&fh->fs->alloc, &fh->file->data,
+            fh->pos, buf);
+    if (n >= 0) {
+        ramfs_extents_pin(&fh->file->data);
+        fh->reserved_cuts = fh->file->data.cuts;
+    }
+    ramfs_rwlock_unlock(&fh->file->lock);
+    if (n < 0) {
+        *buf = NULL;
+        return -1;
+    }
+
+    if ((size_t) n > len) {
+        n = len;
+    }
+    fh->reserved = *buf;
+    fh->reserved_len = n;
+    return n;
+}
+
+ssize_t ramfs_write_commit(ramfs_fh_t *fh, size_t used)
+{
+    assert(fh != NULL);
+
+    if (fh->reserved == NULL || used > fh->reserved_len) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    ramfs_rwlock_wrlock(&fh->file->lock);
+    size_t n = ramfs_extents_commit(&fh->file->data, fh->pos, fh->reserved,
+            fh->reserved_len, used, fh->reserved_cuts);
+    publish_size(fh->file);
+    if (n > 0) {
+        fh->file->entry.dirty |= RAMFS_DIRTY_DATA;
+    }
+    struct iovec iov = {fh->reserved, n};
+    ramfs_journal_write(fh->fs, &fh->file->entry, fh->pos, &iov, 1, n);
+    ramfs_extents_unpin(&fh->fs->alloc, &fh->file->data);
+    ramfs_rwlock_unlock(&fh->file->lock);
+
+    fh->pos += n;
+    fh->reserved = NULL;
+    fh->reserved_len = 0;
+    return n;
+}
+
+ssize_t ramfs_seek(ramfs_fh_t *fh, off_t offset, int whence)
+{
+    assert(fh != NULL);
+
+    ssize_t pos = fh->pos;
+
+    if (whence == SEEK_CUR) {
+        pos += offset;
+    } else if (whence == SEEK_SET) {
+        pos = offset;
+    } else if (whence == SEEK_END) {
+        ramfs_rwlock_rdlock(&fh->file->lock);
+        pos = fh->file->data.size + offset;
+        ramfs_rwlock_unlock(&fh->file->lock);
+    }
+
+    if (pos < 0) {
+        pos = 0;
+    }
+
+    fh->pos = pos;
+    return pos;
+}
+
+size_t ramfs_tell(const ramfs_fh_t *fh)
+{
+    assert(fh != NULL);
+
+    return fh->pos;
+}
+
+size_t ramfs_access(const ramfs_fh_t *fh, const void **buf)
+{
+    assert(fh != NULL);
+    assert(buf != NULL);
+
+    ramfs_rwlock_rdlock(&fh->file->lock);
+    size_t len = ramfs_extents_run(&fh->file->data, 0, buf);
+    ramfs_rwlock_unlock(&fh->file->lock);
+    return len;
+}
+
+size_t ramfs_access_extent(const ramfs_fh_t *fh, size_t offset,
+        const void **buf)
+{
+    assert(fh != NULL);
+    assert(buf != NULL);
+
+    ramfs_rwlock_rdlock(&fh->file->lock);
+    size_t len = ramfs_extents_span(&fh->file->data, offset, buf);
+    ramfs_rwlock_unlock(&fh->file->lock);
+    return len;
+}
+
+ssize_t ramfs_read_view(ramfs_fh_t *fh, off_t offset, size_t len,
+        ramfs_span_t **spans)
+{
+    assert(fh != NULL);
+    assert(spans != NULL);
+
+    *spans = NULL;
+
+    if (offset < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    ramfs_extents_t *data = &fh->file->data;
+
+    ramfs_rwlock_rdlock(&fh->file->lock);
+    if ((size_t) offset >= data->size || len == 0) {
+        ramfs_rwlock_unlock(&fh->file->lock);
+        return 0;
+    }
+
+    if (len > data->size - offset) {
+        len = data->size - offset;
+    }
+
+    /* one span per extent touched */
+    size_t count = (offset + len - 1) / RAMFS_EXTENT_SIZE -
+            offset / RAMFS_EXTENT_SIZE + 1;
+    ramfs_span_t *view = ramfs_malloc(&fh->fs->alloc, sizeof(*view) * count);
+    if (view == NULL) {
+        ramfs_rwlock_unlock(&fh->file->lock);
+        return -1;
+    }
+
+    size_t pos = offset;
+    for (size_t i = 0; i < count; i++) {
+        size_t n = ramfs_extents_span(data, pos, &view[i].buf);
+        if (n > offset + len - pos) {
+            n = offset + len - pos;
+        }
+        view[i].len = n;
+        pos += n;
+    }
+
+    ramfs_extents_pin(data);
+    ramfs_rwlock_unlock(&fh->file->lock);
+
+    *spans = view;
+    return count;
+}
+
+void ramfs_release_view(ramfs_fh_t *fh, ramfs_span_t *spans)
+{
+    assert(fh != NULL);
+
+    if (spans == NULL) {
+        return;
+    }
+
+    ramfs_rwlock_wrlock(&fh->file->lock);
+    ramfs_extents_unpin(&fh->fs->alloc, &fh->file->data);
+    ramfs_rwlock_unlock(&fh->file->lock);
+    ramfs_free(&fh->fs->alloc, spans);
+}
+
+int ramfs_unlink(ramfs_entry_t *entry)
+{
+    assert(entry != NULL);
+
+    if (entry->type != RAMFS_ENTRY_TYPE_FILE) {
+        errno = ENFILE;
+        return -1;
+    }
+
+    ramfs_fs_t *fs = entry_fs(entry);
+    if (check_writable(fs) < 0) {
+        return -1;
+    }
+
+    /* holding the topology lock keeps entry->parent from changing */
+    ramfs_rwlock_rdlock(&fs->topology);
+    ramfs_dir_t *parent = entry->parent;
+    ramfs_rwlock_wrlock(&parent->lock);
+    ramfs_dcache_forget(fs->dcache, entry, 0);
+    ramfs_index_remove(fs, entry);
+    parent->entry.dirty |= RAMFS_DIRTY_CHILDREN;
+    ramfs_journal_change(fs, RAMFS_JOURNAL_UNLINK, entry, 0);
+    ramfs_rwlock_unlock(&parent->lock);
+    ramfs_rwlock_unlock(&fs->topology);
+
+    ramfs_entry_release(fs, entry);
+    return 0;
+}
+
+int ramfs_unlink_at(ramfs_entry_t *dir, const char *path)
+{
+    assert(dir != NULL);
+    assert(path != NULL);
+
+    if (!ramfs_is_dir(dir)) {
+        errno = ENOTDIR;
+        return -1;
+    }
+
+    ramfs_fs_t *fs = ((ramfs_dir_t *) dir)->fs;
+    if (check_writable(fs) < 0) {
+        return -1;
+    }
+
+    ramfs_name_t name;
+    ramfs_name_basename(path, &name);
+    if (name.len == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    ramfs_dir_t *parent = lock_parent((ramfs_dir_t *) dir, path, 1);
+    if (parent == NULL) {
+        return -1;
+    }
+
+    ramfs_entry_t *entry = ramfs_index_find(parent, &name);
+    if (entry == NULL || entry->type != RAMFS_ENTRY_TYPE_FILE) {
+        ramfs_rwlock_unlock(&parent->lock);
+        if (entry != NULL) {
+            errno = ENFILE;
+        }
+        return -1;
+    }
+
+    ramfs_dcache_forget(fs->dcache, entry, 0);
+    ramfs_index_remove(fs, entry);
+    parent->entry.dirty |= RAMFS_DIRTY_CHILDREN;
+    ramfs_journal_change(fs, RAMFS_JOURNAL_UNLINK, entry, 0);
+    ramfs_rwlock_unlock(&parent->lock);
+
+    ramfs_entry_release(fs, entry);
+    return 0;
+}
+
+static int is_ancestor(const ramfs_dir_t *dir, const ramfs_dir_t *of)
+{
+    for (of = of->entry.parent; of != NULL; of = of->entry.parent) {
+        if (of == dir) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Lock order for two directories: an ancestor before its descendants, which
+ * is the order path walks take them in, otherwise by address. Only one
+ * thread can hold two directories at once, see ramfs_fs_t. */
+static void lock_pair(ramfs_dir_t *a, ramfs_dir_t *b)
+{
+    if (a == b) {
+        ramfs_rwlock_wrlock(&a->lock);
+        return;
+    }
+
+    if (is_ancestor(b, a) || (!is_ancestor(a, b) && b < a)) {
+        ramfs_dir_t *tmp = a;
+        a = b;
+        b = tmp;
+    }
+    ramfs_rwlock_wrlock(&a->lock);
+    ramfs_rwlock_wrlock(&b->lock);
+}
+
+static void unlock_pair(ramfs_dir_t *a, ramfs_dir_t *b)
+{
+    ramfs_rwlock_unlock(&a->lock);
+    if (a != b) {
+        ramfs_rwlock_unlock(&b->lock);
+    }
+}
+
+/* both parents are locked for writing */
+static int rename_in(ramfs_fs_t *fs, ramfs_dir_t *src_parent,
+        const char *src, ramfs_dir_t *dst_parent, const char *dst)
+{
+    ramfs_name_t name;
+    ramfs_name_basename(src, &name);
+    ramfs_entry_t *entry = ramfs_index_find(src_parent, &name);
+    if (entry == NULL) {
+        return -1;
+    }
+
+    ramfs_name_basename(dst, &name);
+    if (name.len == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (ramfs_index_find(dst_parent, &name) != NULL) {
+        errno = EEXIST;
+        return -1;
+    }
+
+    /* a directory cannot be moved below itself */
+    if (ramfs_is_dir(entry) && (dst_parent == (ramfs_dir_t *) entry ||
+            is_ancestor((ramfs_dir_t *) entry, dst_parent))) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    name.str = ramfs_strndup(&fs->alloc, name.str, name.len);
+    if (name.str == NULL) {
+        return -1;
+    }
+
+    /* once there is room in the destination the move cannot fail */
+    if (ramfs_index_reserve(fs, dst_parent, 1) < 0) {
+        ramfs_free(&fs->alloc, (void *) name.str);
+        return -1;
+    }
+
+    ramfs_dcache_forget(fs->dcache, entry, ramfs_is_dir(entry));
+    ramfs_index_remove(fs, entry);
+    /* lock-free lookups compare names unlocked, let the ones that could
+     * still see the entry finish before its name changes */
+    ramfs_rcu_synchronize();
+    drop_name(fs, entry->name.str);
+    entry->name = name;
+    ramfs_journal_link(fs, RAMFS_JOURNAL_RENAME, dst_parent, entry);
+    ramfs_index_insert(fs, dst_parent, entry);
+    src_parent->entry.dirty |= RAMFS_DIRTY_CHILDREN;
+    dst_parent->entry.dirty |= RAMFS_DIRTY_CHILDREN;
+    ramfs_dcache_created(fs->dcache);
+    return 0;
+}
+
+static int rename_at(ramfs_fs_t *fs, ramfs_dir_t *src_dir, const char *src,
+        ramfs_dir_t *dst_dir, const char *dst)
+{
+    if (check_writable(fs) < 0) {
+        return -1;
+    }
+
+    if (src_dir == dst_dir && strcmp(src, dst) == 0) {
+        return 0;
+    }
+
+    ramfs_rwlock_wrlock(&fs->topology);
+
+    /* directories can neither move nor go away until the topology lock is
+     * released, so the parents stay valid between the walks and locking */
+    ramfs_dir_t *src_parent = lock_parent(src_dir, src, 0);
+    if (src_parent == NULL) {
+        ramfs_rwlock_unlock(&fs->topology);
+        errno = ENOENT;
+        return -1;
+    }
+    ramfs_rwlock_unlock(&src_parent->lock);
+
+    ramfs_dir_t *dst_parent = lock_parent(dst_dir, dst, 0);
+    if (dst_parent == NULL) {
+        ramfs_rwlock_unlock(&fs->topology);
+        errno = ENOENT;
+        return -1;
+    }
+    ramfs_rwlock_unlock(&dst_parent->lock);
+
+    lock_pair(src_parent, dst_parent);
+    int ret = rename_in(fs, src_parent, src, dst_parent, dst);
+    unlock_pair(src_parent, dst_parent);
+
+    ramfs_rwlock_unlock(&fs->topology);
+    ramfs_rcu_reclaim(fs);
+    return ret;
+}
+
+int ramfs_rename(ramfs_fs_t *fs, const char *src, const char *dst)
+{
+    assert(fs != NULL);
+    assert(src != NULL);
+    assert(dst != NULL);
+
+    return rename_at(fs, &fs->root, src, &fs->root, dst);
+}
+
+int ramfs_rename_at(ramfs_entry_t *src_dir, const char *src,
+        ramfs_entry_t *dst_dir, const char *dst)
+{
+    assert(src_dir != NULL);
+    assert(src != NULL);
+    assert(dst_dir != NULL);
+    assert(dst != NULL);
+
+    if (!ramfs_is_dir(src_dir) || !ramfs_is_dir(dst_dir)) {
+        errno = ENOTDIR;
+        return -1;
+    }
+
+    ramfs_dir_t *dir = (ramfs_dir_t *) src_dir;
+    return rename_at(dir->fs, dir, src, (ramfs_dir_t *) dst_dir, dst);
+}
+
+ramfs_dh_t *ramfs_opendir(ramfs_fs_t *fs, const ramfs_entry_t *entry)
+{
+    assert(fs != NULL);
+    assert(entry != NULL);
+
+    if (ramfs_is_file(entry)) {
+        errno = ENOTDIR;
+        return NULL;
+    }
+
+    ramfs_dh_t *dh = slab_alloc(fs, RAMFS_SLAB_DH);
+    if (dh == NULL) {
+        return NULL;
+    }
+    dh->fs = fs;
+    dh->dir = (ramfs_dir_t *) entry;
+    if (ramfs_image_populate(dh->dir) < 0) {
+        slab_free(fs, RAMFS_SLAB_DH, dh);
+        return NULL;
+    }
+    ramfs_rwlock_rdlock(&dh->dir->lock);
+    ramfs_index_seek(dh->dir, &dh->cursor, 0);
+    ramfs_rwlock_unlock(&dh->dir->lock);
+    return dh;
+}
+
+void ramfs_closedir(ramfs_dh_t *dh)
+{
+    assert(dh != NULL);
+
+    slab_free(dh->fs, RAMFS_SLAB_DH, dh);
+}
+
+const ramfs_entry_t *ramfs_readdir(ramfs_dh_t *dh)
+{
+    assert(dh != NULL);
+
+    ramfs_rwlock_rdlock(&dh->dir->lock);
+    const ramfs_entry_t *entry = ramfs_index_next(dh->dir, &dh->cursor);
+    ramfs_rwlock_unlock(&dh->dir->lock);
+    return entry;
+}
+
+size_t ramfs_readdir_batch(ramfs_dh_t *dh, ramfs_dirent_t *ents, size_t count)
+{
+    assert(dh != NULL);
+    assert(ents != NULL || count == 0);
+
+    size_t n = 0;
+    ramfs_rwlock_rdlock(&dh->dir->lock);
+    while (n < count) {
+        const ramfs_entry_t *entry = ramfs_index_next(dh->dir, &dh->cursor);
+        if (entry == NULL) {
+            break;
+        }
+
+        ramfs_stat_t st;
+        ramfs_stat(dh->fs, entry, &st);
+        ents[n].name = entry->name.str;
+        ents[n].name_len = entry->name.len;
+        ents[n].type = st.type;
+        ents[n].size = st.size;
+        n++;
+    }
+    ramfs_rwlock_unlock(&dh->dir->lock);
+    return n;
+}
+
+void ramfs_seekdir(ramfs_dh_t *dh, long loc)
+{
+    assert(dh != NULL);
+    assert(loc >= 0);
+
+    ramfs_rwlock_rdlock(&dh->dir->lock);
+    ramfs_index_seek(dh->dir, &dh->cursor, loc);
+    ramfs_rwlock_unlock(&dh->dir->lock);
+}
+
+long ramfs_telldir(ramfs_dh_t *dh)
+{
+    assert(dh != NULL);
+
+    ramfs_rwlock_rdlock(&dh->dir->lock);
+    long loc = ramfs_index_tell(dh->dir, &dh->cursor);
+    ramfs_rwlock_unlock(&dh->dir->lock);
+    return loc;
+}
+
+/* parent is locked for writing */
+static ramfs_entry_t *mkdir_in(ramfs_fs_t *fs, ramfs_dir_t *parent,
+        const char *path, size_t capacity)
+{
+    ramfs_name_t name;
+    ramfs_name_basename(path, &name);
+    if (name.len == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (ramfs_index_find(parent, &name) != NULL) {
+        errno = EEXIST;
+        return NULL;
+    }
+
+    ramfs_dir_t *dir = ramfs_dir_new(fs, &name);
+    if (dir == NULL) {
+        return NULL;
+    }
+
+    if (ramfs_index_reserve(fs, dir, capacity) < 0 ||
+            (fs->journal != NULL &&
+            ramfs_index_reserve(fs, parent, 1) < 0)) {
+        ramfs_entry_free(fs, &dir->entry);
+        return NULL;
+    }
+    /* recorded before it can be found, as in create_in() */
+    ramfs_journal_link(fs, RAMFS_JOURNAL_MKDIR, parent, &dir->entry);
+
+    if (ramfs_index_insert(fs, parent, &dir->entry) < 0) {
+        ramfs_entry_free(fs, &dir->entry);
+        return NULL;
+    }
+    parent->entry.dirty |= RAMFS_DIRTY_CHILDREN;
+
+    ramfs_dcache_created(fs->dcache);
+    return &dir->entry;
+}
+
+static ramfs_entry_t *mkdir_at(ramfs_fs_t *fs, ramfs_dir_t *start,
+        const char *path, size_t capacity)
+{
+    if (check_writable(fs) < 0) {
+        return NULL;
+    }
+
+    ramfs_dir_t *parent = lock_parent(start, path, 1);
+    if (parent == NULL) {
+        return NULL;
+    }
+
+    ramfs_entry_t *entry = mkdir_in(fs, parent, path, capacity);
+    ramfs_rwlock_unlock(&parent->lock);
+    return entry;
+}
+
+ramfs_entry_t *ramfs_mkdir(ramfs_fs_t *fs, const char *path)
+{
+    return ramfs_mkdir_ex(fs, path, 0);
+}
+
+ramfs_entry_t *ramfs_mkdir_ex(ramfs_fs_t *fs, const char *path,
+        size_t capacity)
+{
+    assert(fs != NULL);
+    assert(path != NULL);
+
+    return mkdir_at(fs, &fs->root, path, capacity);
+}
+
+ramfs_entry_t *ramfs_mkdir_at(ramfs_entry_t *dir, const char *path)
+{
+    assert(dir != NULL);
+    assert(path != NULL);
+
+    if (!ramfs_is_dir(dir)) {
+        errno = ENOTDIR;
+        return NULL;
+    }
+
+    ramfs_dir_t *parent = (ramfs_dir_t *) dir;
+    return mkdir_at(parent->fs, parent, path, 0);
+}
+
+int ramfs_rmdir(ramfs_entry_t *entry)
+{
+    assert(entry != NULL);
+
+    if (!ramfs_is_dir(entry)) {
+        errno = ENOTDIR;
+        return -1;
+    }
+
+    if (entry->parent == NULL) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    ramfs_fs_t *fs = entry_fs(entry);
+    ramfs_dir_t *dir = (ramfs_dir_t *) entry;
+    if (check_writable(fs) < 0) {
+        return -1;
+    }
+
+    ramfs_rwlock_wrlock(&fs->topology);
+    ramfs_dir_t *parent = entry->parent;
+    ramfs_rwlock_wrlock(&parent->lock);
+    ramfs_rwlock_wrlock(&dir->lock);
+    size_t count = dir_count(dir);
+    if (count == 0) {
+        ramfs_dcache_forget(fs->dcache, entry, 0);
+        ramfs_index_remove(fs, entry);
+        parent->entry.dirty |= RAMFS_DIRTY_CHILDREN;
+        ramfs_journal_change(fs, RAMFS_JOURNAL_UNLINK, entry, 0);
+    }
+    ramfs_rwlock_unlock(&dir->lock);
+    ramfs_rwlock_unlock(&parent->lock);
+    ramfs_rwlock_unlock(&fs->topology);
+
+    if (count > 0) {
+        errno = ENOTEMPTY;
+        return -1;
+    }
+
+    ramfs_entry_release(fs, entry);
+    return 0;
+}
+
+/* The root cannot be unlinked, its entries are instead. With
+ * CONFIG_RAMFS_RCU that happens one at a time, last first, so lock-free
+ * lookups never see an entry that is already queued to be freed. */
+static void empty_root(ramfs_fs_t *fs)
+{
+    ramfs_dir_t *root = &fs->root;
+
+    ramfs_rwlock_wrlock(&root->lock);
+    root->entry.dirty |= RAMFS_DIRTY_CHILDREN;
+    ramfs_journal_change(fs, RAMFS_JOURNAL_UNLINK, &root->entry, 0);
+#ifdef CONFIG_RAMFS_RCU
+    size_t count;
+    while ((count = ramfs_index_count(root)) > 0) {
+        ramfs_index_cursor_t cursor;
+        ramfs_index_seek(root, &cursor, count - 1);
+        ramfs_entry_t *entry = ramfs_index_next(root, &cursor);
+        ramfs_index_remove(fs, entry);
+        ramfs_rcu_retire(fs, &entry->rcu, free_retired);
+    }
+#else
+    ramfs_index_drain(fs, root, ramfs_entry_free);
+    ramfs_index_destroy(fs, root);
+#endif
+    ramfs_rwlock_unlock(&root->lock);
+}
+
+void ramfs_rmtree(ramfs_entry_t *entry)
+{
+    assert(entry != NULL);
+
+    ramfs_fs_t *fs = entry_fs(entry);
+    if (check_writable(fs) < 0) {
+        return;
+    }
+
+    ramfs_rwlock_wrlock(&fs->topology);
+    ramfs_dir_t *parent = entry->parent;
+    if (parent == NULL) {
+        ramfs_dcache_forget(fs->dcache, entry, 1);
+        /* what is left in the image is gone too */
+        ramfs_mutex_lock(&fs->image_lock);
+        __atomic_store_n(&fs->root.image, NULL, __ATOMIC_RELEASE);
+        ramfs_mutex_unlock(&fs->image_lock);
+        empty_root(fs);
+        ramfs_rwlock_unlock(&fs->topology);
+        ramfs_rcu_reclaim(fs);
+        return;
+    }
+
+    ramfs_rwlock_wrlock(&parent->lock);
+    ramfs_dcache_forget(fs->dcache, entry, 1);
+    ramfs_index_remove(fs, entry);
+    parent->entry.dirty |= RAMFS_DIRTY_CHILDREN;
+    ramfs_journal_change(fs, RAMFS_JOURNAL_UNLINK, entry, 0);
+    ramfs_rwlock_unlock(&parent->lock);
+    ramfs_rwlock_unlock(&fs->topology);
+
+    ramfs_entry_release(fs, entry);
+}
@@ -0,0 +1,348 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/* Each directory keeps its entries in an array in insertion order and an open
+ * addressing table of (hash, position) slots pointing into it. Removing an
+ * entry leaves a hole in the array, which is squeezed out the next time the
+ * array is resized. Every entry gets a sequence number when it is
+ * inserted and the counter never goes back; readdir cookies are sequence
+ * numbers, so they stay valid across inserts, removals and rehashing. The
+ * array is halved again once a quarter full. */
+
+#include <errno.h>
+#include <stdint.h>
+
+#include "alloc.h"
+#include "ramfs_priv.h"
+
+
+#define MIN_SLOTS 8
+#define MIN_ORDER 4
+#define TOMBSTONE UINT32_MAX
+
+static ramfs_hash_slot_t *find_slot(const ramfs_index_t *index, uint32_t hash,
+        const ramfs_name_t *name)
+{
+    if (index->slots_len == 0) {
+        return NULL;
+    }
+
+    size_t mask = index->slots_len - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        ramfs_hash_slot_t *slot = &index->slots[i];
+        if (slot->pos == 0) {
+            return NULL;
+        }
+        if (slot->pos != TOMBSTONE && slot->hash == hash &&
+                ramfs_name_cmp(&index->order[slot->pos - 1].entry->name,
+                        name) == 0) {
+            return slot;
+        }
+    }
+}
+
+static void place(ramfs_index_t *index, uint32_t hash, size_t pos)
+{
+    size_t mask = index->slots_len - 1;
+    size_t i = hash & mask;
+
+    while (index->slots[i].pos != 0 && index->slots[i].pos != TOMBSTONE) {
+        i = (i + 1) & mask;
+    }
+    if (index->slots[i].pos == TOMBSTONE) {
+        index->tombstones--;
+    }
+
+    index->slots[i].hash = hash;
+    index->slots[i].pos = pos + 1;
+}
+
+/* first position whose sequence number is at least seq */
+static size_t lower_bound(const ramfs_index_t *index, size_t seq)
+{
+    size_t first = 0;
+    size_t last = index->order_len;
+
+    while (first < last) {
+        size_t middle = first + (last - first) / 2;
+        if (index->order[middle].seq < seq) {
+            first = middle + 1;
+        } else {
+            last = middle;
+        }
+    }
+
+    return first;
+}
+
+static void release(ramfs_fs_t *fs, ramfs_index_t *index)
+{
+    ramfs_free(&fs->alloc, index->slots);
+    ramfs_free(&fs->alloc, index->order);
+    index->slots = NULL;
+    index->slots_len = 0;
+    index->tombstones = 0;
+    index->order = NULL;
+    index->order_len = 0;
+    index->order_cap = 0;
+    index->count = 0;
+}
+
+void ramfs_index_init(ramfs_dir_t *dir)
+{
+    dir->index.slots = NULL;
+    dir->index.slots_len = 0;
+    dir->index.tombstones = 0;
+    dir->index.order = NULL;
+    dir->index.order_len = 0;
+    dir->index.order_cap = 0;
+    dir->index.count = 0;
+    dir->index.seq = 0;
+}
+
+void ramfs_index_destroy(ramfs_fs_t *fs, ramfs_dir_t *dir)
+{
+    release(fs, &dir->index);
+    ramfs_index_init(dir);
+}
+
+size_t ramfs_index_count(const ramfs_dir_t *dir)
+{
+    return dir->index.count;
+}
+
+ramfs_entry_t *ramfs_index_find(ramfs_dir_t *dir, const ramfs_name_t *name)
+{
+    const ramfs_index_t *index = &dir->index;
+
+    ramfs_hash_slot_t *slot = find_slot(index, ramfs_name_hash(name), name);
+    if (slot == NULL) {
+        errno = ENOENT;
+        return NULL;
+    }
+
+    return index->order[slot->pos - 1].entry;
+}
+
+int ramfs_index_reserve(ramfs_fs_t *fs, ramfs_dir_t *dir, size_t count)
+{
+    ramfs_index_t *index = &dir->index;
+    size_t live = index->count + count;
+
+    /* squeeze out holes before growing if they make up half the array */
+    size_t holes = index->order_len - index->count;
+    int compact = index->order_len + count > index->order_cap && holes > 0 &&
+            holes >= index->order_len / 2;
+    int rehash = compact || (index->count + index->tombstones + count) * 4 >
+            index->slots_len * 3;
+
+    size_t slots_len = index->slots_len;
+    ramfs_hash_slot_t *slots = NULL;
+    if (rehash) {
+        if (slots_len < MIN_SLOTS) {
+            slots_len = MIN_SLOTS;
+        }
+        while (live * 2 > slots_len) {
+            slots_len *= 2;
+        }
+        slots = ramfs_zalloc(&fs->alloc, sizeof(*slots) * slots_len);
+        if (slots == NULL) {
+            return -1;
+        }
+    }
+
+    size_t order_len = compact ? index->count : index->order_len;
+    if (order_len + count > index->order_cap) {
+        size_t cap = index->order_cap ? index->order_cap : MIN_ORDER;
+        while (cap < order_len + count) {
+            cap *= 2;
+        }
+        ramfs_hash_item_t *order = ramfs_realloc(&fs->alloc, index->order,
+                sizeof(*order) * cap);
+        if (order == NULL) {
+            ramfs_free(&fs->alloc, slots);
+            return -1;
+        }
+        index->order = order;
+        index->order_cap = cap;
+    }
+
+    if (compact) {
+        size_t j = 0;
+        for (size_t i = 0; i < index->order_len; i++) {
+            if (index->order[i].entry != NULL) {
+                index->order[j++] = index->order[i];
+            }
+        }
+        index->order_len = j;
+    }
+
+    if (rehash) {
+        ramfs_free(&fs->alloc, index->slots);
+        index->slots = slots;
+        index->slots_len = slots_len;
+        index->tombstones = 0;
+        for (size_t i = 0; i < index->order_len; i++) {
+            if (index->order[i].entry != NULL) {
+                place(index, index->order[i].hash, i);
+            }
+        }
+    }
+
+    return 0;
+}
+
+int ramfs_index_insert(ramfs_fs_t *fs, ramfs_dir_t *dir, ramfs_entry_t *entry)
+{
+    ramfs_index_t *index = &dir->index;
+
+    if (ramfs_index_reserve(fs, dir, 1) < 0) {
+        return -1;
+    }
+
+    ramfs_hash_item_t *item = &index->order[index->order_len];
+    item->entry = entry;
+    item->seq = index->seq++;
+    item->hash = ramfs_name_hash(&entry->name);
+    place(index, item->hash, index->order_len);
+    index->order_len++;
+    index->count++;
+
+    entry->parent = dir;
+    return 0;
+}
+
+int ramfs_index_load(ramfs_fs_t *fs, ramfs_dir_t *dir,
+        ramfs_entry_t **entries, size_t count)
+{
+    /* order does not matter here, but the table only needs sizing once */
+    if (ramfs_index_reserve(fs, dir, count) < 0) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        ramfs_index_insert(fs, dir, entries[i]);
+    }
+    return 0;
+}
+
+/* halves the order array and resizes the table to fit what is left */
+static void shrink(ramfs_fs_t *fs, ramfs_index_t *index)
+{
+    size_t slots_len = MIN_SLOTS;
+    while ((index->count + 1) * 2 > slots_len) {
+        slots_len *= 2;
+    }
+    ramfs_hash_slot_t *slots = ramfs_zalloc(&fs->alloc,
+            sizeof(*slots) * slots_len);
+    if (slots == NULL) {
+        return;
+    }
+
+    size_t j = 0;
+    for (size_t i = 0; i < index->order_len; i++) {
+        if (index->order[i].entry != NULL) {
+            index->order[j++] = index->order[i];
+        }
+    }
+    index->order_len = j;
+
+    size_t cap = index->order_cap / 2;
+    ramfs_hash_item_t *order = ramfs_realloc(&fs->alloc, index->order,
+            sizeof(*order) * cap);
+    if (order != NULL) {
+        index->order = order;
+        index->order_cap = cap;
+    }
+
+    ramfs_free(&fs->alloc, index->slots);
+    index->slots = slots;
+    index->slots_len = slots_len;
+    index->tombstones = 0;
+    for (size_t i = 0; i < index->order_len; i++) {
+        place(index, index->order[i].hash, i);
+    }
+}
+
+void ramfs_index_remove(ramfs_fs_t *fs, ramfs_entry_t *entry)
+{
+    ramfs_index_t *index = &entry->parent->index;
+
+    ramfs_hash_slot_t *slot = find_slot(index, ramfs_name_hash(&entry->name),
+            &entry->name);
+    if (slot == NULL) {
+        return;
+    }
+
+    index->order[slot->pos - 1].entry = NULL;
+    slot->pos = TOMBSTONE;
+    index->tombstones++;
+    index->count--;
+    entry->parent = NULL;
+
+    while (index->order_len > 0 &&
+            index->order[index->order_len - 1].entry == NULL) {
+        index->order_len--;
+    }
+
+    /* halve once a quarter full, like the vector index, so alternating
+     * inserts and removes never resize, and a reservation made before
+     * removing still holds. Shrinking is best effort, the old arrays are
+     * still valid on failure */
+    if (index->order_cap > MIN_ORDER && index->count <= index->order_cap / 4) {
+        shrink(fs, index);
+    }
+}
+
+void ramfs_index_drain(ramfs_fs_t *fs, ramfs_dir_t *dir,
+        void (*fn)(ramfs_fs_t *fs, ramfs_entry_t *entry))
+{
+    ramfs_index_t *index = &dir->index;
+
+    for (size_t i = 0; i < index->order_len; i++) {
+        if (index->order[i].entry != NULL) {
+            fn(fs, index->order[i].entry);
+        }
+    }
+    release(fs, index);
+}
+
+void ramfs_index_seek(ramfs_dir_t *dir, ramfs_index_cursor_t *cursor,
+        long loc)
+{
+    cursor->seq = loc;
+    cursor->pos = lower_bound(&dir->index, cursor->seq);
+}
+
+long ramfs_index_tell(ramfs_dir_t *dir, const ramfs_index_cursor_t *cursor)
+{
+    return cursor->seq;
+}
+
+ramfs_entry_t *ramfs_index_next(ramfs_dir_t *dir,
+        ramfs_index_cursor_t *cursor)
+{
+    const ramfs_index_t *index = &dir->index;
+    size_t pos = cursor->pos;
+
+    /* the position is only a hint, holes may have been squeezed out since */
+    if (pos > index->order_len ||
+            (pos < index->order_len && index->order[pos].seq < cursor->seq) ||
+            (pos > 0 && index->order[pos - 1].seq >= cursor->seq)) {
+        pos = lower_bound(index, cursor->seq);
+    }
+
+    while (pos < index->order_len && index->order[pos].entry == NULL) {
+        pos++;
+    }
+
+    if (pos == index->order_len) {
+        cursor->pos = pos;
+        return NULL;
+    }
+
+    cursor->seq = index->order[pos].seq + 1;
+    cursor->pos = pos + 1;
+    return index->order[pos].entry;
+}
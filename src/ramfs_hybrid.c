@@ -0,0 +1,352 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/* Small directories keep their entries in a sorted array with a parallel
+ * array of name hashes, which lookups scan linearly. A directory that grows
+ * past small_dir_max entries moves them into a red-black tree, and one that
+ * shrinks to small_dir_min entries moves them back. Both representations
+ * are sorted by name and readdir locations are indexes, so a conversion is
+ * not visible to open directory handles. */
+
+#include <errno.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "ramfs_priv.h"
+#include "rbtree.h"
+
+
+#define MIN_SMALL 4
+
+static int ramfs_cmp(const void *left, const void *right)
+{
+    if (left == NULL) {
+        if (right == NULL) {
+            return 0;
+        }
+        return -1;
+    } else if (right == NULL) {
+        return 1;
+    }
+
+    return ramfs_name_cmp((const ramfs_name_t *) left,
+            (const ramfs_name_t *) right);
+}
+
+static ssize_t small_find(const ramfs_index_t *index, const ramfs_name_t *name)
+{
+    uint32_t hash = ramfs_name_hash(name);
+
+    for (size_t i = 0; i < index->small_len; i++) {
+        if (index->hashes[i] == hash &&
+                ramfs_name_cmp(&index->small[i]->name, name) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/* both arrays share one allocation, entries first */
+static int small_resize(ramfs_fs_t *fs, ramfs_index_t *index, size_t cap)
+{
+    ramfs_entry_t **small = ramfs_malloc(&fs->alloc,
+            (sizeof(*small) + sizeof(*index->hashes)) * cap);
+    if (small == NULL) {
+        return -1;
+    }
+    uint32_t *hashes = (uint32_t *) (small + cap);
+
+    if (index->small_len > 0) {
+        memcpy(small, index->small, sizeof(*small) * index->small_len);
+        memcpy(hashes, index->hashes, sizeof(*hashes) * index->small_len);
+    }
+    ramfs_free(&fs->alloc, index->small);
+
+    index->small = small;
+    index->hashes = hashes;
+    index->small_cap = cap;
+    return 0;
+}
+
+static void to_tree(ramfs_fs_t *fs, ramfs_index_t *index)
+{
+    ramfs_rbtree_init(&index->rbtree, ramfs_cmp);
+    for (size_t i = 0; i < index->small_len; i++) {
+        ramfs_entry_t *entry = index->small[i];
+        entry->rbnode.key = &entry->name;
+        ramfs_rbtree_insert(&index->rbtree, &entry->rbnode);
+    }
+
+    ramfs_free(&fs->alloc, index->small);
+    index->small = NULL;
+    index->hashes = NULL;
+    index->small_len = 0;
+    index->small_cap = 0;
+    index->tree = 1;
+}
+
+static void to_small(ramfs_fs_t *fs, ramfs_index_t *index)
+{
+    size_t count = index->rbtree.count;
+
+    /* leave room to grow back up to the threshold */
+    size_t cap = MIN_SMALL;
+    while (cap < count * 2) {
+        cap *= 2;
+    }
+    if (cap > fs->small_dir_max) {
+        cap = fs->small_dir_max;
+    }
+
+    /* best effort, stay a tree if there is no memory */
+    if (small_resize(fs, index, cap) < 0) {
+        return;
+    }
+
+    ramfs_rbnode_t *node = ramfs_rbtree_first(&index->rbtree);
+    for (size_t i = 0; i < count; i++) {
+        ramfs_entry_t *entry = (ramfs_entry_t *) node;
+        index->small[i] = entry;
+        index->hashes[i] = ramfs_name_hash(&entry->name);
+        node = ramfs_rbtree_next(node);
+    }
+    index->small_len = count;
+    ramfs_rbtree_init(&index->rbtree, ramfs_cmp);
+    index->tree = 0;
+}
+
+void ramfs_index_init(ramfs_dir_t *dir)
+{
+    dir->index.small = NULL;
+    dir->index.hashes = NULL;
+    dir->index.small_len = 0;
+    dir->index.small_cap = 0;
+    ramfs_rbtree_init(&dir->index.rbtree, ramfs_cmp);
+    dir->index.tree = 0;
+    dir->index.gen = 0;
+}
+
+void ramfs_index_destroy(ramfs_fs_t *fs, ramfs_dir_t *dir)
+{
+    ramfs_free(&fs->alloc, dir->index.small);
+    ramfs_index_init(dir);
+}
+
+size_t ramfs_index_count(const ramfs_dir_t *dir)
+{
+    if (dir->index.tree) {
+        return dir->index.rbtree.count;
+    }
+
+    return dir->index.small_len;
+}
+
+ramfs_entry_t *ramfs_index_find(ramfs_dir_t *dir, const ramfs_name_t *name)
+{
+    ramfs_index_t *index = &dir->index;
+    ramfs_entry_t *entry = NULL;
+
+    if (index->tree) {
+        entry = (ramfs_entry_t *) ramfs_rbtree_search(&index->rbtree, name);
+    } else {
+        ssize_t i = small_find(index, name);
+        if (i >= 0) {
+            entry = index->small[i];
+        }
+    }
+
+    if (entry == NULL) {
+        errno = ENOENT;
+    }
+    return entry;
+}
+
+int ramfs_index_reserve(ramfs_fs_t *fs, ramfs_dir_t *dir, size_t count)
+{
+    ramfs_index_t *index = &dir->index;
+    size_t need = index->small_len + count;
+
+    /* trees and conversions to a tree need no memory */
+    if (index->tree || need > fs->small_dir_max ||
+            need <= index->small_cap) {
+        return 0;
+    }
+
+    size_t cap = index->small_cap ? index->small_cap : MIN_SMALL;
+    while (cap < need) {
+        cap *= 2;
+    }
+    if (cap > fs->small_dir_max) {
+        cap = fs->small_dir_max;
+    }
+
+    return small_resize(fs, index, cap);
+}
+
+int ramfs_index_insert(ramfs_fs_t *fs, ramfs_dir_t *dir, ramfs_entry_t *entry)
+{
+    ramfs_index_t *index = &dir->index;
+
+    if (ramfs_index_reserve(fs, dir, 1) < 0) {
+        return -1;
+    }
+
+    if (!index->tree && index->small_len + 1 > fs->small_dir_max) {
+        to_tree(fs, index);
+    }
+
+    if (index->tree) {
+        entry->rbnode.key = &entry->name;
+        if (ramfs_rbtree_insert(&index->rbtree, &entry->rbnode) == NULL) {
+            errno = EEXIST;
+            return -1;
+        }
+    } else {
+        size_t i = 0;
+        while (i < index->small_len &&
+                ramfs_name_cmp(&index->small[i]->name, &entry->name) < 0) {
+            i++;
+        }
+        memmove(&index->small[i + 1], &index->small[i],
+                sizeof(*index->small) * (index->small_len - i));
+        memmove(&index->hashes[i + 1], &index->hashes[i],
+                sizeof(*index->hashes) * (index->small_len - i));
+        index->small[i] = entry;
+        index->hashes[i] = ramfs_name_hash(&entry->name);
+        index->small_len++;
+    }
+
+    index->gen++;
+    entry->parent = dir;
+    return 0;
+}
+
+int ramfs_index_load(ramfs_fs_t *fs, ramfs_dir_t *dir,
+        ramfs_entry_t **entries, size_t count)
+{
+    ramfs_index_t *index = &dir->index;
+
+    if (count > fs->small_dir_max) {
+        for (size_t i = 0; i < count; i++) {
+            entries[i]->rbnode.key = &entries[i]->name;
+        }
+        ramfs_rbtree_build(&index->rbtree, (ramfs_rbnode_t **) entries,
+                count);
+        index->tree = 1;
+    } else {
+        if (ramfs_index_reserve(fs, dir, count) < 0) {
+            return -1;
+        }
+        for (size_t i = 0; i < count; i++) {
+            index->small[i] = entries[i];
+            index->hashes[i] = ramfs_name_hash(&entries[i]->name);
+        }
+        index->small_len = count;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        entries[i]->parent = dir;
+    }
+    index->gen++;
+    return 0;
+}
+
+void ramfs_index_remove(ramfs_fs_t *fs, ramfs_entry_t *entry)
+{
+    ramfs_index_t *index = &entry->parent->index;
+
+    if (index->tree) {
+        ramfs_rbtree_delete_node(&index->rbtree, &entry->rbnode);
+        if (index->rbtree.count <= fs->small_dir_min) {
+            to_small(fs, index);
+        }
+    } else {
+        ssize_t i = small_find(index, &entry->name);
+        if (i < 0) {
+            return;
+        }
+        memmove(&index->small[i], &index->small[i + 1],
+                sizeof(*index->small) * (index->small_len - i - 1));
+        memmove(&index->hashes[i], &index->hashes[i + 1],
+                sizeof(*index->hashes) * (index->small_len - i - 1));
+        index->small_len--;
+
+        /* same hysteresis as the vector index, best effort */
+        if (index->small_cap > MIN_SMALL &&
+                index->small_len <= index->small_cap / 4) {
+            small_resize(fs, index, index->small_cap / 2);
+        }
+    }
+
+    index->gen++;
+    entry->parent = NULL;
+}
+
+static void drain_nodes(ramfs_fs_t *fs, ramfs_rbnode_t *node,
+        void (*fn)(ramfs_fs_t *fs, ramfs_entry_t *entry))
+{
+    if (node == RAMFS_RBTREE_NULL) {
+        return;
+    }
+
+    drain_nodes(fs, node->left, fn);
+    drain_nodes(fs, node->right, fn);
+    fn(fs, (ramfs_entry_t *) node);
+}
+
+void ramfs_index_drain(ramfs_fs_t *fs, ramfs_dir_t *dir,
+        void (*fn)(ramfs_fs_t *fs, ramfs_entry_t *entry))
+{
+    ramfs_index_t *index = &dir->index;
+
+    if (index->tree) {
+        drain_nodes(fs, index->rbtree.root, fn);
+    } else {
+        for (size_t i = 0; i < index->small_len; i++) {
+            fn(fs, index->small[i]);
+        }
+    }
+    ramfs_index_destroy(fs, dir);
+}
+
+void ramfs_index_seek(ramfs_dir_t *dir, ramfs_index_cursor_t *cursor,
+        long loc)
+{
+    size_t count = ramfs_index_count(dir);
+
+    cursor->entry = NULL;
+    cursor->loc = (size_t) loc < count ? (size_t) loc : count;
+}
+
+long ramfs_index_tell(ramfs_dir_t *dir, const ramfs_index_cursor_t *cursor)
+{
+    return cursor->loc;
+}
+
+ramfs_entry_t *ramfs_index_next(ramfs_dir_t *dir,
+        ramfs_index_cursor_t *cursor)
+{
+    ramfs_index_t *index = &dir->index;
+    ramfs_entry_t *entry;
+
+    if (cursor->loc >= ramfs_index_count(dir)) {
+        return NULL;
+    }
+
+    if (!index->tree) {
+        entry = index->small[cursor->loc];
+    } else if (cursor->entry != NULL && cursor->gen == index->gen) {
+        entry = (ramfs_entry_t *) ramfs_rbtree_next(&cursor->entry->rbnode);
+    } else {
+        /* the directory changed, find the entry by its index */
+        entry = (ramfs_entry_t *) ramfs_rbtree_select(&index->rbtree,
+                cursor->loc);
+    }
+
+    cursor->entry = entry;
+    cursor->gen = index->gen;
+    cursor->loc++;
+    return entry;
+}
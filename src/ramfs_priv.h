@@ -0,0 +1,424 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef ESP_PLATFORM
+# include "sdkconfig.h"
+#endif
+
+#include "dcache.h"
+#include "epoch.h"
+#include "extent.h"
+#include "journal.h"
+#include "lock.h"
+#include "name.h"
+#include "slab.h"
+#if defined(CONFIG_RAMFS_USE_RBTREE) || defined(CONFIG_RAMFS_USE_HYBRID)
+# include "rbtree.h"
+#endif
+
+
+#ifndef CONFIG_RAMFS_SMALL_DIR_MAX
+# define CONFIG_RAMFS_SMALL_DIR_MAX 16
+#endif
+
+#ifndef CONFIG_RAMFS_SMALL_DIR_MIN
+# define CONFIG_RAMFS_SMALL_DIR_MIN 8
+#endif
+
+#ifndef CONFIG_RAMFS_DCACHE_SIZE
+# define CONFIG_RAMFS_DCACHE_SIZE 0
+#endif
+
+#ifdef CONFIG_RAMFS_RCU
+# ifndef CONFIG_RAMFS_LOCK_PTHREAD
+#  error "CONFIG_RAMFS_RCU needs CONFIG_RAMFS_LOCK_PTHREAD"
+# endif
+# if defined(CONFIG_RAMFS_USE_RBTREE) || defined(CONFIG_RAMFS_USE_HASH) || \
+        defined(CONFIG_RAMFS_USE_HYBRID)
+#  error "CONFIG_RAMFS_RCU needs the vector directory index"
+# endif
+#endif
+
+#define RAMFS_PRIVATE_STRUCTS
+typedef struct ramfs_fs_t ramfs_fs_t;
+typedef struct ramfs_dir_t ramfs_dir_t;
+typedef struct ramfs_entry_t ramfs_entry_t;
+struct ramfs_image_entry_t;
+
+/* Directory index, one per directory. Which container backs it is chosen at
+ * build time; the rest of the filesystem only goes through the
+ * ramfs_index_*() functions below. */
+#if defined(CONFIG_RAMFS_USE_RBTREE)
+typedef struct ramfs_index_t {
+    ramfs_rbtree_t rbtree;
+    unsigned int gen; /* bumped on every change */
+} ramfs_index_t;
+
+typedef struct ramfs_index_cursor_t {
+    ramfs_entry_t *entry; /* last entry returned */
+    size_t loc;
+    unsigned int gen; /* index generation entry was returned in */
+} ramfs_index_cursor_t;
+#elif defined(CONFIG_RAMFS_USE_HYBRID)
+typedef struct ramfs_index_t {
+    ramfs_entry_t **small; /* sorted by name */
+    uint32_t *hashes; /* name hashes, parallel to small */
+    size_t small_len;
+    size_t small_cap;
+    ramfs_rbtree_t rbtree;
+    int tree; /* entries are in rbtree instead of small */
+    unsigned int gen; /* bumped on every change */
+} ramfs_index_t;
+
+typedef struct ramfs_index_cursor_t {
+    ramfs_entry_t *entry; /* last entry returned */
+    size_t loc;
+    unsigned int gen; /* index generation entry was returned in */
+} ramfs_index_cursor_t;
+#elif defined(CONFIG_RAMFS_USE_HASH)
+typedef struct ramfs_hash_slot_t {
+    uint32_t hash; /* cached name hash */
+    uint32_t pos; /* position in order + 1, 0 if empty */
+} ramfs_hash_slot_t;
+
+typedef struct ramfs_hash_item_t {
+    ramfs_entry_t *entry; /* NULL once removed */
+    size_t seq; /* insertion sequence number, used as readdir cookie */
+    uint32_t hash; /* cached name hash, for rehashing */
+} ramfs_hash_item_t;
+
+typedef struct ramfs_index_t {
+    ramfs_hash_slot_t *slots; /* open addressing, linear probing */
+    size_t slots_len; /* power of two */
+    size_t tombstones;
+    ramfs_hash_item_t *order; /* entries in insertion order */
+    size_t order_len;
+    size_t order_cap;
+    size_t count; /* live entries */
+    size_t seq; /* next sequence number */
+} ramfs_index_t;
+
+typedef struct ramfs_index_cursor_t {
+    size_t pos; /* position hint into order */
+    size_t seq; /* sequence number of the next entry to return */
+} ramfs_index_cursor_t;
+#else
+typedef struct ramfs_children_t {
+#ifdef CONFIG_RAMFS_RCU
+    ramfs_rcu_head_t rcu; /* replaced arrays wait for a grace period */
+#endif
+    size_t len;
+    size_t cap;
+    ramfs_entry_t *entries[]; /* sorted by name */
+} ramfs_children_t;
+
+typedef struct ramfs_index_t {
+    ramfs_children_t *children; /* NULL until the first insert */
+#ifdef CONFIG_RAMFS_RCU
+    unsigned int seq; /* odd while entries move within children */
+#endif
+} ramfs_index_t;
+
+typedef struct ramfs_index_cursor_t {
+    size_t loc;
+} ramfs_index_cursor_t;
+#endif
+
+/* what changed about an entry since the last checkpoint */
+#define RAMFS_DIRTY_NEW 1 /* a file created, all of its data is new */
+#define RAMFS_DIRTY_DATA 2 /* file data written or truncated, see the dirty
+                              bits of its extents */
+#define RAMFS_DIRTY_CHILDREN 4 /* entries added to, removed from or renamed
+                                  in a directory */
+
+/* format structures */
+struct ramfs_entry_t {
+#if defined(CONFIG_RAMFS_USE_RBTREE) || defined(CONFIG_RAMFS_USE_HYBRID)
+    ramfs_rbnode_t rbnode;
+#endif
+    ramfs_dir_t *parent;
+    ramfs_name_t name;
+    uint8_t type;
+    uint8_t dirty; /* RAMFS_DIRTY_* since the last checkpoint, under the
+                      lock of the entry itself */
+    uint32_t id; /* names the entry in the journal and checkpoints */
+#ifdef CONFIG_RAMFS_RCU
+    ramfs_rcu_head_t rcu; /* unlinked entries wait for a grace period */
+#endif
+};
+
+struct ramfs_dir_t {
+    ramfs_entry_t entry;
+    ramfs_fs_t *fs;
+    ramfs_index_t index;
+    ramfs_rwlock_t lock; /* index, and name and parent of the children */
+    /* record of a mounted image whose children are not read in yet, NULL
+     * once they are, see ramfs_image_populate() */
+    const struct ramfs_image_entry_t *image;
+};
+
+typedef struct ramfs_file_t {
+    ramfs_entry_t entry;
+    ramfs_extents_t data;
+    ramfs_rwlock_t lock; /* data */
+#ifdef CONFIG_RAMFS_RCU
+    size_t size; /* copy of data.size that stat reads without the lock */
+#endif
+} ramfs_file_t;
+
+/* user handles */
+typedef struct ramfs_dh_t {
+    ramfs_fs_t *fs;
+    ramfs_dir_t *dir;
+    ramfs_index_cursor_t cursor;
+} ramfs_dh_t;
+
+typedef struct ramfs_fh_t {
+    ramfs_fs_t *fs;
+    ramfs_file_t *file;
+    int flags;
+    unsigned int reserved_cuts; /* data.cuts when reserved */
+    size_t pos;
+    void *reserved; /* memory from ramfs_write_reserve(), until committed */
+    size_t reserved_len;
+} ramfs_fh_t;
+
+#include "ramfs/ramfs.h"
+
+/* Locks are taken in this order and released in any order:
+ *
+ *   1. checkpoint_lock, by checkpoints, compaction and applying checkpoints
+ *   2. topology, for writing by anything that moves or removes a directory
+ *      and for reading by anything that follows parent pointers up
+ *   3. directories, an ancestor before its descendants. Path walks hold at
+ *      most two, hand over hand, the next one before letting go of the last.
+ *      Only rename holds two directories that are not parent and child, and
+ *      with topology held for writing, so it is free to take unrelated ones
+ *      by address.
+ *   4. a file
+ *   5. image_lock, then slab_lock, then the allocator lock, then the dentry
+ *      cache lock, then the retired list lock
+ *   6. the journal lock, which is taken with anything above held and
+ *      nothing under it
+ *
+ * With CONFIG_RAMFS_RCU path lookups take none of these. They run in an
+ * epoch read section instead, and unlinked entries are only freed once
+ * every read section that could have seen them has ended.
+ */
+struct ramfs_fs_t {
+    ramfs_dir_t root;
+    ramfs_allocator_t alloc;
+    ramfs_slab_t slab[RAMFS_SLAB_MAX];
+    size_t small_dir_max;
+    size_t small_dir_min;
+    ramfs_dcache_t *dcache;
+    ramfs_rwlock_t topology;
+    ramfs_mutex_t slab_lock;
+    ramfs_epoch_t epoch;
+    const char *image; /* mounted image, or NULL */
+    size_t image_len;
+    int readonly;
+    ramfs_mutex_t image_lock; /* reading directories in from the image */
+    uint32_t next_id; /* last entry id handed out */
+    ramfs_journal_t *journal; /* or NULL */
+    ramfs_mutex_t checkpoint_lock;
+    uint32_t checkpoint_seq; /* of the last checkpoint taken or applied */
+};
+
+/**
+ * \brief       Allocate a file entry that is in no directory yet
+ * \param[in]   fs      \a ramfs_fs_t pointer
+ * \param[in]   name    name, copied unless it is in the mounted image
+ * \return              \a ramfs_file_t pointer or \a NULL on error
+ */
+ramfs_file_t *ramfs_file_new(ramfs_fs_t *fs, const ramfs_name_t *name);
+
+/**
+ * \brief       Allocate an empty directory entry that is in no directory yet
+ * \param[in]   fs      \a ramfs_fs_t pointer
+ * \param[in]   name    name, copied unless it is in the mounted image
+ * \return              \a ramfs_dir_t pointer or \a NULL on error
+ */
+ramfs_dir_t *ramfs_dir_new(ramfs_fs_t *fs, const ramfs_name_t *name);
+
+/**
+ * \brief       Rename an entry that is in no directory
+ * \param[in]   fs      \a ramfs_fs_t pointer
+ * \param[in]   entry   \a ramfs_entry_t pointer
+ * \param[in]   name    new name, copied unless it is in the mounted image
+ * \return              0 on success, -1 on error
+ */
+int ramfs_entry_set_name(ramfs_fs_t *fs, ramfs_entry_t *entry,
+        const ramfs_name_t *name);
+
+/**
+ * \brief       Free an entry that is no longer reachable from the tree
+ *
+ * Directories are freed with everything in them.
+ *
+ * \param[in]   fs      \a ramfs_fs_t pointer
+ * \param[in]   entry   \a ramfs_entry_t pointer
+ */
+void ramfs_entry_free(ramfs_fs_t *fs, ramfs_entry_t *entry);
+
+/**
+ * \brief       Free an entry that was just unlinked
+ *
+ * With \a CONFIG_RAMFS_RCU it is only freed once lock-free lookups that
+ * might have found it are done. No locks may be held.
+ *
+ * \param[in]   fs      \a ramfs_fs_t pointer
+ * \param[in]   entry   \a ramfs_entry_t pointer
+ */
+void ramfs_entry_release(ramfs_fs_t *fs, ramfs_entry_t *entry);
+
+/**
+ * \brief       Read the children of a directory in from the mounted image
+ *
+ * Does nothing if they were read in already, or the directory is not from
+ * an image. Must be called before the index of a directory is used, without
+ * holding the directory lock.
+ *
+ * \param[in]   dir     \a ramfs_dir_t pointer
+ * \return              0 on success, -1 on error
+ */
+int ramfs_image_populate(ramfs_dir_t *dir);
+
+/**
+ * \brief       Initialize an empty directory index
+ * \param[out]  dir     \a ramfs_dir_t pointer
+ */
+void ramfs_index_init(ramfs_dir_t *dir);
+
+/**
+ * \brief       Free the memory held by a directory index
+ *
+ * The entries themselves are not touched, see \a ramfs_index_drain().
+ *
+ * \param[in]   fs      \a ramfs_fs_t pointer
+ * \param[in]   dir     \a ramfs_dir_t pointer
+ */
+void ramfs_index_destroy(ramfs_fs_t *fs, ramfs_dir_t *dir);
+
+/**
+ * \brief       Number of entries in a directory
+ * \param[in]   dir     \a ramfs_dir_t pointer
+ * \return              entry count
+ */
+size_t ramfs_index_count(const ramfs_dir_t *dir);
+
+/**
+ * \brief       Look up an entry by name
+ * \param[in]   dir     \a ramfs_dir_t pointer
+ * \param[in]   name    name to look for
+ * \return              \a ramfs_entry_t pointer or \a NULL with \a errno set
+ *                      to \a ENOENT
+ */
+ramfs_entry_t *ramfs_index_find(ramfs_dir_t *dir, const ramfs_name_t *name);
+
+#ifdef CONFIG_RAMFS_RCU
+/**
+ * \brief       Look up an entry by name without the directory lock
+ *
+ * Must be called in a read section, see \a ramfs_rcu_read_lock().
+ *
+ * \param[in]   dir     \a ramfs_dir_t pointer
+ * \param[in]   name    name to look for
+ * \param[out]  entry   set to the \a ramfs_entry_t pointer, or \a NULL if
+ *                      there is none
+ * \return              0 on success, -1 if writers kept changing the
+ *                      directory and the caller should take the lock
+ */
+int ramfs_index_find_rcu(ramfs_dir_t *dir, const ramfs_name_t *name,
+        ramfs_entry_t **entry);
+#endif
+
+/**
+ * \brief       Make room for more entries
+ *
+ * After a successful call the next \a count inserts do not allocate.
+ *
+ * \param[in]   fs      \a ramfs_fs_t pointer
+ * \param[in]   dir     \a ramfs_dir_t pointer
+ * \param[in]   count   number of entries about to be inserted
+ * \return              0 on success, -1 on error
+ */
+int ramfs_index_reserve(ramfs_fs_t *fs, ramfs_dir_t *dir, size_t count);
+
+/**
+ * \brief       Add an entry to a directory and set its parent
+ *
+ * The caller checks that the name is not taken yet.
+ *
+ * \param[in]   fs      \a ramfs_fs_t pointer
+ * \param[in]   dir     \a ramfs_dir_t pointer
+ * \param[in]   entry   \a ramfs_entry_t pointer
+ * \return              0 on success, -1 on error
+ */
+int ramfs_index_insert(ramfs_fs_t *fs, ramfs_dir_t *dir, ramfs_entry_t *entry);
+
+/**
+ * \brief       Fill an empty directory and set the parents
+ *
+ * Faster than inserting the entries one by one, the containers are built
+ * from the sorted entries directly.
+ *
+ * \param[in]   fs      \a ramfs_fs_t pointer
+ * \param[in]   dir     \a ramfs_dir_t pointer, empty
+ * \param[in]   entries entries sorted by name, without duplicates
+ * \param[in]   count   number of entries
+ * \return              0 on success, -1 on error
+ */
+int ramfs_index_load(ramfs_fs_t *fs, ramfs_dir_t *dir,
+        ramfs_entry_t **entries, size_t count);
+
+/**
+ * \brief       Remove an entry from its parent directory
+ * \param[in]   fs      \a ramfs_fs_t pointer
+ * \param[in]   entry   \a ramfs_entry_t pointer
+ */
+void ramfs_index_remove(ramfs_fs_t *fs, ramfs_entry_t *entry);
+
+/**
+ * \brief       Empty a directory, handing each entry to a callback
+ *
+ * Entries are visited in no particular order and may be freed by \a fn.
+ *
+ * \param[in]   fs      \a ramfs_fs_t pointer
+ * \param[in]   dir     \a ramfs_dir_t pointer
+ * \param[in]   fn      called once for every entry
+ */
+void ramfs_index_drain(ramfs_fs_t *fs, ramfs_dir_t *dir,
+        void (*fn)(ramfs_fs_t *fs, ramfs_entry_t *entry));
+
+/**
+ * \brief       Position a cursor
+ * \param[in]   dir     \a ramfs_dir_t pointer
+ * \param[out]  cursor  \a ramfs_index_cursor_t pointer
+ * \param[in]   loc     location from \a ramfs_index_tell(), 0 for the start
+ */
+void ramfs_index_seek(ramfs_dir_t *dir, ramfs_index_cursor_t *cursor,
+        long loc);
+
+/**
+ * \brief       Return the current location of a cursor
+ * \param[in]   dir     \a ramfs_dir_t pointer
+ * \param[in]   cursor  \a ramfs_index_cursor_t pointer
+ * \return              location
+ */
+long ramfs_index_tell(ramfs_dir_t *dir, const ramfs_index_cursor_t *cursor);
+
+/**
+ * \brief       Return the entry at a cursor and advance it
+ * \param[in]   dir     \a ramfs_dir_t pointer
+ * \param[in]   cursor  \a ramfs_index_cursor_t pointer
+ * \return              \a ramfs_entry_t pointer or \a NULL at the end
+ */
+ramfs_entry_t *ramfs_index_next(ramfs_dir_t *dir,
+        ramfs_index_cursor_t *cursor);
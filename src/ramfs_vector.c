@@ -2,67 +2,41 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
-#include <assert.h>
 #include <errno.h>
-#include <fcntl.h>
-#include <stdlib.h>
 #include <string.h>
-#include <sys/stat.h>
-#include <unistd.h>
-
-
-#define RAMFS_PRIVATE_STRUCTS
-typedef struct ramfs_fs_t ramfs_fs_t;
-typedef struct ramfs_dir_t ramfs_dir_t;
-
-/* format structures */
-typedef struct ramfs_entry_t {
-    ramfs_dir_t *parent;
-    const char *name;
-    int type;
-} ramfs_entry_t;
-
-typedef struct ramfs_dir_t {
-    ramfs_entry_t entry;
-    ramfs_entry_t **children;
-    size_t children_len;
-} ramfs_dir_t;
-
-typedef struct ramfs_file_t {
-    ramfs_entry_t entry;
-    unsigned char *data;
-    size_t size;
-} ramfs_file_t;
-
-/* user handles */
-typedef struct ramfs_fs_t {
-    ramfs_dir_t root;
-} ramfs_fs_t;
-
-typedef struct ramfs_dh_t {
-    ramfs_fs_t *fs;
-    ramfs_dir_t *dir;
-    size_t loc;
-} ramfs_dh_t;
-
-typedef struct ramfs_fh_t {
-    ramfs_fs_t *fs;
-    ramfs_file_t *file;
-    int flags;
-    size_t pos;
-} ramfs_fh_t;
-
-#include "ramfs/ramfs.h"
-
-
-static ssize_t find_entry(ramfs_entry_t *dir, const char *name)
+
+#include "alloc.h"
+#include "ramfs_priv.h"
+
+
+#define MIN_CHILDREN 4
+#define RCU_RETRIES 4
+
+#ifdef CONFIG_RAMFS_RCU
+/* lookups read the array while it changes, see ramfs_index_find_rcu() */
+# define LOAD(x) __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+# define STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+#else
+# define LOAD(x) (x)
+# define STORE(x, v) ((x) = (v))
+#endif
+
+static size_t children_len(const ramfs_children_t *children)
+{
+    return children != NULL ? LOAD(children->len) : 0;
+}
+
+/* returns the index of name, or -(insertion point + 1) */
+static ssize_t find_index(const ramfs_children_t *children,
+        const ramfs_name_t *name)
 {
-    int first = 0;
-    int last = ((ramfs_dir_t *) dir)->children_len - 1;
+    ssize_t first = 0;
+    ssize_t last = (ssize_t) children_len(children) - 1;
 
     while (first <= last) {
-        int middle = (first + last) / 2;
-        int cmp = strcmp(((ramfs_dir_t *) dir)->children[middle]->name, name);
+        ssize_t middle = (first + last) / 2;
+        ramfs_entry_t *entry = LOAD(children->entries[middle]);
+        int cmp = ramfs_name_cmp(&entry->name, name);
         if (cmp == 0) {
             return middle;
         } else if (cmp < 0) {
@@ -72,677 +46,254 @@ static ssize_t find_entry(ramfs_entry_t *dir, const char *name)
         }
     }
 
-    errno = ENOENT;
-    return -(last + 2);
+    return -(first + 1);
 }
 
-static int insert(ramfs_entry_t *parent, ramfs_entry_t *child, int i)
+/* Shifts entries within the array. Lookups without the lock may see an
+ * entry twice while this runs, and retry once they notice the sequence
+ * number changed. */
+static void move(ramfs_index_t *index, size_t dst, size_t src, size_t n)
 {
-    if (!ramfs_is_dir(parent)) {
-        errno = ENOTDIR;
-        return -1;
-    }
-    ramfs_dir_t *dir = (ramfs_dir_t *) parent;
+    ramfs_entry_t **entries = index->children->entries;
 
-    size_t new_size = sizeof(*dir->children) * (dir->children_len + 1);
-    ramfs_entry_t **new_children = realloc(dir->children, new_size);
-    if (new_children == NULL) {
-        return -1;
+#ifdef CONFIG_RAMFS_RCU
+    __atomic_store_n(&index->seq, index->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    if (dst > src) {
+        for (size_t i = n; i > 0; i--) {
+            STORE(entries[dst + i - 1], entries[src + i - 1]);
+        }
+    } else {
+        for (size_t i = 0; i < n; i++) {
+            STORE(entries[dst + i], entries[src + i]);
+        }
     }
-    dir->children = new_children;
-
-    memmove(&dir->children[i + 1], &dir->children[i],
-            sizeof(*dir->children) * (dir->children_len - i));
-
-    dir->children[i] = child;
-    dir->children_len++;
-    child->parent = dir;
-    return 0;
+#else
+    memmove(&entries[dst], &entries[src], sizeof(*entries) * n);
+#endif
 }
 
-static ramfs_entry_t *remove_index(ramfs_entry_t *parent, size_t i)
+static void move_done(ramfs_index_t *index)
 {
-    if (!ramfs_is_dir(parent)) {
-        errno = ENOTDIR;
-        return NULL;
-    }
-    ramfs_dir_t *dir = (ramfs_dir_t *) parent;
-
-    if (i >= dir->children_len) {
-        errno = ERANGE;
-        return NULL;
-    }
-    ramfs_entry_t *child = dir->children[i];
-
-    memmove(&dir->children[i], &dir->children[i + 1],
-            sizeof(*dir->children) * (dir->children_len - i - 1));
-    size_t new_size = sizeof(*dir->children) * (dir->children_len - 1);
-    ramfs_entry_t **new_children = realloc(dir->children, new_size);
-    if (new_size != 0 && new_children == NULL) {
-        return NULL;
-    }
-
-    dir->children = new_children;
-    dir->children_len--;
-    child->parent = NULL;
-    return child;
+#ifdef CONFIG_RAMFS_RCU
+    __atomic_store_n(&index->seq, index->seq + 1, __ATOMIC_RELEASE);
+#endif
 }
 
-static ramfs_entry_t *remove(ramfs_entry_t *entry)
+void ramfs_index_init(ramfs_dir_t *dir)
 {
-    ssize_t i = find_entry(&entry->parent->entry, entry->name);
-    if (i < 0) {
-        return NULL;
-    }
-
-    return remove_index(&entry->parent->entry, i);
+    dir->index.children = NULL;
+#ifdef CONFIG_RAMFS_RCU
+    dir->index.seq = 0;
+#endif
 }
 
-ramfs_fs_t *ramfs_init(void)
+void ramfs_index_destroy(ramfs_fs_t *fs, ramfs_dir_t *dir)
 {
-    ramfs_fs_t *fs = calloc(1, sizeof(*fs));
-
-    if (fs == NULL) {
-        return NULL;
-    }
-
-    return fs;
+    ramfs_free(&fs->alloc, dir->index.children);
+    ramfs_index_init(dir);
 }
 
-void ramfs_deinit(ramfs_fs_t *fs)
+size_t ramfs_index_count(const ramfs_dir_t *dir)
 {
-    assert(fs != NULL);
-
-    ramfs_rmtree(&fs->root.entry);
-    free(fs);
+    return children_len(LOAD(dir->index.children));
 }
 
-ramfs_entry_t *ramfs_get_parent(ramfs_fs_t *fs, const char *path)
+ramfs_entry_t *ramfs_index_find(ramfs_dir_t *dir, const ramfs_name_t *name)
 {
-    ramfs_dir_t *dir;
-
-    assert(fs != NULL);
-    assert(path != NULL);
-
-    dir = &fs->root;
-
-    while (*path == '/') {
-        path++;
-    }
-
-    const char *end;
-    while ((end = strchr(path, '/')) != NULL) {
-        char *key = strndup(path, end - path);
-        if (key == NULL) {
-            return NULL;
-        }
-        ssize_t i = find_entry(&dir->entry, key);
-        free(key);
-        if (i < 0) {
-            return NULL;
-        }
-        if (!ramfs_is_dir(dir->children[i])) {
-            errno = ENOTDIR;
-            return NULL;
-        }
-        dir = (ramfs_dir_t *) dir->children[i];
-        path = end + 1;
-        while (*path == '/') {
-            path++;
-        }
-    }
-
-    return &dir->entry;
-}
-
-ramfs_entry_t *ramfs_get_entry(ramfs_fs_t *fs, const char *path)
-{
-    assert(fs != NULL);
-    assert(path != NULL);
-
-    while (*path == '/') {
-        path++;
-    }
-
-    ramfs_dir_t *parent = (ramfs_dir_t *) ramfs_get_parent(fs, path);
-    if (parent == NULL) {
-        return NULL;
-    }
-
-    size_t len = strlen(path);
-    const char *key = path + len;
-    while (key > path && *(key - 1) != '/') {
-        key--;
-    }
-
-    if (len - (key - path) == 0) {
-        errno = EINVAL;
-        return NULL;
-    }
-
-    ssize_t i = find_entry(&parent->entry, key);
+    ssize_t i = find_index(dir->index.children, name);
     if (i < 0) {
+        errno = ENOENT;
         return NULL;
     }
 
-    return parent->children[i];
+    return dir->index.children->entries[i];
 }
 
-char *ramfs_get_name(const ramfs_entry_t *entry)
+#ifdef CONFIG_RAMFS_RCU
+int ramfs_index_find_rcu(ramfs_dir_t *dir, const ramfs_name_t *name,
+        ramfs_entry_t **entry)
 {
-    assert(entry != NULL);
+    ramfs_index_t *index = &dir->index;
 
-    return strdup(entry->name);
-}
-
-char *ramfs_get_path(const ramfs_entry_t *entry)
-{
-    assert(entry != NULL);
-
-    size_t len = 0;
-    const ramfs_entry_t *node = entry;
-
-    while (node != NULL) {
-        len += strlen((char *) node->name) + 1;
-        node = &node->parent->entry;
-    }
+    for (int tries = 0; tries < RCU_RETRIES; tries++) {
+        unsigned int seq = __atomic_load_n(&index->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            continue;
+        }
 
-    char *path = malloc(len + 1);
-    path[len] = '\0';
+        ramfs_children_t *children = LOAD(index->children);
+        ssize_t i = find_index(children, name);
+        *entry = i >= 0 ? LOAD(children->entries[i]) : NULL;
 
-    node = entry;
-    while (node != NULL) {
-        int name_len = strlen((char *) node->name);
-        len -= name_len;
-        memcpy(path + len, (char *) node->name, name_len);
-        path[--len] = '/';
-        node = &node->parent->entry;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&index->seq, __ATOMIC_RELAXED) == seq) {
+            return 0;
+        }
     }
 
-    return path;
-}
-
-int ramfs_is_dir(const ramfs_entry_t *entry)
-{
-    assert(entry != NULL);
-
-    return entry->type == RAMFS_ENTRY_TYPE_DIR;
-}
-
-int ramfs_is_file(const ramfs_entry_t *entry)
-{
-    assert(entry != NULL);
-
-    return entry->type == RAMFS_ENTRY_TYPE_FILE;
+    return -1;
 }
 
-void ramfs_stat(ramfs_fs_t *fs, const ramfs_entry_t *entry, ramfs_stat_t *st)
+static void free_children(ramfs_fs_t *fs, ramfs_rcu_head_t *head)
 {
-    assert(fs != NULL);
-    assert(entry != NULL);
-    assert(st != NULL);
-
-    memset(st, 0, sizeof(*st));
-    st->type = entry->type;
-    if (entry->type == RAMFS_ENTRY_TYPE_FILE) {
-        ramfs_file_t *file = (ramfs_file_t *) entry;
-        st->size = file->size;
-    }
-}
-
-ramfs_entry_t *ramfs_create(ramfs_fs_t *fs, const char *path, int flags)
-{
-    ramfs_file_t *file;
-
-    assert(fs != NULL);
-    assert(path != NULL);
-
-    while (*path == '/') {
-        path++;
-    }
-
-    ramfs_dir_t *parent = (ramfs_dir_t *) ramfs_get_parent(fs, path);
-    if (parent == NULL) {
-        return NULL;
-    }
-
-    size_t len = strlen(path);
-    const char *name = path + len;
-    while (name > path && *(name - 1) != '/') {
-        name--;
-    }
-    if (len - (path - name) == 0) {
-        errno = EINVAL;
-        return NULL;
-    }
-
-    ssize_t i = find_entry(&parent->entry, name);
-    if (i >= 0) {
-        errno = EEXIST;
-        return NULL;
-    }
-    i = -i - 1;
-
-    if (strlen(name) == 0 || strchr(name, '/')) {
-        errno = EINVAL;
-        return NULL;
-    }
-
-    file = calloc(1, sizeof(*file));
-    if (file == NULL) {
-        return NULL;
-    }
-
-    file->entry.name = strdup(name);
-    if (file->entry.name == NULL) {
-        free(file);
-        return NULL;
-    }
-    file->entry.parent = parent;
-    file->entry.type = RAMFS_ENTRY_TYPE_FILE;
-
-    if (insert(&parent->entry, &file->entry, i) < 0) {
-        free((void *) file->entry.name);
-        free(file);
-        return NULL;
-    }
-
-    return &file->entry;
+    ramfs_free(&fs->alloc, head);
 }
+#endif
 
-int ramfs_truncate(ramfs_fs_t *fs, ramfs_entry_t *entry, size_t size)
+static int resize(ramfs_fs_t *fs, ramfs_index_t *index, size_t cap)
 {
-    assert(fs != NULL);
-    assert(entry != NULL);
+    ramfs_children_t *children = index->children;
+    size_t len = children_len(children);
+    size_t size = sizeof(*children) + sizeof(*children->entries) * cap;
 
-    if (entry->type != RAMFS_ENTRY_TYPE_FILE) {
+#ifdef CONFIG_RAMFS_RCU
+    /* lookups may still be reading the old array, so it is replaced rather
+     * than reallocated */
+    ramfs_children_t *new_children = ramfs_malloc(&fs->alloc, size);
+    if (new_children == NULL) {
         return -1;
     }
-
-    ramfs_file_t *file = (ramfs_file_t *) entry;
-
-    unsigned char *new_data = realloc(file->data, size);
-    if (new_data == NULL) {
+    if (children != NULL) {
+        memcpy(new_children->entries, children->entries,
+                sizeof(*children->entries) * len);
+    }
+#else
+    ramfs_children_t *new_children = ramfs_realloc(&fs->alloc, children,
+            size);
+    if (new_children == NULL) {
         return -1;
     }
-    file->data = new_data;
-
-    if (size > file->size) {
-        memset(file->data + file->size, 0, size - file->size);
+#endif
+    new_children->len = len;
+    new_children->cap = cap;
+    STORE(index->children, new_children);
+#ifdef CONFIG_RAMFS_RCU
+    if (children != NULL) {
+        ramfs_rcu_retire(fs, &children->rcu, free_children);
     }
-    file->size = size;
-
+#endif
     return 0;
 }
 
-ramfs_fh_t *ramfs_open(ramfs_fs_t *fs, const ramfs_entry_t *entry,
-        unsigned int flags)
-{
-    assert(fs != NULL);
-    assert(entry != NULL);
-
-    if (entry->type != RAMFS_ENTRY_TYPE_FILE) {
-        return NULL;
-    }
-
-    ramfs_file_t *file = (ramfs_file_t *) entry;
-
-    if (flags & O_TRUNC) {
-        free(file->data);
-        file->data = NULL;
-        file->size = 0;
-    }
-
-    ramfs_fh_t *fh = calloc(1, sizeof(*fh));
-    if (fh == NULL) {
-        return NULL;
-    }
-
-    if (flags & O_APPEND) {
-        fh->pos = file->size;
-    }
-
-    fh->fs = fs;
-    fh->file = file;
-    fh->flags = flags;
-    return fh;
-}
-
-void ramfs_close(ramfs_fh_t *fh)
-{
-    assert(fh != NULL);
-
-    free(fh);
-}
-
-ssize_t ramfs_read(ramfs_fh_t *fh, char *buf, size_t len)
+int ramfs_index_reserve(ramfs_fs_t *fs, ramfs_dir_t *dir, size_t count)
 {
-    assert(fh != NULL);
-    assert(buf != NULL);
+    ramfs_index_t *index = &dir->index;
+    size_t old_cap = index->children != NULL ? index->children->cap : 0;
+    size_t need = children_len(index->children) + count;
 
-    if (fh->pos >= fh->file->size) {
+    if (need <= old_cap) {
         return 0;
     }
 
-    if (len > fh->file->size - fh->pos) {
-        len = fh->file->size - fh->pos;
+    size_t cap = old_cap ? old_cap : MIN_CHILDREN;
+    while (cap < need) {
+        cap *= 2;
     }
 
-    memcpy(buf, fh->file->data + fh->pos, len);
-    fh->pos += len;
-    return len;
+    return resize(fs, index, cap);
 }
 
-ssize_t ramfs_write(ramfs_fh_t *fh, const char *buf, size_t len)
+int ramfs_index_insert(ramfs_fs_t *fs, ramfs_dir_t *dir, ramfs_entry_t *entry)
 {
-    assert(fh != NULL);
-    assert(buf != NULL);
+    ramfs_index_t *index = &dir->index;
 
-    if (!(fh->flags & O_WRONLY || fh->flags & O_RDWR)) {
-        errno = EBADF;
+    if (ramfs_index_reserve(fs, dir, 1) < 0) {
         return -1;
     }
 
-    if (fh->pos + len > fh->file->size) {
-        size_t new_size = fh->pos + len;
-        unsigned char *p = realloc(fh->file->data, new_size);
-        if (new_size != 0 && p == NULL) {
-            return -1;
-        }
-        fh->file->data = p;
-        if (fh->pos > fh->file->size) {
-            memset(fh->file->data + fh->file->size, 0,
-                    fh->pos - fh->file->size);
-        }
-        fh->file->size = fh->pos + len;
-    }
-
-    memcpy(fh->file->data + fh->pos, buf, len);
-    fh->pos += len;
-    return len;
-}
-
-ssize_t ramfs_seek(ramfs_fh_t *fh, off_t offset, int whence)
-{
-    assert(fh != NULL);
-
-    ssize_t pos = fh->pos;
-
-    if (whence == SEEK_CUR) {
-        pos += offset;
-    } else if (whence == SEEK_SET) {
-        pos = offset;
-    } else if (whence == SEEK_END) {
-        pos = fh->file->size + offset;
-    }
-
-    if (pos < 0) {
-        pos = 0;
-    }
-
-    fh->pos = pos;
-    return pos;
-}
-
-size_t ramfs_tell(const ramfs_fh_t *fh)
-{
-    assert(fh != NULL);
-
-    return fh->pos;
-}
-
-size_t ramfs_access(const ramfs_fh_t *fh, const void **buf)
-{
-    assert(fh != NULL);
-
-    *buf = fh->file->data;
-    return fh->file->size;
-}
-
-int ramfs_unlink(ramfs_entry_t *entry)
-{
-    assert(entry != NULL);
-
-    if (entry->type != RAMFS_ENTRY_TYPE_FILE) {
-        errno = ENFILE;
-        return -1;
-    }
-
-    if (remove(entry) == NULL) {
-        return -1;
-    }
-
-    free((void *) entry->name);
-    free(entry);
+    ramfs_children_t *children = index->children;
+    size_t len = children->len;
+    size_t i = -find_index(children, &entry->name) - 1;
+    move(index, i + 1, i, len - i);
+    STORE(children->entries[i], entry);
+    STORE(children->len, len + 1);
+    move_done(index);
+    entry->parent = dir;
     return 0;
 }
 
-int ramfs_rename(ramfs_fs_t *fs, const char *src, const char *dst)
+int ramfs_index_load(ramfs_fs_t *fs, ramfs_dir_t *dir,
+        ramfs_entry_t **entries, size_t count)
 {
-    assert(fs != NULL);
-    assert(src != NULL);
-    assert(dst != NULL);
-
-    if (strcmp(src, dst) == 0) {
+    if (count == 0) {
         return 0;
     }
-
-    while (*src == '/') {
-        src++;
-    }
-    ramfs_dir_t *src_parent = (ramfs_dir_t *) ramfs_get_parent(fs, src);
-    if (src_parent == NULL) {
-        errno = ENOENT;
+    if (ramfs_index_reserve(fs, dir, count) < 0) {
         return -1;
     }
 
-    while (*dst == '/') {
-        dst++;
-    }
-    ramfs_dir_t *dst_parent = (ramfs_dir_t *) ramfs_get_parent(fs, dst);
-    if (dst_parent == NULL) {
-        errno = ENOENT;
-        return -1;
-    }
-
-    size_t len = strlen(src);
-    const char *name = src + len;
-    while (name > src && *(name - 1) != '/') {
-        name--;
-    }
-    ssize_t src_index = find_entry(&src_parent->entry, name);
-    if (src_index < 0) {
-        return -1;
-    }
-
-    len = strlen(dst);
-    name = dst + len;
-    while (name > dst && *(name - 1) != '/') {
-        name--;
-    }
-    ssize_t dst_index = find_entry(&dst_parent->entry, name);
-    if (dst_index >= 0) {
-        errno = EEXIST;
-        return -1;
-    }
-
-    name = strdup(name);
-    if (name == NULL) {
-        return -1;
-    }
-
-    ramfs_entry_t *entry = remove(src_parent->children[src_index]);
-    if (entry == NULL) {
-        return -1;
-    }
-    dst_index = find_entry(&dst_parent->entry, name);
-    dst_index = -dst_index - 1;
-    free((void *) entry->name);
-    entry->name = name;
-    if (insert(&dst_parent->entry, entry, dst_index) < 0) {
-        return -1;
+    ramfs_children_t *children = dir->index.children;
+    for (size_t i = 0; i < count; i++) {
+        STORE(children->entries[i], entries[i]);
+        entries[i]->parent = dir;
     }
-
+    STORE(children->len, count);
     return 0;
 }
 
-ramfs_dh_t *ramfs_opendir(ramfs_fs_t *fs, const ramfs_entry_t *entry)
+void ramfs_index_remove(ramfs_fs_t *fs, ramfs_entry_t *entry)
 {
-    assert(fs != NULL);
-    assert(entry != NULL);
+    ramfs_dir_t *dir = entry->parent;
+    ramfs_index_t *index = &dir->index;
+    ramfs_children_t *children = index->children;
 
-    if (ramfs_is_file(entry)) {
-        errno = ENOTDIR;
-        return NULL;
+    ssize_t i = find_index(children, &entry->name);
+    if (i < 0) {
+        return;
     }
 
-    ramfs_dh_t *dh = calloc(1, sizeof(*dh));
-    dh->fs = fs;
-    dh->dir = (ramfs_dir_t *) entry;
-    return dh;
-}
-
-void ramfs_closedir(ramfs_dh_t *dh)
-{
-    assert(dh != NULL);
-
-    free(dh);
-}
-
-const ramfs_entry_t *ramfs_readdir(ramfs_dh_t *dh)
-{
-    assert(dh != NULL);
+    size_t len = children->len;
+    move(index, i, i + 1, len - i - 1);
+    STORE(children->len, len - 1);
+    move_done(index);
+    entry->parent = NULL;
 
-    if (dh->loc < dh->dir->children_len) {
-        return dh->dir->children[dh->loc++];
+    /* halve once a quarter full, so alternating inserts and removes never
+     * resize, and a reservation made before removing still holds */
+    if (children->cap > MIN_CHILDREN && children->len <= children->cap / 4) {
+        /* shrinking is best effort, the old array is still valid on
+         * failure */
+        resize(fs, index, children->cap / 2);
     }
-
-    return NULL;
 }
 
-void ramfs_seekdir(ramfs_dh_t *dh, long loc)
+void ramfs_index_drain(ramfs_fs_t *fs, ramfs_dir_t *dir,
+        void (*fn)(ramfs_fs_t *fs, ramfs_entry_t *entry))
 {
-    assert(dh != NULL);
-    assert(loc >= 0);
+    ramfs_children_t *children = dir->index.children;
 
-    if (loc < dh->dir->children_len) {
-        dh->loc = loc;
-    } else {
-        dh->loc = dh->dir->children_len;
+    for (size_t i = 0; i < children_len(children); i++) {
+        fn(fs, children->entries[i]);
+    }
+    if (children != NULL) {
+        children->len = 0;
     }
 }
 
-long ramfs_telldir(ramfs_dh_t *dh)
-{
-    assert(dh != NULL);
-
-    return dh->loc;
-}
-
-ramfs_entry_t *ramfs_mkdir(ramfs_fs_t *fs, const char *path)
+void ramfs_index_seek(ramfs_dir_t *dir, ramfs_index_cursor_t *cursor,
+        long loc)
 {
-    assert(fs != NULL);
-    assert(path != NULL);
-
-    while (*path == '/') {
-        path++;
-    }
-
-    ramfs_dir_t *parent = (ramfs_dir_t *) ramfs_get_parent(fs, path);
-    if (parent == NULL) {
-        return NULL;
-    }
-
-    size_t len = strlen(path);
-    const char *name = path + len;
-    while (name > path && *(name - 1) != '/') {
-        name--;
-    }
-    if (len - (path - name) == 0) {
-        name--;
-        errno = EINVAL;
-        return NULL;
-    }
-
-    ssize_t i = find_entry(&parent->entry, name);
-    if (i >= 0) {
-        errno = EEXIST;
-        return NULL;
-    }
-    i = -i - 1;
+    size_t len = children_len(dir->index.children);
 
-    if (strlen(name) == 0 || strchr(name, '/')) {
-        errno = EINVAL;
-        return NULL;
-    }
-
-    ramfs_dir_t *dir = calloc(1, sizeof(*dir));
-    if (dir == NULL) {
-        return NULL;
-    }
-
-    dir->entry.name = strdup(name);
-    if (dir->entry.name == NULL) {
-        free(dir);
-        return NULL;
-    }
-    dir->entry.parent = parent;
-    dir->entry.type = RAMFS_ENTRY_TYPE_DIR;
-
-    if (insert(&parent->entry, &dir->entry, i) < 0) {
-        free((void *) dir->entry.name);
-        free(dir);
-        return NULL;
+    if ((size_t) loc < len) {
+        cursor->loc = loc;
+    } else {
+        cursor->loc = len;
     }
-
-    return &dir->entry;
 }
 
-int ramfs_rmdir(ramfs_entry_t *entry)
+long ramfs_index_tell(ramfs_dir_t *dir, const ramfs_index_cursor_t *cursor)
 {
-    assert(entry != NULL);
-
-    if (!ramfs_is_dir(entry)) {
-        errno = ENOTDIR;
-        return -1;
-    }
-
-    if (((ramfs_dir_t *) entry)->children_len > 0) {
-        errno = ENOTEMPTY;
-        return -1;
-    }
-
-    if (remove(entry) == NULL) {
-        return -1;
-    }
-
-    free((void *) entry->name);
-    free(entry);
-    return 0;
+    return cursor->loc;
 }
 
-void ramfs_rmtree(ramfs_entry_t *entry)
+ramfs_entry_t *ramfs_index_next(ramfs_dir_t *dir,
+        ramfs_index_cursor_t *cursor)
 {
-    assert(entry != NULL);
-
-    if (ramfs_is_file(entry)) {
-        ramfs_unlink(entry);
-        return;
+    if (cursor->loc < children_len(dir->index.children)) {
+        return dir->index.children->entries[cursor->loc++];
     }
 
-    ramfs_dir_t *dir = (ramfs_dir_t *) entry;
-
-    for (int i = 0; i < dir->children_len; i++) {
-        if (ramfs_is_dir(dir->children[i])) {
-            ramfs_rmtree(dir->children[i]);
-        } else {
-            free(((ramfs_file_t *) dir->children[i])->data);
-            free((void *) dir->children[i]->name);
-            free(dir->children[i]);
-        }
-    }
-    if (entry->parent != NULL) {
-        free((void *) entry->name);
-        free(entry);
-    }
+    return NULL;
 }
@@ -59,7 +59,8 @@ ramfs_rbnode_t ramfs_rbtree_null_node = {
     RAMFS_RBTREE_NULL,    /* Left.  */
     RAMFS_RBTREE_NULL,    /* Right.  */
     NULL,                 /* Key.  */
-    BLACK                 /* Color.  */
+    BLACK,                /* Color.  */
+    0                     /* Size.  */
 };
 
 /** rotate subtree left (to preserve redblack property) */
@@ -136,6 +137,9 @@ static void ramfs_rbtree_rotate_left(ramfs_rbtree_t *rbtree,
     }
     right->left = node;
     node->parent = right;
+
+    right->size = node->size;
+    node->size = node->left->size + node->right->size + 1;
 }
 
 /*
@@ -163,6 +167,9 @@ static void ramfs_rbtree_rotate_right(ramfs_rbtree_t *rbtree,
     }
     left->right = node;
     node->parent = left;
+
+    left->size = node->size;
+    node->size = node->left->size + node->right->size + 1;
 }
 
 static void ramfs_rbtree_insert_fixup(ramfs_rbtree_t *rbtree,
@@ -263,8 +270,14 @@ ramfs_rbnode_t *ramfs_rbtree_insert(ramfs_rbtree_t *rbtree,
     data->parent = parent;
     data->left = data->right = RAMFS_RBTREE_NULL;
     data->color = RED;
+    data->size = 1;
     rbtree->count++;
 
+    /* the new node is in the subtree of everything above it */
+    for (node = parent; node != RAMFS_RBTREE_NULL; node = node->parent) {
+        node->size++;
+    }
+
     /* Insert it into the tree... */
     if (parent != RAMFS_RBTREE_NULL) {
         if (r < 0) {
@@ -282,6 +295,57 @@ ramfs_rbnode_t *ramfs_rbtree_insert(ramfs_rbtree_t *rbtree,
     return data;
 }
 
+/*
+ * Builds a subtree from the middle out. Subtrees on either side of a node
+ * differ in size by at most one, so every path ends on one of the last two
+ * levels, and colouring only the deepest level red balances the black
+ * heights.
+ */
+static ramfs_rbnode_t *ramfs_rbtree_build_sub(ramfs_rbnode_t **nodes,
+                                              size_t count,
+                                              ramfs_rbnode_t *parent,
+                                              size_t depth, size_t red_depth)
+{
+    ramfs_rbnode_t *node;
+    size_t middle;
+
+    if (count == 0) {
+        return RAMFS_RBTREE_NULL;
+    }
+
+    middle = count / 2;
+    node = nodes[middle];
+    node->parent = parent;
+    node->left = ramfs_rbtree_build_sub(nodes, middle, node, depth + 1,
+                                        red_depth);
+    node->right = ramfs_rbtree_build_sub(nodes + middle + 1,
+                                         count - middle - 1, node, depth + 1,
+                                         red_depth);
+    node->color = depth == red_depth ? RED : BLACK;
+    node->size = count;
+    return node;
+}
+
+void ramfs_rbtree_build(ramfs_rbtree_t *rbtree, ramfs_rbnode_t **nodes,
+                        size_t count)
+{
+    size_t red_depth = 0;
+
+    if (count == 0) {
+        return;
+    }
+
+    /* the deepest level, counted from 0 at the root */
+    while ((count >> (red_depth + 1)) != 0) {
+        red_depth++;
+    }
+
+    rbtree->root = ramfs_rbtree_build_sub(nodes, count, RAMFS_RBTREE_NULL, 0,
+                                          red_depth);
+    rbtree->root->color = BLACK;
+    rbtree->count = count;
+}
+
 /*
  * Searches the red black tree, returns the data if key is found or NULL
  * otherwise.
@@ -303,6 +367,12 @@ static void swap_int8(uint8_t *x, uint8_t *y)
     uint8_t t = *x; *x = *y; *y = t;
 }
 
+/** helpers for delete: swap subtree sizes */
+static void swap_size(size_t *x, size_t *y)
+{
+    size_t t = *x; *x = *y; *y = t;
+}
+
 /** helpers for delete: swap node pointers */
 static void swap_np(ramfs_rbnode_t **x, ramfs_rbnode_t **y)
 {
@@ -358,6 +428,8 @@ ramfs_rbnode_t *ramfs_rbtree_delete_node(ramfs_rbtree_t *rbtree,
 
         /* swap colors - colors are tied to the position in the tree */
         swap_int8(&node->color, &smright->color);
+        /* and so are subtree sizes */
+        swap_size(&node->size, &smright->size);
 
         /* swap child pointers in parents of smright/to_delete */
         change_parent_ptr(rbtree, node->parent, node, smright);
@@ -395,6 +467,12 @@ ramfs_rbnode_t *ramfs_rbtree_delete_node(ramfs_rbtree_t *rbtree,
         child = node->right;
     }
 
+    /* everything above to_delete loses one node */
+    for (ramfs_rbnode_t *up = node->parent; up != RAMFS_RBTREE_NULL;
+            up = up->parent) {
+        up->size--;
+    }
+
     /* unlink to_delete from the tree, replace to_delete with child */
     change_parent_ptr(rbtree, node->parent, node, child);
     change_child_ptr(child, node, node->parent);
@@ -415,6 +493,7 @@ ramfs_rbnode_t *ramfs_rbtree_delete_node(ramfs_rbtree_t *rbtree,
     node->left = RAMFS_RBTREE_NULL;
     node->right = RAMFS_RBTREE_NULL;
     node->color = BLACK;
+    node->size = 0;
     return node;
 }
 
@@ -573,6 +652,36 @@ int ramfs_rbtree_find_less_equal(ramfs_rbtree_t *rbtree, const void *key,
 /*
  * Finds the first element in the red black tree
  */
+ramfs_rbnode_t *ramfs_rbtree_select(ramfs_rbtree_t *rbtree, size_t k)
+{
+    ramfs_rbnode_t *node = rbtree->root;
+
+    while (node != RAMFS_RBTREE_NULL) {
+        if (k < node->left->size) {
+            node = node->left;
+        } else if (k == node->left->size) {
+            return node;
+        } else {
+            k -= node->left->size + 1;
+            node = node->right;
+        }
+    }
+    return NULL;
+}
+
+size_t ramfs_rbtree_rank(ramfs_rbtree_t *rbtree, ramfs_rbnode_t *node)
+{
+    size_t rank = node->left->size;
+
+    while (node != rbtree->root) {
+        if (node == node->parent->right) {
+            rank += node->parent->left->size + 1;
+        }
+        node = node->parent;
+    }
+    return rank;
+}
+
 ramfs_rbnode_t *ramfs_rbtree_first(ramfs_rbtree_t *rbtree)
 {
     ramfs_rbnode_t *node = NULL;
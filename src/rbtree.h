@@ -68,6 +68,8 @@ struct ramfs_rbnode_t {
     const void *key;
     /** colour of this node */
     uint8_t color;
+    /** number of nodes in the subtree rooted here, 0 for RAMFS_RBTREE_NULL */
+    size_t size;
 };
 
 /** The nullpointer, points to empty node */
@@ -116,6 +118,16 @@ void ramfs_rbtree_init(ramfs_rbtree_t *rbtree,
 ramfs_rbnode_t *ramfs_rbtree_insert(ramfs_rbtree_t *rbtree,
                                     ramfs_rbnode_t *data);
 
+/**
+ * Fill an empty tree from nodes sorted by key, in O(n).
+ * @param rbtree: empty tree.
+ * @param nodes: nodes with their keys set, in ascending order without
+ *   duplicates.
+ * @param count: number of nodes.
+ */
+void ramfs_rbtree_build(ramfs_rbtree_t *rbtree, ramfs_rbnode_t **nodes,
+                        size_t count);
+
 /**
  * Delete element from tree by node.
  * @param rbtree: tree to delete from.
@@ -154,6 +166,22 @@ ramfs_rbnode_t *ramfs_rbtree_search(ramfs_rbtree_t *rbtree, const void *key);
 int ramfs_rbtree_find_less_equal(ramfs_rbtree_t *rbtree, const void *key,
                                  ramfs_rbnode_t **result);
 
+/**
+ * Find the node at a position in sorted order, in O(log n).
+ * @param rbtree: tree
+ * @param k: zero based position.
+ * @return: node with k smaller nodes or NULL if k is out of range.
+ */
+ramfs_rbnode_t *ramfs_rbtree_select(ramfs_rbtree_t *rbtree, size_t k);
+
+/**
+ * Return the position of a node in sorted order, in O(log n).
+ * @param rbtree: tree the node is in.
+ * @param node: node
+ * @return: number of smaller nodes in the tree.
+ */
+size_t ramfs_rbtree_rank(ramfs_rbtree_t *rbtree, ramfs_rbnode_t *node);
+
 /**
  * Returns first (smallest) node in the tree
  * @param rbtree: tree
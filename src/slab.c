@@ -0,0 +1,121 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "slab.h"
+
+
+#define ALIGN sizeof(max_align_t)
+#define ALIGN_UP(x) (((x) + ALIGN - 1) & ~(ALIGN - 1))
+
+/* pages are chained through their first word */
+#define PAGE_HDR_SIZE ALIGN_UP(sizeof(void *))
+
+void ramfs_slab_init(ramfs_slab_t *slab, size_t obj_size)
+{
+    memset(slab, 0, sizeof(*slab));
+
+    if (obj_size < sizeof(void *)) {
+        obj_size = sizeof(void *);
+    }
+    slab->obj_size = ALIGN_UP(obj_size);
+
+    slab->per_page = (CONFIG_RAMFS_SLAB_PAGE_SIZE - PAGE_HDR_SIZE) /
+            slab->obj_size;
+    if (slab->per_page == 0) {
+        slab->per_page = 1;
+    }
+}
+
+#if defined(CONFIG_RAMFS_USE_SLAB)
+static int grow(const ramfs_allocator_t *alloc, ramfs_slab_t *slab)
+{
+    unsigned char *page = ramfs_malloc(alloc,
+            PAGE_HDR_SIZE + slab->obj_size * slab->per_page);
+    if (page == NULL) {
+        return -1;
+    }
+
+    *(void **) page = slab->pages;
+    slab->pages = page;
+    slab->pages_len++;
+
+    unsigned char *obj = page + PAGE_HDR_SIZE;
+    for (size_t i = 0; i < slab->per_page; i++) {
+        *(void **) obj = slab->free_list;
+        slab->free_list = obj;
+        obj += slab->obj_size;
+    }
+
+    return 0;
+}
+
+void *ramfs_slab_alloc(const ramfs_allocator_t *alloc, ramfs_slab_t *slab)
+{
+    if (slab->free_list == NULL && grow(alloc, slab) < 0) {
+        return NULL;
+    }
+
+    void *obj = slab->free_list;
+    slab->free_list = *(void **) obj;
+    slab->in_use++;
+
+    memset(obj, 0, slab->obj_size);
+    return obj;
+}
+
+void ramfs_slab_free(const ramfs_allocator_t *alloc, ramfs_slab_t *slab,
+        void *obj)
+{
+    if (obj == NULL) {
+        return;
+    }
+
+    *(void **) obj = slab->free_list;
+    slab->free_list = obj;
+    slab->in_use--;
+}
+
+void ramfs_slab_destroy(const ramfs_allocator_t *alloc, ramfs_slab_t *slab)
+{
+    void *page = slab->pages;
+
+    while (page != NULL) {
+        void *next = *(void **) page;
+        ramfs_free(alloc, page);
+        page = next;
+    }
+
+    slab->pages = NULL;
+    slab->pages_len = 0;
+    slab->free_list = NULL;
+    slab->in_use = 0;
+}
+#else
+void *ramfs_slab_alloc(const ramfs_allocator_t *alloc, ramfs_slab_t *slab)
+{
+    void *obj = ramfs_zalloc(alloc, slab->obj_size);
+    if (obj != NULL) {
+        slab->in_use++;
+    }
+    return obj;
+}
+
+void ramfs_slab_free(const ramfs_allocator_t *alloc, ramfs_slab_t *slab,
+        void *obj)
+{
+    if (obj != NULL) {
+        ramfs_free(alloc, obj);
+        slab->in_use--;
+    }
+}
+
+void ramfs_slab_destroy(const ramfs_allocator_t *alloc, ramfs_slab_t *slab)
+{
+    slab->in_use = 0;
+}
+#endif
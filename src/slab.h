@@ -0,0 +1,69 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <stddef.h>
+
+#ifdef ESP_PLATFORM
+# include "sdkconfig.h"
+#endif
+
+
+#ifndef CONFIG_RAMFS_SLAB_PAGE_SIZE
+# define CONFIG_RAMFS_SLAB_PAGE_SIZE 1024
+#endif
+
+typedef struct ramfs_allocator_t ramfs_allocator_t;
+
+/**
+ * \brief       Cache of fixed-size objects
+ *
+ * With \a CONFIG_RAMFS_USE_SLAB objects are carved out of pages of
+ * \a CONFIG_RAMFS_SLAB_PAGE_SIZE bytes and recycled through a free list.
+ * Without it every object is allocated and freed individually; the cache then
+ * only keeps count.
+ */
+typedef struct ramfs_slab_t {
+    size_t obj_size; /**< object size rounded up for alignment */
+    size_t per_page; /**< objects per page */
+    void *free_list; /**< free objects */
+    void *pages; /**< list of pages */
+    size_t pages_len; /**< number of pages */
+    size_t in_use; /**< number of objects handed out */
+} ramfs_slab_t;
+
+/**
+ * \brief       Initialize a cache
+ * \param[out]  slab        \a ramfs_slab_t pointer
+ * \param[in]   obj_size    size of each object
+ */
+void ramfs_slab_init(ramfs_slab_t *slab, size_t obj_size);
+
+/**
+ * \brief       Get a zeroed object from a cache
+ * \param[in]   alloc   \a ramfs_allocator_t pointer
+ * \param[in]   slab    \a ramfs_slab_t pointer
+ * \return              object or \a NULL on error
+ */
+void *ramfs_slab_alloc(const ramfs_allocator_t *alloc, ramfs_slab_t *slab);
+
+/**
+ * \brief       Return an object to a cache
+ * \param[in]   alloc   \a ramfs_allocator_t pointer
+ * \param[in]   slab    \a ramfs_slab_t pointer
+ * \param[in]   obj     object, may be \a NULL
+ */
+void ramfs_slab_free(const ramfs_allocator_t *alloc, ramfs_slab_t *slab,
+        void *obj);
+
+/**
+ * \brief       Free all pages of a cache
+ *
+ * Objects still in use become invalid.
+ *
+ * \param[in]   alloc   \a ramfs_allocator_t pointer
+ * \param[in]   slab    \a ramfs_slab_t pointer
+ */
+void ramfs_slab_destroy(const ramfs_allocator_t *alloc, ramfs_slab_t *slab);
@@ -4,11 +4,15 @@
 
 #include "ramfs/ramfs.h"
 #include "ramfs/vfs.h"
+#include "lock.h"
 
 #include "esp_err.h"
 #include "esp_vfs.h"
 
+#include <assert.h>
 #include <dirent.h>
+#include <errno.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -28,11 +32,23 @@ typedef struct {
 } ramfs_vfs_dh_t;
 #endif
 
+/* The descriptor table grows by segments. The first holds max_files
+ * descriptors and every further one as many as all before it, so the table
+ * doubles without moving slots that lookups may be reading unlocked. */
+#define RAMFS_VFS_FD_SEGMENTS 16
+
+typedef struct {
+    ramfs_fh_t *fh; /* NULL while free or being opened */
+    int next_free; /* next descriptor on the free list, -1 at the end */
+} ramfs_vfs_fd_t;
+
 typedef struct {
     ramfs_fs_t *fs;
     char base_path[ESP_VFS_PATH_MAX + 1];
-    size_t fh_len;
-    ramfs_fh_t *fh[];
+    size_t fd_base; /* descriptors in the first segment */
+    ramfs_vfs_fd_t *fd[RAMFS_VFS_FD_SEGMENTS];
+    int free_fd; /* head of the free list, -1 if empty */
+    ramfs_mutex_t lock; /* segments and the free list */
 } ramfs_vfs_t;
 
 static ramfs_vfs_t *s_ramfs_vfs[CONFIG_RAMFS_MAX_PARTITIONS];
@@ -50,64 +66,242 @@ static esp_err_t ramfs_get_empty(int *index)
     return ESP_ERR_NOT_FOUND;
 }
 
+/* The VFS hands over paths below the base path with their leading slash,
+ * which is all that is left of the mount point itself. */
+static ramfs_entry_t *get_entry(ramfs_vfs_t *vfs, const char *path)
+{
+    if (path[0] == '\0' || strcmp(path, "/") == 0) {
+        return ramfs_get_parent(vfs->fs, "/");
+    }
+
+    return ramfs_get_entry(vfs->fs, path);
+}
+
+static void fill_stat(ramfs_vfs_t *vfs, const ramfs_entry_t *entry,
+        struct stat *st)
+{
+    ramfs_stat_t rst;
+
+    ramfs_stat(vfs->fs, entry, &rst);
+    memset(st, 0, sizeof(*st));
+    st->st_mode = S_IRWXU | S_IRWXG | S_IRWXO;
+    st->st_size = rst.size;
+    if (rst.type == RAMFS_ENTRY_TYPE_DIR) {
+        st->st_mode |= S_IFDIR;
+    } else if (rst.type == RAMFS_ENTRY_TYPE_FILE) {
+        st->st_mode |= S_IFREG;
+    }
+}
+
+static ramfs_vfs_fd_t *fd_slot(ramfs_vfs_t *vfs, int fd)
+{
+    if (fd < 0) {
+        return NULL;
+    }
+
+    size_t index = fd / vfs->fd_base;
+    size_t seg = index == 0 ? 0 : sizeof(unsigned long) * 8 -
+            __builtin_clzl(index);
+    if (seg >= RAMFS_VFS_FD_SEGMENTS) {
+        return NULL;
+    }
+
+    ramfs_vfs_fd_t *slots = __atomic_load_n(&vfs->fd[seg], __ATOMIC_ACQUIRE);
+    if (slots == NULL) {
+        return NULL;
+    }
+
+    size_t start = seg == 0 ? 0 : vfs->fd_base << (seg - 1);
+    return &slots[fd - start];
+}
+
+static ramfs_fh_t *fd_get(ramfs_vfs_t *vfs, int fd)
+{
+    ramfs_vfs_fd_t *slot = fd_slot(vfs, fd);
+    if (slot == NULL) {
+        return NULL;
+    }
+
+    return __atomic_load_n(&slot->fh, __ATOMIC_ACQUIRE);
+}
+
+/* adds a segment and puts its descriptors on the free list, with the lock
+ * held */
+static int fd_grow(ramfs_vfs_t *vfs)
+{
+    size_t seg = 0;
+    while (seg < RAMFS_VFS_FD_SEGMENTS && vfs->fd[seg] != NULL) {
+        seg++;
+    }
+    if (seg >= RAMFS_VFS_FD_SEGMENTS) {
+        return -1;
+    }
+
+    size_t start = seg == 0 ? 0 : vfs->fd_base << (seg - 1);
+    size_t len = seg == 0 ? vfs->fd_base : start;
+    if (start + len > INT_MAX) {
+        return -1;
+    }
+
+    ramfs_vfs_fd_t *slots = calloc(len, sizeof(*slots));
+    if (slots == NULL) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        slots[i].next_free = i + 1 < len ? start + i + 1 : vfs->free_fd;
+    }
+    vfs->free_fd = start;
+    __atomic_store_n(&vfs->fd[seg], slots, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/* takes a descriptor off the free list, it stays unusable until published
+ * with fd_publish() */
+static int fd_alloc(ramfs_vfs_t *vfs)
+{
+    ramfs_mutex_lock(&vfs->lock);
+    if (vfs->free_fd < 0 && fd_grow(vfs) < 0) {
+        ramfs_mutex_unlock(&vfs->lock);
+        errno = ENFILE;
+        return -1;
+    }
+
+    int fd = vfs->free_fd;
+    vfs->free_fd = fd_slot(vfs, fd)->next_free;
+    ramfs_mutex_unlock(&vfs->lock);
+    return fd;
+}
+
+static void fd_publish(ramfs_vfs_t *vfs, int fd, ramfs_fh_t *fh)
+{
+    __atomic_store_n(&fd_slot(vfs, fd)->fh, fh, __ATOMIC_RELEASE);
+}
+
+/* puts a descriptor back on the free list and returns the handle it had */
+static ramfs_fh_t *fd_free(ramfs_vfs_t *vfs, int fd)
+{
+    ramfs_vfs_fd_t *slot = fd_slot(vfs, fd);
+    if (slot == NULL) {
+        return NULL;
+    }
+
+    ramfs_mutex_lock(&vfs->lock);
+    ramfs_fh_t *fh = slot->fh;
+    if (fh != NULL) {
+        slot->fh = NULL;
+        slot->next_free = vfs->free_fd;
+        vfs->free_fd = fd;
+    }
+    ramfs_mutex_unlock(&vfs->lock);
+    return fh;
+}
+
+/* returns a descriptor from fd_alloc() that was never published */
+static void fd_release(ramfs_vfs_t *vfs, int fd)
+{
+    ramfs_mutex_lock(&vfs->lock);
+    fd_slot(vfs, fd)->next_free = vfs->free_fd;
+    vfs->free_fd = fd;
+    ramfs_mutex_unlock(&vfs->lock);
+}
+
 static ssize_t ramfs_vfs_write(void *ctx, int fd, const void *data, size_t size)
 {
     ramfs_vfs_t *vfs = (ramfs_vfs_t *) ctx;
 
-    if (fd < 0 || fd >= vfs->fh_len || vfs->fh[fd] == NULL) {
+    ramfs_fh_t *fh = fd_get(vfs, fd);
+    if (fh == NULL) {
+        errno = EBADF;
         return -1;
     }
 
-    return ramfs_write(vfs->fh[fd], data, size);
+    return ramfs_write(fh, data, size);
 }
 
 static off_t ramfs_vfs_lseek(void *ctx, int fd, off_t offset, int mode)
 {
     ramfs_vfs_t *vfs = (ramfs_vfs_t *) ctx;
 
-    if (fd < 0 || fd >= vfs->fh_len || vfs->fh[fd] == NULL) {
+    ramfs_fh_t *fh = fd_get(vfs, fd);
+    if (fh == NULL) {
+        errno = EBADF;
         return -1;
     }
 
-    return ramfs_seek(vfs->fh[fd], offset, mode);
+    return ramfs_seek(fh, offset, mode);
 }
 
 static ssize_t ramfs_vfs_read(void *ctx, int fd, void *data, size_t size)
 {
     ramfs_vfs_t *vfs = (ramfs_vfs_t *) ctx;
 
-    if (fd < 0 || fd >= vfs->fh_len || vfs->fh[fd] == NULL) {
+    ramfs_fh_t *fh = fd_get(vfs, fd);
+    if (fh == NULL) {
+        errno = EBADF;
         return -1;
     }
 
-    return ramfs_read(vfs->fh[fd], data, size);
+    return ramfs_read(fh, data, size);
 }
 
-static int ramfs_vfs_open(void *ctx, const char *path, int flags, int mode)
+static ssize_t ramfs_vfs_pread(void *ctx, int fd, void *dst, size_t size,
+        off_t offset)
 {
     ramfs_vfs_t *vfs = (ramfs_vfs_t *) ctx;
 
-    int fd;
-    for (fd = 0; fd < vfs->fh_len; fd++) {
-        if (vfs->fh[fd] == NULL) {
-            break;
-        }
+    ramfs_fh_t *fh = fd_get(vfs, fd);
+    if (fh == NULL) {
+        errno = EBADF;
+        return -1;
     }
-    if (fd >= vfs->fh_len) {
+
+    return ramfs_pread(fh, dst, size, offset);
+}
+
+static ssize_t ramfs_vfs_pwrite(void *ctx, int fd, const void *src,
+        size_t size, off_t offset)
+{
+    ramfs_vfs_t *vfs = (ramfs_vfs_t *) ctx;
+
+    ramfs_fh_t *fh = fd_get(vfs, fd);
+    if (fh == NULL) {
+        errno = EBADF;
         return -1;
     }
 
-    ramfs_entry_t *entry = ramfs_get_entry(vfs->fs, path);
+    return ramfs_pwrite(fh, src, size, offset);
+}
+
+static int ramfs_vfs_open(void *ctx, const char *path, int flags, int mode)
+{
+    ramfs_vfs_t *vfs = (ramfs_vfs_t *) ctx;
+
+    int fd = fd_alloc(vfs);
+    if (fd < 0) {
+        return -1;
+    }
 
-    if (entry == NULL && flags & (O_CREAT | O_TRUNC)) {
+    ramfs_entry_t *entry = get_entry(vfs, path);
+    if (entry == NULL && errno == ENOENT && flags & O_CREAT) {
         entry = ramfs_create(vfs->fs, path, flags);
+    } else if (entry != NULL && (flags & (O_CREAT | O_EXCL)) ==
+            (O_CREAT | O_EXCL)) {
+        errno = EEXIST;
+        entry = NULL;
     }
 
-    if (entry == NULL) {
+    ramfs_fh_t *fh = NULL;
+    if (entry != NULL) {
+        fh = ramfs_open(vfs->fs, entry, flags);
+    }
+
+    if (fh == NULL) {
+        fd_release(vfs, fd);
         return -1;
     }
 
-    vfs->fh[fd] = ramfs_open(vfs->fs, entry, flags);
+    fd_publish(vfs, fd, fh);
     return fd;
 }
 
@@ -115,33 +309,27 @@ static int ramfs_vfs_close(void *ctx, int fd)
 {
     ramfs_vfs_t *vfs = (ramfs_vfs_t *) ctx;
 
-    if (fd < 0 || fd >= vfs->fh_len || vfs->fh[fd] == NULL) {
+    ramfs_fh_t *fh = fd_free(vfs, fd);
+    if (fh == NULL) {
+        errno = EBADF;
         return -1;
     }
 
-    ramfs_close(vfs->fh[fd]);
-    vfs->fh[fd] = NULL;
+    ramfs_close(fh);
     return 0;
 }
 
 static int ramfs_vfs_fstat(void *ctx, int fd, struct stat *st)
 {
     ramfs_vfs_t *vfs = (ramfs_vfs_t *) ctx;
-    ramfs_stat_t rst;
 
-    if (fd < 0 || fd >= vfs->fh_len || vfs->fh[fd] == NULL) {
+    ramfs_fh_t *fh = fd_get(vfs, fd);
+    if (fh == NULL) {
+        errno = EBADF;
         return -1;
     }
 
-    ramfs_stat(vfs->fs, vfs->fh[fd]->entry, &rst);
-    memset(st, 0, sizeof(*st));
-    st->st_mode = S_IRWXG | S_IRWXG | S_IRWXO;
-    st->st_size = rst.size;
-    if (st->st_mode == RAMFS_ENTRY_TYPE_DIR) {
-        st->st_mode |= S_IFDIR;
-    } else if (st->st_mode == RAMFS_ENTRY_TYPE_FILE) {
-        st->st_mode |= S_IFREG;
-    }
+    fill_stat(vfs, fh->entry, st);
     return 0;
 }
 
@@ -149,22 +337,13 @@ static int ramfs_vfs_fstat(void *ctx, int fd, struct stat *st)
 static int ramfs_vfs_stat(void *ctx, const char *path, struct stat *st)
 {
     ramfs_vfs_t *vfs = (ramfs_vfs_t *) ctx;
-    ramfs_stat_t rst;
 
-    const ramfs_entry_t *entry = ramfs_get_entry(vfs->fs, path);
+    const ramfs_entry_t *entry = get_entry(vfs, path);
     if (entry == NULL) {
         return -1;
     }
 
-    ramfs_stat(vfs->fs, entry, &rst);
-    memset(st, 0, sizeof(*st));
-    st->st_mode = S_IRWXG | S_IRWXG | S_IRWXO;
-    st->st_size = rst.size;
-    if (st->st_mode == RAMFS_ENTRY_TYPE_DIR) {
-        st->st_mode |= S_IFDIR;
-    } else if (st->st_mode == RAMFS_ENTRY_TYPE_FILE) {
-        st->st_mode |= S_IFREG;
-    }
+    fill_stat(vfs, entry, st);
     return 0;
 }
 
@@ -190,14 +369,22 @@ static int ramfs_vfs_rename(void *ctx, const char *src, const char *dst)
 static DIR *ramfs_vfs_opendir(void *ctx, const char *path)
 {
     ramfs_vfs_t *vfs = (ramfs_vfs_t *) ctx;
-    ramfs_vfs_dh_t *dh = malloc(sizeof(*dh));
 
-    const ramfs_entry_t *entry = ramfs_get_entry(vfs->fs, path);
+    const ramfs_entry_t *entry = get_entry(vfs, path);
     if (entry == NULL) {
         return NULL;
     }
 
+    ramfs_vfs_dh_t *dh = malloc(sizeof(*dh));
+    if (dh == NULL) {
+        return NULL;
+    }
+
     dh->dh = ramfs_opendir(vfs->fs, entry);
+    if (dh->dh == NULL) {
+        free(dh);
+        return NULL;
+    }
     return (DIR *) dh;
 }
 
@@ -228,8 +415,13 @@ static int ramfs_vfs_readdir_r(void *ctx, DIR *pdir, struct dirent *ent,
     }
 
     ent->d_ino = ramfs_telldir(dh->dh);
-    const char *name = ramfs_get_name(entry);
-    strlcpy(ent->d_name, name, sizeof(ent->d_name));
+    size_t len;
+    const char *name = ramfs_get_name_ref(entry, &len);
+    if (len > sizeof(ent->d_name) - 1) {
+        len = sizeof(ent->d_name) - 1;
+    }
+    memcpy(ent->d_name, name, len);
+    ent->d_name[len] = '\0';
     ent->d_type = DT_UNKNOWN;
     if (ramfs_is_dir(entry)) {
         ent->d_type = DT_DIR;
@@ -258,7 +450,7 @@ static int ramfs_vfs_mkdir(void *ctx, const char *path, mode_t mode)
 {
     ramfs_vfs_t *vfs = (ramfs_vfs_t *) ctx;
 
-    return ramfs_mkdir(vfs->fs, path) != NULL;
+    return ramfs_mkdir(vfs->fs, path) == NULL ? -1 : 0;
 }
 
 static int ramfs_vfs_rmdir(void *ctx, const char *path)
@@ -278,7 +470,7 @@ static int ramfs_vfs_closedir(void *ctx, DIR *pdir)
     ramfs_vfs_dh_t *dh = (ramfs_vfs_dh_t *) pdir;
 
     ramfs_closedir(dh->dh);
-    dh->dh = NULL;
+    free(dh);
     return 0;
 }
 
@@ -286,7 +478,7 @@ static int ramfs_vfs_access(void *ctx, const char *path, int amode)
 {
     ramfs_vfs_t *vfs = (ramfs_vfs_t *) ctx;
 
-    const ramfs_entry_t *entry = ramfs_get_entry(vfs->fs, path);
+    const ramfs_entry_t *entry = get_entry(vfs, path);
     if (entry == NULL) {
         return -1;
     }
@@ -310,11 +502,13 @@ static int ramfs_vfs_ftruncate(void *ctx, int fd, off_t length)
 {
     ramfs_vfs_t *vfs = (ramfs_vfs_t *) ctx;
 
-    if (fd < 0 || fd >= vfs->fh_len || vfs->fh[fd] == NULL) {
+    ramfs_fh_t *fh = fd_get(vfs, fd);
+    if (fh == NULL) {
+        errno = EBADF;
         return -1;
     }
 
-    ramfs_entry_t *entry = vfs->fh[fd]->entry;
+    ramfs_entry_t *entry = fh->entry;
 
     return ramfs_truncate(vfs->fs, entry, length);
 }
@@ -331,6 +525,8 @@ esp_err_t ramfs_vfs_register(const ramfs_vfs_conf_t *conf)
         .write_p = &ramfs_vfs_write,
         .lseek_p = &ramfs_vfs_lseek,
         .read_p = &ramfs_vfs_read,
+        .pread_p = &ramfs_vfs_pread,
+        .pwrite_p = &ramfs_vfs_pwrite,
         .open_p = &ramfs_vfs_open,
         .close_p = &ramfs_vfs_close,
         .fstat_p = &ramfs_vfs_fstat,
@@ -357,18 +553,34 @@ esp_err_t ramfs_vfs_register(const ramfs_vfs_conf_t *conf)
         return ESP_ERR_INVALID_STATE;
     }
 
-    ramfs_vfs_t *vfs = calloc(1, sizeof(ramfs_vfs_t) +
-            (sizeof(ramfs_fh_t) * conf->max_files));
+    size_t len = strlen(conf->base_path);
+    if (len > ESP_VFS_PATH_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    ramfs_vfs_t *vfs = calloc(1, sizeof(ramfs_vfs_t));
     if (vfs == NULL) {
         return ESP_ERR_NO_MEM;
     }
 
     vfs->fs = conf->fs;
-    strlcpy(vfs->base_path, conf->base_path, sizeof(*vfs->base_path));
-    vfs->fh_len = conf->max_files;
+    memcpy(vfs->base_path, conf->base_path, len + 1);
+    vfs->fd_base = conf->max_files > 0 ? conf->max_files : 1;
+    vfs->free_fd = -1;
+    if (ramfs_mutex_init(&vfs->lock) < 0) {
+        free(vfs);
+        return ESP_ERR_NO_MEM;
+    }
+    if (fd_grow(vfs) < 0) {
+        ramfs_mutex_destroy(&vfs->lock);
+        free(vfs);
+        return ESP_ERR_NO_MEM;
+    }
 
     esp_err_t err = esp_vfs_register(vfs->base_path, &funcs, vfs);
     if (err != ESP_OK) {
+        free(vfs->fd[0]);
+        ramfs_mutex_destroy(&vfs->lock);
         free(vfs);
         return err;
     }
@@ -376,3 +588,44 @@ esp_err_t ramfs_vfs_register(const ramfs_vfs_conf_t *conf)
     s_ramfs_vfs[index] = vfs;
     return ESP_OK;
 }
+
+esp_err_t ramfs_vfs_unregister(const char *base_path)
+{
+    assert(base_path != NULL);
+
+    int index;
+    for (index = 0; index < CONFIG_RAMFS_MAX_PARTITIONS; index++) {
+        if (s_ramfs_vfs[index] != NULL &&
+                strcmp(s_ramfs_vfs[index]->base_path, base_path) == 0) {
+            break;
+        }
+    }
+    if (index >= CONFIG_RAMFS_MAX_PARTITIONS) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    ramfs_vfs_t *vfs = s_ramfs_vfs[index];
+    esp_err_t err = esp_vfs_unregister(vfs->base_path);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    /* descriptors left open are closed here, the filesystem stays */
+    for (size_t seg = 0; seg < RAMFS_VFS_FD_SEGMENTS; seg++) {
+        if (vfs->fd[seg] == NULL) {
+            break;
+        }
+        size_t len = seg == 0 ? vfs->fd_base : vfs->fd_base << (seg - 1);
+        for (size_t i = 0; i < len; i++) {
+            if (vfs->fd[seg][i].fh != NULL) {
+                ramfs_close(vfs->fd[seg][i].fh);
+            }
+        }
+        free(vfs->fd[seg]);
+    }
+    ramfs_mutex_destroy(&vfs->lock);
+    free(vfs);
+
+    s_ramfs_vfs[index] = NULL;
+    return ESP_OK;
+}
@@ -0,0 +1,118 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "ramfs/ramfs.h"
+
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *op, size_t n, double start)
+{
+    printf("%-8s %6zu entries %10.1f ns/op\n", op, n,
+            (now() - start) * 1e9 / n);
+}
+
+static void bench(size_t n)
+{
+    char path[32];
+    size_t *order;
+    ramfs_fs_t *fs;
+    double start;
+
+    /* visit names in a random order, so sorted containers see no pattern */
+    order = malloc(sizeof(*order) * n);
+    assert(order != NULL);
+    for (size_t i = 0; i < n; i++) {
+        order[i] = i;
+    }
+    srand(n);
+    for (size_t i = n - 1; i > 0; i--) {
+        size_t j = rand() % (i + 1);
+        size_t tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    fs = ramfs_init();
+    assert(fs != NULL);
+    assert(ramfs_mkdir(fs, "dir") != NULL);
+
+    start = now();
+    for (size_t i = 0; i < n; i++) {
+        snprintf(path, sizeof(path), "dir/file%zu", order[i]);
+        assert(ramfs_create(fs, path, 0) != NULL);
+    }
+    report("create", n, start);
+
+    start = now();
+    for (size_t i = 0; i < n; i++) {
+        snprintf(path, sizeof(path), "dir/file%zu", i);
+        assert(ramfs_get_entry(fs, path) != NULL);
+    }
+    report("lookup", n, start);
+
+    ramfs_entry_t *dir = ramfs_get_entry(fs, "dir");
+    start = now();
+    for (size_t i = 0; i < n; i++) {
+        snprintf(path, sizeof(path), "file%zu", i);
+        assert(ramfs_get_entry_at(dir, path) != NULL);
+    }
+    report("lookupat", n, start);
+
+    start = now();
+    for (size_t i = 0; i < n; i++) {
+        snprintf(path, sizeof(path), "dir/miss%zu", i);
+        assert(ramfs_get_entry(fs, path) == NULL);
+    }
+    report("miss", n, start);
+
+    long *locs = malloc(sizeof(*locs) * n);
+    assert(locs != NULL);
+
+    start = now();
+    ramfs_dh_t *dh = ramfs_opendir(fs, dir);
+    assert(dh != NULL);
+    size_t count = 0;
+    do {
+        locs[count] = ramfs_telldir(dh);
+    } while (ramfs_readdir(dh) != NULL && ++count < n);
+    assert(count == n);
+    report("readdir", n, start);
+
+    /* paging through a listing: seek to a location, read one entry */
+    start = now();
+    for (size_t i = 0; i < n; i++) {
+        ramfs_seekdir(dh, locs[order[i]]);
+        assert(ramfs_readdir(dh) != NULL);
+    }
+    report("seekdir", n, start);
+    ramfs_closedir(dh);
+    free(locs);
+
+    start = now();
+    for (size_t i = 0; i < n; i++) {
+        snprintf(path, sizeof(path), "dir/file%zu", order[i]);
+        assert(ramfs_unlink(ramfs_get_entry(fs, path)) == 0);
+    }
+    report("unlink", n, start);
+
+    ramfs_deinit(fs);
+    free(order);
+}
+
+int main(int argc, char *argv[])
+{
+    for (size_t n = 100; n <= 10000; n *= 10) {
+        bench(n);
+    }
+
+    return 0;
+}
@@ -0,0 +1,102 @@
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ramfs/ramfs.h"
+#include "image_util.h"
+
+
+#define DIRS 10
+#define FILE_SIZE 256
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *op, size_t n, double start)
+{
+    printf("%-8s %6zu entries %10.1f ns/op\n", op, n,
+            (now() - start) * 1e9 / n);
+}
+
+/* what booting without an image does: every call replayed */
+static ramfs_fs_t *replay(size_t n, const char *data)
+{
+    char path[32];
+
+    ramfs_fs_t *fs = ramfs_init();
+    assert(fs != NULL);
+    for (size_t d = 0; d < DIRS; d++) {
+        snprintf(path, sizeof(path), "dir%zu", d);
+        assert(ramfs_mkdir(fs, path) != NULL);
+    }
+    for (size_t i = 0; i < n; i++) {
+        snprintf(path, sizeof(path), "dir%zu/file%zu", i % DIRS, i);
+        ramfs_entry_t *entry = ramfs_create(fs, path, 0);
+        assert(entry != NULL);
+        ramfs_fh_t *fh = ramfs_open(fs, entry, O_WRONLY);
+        assert(fh != NULL);
+        assert(ramfs_write(fh, data, FILE_SIZE) == FILE_SIZE);
+        ramfs_close(fh);
+    }
+    return fs;
+}
+
+static void bench(size_t n)
+{
+    char data[FILE_SIZE];
+    mem_t image = {0};
+    double start;
+
+    memset(data, 'x', sizeof(data));
+
+    start = now();
+    ramfs_fs_t *fs = replay(n, data);
+    report("replay", n, start);
+
+    start = now();
+    assert(ramfs_save_image(fs, write_mem, &image) == image.len);
+    report("save", n, start);
+    ramfs_deinit(fs);
+
+    start = now();
+    fs = ramfs_load_image(image.buf, image.len, NULL);
+    assert(fs != NULL);
+    report("load", n, start);
+    assert(ramfs_get_entry(fs, "dir3/file3") != NULL);
+    ramfs_deinit(fs);
+
+    /* in place, directories are read in as they are first looked into */
+    start = now();
+    fs = ramfs_mount_image(image.buf, image.len, NULL);
+    assert(fs != NULL);
+    assert(ramfs_get_entry(fs, "dir3/file3") != NULL);
+    report("mount", n, start);
+
+    start = now();
+    for (size_t i = 0; i < n; i++) {
+        char path[32];
+        snprintf(path, sizeof(path), "dir%zu/file%zu", i % DIRS, i);
+        assert(ramfs_get_entry(fs, path) != NULL);
+    }
+    report("lookup", n, start);
+    ramfs_deinit(fs);
+
+    free(image.buf);
+}
+
+int main(int argc, char *argv[])
+{
+    for (size_t n = 100; n <= 100000; n *= 10) {
+        bench(n);
+    }
+
+    return 0;
+}
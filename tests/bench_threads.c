@@ -0,0 +1,110 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "ramfs/ramfs.h"
+
+
+#define PATHS 256
+#define LOOKUPS 200000
+#define CREATES 5000
+#define MAX_THREADS 8
+
+static ramfs_fs_t *s_fs;
+static char s_paths[PATHS][64];
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* the stat-heavy pattern: resolve a deep path, then stat it */
+static void *reader(void *arg)
+{
+    unsigned int seed = (unsigned int) (size_t) arg;
+    ramfs_stat_t st;
+
+    for (size_t i = 0; i < LOOKUPS; i++) {
+        ramfs_entry_t *entry = ramfs_get_entry(s_fs,
+                s_paths[rand_r(&seed) % PATHS]);
+        assert(entry != NULL);
+        ramfs_stat(s_fs, entry, &st);
+    }
+
+    return NULL;
+}
+
+/* creates that only contend on the lock of their own directory */
+static void *creator(void *arg)
+{
+    ramfs_entry_t *dir = arg;
+    char name[16];
+
+    for (size_t i = 0; i < CREATES; i++) {
+        snprintf(name, sizeof(name), "file%zu", i);
+        assert(ramfs_create_at(dir, name, 0) != NULL);
+    }
+
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    pthread_t threads[MAX_THREADS];
+
+    s_fs = ramfs_init();
+    assert(s_fs != NULL);
+
+    assert(ramfs_mkdir(s_fs, "a") != NULL);
+    assert(ramfs_mkdir(s_fs, "a/b") != NULL);
+    assert(ramfs_mkdir(s_fs, "a/b/c") != NULL);
+    for (int i = 0; i < PATHS; i++) {
+        snprintf(s_paths[i], sizeof(s_paths[i]), "a/b/c/file%d", i);
+        assert(ramfs_create(s_fs, s_paths[i], 0) != NULL);
+    }
+
+    for (size_t n = 1; n <= MAX_THREADS; n *= 2) {
+        double start = now();
+        for (size_t i = 0; i < n; i++) {
+            assert(pthread_create(&threads[i], NULL, reader,
+                    (void *) (i + 1)) == 0);
+        }
+        for (size_t i = 0; i < n; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        printf("lookup   %zu threads %10.0f ops/s\n", n,
+                n * LOOKUPS / (now() - start));
+    }
+
+    for (size_t n = 1; n <= MAX_THREADS; n *= 2) {
+        ramfs_entry_t *dirs[MAX_THREADS];
+        char path[32];
+
+        for (size_t i = 0; i < n; i++) {
+            snprintf(path, sizeof(path), "create%zu", i);
+            dirs[i] = ramfs_mkdir(s_fs, path);
+            assert(dirs[i] != NULL);
+        }
+        double start = now();
+        for (size_t i = 0; i < n; i++) {
+            assert(pthread_create(&threads[i], NULL, creator, dirs[i]) == 0);
+        }
+        for (size_t i = 0; i < n; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        printf("create   %zu threads %10.0f ops/s\n", n,
+                n * CREATES / (now() - start));
+        for (size_t i = 0; i < n; i++) {
+            ramfs_rmtree(dirs[i]);
+        }
+    }
+
+    ramfs_deinit(s_fs);
+
+    return 0;
+}
@@ -0,0 +1,145 @@
+#include <assert.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ramfs/ramfs.h"
+#include "ramfs/vfs.h"
+#include "vfs_shim.h"
+
+
+#define FILE_SIZE (1024 * 1024)
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *op, size_t n, double start)
+{
+    printf("%-8s %6zu ops %12.1f ns/op\n", op, n, (now() - start) * 1e9 / n);
+}
+
+static void report_rate(const char *op, size_t chunk, double start)
+{
+    printf("%-8s %6zu bytes %10.1f MiB/s\n", op, chunk,
+            FILE_SIZE / (now() - start) / (1024 * 1024));
+}
+
+/* one file written and read back through the VFS in chunks of a size */
+static void bench_io(size_t chunk)
+{
+    char *buf = malloc(chunk);
+    assert(buf != NULL);
+    memset(buf, 'x', chunk);
+
+    int fd = vfs_open("/ramfs/data", O_RDWR | O_CREAT | O_TRUNC, 0666);
+    assert(fd >= 0);
+
+    double start = now();
+    for (size_t done = 0; done < FILE_SIZE; done += chunk) {
+        assert(vfs_write(fd, buf, chunk) == chunk);
+    }
+    report_rate("write", chunk, start);
+
+    assert(vfs_lseek(fd, 0, SEEK_SET) == 0);
+    start = now();
+    for (size_t done = 0; done < FILE_SIZE; done += chunk) {
+        assert(vfs_read(fd, buf, chunk) == chunk);
+    }
+    report_rate("read", chunk, start);
+
+    start = now();
+    for (size_t done = 0; done < FILE_SIZE; done += chunk) {
+        assert(vfs_pread(fd, buf, chunk, done) == chunk);
+    }
+    report_rate("pread", chunk, start);
+
+    assert(vfs_close(fd) == 0);
+    free(buf);
+}
+
+static void bench_files(size_t n)
+{
+    char path[PATH_MAX];
+    struct stat st;
+    double start;
+
+    assert(vfs_mkdir("/ramfs/dir", 0777) == 0);
+
+    start = now();
+    for (size_t i = 0; i < n; i++) {
+        snprintf(path, sizeof(path), "/ramfs/dir/file%zu", i);
+        int fd = vfs_open(path, O_WRONLY | O_CREAT, 0666);
+        assert(fd >= 0);
+        assert(vfs_close(fd) == 0);
+    }
+    report("create", n, start);
+
+    start = now();
+    for (size_t i = 0; i < n; i++) {
+        snprintf(path, sizeof(path), "/ramfs/dir/file%zu", i);
+        int fd = vfs_open(path, O_RDONLY, 0);
+        assert(fd >= 0);
+        assert(vfs_close(fd) == 0);
+    }
+    report("open", n, start);
+
+    start = now();
+    for (size_t i = 0; i < n; i++) {
+        snprintf(path, sizeof(path), "/ramfs/dir/file%zu", i);
+        assert(vfs_stat(path, &st) == 0);
+    }
+    report("stat", n, start);
+
+    start = now();
+    DIR *dir = vfs_opendir("/ramfs/dir");
+    assert(dir != NULL);
+    size_t seen = 0;
+    while (vfs_readdir(dir) != NULL) {
+        seen++;
+    }
+    assert(vfs_closedir(dir) == 0);
+    assert(seen == n);
+    report("readdir", n, start);
+
+    start = now();
+    for (size_t i = 0; i < n; i++) {
+        snprintf(path, sizeof(path), "/ramfs/dir/file%zu", i);
+        assert(vfs_unlink(path) == 0);
+    }
+    report("unlink", n, start);
+
+    assert(vfs_rmdir("/ramfs/dir") == 0);
+}
+
+int main(int argc, char *argv[])
+{
+    ramfs_fs_t *fs = ramfs_init();
+    assert(fs != NULL);
+
+    ramfs_vfs_conf_t conf = {
+        .base_path = "/ramfs",
+        .fs = fs,
+        .max_files = 4,
+    };
+    assert(ramfs_vfs_register(&conf) == ESP_OK);
+
+    for (size_t chunk = 64; chunk <= 16384; chunk *= 4) {
+        bench_io(chunk);
+    }
+    for (size_t n = 100; n <= 10000; n *= 10) {
+        bench_files(n);
+    }
+
+    assert(ramfs_vfs_unregister("/ramfs") == ESP_OK);
+    ramfs_deinit(fs);
+
+    return 0;
+}
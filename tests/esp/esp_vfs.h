@@ -0,0 +1,62 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+/* Host stand-in for the part of the ESP-IDF VFS interface that vfs.c uses,
+ * so it can be built and tested off target. Calls are routed by vfs_shim.h
+ * instead of the C library. */
+
+#include <dirent.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "esp_err.h"
+
+
+#define ESP_VFS_PATH_MAX 15
+#define ESP_VFS_FLAG_CONTEXT_PTR 1
+
+/* Newlib on ESP-IDF defines DIR, and filesystems embed it at the start of
+ * their directory handles. glibc and musl leave it opaque, so it is filled
+ * in with the same layout here. */
+struct __dirstream {
+    uint16_t dd_vfs_idx;
+    uint16_t dd_rsv;
+};
+
+typedef struct {
+    int flags;
+    ssize_t (*write_p)(void *ctx, int fd, const void *data, size_t size);
+    off_t (*lseek_p)(void *ctx, int fd, off_t size, int mode);
+    ssize_t (*read_p)(void *ctx, int fd, void *dst, size_t size);
+    ssize_t (*pread_p)(void *ctx, int fd, void *dst, size_t size,
+            off_t offset);
+    ssize_t (*pwrite_p)(void *ctx, int fd, const void *src, size_t size,
+            off_t offset);
+    int (*open_p)(void *ctx, const char *path, int flags, int mode);
+    int (*close_p)(void *ctx, int fd);
+    int (*fstat_p)(void *ctx, int fd, struct stat *st);
+    int (*stat_p)(void *ctx, const char *path, struct stat *st);
+    int (*unlink_p)(void *ctx, const char *path);
+    int (*rename_p)(void *ctx, const char *src, const char *dst);
+    DIR *(*opendir_p)(void *ctx, const char *name);
+    struct dirent *(*readdir_p)(void *ctx, DIR *pdir);
+    int (*readdir_r_p)(void *ctx, DIR *pdir, struct dirent *entry,
+            struct dirent **out_dirent);
+    long (*telldir_p)(void *ctx, DIR *pdir);
+    void (*seekdir_p)(void *ctx, DIR *pdir, long offset);
+    int (*closedir_p)(void *ctx, DIR *pdir);
+    int (*mkdir_p)(void *ctx, const char *name, mode_t mode);
+    int (*rmdir_p)(void *ctx, const char *name);
+    int (*access_p)(void *ctx, const char *path, int amode);
+    int (*truncate_p)(void *ctx, const char *path, off_t length);
+    int (*ftruncate_p)(void *ctx, int fd, off_t length);
+} esp_vfs_t;
+
+esp_err_t esp_vfs_register(const char *base_path, const esp_vfs_t *vfs,
+        void *ctx);
+
+esp_err_t esp_vfs_unregister(const char *base_path);
@@ -0,0 +1,339 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "esp_vfs.h"
+#include "vfs_shim.h"
+
+
+#define MAX_MOUNTS 8
+
+typedef struct {
+    char base_path[ESP_VFS_PATH_MAX + 1];
+    size_t base_len;
+    esp_vfs_t ops;
+    void *ctx;
+} mount_t;
+
+static mount_t s_mounts[MAX_MOUNTS];
+
+/* A global descriptor is the filesystem's own descriptor with the mount
+ * index in its low bits, so no table is needed to map them back. */
+static int to_global(int index, int fd)
+{
+    return fd < 0 ? fd : fd * MAX_MOUNTS + index;
+}
+
+static mount_t *from_global(int fd, int *local)
+{
+    if (fd < 0 || s_mounts[fd % MAX_MOUNTS].base_len == 0) {
+        errno = EBADF;
+        return NULL;
+    }
+
+    *local = fd / MAX_MOUNTS;
+    return &s_mounts[fd % MAX_MOUNTS];
+}
+
+/* finds the mount for a path and returns the part below its base path */
+static mount_t *route(const char *path, const char **rest)
+{
+    for (int i = 0; i < MAX_MOUNTS; i++) {
+        mount_t *mount = &s_mounts[i];
+        if (mount->base_len != 0 &&
+                strncmp(path, mount->base_path, mount->base_len) == 0 &&
+                (path[mount->base_len] == '/' ||
+                 path[mount->base_len] == '\0')) {
+            *rest = path + mount->base_len;
+            return mount;
+        }
+    }
+
+    errno = ENOENT;
+    return NULL;
+}
+
+esp_err_t esp_vfs_register(const char *base_path, const esp_vfs_t *vfs,
+        void *ctx)
+{
+    size_t len = strlen(base_path);
+    if (len == 0 || len > ESP_VFS_PATH_MAX || base_path[0] != '/' ||
+            base_path[len - 1] == '/') {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!(vfs->flags & ESP_VFS_FLAG_CONTEXT_PTR)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    for (int i = 0; i < MAX_MOUNTS; i++) {
+        mount_t *mount = &s_mounts[i];
+        if (mount->base_len == 0) {
+            memcpy(mount->base_path, base_path, len + 1);
+            mount->base_len = len;
+            mount->ops = *vfs;
+            mount->ctx = ctx;
+            return ESP_OK;
+        }
+    }
+
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t esp_vfs_unregister(const char *base_path)
+{
+    for (int i = 0; i < MAX_MOUNTS; i++) {
+        mount_t *mount = &s_mounts[i];
+        if (mount->base_len != 0 &&
+                strcmp(mount->base_path, base_path) == 0) {
+            memset(mount, 0, sizeof(*mount));
+            return ESP_OK;
+        }
+    }
+
+    return ESP_ERR_INVALID_STATE;
+}
+
+/* calls an op of the mount a path or descriptor was routed to, failing
+ * with ENOSYS for ops the filesystem does not have */
+#define CALL(mount, op, ...) \
+    ((mount)->ops.op == NULL ? (errno = ENOSYS, -1) : \
+            (mount)->ops.op((mount)->ctx, __VA_ARGS__))
+
+int vfs_open(const char *path, int flags, int mode)
+{
+    const char *rest;
+    mount_t *mount = route(path, &rest);
+    if (mount == NULL) {
+        return -1;
+    }
+
+    return to_global(mount - s_mounts, CALL(mount, open_p, rest, flags,
+            mode));
+}
+
+int vfs_close(int fd)
+{
+    int local;
+    mount_t *mount = from_global(fd, &local);
+    if (mount == NULL) {
+        return -1;
+    }
+
+    return CALL(mount, close_p, local);
+}
+
+ssize_t vfs_read(int fd, void *dst, size_t size)
+{
+    int local;
+    mount_t *mount = from_global(fd, &local);
+    if (mount == NULL) {
+        return -1;
+    }
+
+    return CALL(mount, read_p, local, dst, size);
+}
+
+ssize_t vfs_write(int fd, const void *src, size_t size)
+{
+    int local;
+    mount_t *mount = from_global(fd, &local);
+    if (mount == NULL) {
+        return -1;
+    }
+
+    return CALL(mount, write_p, local, src, size);
+}
+
+ssize_t vfs_pread(int fd, void *dst, size_t size, off_t offset)
+{
+    int local;
+    mount_t *mount = from_global(fd, &local);
+    if (mount == NULL) {
+        return -1;
+    }
+
+    return CALL(mount, pread_p, local, dst, size, offset);
+}
+
+ssize_t vfs_pwrite(int fd, const void *src, size_t size, off_t offset)
+{
+    int local;
+    mount_t *mount = from_global(fd, &local);
+    if (mount == NULL) {
+        return -1;
+    }
+
+    return CALL(mount, pwrite_p, local, src, size, offset);
+}
+
+off_t vfs_lseek(int fd, off_t offset, int mode)
+{
+    int local;
+    mount_t *mount = from_global(fd, &local);
+    if (mount == NULL) {
+        return -1;
+    }
+
+    return CALL(mount, lseek_p, local, offset, mode);
+}
+
+int vfs_fstat(int fd, struct stat *st)
+{
+    int local;
+    mount_t *mount = from_global(fd, &local);
+    if (mount == NULL) {
+        return -1;
+    }
+
+    return CALL(mount, fstat_p, local, st);
+}
+
+int vfs_ftruncate(int fd, off_t length)
+{
+    int local;
+    mount_t *mount = from_global(fd, &local);
+    if (mount == NULL) {
+        return -1;
+    }
+
+    return CALL(mount, ftruncate_p, local, length);
+}
+
+int vfs_stat(const char *path, struct stat *st)
+{
+    const char *rest;
+    mount_t *mount = route(path, &rest);
+    if (mount == NULL) {
+        return -1;
+    }
+
+    return CALL(mount, stat_p, rest, st);
+}
+
+int vfs_unlink(const char *path)
+{
+    const char *rest;
+    mount_t *mount = route(path, &rest);
+    if (mount == NULL) {
+        return -1;
+    }
+
+    return CALL(mount, unlink_p, rest);
+}
+
+int vfs_rename(const char *src, const char *dst)
+{
+    const char *src_rest, *dst_rest;
+    mount_t *mount = route(src, &src_rest);
+    if (mount == NULL) {
+        return -1;
+    }
+    if (route(dst, &dst_rest) != mount) {
+        errno = EXDEV;
+        return -1;
+    }
+
+    return CALL(mount, rename_p, src_rest, dst_rest);
+}
+
+int vfs_mkdir(const char *path, mode_t mode)
+{
+    const char *rest;
+    mount_t *mount = route(path, &rest);
+    if (mount == NULL) {
+        return -1;
+    }
+
+    return CALL(mount, mkdir_p, rest, mode);
+}
+
+int vfs_rmdir(const char *path)
+{
+    const char *rest;
+    mount_t *mount = route(path, &rest);
+    if (mount == NULL) {
+        return -1;
+    }
+
+    return CALL(mount, rmdir_p, rest);
+}
+
+int vfs_access(const char *path, int amode)
+{
+    const char *rest;
+    mount_t *mount = route(path, &rest);
+    if (mount == NULL) {
+        return -1;
+    }
+
+    return CALL(mount, access_p, rest, amode);
+}
+
+int vfs_truncate(const char *path, off_t length)
+{
+    const char *rest;
+    mount_t *mount = route(path, &rest);
+    if (mount == NULL) {
+        return -1;
+    }
+
+    return CALL(mount, truncate_p, rest, length);
+}
+
+DIR *vfs_opendir(const char *path)
+{
+    const char *rest;
+    mount_t *mount = route(path, &rest);
+    if (mount == NULL) {
+        return NULL;
+    }
+    if (mount->ops.opendir_p == NULL) {
+        errno = ENOSYS;
+        return NULL;
+    }
+
+    DIR *dir = mount->ops.opendir_p(mount->ctx, rest);
+    if (dir != NULL) {
+        dir->dd_vfs_idx = mount - s_mounts;
+    }
+    return dir;
+}
+
+struct dirent *vfs_readdir(DIR *dir)
+{
+    mount_t *mount = &s_mounts[dir->dd_vfs_idx];
+
+    if (mount->ops.readdir_p == NULL) {
+        errno = ENOSYS;
+        return NULL;
+    }
+
+    return mount->ops.readdir_p(mount->ctx, dir);
+}
+
+long vfs_telldir(DIR *dir)
+{
+    mount_t *mount = &s_mounts[dir->dd_vfs_idx];
+
+    return CALL(mount, telldir_p, dir);
+}
+
+void vfs_seekdir(DIR *dir, long loc)
+{
+    mount_t *mount = &s_mounts[dir->dd_vfs_idx];
+
+    if (mount->ops.seekdir_p != NULL) {
+        mount->ops.seekdir_p(mount->ctx, dir, loc);
+    }
+}
+
+int vfs_closedir(DIR *dir)
+{
+    mount_t *mount = &s_mounts[dir->dd_vfs_idx];
+
+    return CALL(mount, closedir_p, dir);
+}
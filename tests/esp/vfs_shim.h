@@ -0,0 +1,37 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+/* POSIX-like calls routed to the filesystems registered with
+ * esp_vfs_register(), the way newlib routes them on ESP-IDF. Paths must
+ * start with a registered base path. Each call returns -1 with errno set on
+ * error, like its C library counterpart. */
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+
+int vfs_open(const char *path, int flags, int mode);
+int vfs_close(int fd);
+ssize_t vfs_read(int fd, void *dst, size_t size);
+ssize_t vfs_write(int fd, const void *src, size_t size);
+ssize_t vfs_pread(int fd, void *dst, size_t size, off_t offset);
+ssize_t vfs_pwrite(int fd, const void *src, size_t size, off_t offset);
+off_t vfs_lseek(int fd, off_t offset, int mode);
+int vfs_fstat(int fd, struct stat *st);
+int vfs_ftruncate(int fd, off_t length);
+int vfs_stat(const char *path, struct stat *st);
+int vfs_unlink(const char *path);
+int vfs_rename(const char *src, const char *dst);
+int vfs_mkdir(const char *path, mode_t mode);
+int vfs_rmdir(const char *path);
+int vfs_access(const char *path, int amode);
+int vfs_truncate(const char *path, off_t length);
+DIR *vfs_opendir(const char *path);
+struct dirent *vfs_readdir(DIR *dir);
+long vfs_telldir(DIR *dir);
+void vfs_seekdir(DIR *dir, long loc);
+int vfs_closedir(DIR *dir);
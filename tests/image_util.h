@@ -0,0 +1,46 @@
+#pragma once
+
+/* Write callbacks and checks shared by the image, mount, overlay and
+ * checkpoint tests. */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+
+typedef struct mem_t {
+    char *buf;
+    size_t len;
+    size_t cap;
+} mem_t;
+
+/* \a ramfs_image_write_t to a FILE */
+static inline int write_stdio(void *ctx, const void *buf, size_t len)
+{
+    return fwrite(buf, 1, len, ctx) == len ? 0 : -1;
+}
+
+/* \a ramfs_image_write_t to a mem_t, grown to fit */
+static inline int write_mem(void *ctx, const void *buf, size_t len)
+{
+    mem_t *mem = ctx;
+
+    if (mem->len + len > mem->cap) {
+        while (mem->len + len > mem->cap) {
+            mem->cap = mem->cap ? mem->cap * 2 : 4096;
+        }
+        mem->buf = realloc(mem->buf, mem->cap);
+        assert(mem->buf != NULL);
+    }
+    memcpy(mem->buf + mem->len, buf, len);
+    mem->len += len;
+    return 0;
+}
+
+/* p points into the len bytes at map */
+static inline int in_map(const void *p, const char *map, ssize_t len)
+{
+    return (const char *) p >= map && (const char *) p < map + len;
+}
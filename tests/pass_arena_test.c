@@ -0,0 +1,112 @@
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ramfs/ramfs.h"
+
+
+static size_t s_allocs;
+
+static void *counting_malloc(void *ctx, size_t size)
+{
+    s_allocs++;
+    return malloc(size);
+}
+
+static void *counting_realloc(void *ctx, void *ptr, size_t size)
+{
+    if (ptr == NULL) {
+        s_allocs++;
+    }
+    return realloc(ptr, size);
+}
+
+static void counting_free(void *ctx, void *ptr)
+{
+    if (ptr != NULL) {
+        s_allocs--;
+    }
+    free(ptr);
+}
+
+static void populate(ramfs_fs_t *fs)
+{
+    ramfs_entry_t *file;
+    ramfs_fh_t *fh;
+    char path[32];
+
+    assert(ramfs_mkdir(fs, "dir") != NULL);
+    assert(ramfs_mkdir(fs, "dir/sub") != NULL);
+
+    for (int i = 0; i < 20; i++) {
+        snprintf(path, sizeof(path), "dir/sub/file%d", i);
+        file = ramfs_create(fs, path, 0);
+        assert(file != NULL);
+        fh = ramfs_open(fs, file, O_WRONLY);
+        assert(fh != NULL);
+        for (int j = 0; j < 100; j++) {
+            assert(ramfs_write(fh, path, strlen(path)) == strlen(path));
+        }
+        ramfs_close(fh);
+    }
+
+    file = ramfs_get_entry(fs, "dir/sub/file3");
+    assert(file != NULL);
+    assert(ramfs_unlink(file) == 0);
+}
+
+int main(int argc, char *argv[])
+{
+    static char region[64 * 1024];
+    ramfs_allocator_t alloc;
+    ramfs_config_t config = {
+        .allocator = &alloc,
+    };
+    ramfs_fs_t *fs;
+
+    /* custom allocator sees every allocation and every free */
+    alloc = (ramfs_allocator_t) {
+        .malloc = counting_malloc,
+        .realloc = counting_realloc,
+        .free = counting_free,
+    };
+    fs = ramfs_init_ex(&config);
+    assert(fs != NULL);
+    populate(fs);
+    assert(s_allocs > 0);
+    ramfs_deinit(fs);
+    assert(s_allocs == 0);
+
+    /* arena over a fixed region */
+    assert(ramfs_arena_init(&alloc, region, sizeof(region)) == 0);
+    fs = ramfs_init_ex(&config);
+    assert(fs != NULL);
+    populate(fs);
+    ramfs_deinit(fs);
+
+    /* a full arena fails allocations instead of growing */
+    assert(ramfs_arena_init(&alloc, region, 4096) == 0);
+    fs = ramfs_init_ex(&config);
+    assert(fs != NULL);
+    assert(ramfs_mkdir(fs, "dir") != NULL);
+    ramfs_entry_t *file = ramfs_create(fs, "dir/file", 0);
+    assert(file != NULL);
+    ramfs_fh_t *fh = ramfs_open(fs, file, O_WRONLY);
+    assert(fh != NULL);
+    char buf[8192] = {0};
+    assert(ramfs_write(fh, buf, sizeof(buf)) < (ssize_t) sizeof(buf));
+    ramfs_close(fh);
+    ramfs_deinit(fs);
+
+    /* arena growing in chunks from the heap */
+    assert(ramfs_arena_init(&alloc, NULL, 4096) == 0);
+    fs = ramfs_init_ex(&config);
+    assert(fs != NULL);
+    populate(fs);
+    ramfs_deinit(fs);
+
+    exit(EXIT_SUCCESS);
+    return 0;
+}
@@ -0,0 +1,83 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ramfs/ramfs.h"
+
+
+int main(int argc, char *argv[])
+{
+    ramfs_config_t config = {
+        .dcache_size = 16,
+    };
+    ramfs_fs_t *fs;
+    ramfs_entry_t *root, *dir, *sub, *file, *entry;
+
+    fs = ramfs_init_ex(&config);
+    assert(fs != NULL);
+    root = ramfs_get_parent(fs, "/");
+    assert(root != NULL);
+
+    dir = ramfs_mkdir_at(root, "dir");
+    assert(dir != NULL);
+    assert(ramfs_get_entry(fs, "dir") == dir);
+
+    /* names and relative paths resolve from the directory */
+    sub = ramfs_mkdir_at(dir, "sub");
+    assert(sub != NULL);
+    assert(ramfs_get_entry(fs, "dir/sub") == sub);
+    file = ramfs_create_at(dir, "sub/file", 0);
+    assert(file != NULL);
+    assert(ramfs_get_entry_at(sub, "file") == file);
+    assert(ramfs_get_entry_at(dir, "sub/file") == file);
+    assert(ramfs_get_entry(fs, "dir/sub/file") == file);
+    assert(ramfs_create_at(sub, "file", 0) == NULL);
+    assert(errno == EEXIST);
+    assert(ramfs_get_entry_at(sub, "missing") == NULL);
+    assert(errno == ENOENT);
+
+    /* absolute paths start at the root */
+    assert(ramfs_get_entry_at(sub, "/dir/sub/file") == file);
+    assert(ramfs_mkdir_at(sub, "/top") != NULL);
+    assert(ramfs_get_entry_at(root, "top") != NULL);
+
+    /* a file is not a directory to resolve from */
+    assert(ramfs_get_entry_at(file, "x") == NULL);
+    assert(errno == ENOTDIR);
+    assert(ramfs_create_at(file, "x", 0) == NULL);
+    assert(errno == ENOTDIR);
+    assert(ramfs_mkdir_at(file, "x") == NULL);
+    assert(errno == ENOTDIR);
+
+    /* renames between directories keep the dentry cache coherent */
+    assert(ramfs_get_entry(fs, "dir/moved") == NULL);
+    assert(ramfs_rename_at(sub, "file", dir, "moved") == 0);
+    assert(ramfs_get_entry(fs, "dir/sub/file") == NULL);
+    assert(ramfs_get_entry(fs, "dir/moved") == file);
+    assert(ramfs_get_entry_at(dir, "moved") == file);
+    assert(ramfs_rename_at(dir, "moved", dir, "moved") == 0);
+    assert(ramfs_rename_at(dir, "nothing", sub, "file") == -1);
+
+    entry = ramfs_create_at(sub, "other", 0);
+    assert(entry != NULL);
+    assert(ramfs_rename_at(dir, "moved", sub, "other") == -1);
+    assert(errno == EEXIST);
+
+    /* a directory cannot move below itself */
+    assert(ramfs_rename_at(root, "dir", sub, "loop") == -1);
+    assert(errno == EINVAL);
+    assert(ramfs_rename_at(root, "dir", dir, "loop") == -1);
+    assert(errno == EINVAL);
+
+    assert(ramfs_unlink_at(dir, "moved") == 0);
+    assert(ramfs_get_entry(fs, "dir/moved") == NULL);
+    assert(ramfs_unlink_at(dir, "moved") == -1);
+    assert(errno == ENOENT);
+    assert(ramfs_unlink_at(dir, "sub/other") == 0);
+    assert(ramfs_get_entry_at(sub, "other") == NULL);
+
+    ramfs_deinit(fs);
+
+    return 0;
+}
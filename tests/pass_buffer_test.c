@@ -0,0 +1,128 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ramfs/ramfs.h"
+
+
+#define X10 "0123456789"
+#define X100 X10 X10 X10 X10 X10 X10 X10 X10 X10 X10
+
+/* in read-only memory, so writing to it would crash */
+static const char asset[] = X100 X100 X100 X100 X100 X100 X100 X100 X100 X100
+        X100 X100 X100;
+
+int main(int argc, char *argv[])
+{
+    ramfs_fs_t *fs;
+    ramfs_entry_t *file;
+    ramfs_fh_t *fh;
+    ramfs_stat_t st;
+    ramfs_span_t *spans;
+    char buf[2048];
+    char *owned;
+
+    fs = ramfs_init();
+    assert(fs != NULL);
+    assert(ramfs_mkdir(fs, "dir") != NULL);
+
+    /* referenced memory is read in place */
+    file = ramfs_create_from_buffer(fs, "dir/asset", asset, 1300,
+            RAMFS_BUFFER_REF);
+    assert(file != NULL);
+    ramfs_stat(fs, file, &st);
+    assert(st.size == 1300);
+    fh = ramfs_open(fs, file, O_RDWR);
+    assert(fh != NULL);
+    assert(ramfs_read_view(fh, 0, 1300, &spans) == 3);
+    assert(spans[0].buf == asset);
+    ramfs_release_view(fh, spans);
+    assert(ramfs_read(fh, buf, sizeof(buf)) == 1300);
+    assert(memcmp(buf, asset, 1300) == 0);
+
+    /* writes copy what they touch and leave the rest referenced */
+    assert(ramfs_pwrite(fh, "abc", 3, 600) == 3);
+    assert(memcmp(asset + 600, "012", 3) == 0);
+    assert(ramfs_pread(fh, buf, 6, 598) == 6);
+    assert(memcmp(buf, "89abc3", 6) == 0);
+    assert(ramfs_read_view(fh, 0, 1300, &spans) == 3);
+    assert(spans[0].buf == asset);
+    assert(spans[1].buf != asset + 512);
+    ramfs_release_view(fh, spans);
+
+    /* growing past the partial end of the buffer */
+    assert(ramfs_pwrite(fh, "end", 3, 2000) == 3);
+    assert(ramfs_pread(fh, buf, 703, 1300) == 703);
+    for (int i = 0; i < 700; i++) {
+        assert(buf[i] == 0);
+    }
+    assert(memcmp(buf + 700, "end", 3) == 0);
+    assert(ramfs_pread(fh, buf, 276, 1024) == 276);
+    assert(memcmp(buf, asset + 1024, 276) == 0);
+
+    /* shrinking into referenced memory */
+    assert(ramfs_truncate(fs, file, 100) == 0);
+    assert(ramfs_truncate(fs, file, 200) == 0);
+    assert(ramfs_pread(fh, buf, sizeof(buf), 0) == 200);
+    assert(memcmp(buf, asset, 100) == 0);
+    for (int i = 100; i < 200; i++) {
+        assert(buf[i] == 0);
+    }
+    assert(memcmp(asset, X100, 100) == 0);
+    ramfs_close(fh);
+
+    /* removing referenced files leaves the memory alone */
+    assert(ramfs_create_from_buffer(fs, "dir/other", asset, 512,
+            RAMFS_BUFFER_REF) != NULL);
+    file = ramfs_create_from_buffer(fs, "asset", asset, sizeof(asset),
+            RAMFS_BUFFER_REF);
+    assert(file != NULL);
+    assert(ramfs_unlink(file) == 0);
+    ramfs_rmtree(ramfs_get_entry(fs, "dir"));
+
+    /* owned buffers are written in place and freed with the file */
+    owned = malloc(1100);
+    assert(owned != NULL);
+    memset(owned, 'o', 1100);
+    file = ramfs_create_from_buffer(fs, "owned", owned, 1100,
+            RAMFS_BUFFER_OWN);
+    assert(file != NULL);
+    fh = ramfs_open(fs, file, O_RDWR);
+    assert(fh != NULL);
+    assert(ramfs_pwrite(fh, "in place", 8, 10) == 8);
+    assert(memcmp(owned + 10, "in place", 8) == 0);
+    assert(ramfs_pwrite(fh, "copied", 6, 1090) == 6);
+    assert(memcmp(owned + 1090, "oooooo", 6) == 0);
+    ramfs_stat(fs, file, &st);
+    assert(st.size == 1100);
+
+    /* a truncate to nothing keeps it while a view still points into it */
+    assert(ramfs_read_view(fh, 0, 10, &spans) == 1);
+    assert(spans[0].buf == owned);
+    assert(ramfs_truncate(fs, file, 0) == 0);
+    assert(memcmp(spans[0].buf, "oooooooooo", 10) == 0);
+    ramfs_release_view(fh, spans);
+    ramfs_close(fh);
+    assert(ramfs_unlink(file) == 0);
+
+    /* on failure an owned buffer stays the caller's */
+    owned = malloc(16);
+    assert(owned != NULL);
+    file = ramfs_create_from_buffer(fs, "taken", owned, 16, RAMFS_BUFFER_OWN);
+    assert(file != NULL);
+    owned = malloc(16);
+    assert(owned != NULL);
+    assert(ramfs_create_from_buffer(fs, "taken", owned, 16,
+            RAMFS_BUFFER_OWN) == NULL);
+    assert(errno == EEXIST);
+    free(owned);
+
+    ramfs_deinit(fs);
+    fs = NULL;
+
+    exit(EXIT_SUCCESS);
+    return 0;
+}
@@ -0,0 +1,199 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ramfs/ramfs.h"
+#include "image_util.h"
+
+
+#define EXTENT 512
+
+/* takes a checkpoint of fs and applies it to the replica */
+static size_t ship(ramfs_fs_t *fs, ramfs_fs_t *replica)
+{
+    mem_t mem = {0};
+
+    ssize_t len = ramfs_checkpoint(fs, write_mem, &mem);
+    assert(len > 0 && (size_t) len == mem.len);
+    assert(ramfs_apply_checkpoint(replica, mem.buf, mem.len) == 0);
+    free(mem.buf);
+    return len;
+}
+
+static void write_file(ramfs_fs_t *fs, const char *path, const char *data,
+        size_t len, off_t offset)
+{
+    ramfs_entry_t *entry = ramfs_get_entry(fs, path);
+    if (entry == NULL) {
+        entry = ramfs_create(fs, path, 0);
+        assert(entry != NULL);
+    }
+    ramfs_fh_t *fh = ramfs_open(fs, entry, O_WRONLY);
+    assert(fh != NULL);
+    assert(ramfs_pwrite(fh, data, len, offset) == len);
+    ramfs_close(fh);
+}
+
+/* a and b hold the same tree */
+static void check_same(ramfs_fs_t *fs_a, ramfs_entry_t *a, ramfs_fs_t *fs_b,
+        ramfs_entry_t *b)
+{
+    ramfs_stat_t st_a, st_b;
+
+    ramfs_stat(fs_a, a, &st_a);
+    ramfs_stat(fs_b, b, &st_b);
+    assert(st_a.type == st_b.type);
+    assert(st_a.size == st_b.size);
+
+    if (st_a.type == RAMFS_ENTRY_TYPE_FILE) {
+        char *buf_a = malloc(st_a.size + 1), *buf_b = malloc(st_b.size + 1);
+        assert(buf_a != NULL && buf_b != NULL);
+        ramfs_fh_t *fh_a = ramfs_open(fs_a, a, O_RDONLY);
+        ramfs_fh_t *fh_b = ramfs_open(fs_b, b, O_RDONLY);
+        assert(fh_a != NULL && fh_b != NULL);
+        assert(ramfs_read(fh_a, buf_a, st_a.size) == st_a.size);
+        assert(ramfs_read(fh_b, buf_b, st_b.size) == st_b.size);
+        assert(memcmp(buf_a, buf_b, st_a.size) == 0);
+        ramfs_close(fh_a);
+        ramfs_close(fh_b);
+        free(buf_a);
+        free(buf_b);
+        return;
+    }
+
+    ramfs_dh_t *dh = ramfs_opendir(fs_a, a);
+    assert(dh != NULL);
+    const ramfs_entry_t *child;
+    while ((child = ramfs_readdir(dh)) != NULL) {
+        const char *name = ramfs_get_name_ref(child, NULL);
+        ramfs_entry_t *other = ramfs_get_entry_at(b, name);
+        assert(other != NULL);
+        check_same(fs_a, (ramfs_entry_t *) child, fs_b, other);
+    }
+    ramfs_closedir(dh);
+}
+
+static void check_fs(ramfs_fs_t *a, ramfs_fs_t *b)
+{
+    check_same(a, ramfs_get_parent(a, "/"), b, ramfs_get_parent(b, "/"));
+}
+
+int main(int argc, char *argv[])
+{
+    ramfs_fs_t *fs, *base, *replica, *other;
+    ramfs_fh_t *fh;
+    mem_t mem = {0}, image = {0};
+    char big[8 * EXTENT];
+    size_t len;
+
+    for (size_t i = 0; i < sizeof(big); i++) {
+        big[i] = 'a' + i % 26;
+    }
+
+    /* an empty filesystem is the first base */
+    fs = ramfs_init();
+    assert(fs != NULL);
+    replica = ramfs_init();
+    assert(replica != NULL);
+
+    assert(ramfs_mkdir(fs, "a") != NULL);
+    assert(ramfs_mkdir(fs, "a/b") != NULL);
+    assert(ramfs_mkdir(fs, "empty") != NULL);
+    write_file(fs, "a/big", big, sizeof(big), 0);
+    write_file(fs, "a/b/small", "hello", 5, 0);
+    write_file(fs, "sparse", "end", 3, 5 * EXTENT);
+    assert(ramfs_create_from_buffer(fs, "buf", big, 2 * EXTENT, 0) != NULL);
+    ship(fs, replica);
+    check_fs(fs, replica);
+
+    /* nothing changed, nothing sent but the header */
+    assert(ship(fs, replica) < 64);
+
+    /* one small write sends about the extent it went to */
+    write_file(fs, "a/big", "XYZ", 3, 3 * EXTENT + 10);
+    len = ship(fs, replica);
+    assert(len > EXTENT && len < 2 * EXTENT);
+    check_fs(fs, replica);
+
+    /* moves, renames and removals, in and between directories */
+    assert(ramfs_rename(fs, "a/b/small", "small") == 0);
+    assert(ramfs_rename(fs, "a/b", "empty/c") == 0);
+    assert(ramfs_rename(fs, "small", "empty/c/small2") == 0);
+    assert(ramfs_unlink(ramfs_get_entry(fs, "buf")) == 0);
+    write_file(fs, "buf", "new", 3, 0);
+    assert(ramfs_mkdir(fs, "gone") != NULL);
+    write_file(fs, "gone/x", "x", 1, 0);
+    ship(fs, replica);
+    ramfs_rmtree(ramfs_get_entry(fs, "gone"));
+    assert(ramfs_mkdir(fs, "d") != NULL);
+    assert(ramfs_mkdir(fs, "d/e") != NULL);
+    write_file(fs, "d/e/f", big, 100, 0);
+    ship(fs, replica);
+    check_fs(fs, replica);
+    assert(ramfs_get_entry(replica, "gone") == NULL);
+
+    /* data cut off and grown back, in the same checkpoint */
+    assert(ramfs_truncate(fs, ramfs_get_entry(fs, "a/big"), 100) == 0);
+    assert(ramfs_truncate(fs, ramfs_get_entry(fs, "a/big"), 3 * EXTENT) ==
+            0);
+    write_file(fs, "a/big", "tail", 4, 4 * EXTENT);
+    fh = ramfs_open(fs, ramfs_get_entry(fs, "sparse"), O_WRONLY | O_TRUNC);
+    assert(fh != NULL);
+    ramfs_close(fh);
+    ship(fs, replica);
+    check_fs(fs, replica);
+
+    /* checkpoints apply in order, and only undamaged */
+    write_file(fs, "a/big", "1", 1, 0);
+    assert(ramfs_checkpoint(fs, write_mem, &mem) > 0);
+    mem.buf[mem.len / 2] ^= 1;
+    assert(ramfs_apply_checkpoint(replica, mem.buf, mem.len) == -1);
+    assert(errno == EINVAL);
+    mem.buf[mem.len / 2] ^= 1;
+    assert(ramfs_apply_checkpoint(replica, mem.buf, mem.len) == 0);
+    assert(ramfs_apply_checkpoint(replica, mem.buf, mem.len) == -1);
+    assert(errno == EINVAL);
+    check_fs(fs, replica);
+
+    /* compaction starts a new base, which checkpoints apply to */
+    assert(ramfs_compact(fs, write_mem, &image) == (ssize_t) image.len);
+    base = ramfs_load_image(image.buf, image.len, NULL);
+    assert(base != NULL);
+    other = ramfs_overlay_image(image.buf, image.len, NULL);
+    assert(other != NULL);
+    assert(ramfs_rename(fs, "a", "d/e/a") == 0);
+    write_file(fs, "d/e/a/big", "2", 1, 2 * EXTENT);
+    assert(ramfs_unlink(ramfs_get_entry(fs, "empty/c/small2")) == 0);
+    mem.len = 0;
+    assert(ramfs_checkpoint(fs, write_mem, &mem) > 0);
+    assert(ramfs_apply_checkpoint(replica, mem.buf, mem.len) == -1);
+    assert(errno == EINVAL);
+    assert(ramfs_apply_checkpoint(base, mem.buf, mem.len) == 0);
+    assert(ramfs_apply_checkpoint(other, mem.buf, mem.len) == 0);
+    check_fs(fs, base);
+    check_fs(fs, other);
+    ramfs_deinit(fs);
+    ramfs_deinit(replica);
+
+    /* a replica that took over carries on the sequence */
+    write_file(base, "after", "3", 1, 0);
+    ship(base, other);
+    check_fs(base, other);
+
+    /* an image mounted read-only takes no checkpoints */
+    mem.len = 0;
+    assert(ramfs_checkpoint(base, write_mem, &mem) > 0);
+    ramfs_deinit(base);
+    ramfs_deinit(other);
+    other = ramfs_mount_image(image.buf, image.len, NULL);
+    assert(other != NULL);
+    assert(ramfs_apply_checkpoint(other, mem.buf, mem.len) == -1);
+    assert(errno == EROFS);
+    ramfs_deinit(other);
+    free(mem.buf);
+    free(image.buf);
+
+    return 0;
+}
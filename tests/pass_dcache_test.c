@@ -0,0 +1,149 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ramfs/ramfs.h"
+
+
+int main(int argc, char *argv[])
+{
+    ramfs_config_t config = {
+        .dcache_size = 8,
+    };
+    ramfs_dcache_stats_t stats;
+    ramfs_fs_t *fs;
+    ramfs_entry_t *dir, *file;
+    char path[32];
+
+    fs = ramfs_init_ex(&config);
+    assert(fs != NULL);
+    ramfs_dcache_stats(fs, &stats);
+    if (stats.size == 0) {
+        /* built with lock-free lookups, which bypass the cache */
+        ramfs_deinit(fs);
+        return 0;
+    }
+    assert(stats.size == 8 && stats.used == 0);
+
+    dir = ramfs_mkdir(fs, "dir");
+    assert(dir != NULL);
+    file = ramfs_create(fs, "dir/file", 0);
+    assert(file != NULL);
+
+    /* the second lookup of a path is a hit, leading slashes do not matter */
+    assert(ramfs_get_entry(fs, "dir/file") == file);
+    assert(ramfs_get_entry(fs, "/dir/file") == file);
+    ramfs_dcache_stats(fs, &stats);
+    assert(stats.misses == 1 && stats.hits == 1 && stats.used == 1);
+
+    /* misses are cached and go stale once something is created */
+    errno = 0;
+    assert(ramfs_get_entry(fs, "dir/new") == NULL);
+    assert(errno == ENOENT);
+    errno = 0;
+    assert(ramfs_get_entry(fs, "dir/new") == NULL);
+    assert(errno == ENOENT);
+    assert(ramfs_get_entry(fs, "dir/file/x") == NULL);
+    assert(errno == ENOTDIR);
+    assert(ramfs_get_entry(fs, "dir/file/x") == NULL);
+    assert(errno == ENOTDIR);
+    ramfs_dcache_stats(fs, &stats);
+    assert(stats.hits == 3);
+    ramfs_entry_t *created = ramfs_create(fs, "dir/new", 0);
+    assert(created != NULL);
+    assert(ramfs_get_entry(fs, "dir/new") == created);
+
+    /* unlinked entries are forgotten */
+    assert(ramfs_unlink(created) == 0);
+    assert(ramfs_get_entry(fs, "dir/new") == NULL);
+    assert(errno == ENOENT);
+
+    /* an unlink keeps the other paths, but a path that ran into the file
+     * does not fail the same way anymore */
+    ramfs_entry_t *other = ramfs_create(fs, "dir/other", 0);
+    assert(other != NULL);
+    assert(ramfs_get_entry(fs, "dir/other/x") == NULL);
+    assert(errno == ENOTDIR);
+    assert(ramfs_get_entry(fs, "dir/gone") == NULL);
+    assert(ramfs_get_entry(fs, "dir/file") == file);
+    ramfs_dcache_stats(fs, &stats);
+    size_t hits = stats.hits;
+    assert(ramfs_unlink(other) == 0);
+    assert(ramfs_get_entry(fs, "dir/file") == file);
+    assert(ramfs_get_entry(fs, "dir/gone") == NULL);
+    assert(errno == ENOENT);
+    ramfs_dcache_stats(fs, &stats);
+    assert(stats.hits == hits + 2);
+    assert(ramfs_get_entry(fs, "dir/other/x") == NULL);
+    assert(errno == ENOENT);
+
+    /* renaming a directory forgets the paths below it */
+    assert(ramfs_mkdir(fs, "dir/sub") != NULL);
+    ramfs_entry_t *deep = ramfs_create(fs, "dir/sub/deep", 0);
+    assert(deep != NULL);
+    assert(ramfs_get_entry(fs, "dir/sub/deep") == deep);
+    assert(ramfs_rename(fs, "dir", "moved") == 0);
+    assert(ramfs_get_entry(fs, "dir/sub/deep") == NULL);
+    assert(ramfs_get_entry(fs, "dir/file") == NULL);
+    assert(ramfs_get_entry(fs, "moved/sub/deep") == deep);
+    assert(ramfs_get_entry(fs, "moved/file") == file);
+
+    /* rmdir and rmtree forget what they free */
+    ramfs_entry_t *empty = ramfs_mkdir(fs, "empty");
+    assert(empty != NULL);
+    assert(ramfs_get_entry(fs, "empty") == empty);
+    assert(ramfs_rmdir(empty) == 0);
+    assert(ramfs_get_entry(fs, "empty") == NULL);
+    ramfs_rmtree(ramfs_get_entry(fs, "moved"));
+    assert(ramfs_get_entry(fs, "moved/sub/deep") == NULL);
+    assert(ramfs_get_entry(fs, "moved/file") == NULL);
+    assert(ramfs_get_entry(fs, "moved") == NULL);
+
+    /* the cache stays bounded, evicting the least recently used path */
+    assert(ramfs_mkdir(fs, "many") != NULL);
+    for (int i = 0; i < 32; i++) {
+        snprintf(path, sizeof(path), "many/%d", i);
+        assert(ramfs_create(fs, path, 0) != NULL);
+    }
+    for (int i = 0; i < 32; i++) {
+        snprintf(path, sizeof(path), "many/%d", i);
+        assert(ramfs_get_entry(fs, path) != NULL);
+        assert(ramfs_get_entry(fs, "many/0") != NULL);
+    }
+    ramfs_dcache_stats(fs, &stats);
+    assert(stats.used == stats.size);
+    hits = stats.hits;
+    assert(ramfs_get_entry(fs, "many/31") != NULL);
+    assert(ramfs_get_entry(fs, "many/0") != NULL);
+    assert(ramfs_get_entry(fs, "many/1") != NULL);
+    ramfs_dcache_stats(fs, &stats);
+    assert(stats.hits == hits + 2);
+
+    ramfs_deinit(fs);
+
+    /* slots come with created entries, not up front */
+    fs = ramfs_init_ex(&config);
+    assert(fs != NULL);
+    assert(ramfs_get_entry(fs, "a") == NULL);
+    ramfs_dcache_stats(fs, &stats);
+    assert(stats.size == 8 && stats.used == 0);
+    assert(ramfs_mkdir(fs, "a") != NULL);
+    assert(ramfs_get_entry(fs, "a") != NULL);
+    assert(ramfs_get_entry(fs, "b") == NULL);
+    ramfs_dcache_stats(fs, &stats);
+    assert(stats.used == 1);
+    ramfs_deinit(fs);
+
+    /* the cache can be turned off whatever the build default is */
+    config.dcache_size = RAMFS_DCACHE_OFF;
+    fs = ramfs_init_ex(&config);
+    assert(fs != NULL);
+    assert(ramfs_mkdir(fs, "dir") != NULL);
+    assert(ramfs_get_entry(fs, "dir") != NULL);
+    ramfs_dcache_stats(fs, &stats);
+    assert(stats.size == 0 && stats.used == 0 && stats.hits == 0);
+    ramfs_deinit(fs);
+
+    return 0;
+}
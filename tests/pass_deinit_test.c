@@ -15,6 +15,18 @@ int main(int argc, char *argv[])
     ramfs_deinit(fs);
     fs = NULL;
 
+    /* nested directories are freed once, files and all */
+    fs = ramfs_init();
+    assert(fs != NULL);
+    assert(ramfs_mkdir(fs, "a") != NULL);
+    assert(ramfs_mkdir(fs, "a/b") != NULL);
+    assert(ramfs_mkdir(fs, "a/b/c") != NULL);
+    assert(ramfs_create(fs, "a/b/f", 0) != NULL);
+    assert(ramfs_mkdir(fs, "d") != NULL);
+
+    ramfs_deinit(fs);
+    fs = NULL;
+
     exit(EXIT_SUCCESS);
     return 0;
 }
\ No newline at end of file
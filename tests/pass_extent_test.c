@@ -0,0 +1,89 @@
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ramfs/ramfs.h"
+
+
+int main(int argc, char *argv[])
+{
+    ramfs_fs_t *fs;
+    ramfs_entry_t *file;
+    ramfs_fh_t *fh;
+    ramfs_stat_t st;
+    const void *span;
+    char buf[64];
+    size_t total, len;
+
+    fs = ramfs_init();
+    assert(fs != NULL);
+
+    file = ramfs_create(fs, "test", 0);
+    assert(file != NULL);
+
+    fh = ramfs_open(fs, file, O_RDWR);
+    assert(fh != NULL);
+
+    for (int i = 0; i < 1000; i++) {
+        snprintf(buf, sizeof(buf), "line %04d\n", i);
+        assert(ramfs_write(fh, buf, 10) == 10);
+    }
+
+    ramfs_stat(fs, file, &st);
+    assert(st.size == 10000);
+
+    assert(ramfs_access(fh, &span) > 10);
+    assert(memcmp(span, "line 0000\n", 10) == 0);
+
+    total = 0;
+    while ((len = ramfs_access_extent(fh, total, &span)) > 0) {
+        total += len;
+    }
+    assert(total == 10000);
+
+    assert(ramfs_seek(fh, 9990, SEEK_SET) == 9990);
+    assert(ramfs_read(fh, buf, sizeof(buf)) == 10);
+    assert(memcmp(buf, "line 0999\n", 10) == 0);
+
+    assert(ramfs_seek(fh, 5, SEEK_SET) == 5);
+    assert(ramfs_read(fh, buf, 20) == 20);
+    assert(memcmp(buf, "0000\nline 0001\nline ", 20) == 0);
+
+    assert(ramfs_truncate(fs, file, 15) == 0);
+    ramfs_stat(fs, file, &st);
+    assert(st.size == 15);
+
+    assert(ramfs_truncate(fs, file, 30) == 0);
+    assert(ramfs_seek(fh, 0, SEEK_SET) == 0);
+    assert(ramfs_read(fh, buf, sizeof(buf)) == 30);
+    assert(memcmp(buf, "line 0000\nline", 14) == 0);
+    for (int i = 15; i < 30; i++) {
+        assert(buf[i] == '\0');
+    }
+
+    assert(ramfs_seek(fh, 100000, SEEK_SET) == 100000);
+    assert(ramfs_write(fh, "end", 3) == 3);
+    assert(ramfs_seek(fh, 50000, SEEK_SET) == 50000);
+    assert(ramfs_read(fh, buf, 8) == 8);
+    for (int i = 0; i < 8; i++) {
+        assert(buf[i] == '\0');
+    }
+    assert(ramfs_seek(fh, -3, SEEK_END) == 100000);
+    assert(ramfs_read(fh, buf, 8) == 3);
+    assert(memcmp(buf, "end", 3) == 0);
+
+    ramfs_close(fh);
+
+    fh = ramfs_open(fs, file, O_RDWR | O_TRUNC);
+    assert(fh != NULL);
+    assert(ramfs_access(fh, &span) == 0);
+    ramfs_close(fh);
+
+    ramfs_deinit(fs);
+    fs = NULL;
+
+    exit(EXIT_SUCCESS);
+    return 0;
+}
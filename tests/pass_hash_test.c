@@ -0,0 +1,130 @@
+#include <assert.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ramfs/ramfs.h"
+
+
+#define COUNT 10000
+#define HDR sizeof(max_align_t)
+
+static size_t s_live;
+
+static void *tracking_malloc(void *ctx, size_t size)
+{
+    size_t *p = malloc(HDR + size);
+    if (p == NULL) {
+        return NULL;
+    }
+    *p = size;
+    s_live += size;
+    return (char *) p + HDR;
+}
+
+static void *tracking_realloc(void *ctx, void *ptr, size_t size)
+{
+    if (ptr == NULL) {
+        return tracking_malloc(ctx, size);
+    }
+
+    size_t *p = (size_t *) ((char *) ptr - HDR);
+    size_t old = *p;
+    p = realloc(p, HDR + size);
+    if (p == NULL) {
+        return NULL;
+    }
+    *p = size;
+    s_live = s_live - old + size;
+    return (char *) p + HDR;
+}
+
+static void tracking_free(void *ctx, void *ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+
+    size_t *p = (size_t *) ((char *) ptr - HDR);
+    s_live -= *p;
+    free(p);
+}
+
+static void fill(ramfs_fs_t *fs, const char *dir)
+{
+    char path[32];
+
+    for (int i = 0; i < COUNT; i++) {
+        snprintf(path, sizeof(path), "%s/%d", dir, i);
+        assert(ramfs_create(fs, path, 0) != NULL);
+    }
+}
+
+/* Memory kept by the hash directory index, so this is only built against
+ * the hash index */
+int main(int argc, char *argv[])
+{
+    ramfs_allocator_t alloc = {
+        .malloc = tracking_malloc,
+        .realloc = tracking_realloc,
+        .free = tracking_free,
+    };
+    ramfs_config_t config = {
+        .allocator = &alloc,
+    };
+    ramfs_fs_t *fs;
+    ramfs_entry_t *dir;
+    const ramfs_entry_t *entry;
+    ramfs_dh_t *dh;
+    char path[32];
+    size_t live;
+    int count;
+
+    fs = ramfs_init_ex(&config);
+    assert(fs != NULL);
+
+    /* entries freed with their directory leave slab pages, if any, behind
+     * for the ones below to reuse */
+    assert(ramfs_mkdir(fs, "warm") != NULL);
+    fill(fs, "warm");
+    ramfs_rmtree(ramfs_get_entry(fs, "warm"));
+    dir = ramfs_mkdir(fs, "dir");
+    assert(dir != NULL);
+    live = s_live;
+
+    /* a directory emptied one entry at a time gives its index back */
+    fill(fs, "dir");
+    assert(s_live > live + COUNT * 16);
+    for (int i = 0; i < COUNT; i++) {
+        snprintf(path, sizeof(path), "dir/%d", i);
+        assert(ramfs_unlink(ramfs_get_entry(fs, path)) == 0);
+    }
+    assert(s_live < live + 1024);
+
+    /* what is left is still found and listed as it shrinks */
+    fill(fs, "dir");
+    for (int i = 0; i < COUNT; i++) {
+        if (i % 100 != 0) {
+            snprintf(path, sizeof(path), "dir/%d", i);
+            assert(ramfs_unlink(ramfs_get_entry(fs, path)) == 0);
+        }
+    }
+    for (int i = 0; i < COUNT; i += 100) {
+        snprintf(path, sizeof(path), "dir/%d", i);
+        assert(ramfs_get_entry(fs, path) != NULL);
+    }
+    dh = ramfs_opendir(fs, dir);
+    assert(dh != NULL);
+    count = 0;
+    while ((entry = ramfs_readdir(dh)) != NULL) {
+        count++;
+    }
+    ramfs_closedir(dh);
+    assert(count == COUNT / 100);
+
+    ramfs_deinit(fs);
+    fs = NULL;
+
+    exit(EXIT_SUCCESS);
+    return 0;
+}
@@ -0,0 +1,171 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ramfs/ramfs.h"
+#include "image_util.h"
+
+
+#define FILES 100
+
+static int write_fail(void *ctx, const void *buf, size_t len)
+{
+    int *calls = ctx;
+
+    if (++*calls > 2) {
+        errno = ENOSPC;
+        return -1;
+    }
+    return 0;
+}
+
+static void check_data(ramfs_fs_t *fs, const char *path, const char *data,
+        size_t len)
+{
+    ramfs_entry_t *entry;
+    ramfs_fh_t *fh;
+    char buf[4096];
+
+    entry = ramfs_get_entry(fs, path);
+    assert(entry != NULL);
+    assert(ramfs_is_file(entry));
+    fh = ramfs_open(fs, entry, O_RDONLY);
+    assert(fh != NULL);
+    assert(ramfs_read(fh, buf, sizeof(buf)) == len);
+    assert(memcmp(buf, data, len) == 0);
+    ramfs_close(fh);
+}
+
+int main(int argc, char *argv[])
+{
+    ramfs_fs_t *fs, *loaded;
+    ramfs_entry_t *entry;
+    ramfs_fh_t *fh;
+    ramfs_dh_t *dh;
+    ramfs_stat_t st;
+    char path[32], big[3000], zeros[1500];
+    char *image;
+    ssize_t len;
+    FILE *f;
+
+    fs = ramfs_init();
+    assert(fs != NULL);
+    assert(ramfs_mkdir(fs, "a") != NULL);
+    assert(ramfs_mkdir(fs, "a/b") != NULL);
+    assert(ramfs_mkdir(fs, "a/b/c") != NULL);
+    assert(ramfs_mkdir(fs, "empty") != NULL);
+    assert(ramfs_mkdir(fs, "many") != NULL);
+    assert(ramfs_create(fs, "zero", 0) != NULL);
+
+    for (size_t i = 0; i < sizeof(big); i++) {
+        big[i] = 'a' + i % 26;
+    }
+    entry = ramfs_create(fs, "a/b/big", 0);
+    assert(entry != NULL);
+    fh = ramfs_open(fs, entry, O_WRONLY);
+    assert(fh != NULL);
+    assert(ramfs_write(fh, big, sizeof(big)) == sizeof(big));
+    ramfs_close(fh);
+
+    /* holes come back as zeros */
+    memset(zeros, 0, sizeof(zeros));
+    entry = ramfs_create(fs, "a/sparse", 0);
+    assert(entry != NULL);
+    assert(ramfs_truncate(fs, entry, sizeof(zeros)) == 0);
+
+    /* created in reverse, saved sorted */
+    for (int i = FILES - 1; i >= 0; i--) {
+        snprintf(path, sizeof(path), "many/f%03d", i);
+        entry = ramfs_create(fs, path, 0);
+        assert(entry != NULL);
+        fh = ramfs_open(fs, entry, O_WRONLY);
+        assert(fh != NULL);
+        assert(ramfs_write(fh, path, strlen(path)) == strlen(path));
+        ramfs_close(fh);
+    }
+
+    /* through a file on disk and back */
+    f = tmpfile();
+    assert(f != NULL);
+    len = ramfs_save_image(fs, write_stdio, f);
+    assert(len > 0);
+    assert(ftell(f) == len);
+    rewind(f);
+    image = malloc(len);
+    assert(image != NULL);
+    assert(fread(image, 1, len, f) == (size_t) len);
+    fclose(f);
+
+    loaded = ramfs_load_image(image, len, NULL);
+    assert(loaded != NULL);
+
+    check_data(loaded, "a/b/big", big, sizeof(big));
+    check_data(loaded, "a/sparse", zeros, sizeof(zeros));
+    check_data(loaded, "zero", "", 0);
+    entry = ramfs_get_entry(loaded, "a/b/c");
+    assert(entry != NULL);
+    assert(ramfs_is_dir(entry));
+    ramfs_stat(loaded, ramfs_get_entry(loaded, "empty"), &st);
+    assert(st.type == RAMFS_ENTRY_TYPE_DIR);
+    assert(st.size == 0);
+    ramfs_stat(loaded, ramfs_get_parent(loaded, "/"), &st);
+    assert(st.size == 4);
+
+    entry = ramfs_get_entry(loaded, "many");
+    ramfs_stat(loaded, entry, &st);
+    assert(st.size == FILES);
+    dh = ramfs_opendir(loaded, entry);
+    assert(dh != NULL);
+    for (int i = 0; i < FILES; i++) {
+        const ramfs_entry_t *child = ramfs_readdir(dh);
+        assert(child != NULL);
+        snprintf(path, sizeof(path), "many/f%03d", i);
+        check_data(loaded, path, path, strlen(path));
+        snprintf(path, sizeof(path), "f%03d", i);
+        entry = ramfs_get_entry_at(ramfs_get_entry(loaded, "many"), path);
+        assert(entry != NULL);
+    }
+    assert(ramfs_readdir(dh) == NULL);
+    ramfs_closedir(dh);
+
+    /* the loaded directories take changes like any other */
+    for (int i = 0; i < FILES; i += 2) {
+        snprintf(path, sizeof(path), "many/f%03d", i);
+        assert(ramfs_unlink(ramfs_get_entry(loaded, path)) == 0);
+        snprintf(path, sizeof(path), "many/g%03d", i);
+        assert(ramfs_create(loaded, path, 0) != NULL);
+    }
+    assert(ramfs_create(loaded, "many/f001", 0) == NULL);
+    assert(errno == EEXIST);
+    assert(ramfs_get_entry(loaded, "many/f000") == NULL);
+    assert(ramfs_get_entry(loaded, "many/g098") != NULL);
+    assert(ramfs_rename(loaded, "a/b", "many/b") == 0);
+    check_data(loaded, "many/b/big", big, sizeof(big));
+    ramfs_deinit(loaded);
+
+    /* damaged images are refused */
+    assert(ramfs_load_image(image, 16, NULL) == NULL);
+    assert(errno == EINVAL);
+    assert(ramfs_load_image(image, len - 1, NULL) == NULL);
+    assert(errno == EINVAL);
+    image[0] = 'X';
+    assert(ramfs_load_image(image, len, NULL) == NULL);
+    assert(errno == EINVAL);
+    free(image);
+
+    /* a failed write fails the save */
+    int calls = 0;
+    assert(ramfs_save_image(fs, write_fail, &calls) == -1);
+    assert(errno == ENOSPC);
+
+    /* the filesystem was left unlocked */
+    assert(ramfs_create(fs, "after", 0) != NULL);
+    assert(ramfs_rename(fs, "a/b", "b") == 0);
+
+    ramfs_deinit(fs);
+
+    return 0;
+}
@@ -0,0 +1,225 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ramfs/ramfs.h"
+#include "crc.h"
+#include "journal.h"
+
+
+#define BUFFER 1024
+
+static off_t file_size(const char *path)
+{
+    struct stat st;
+
+    assert(stat(path, &st) == 0);
+    return st.st_size;
+}
+
+/* damages the byte at offset in the file */
+static void flip_byte(const char *path, off_t offset)
+{
+    char c;
+
+    int fd = open(path, O_RDWR);
+    assert(fd >= 0);
+    assert(pread(fd, &c, 1, offset) == 1);
+    c ^= 1;
+    assert(pwrite(fd, &c, 1, offset) == 1);
+    close(fd);
+}
+
+static ramfs_fs_t *reopen(ramfs_fs_t *fs, const ramfs_store_t *store)
+{
+    ramfs_config_t config = {
+        .journal = store,
+        .journal_buffer = BUFFER,
+    };
+
+    if (fs != NULL) {
+        ramfs_deinit(fs);
+    }
+    return ramfs_init_ex(&config);
+}
+
+static void check_file(ramfs_fs_t *fs, const char *path, const char *data,
+        size_t len)
+{
+    char buf[4 * BUFFER];
+    ramfs_entry_t *entry = ramfs_get_entry(fs, path);
+    assert(entry != NULL);
+    ramfs_fh_t *fh = ramfs_open(fs, entry, O_RDONLY);
+    assert(fh != NULL);
+    assert(ramfs_read(fh, buf, sizeof(buf)) == len);
+    assert(memcmp(buf, data, len) == 0);
+    ramfs_close(fh);
+}
+
+static void write_file(ramfs_fs_t *fs, const char *path, const char *data,
+        size_t len)
+{
+    ramfs_entry_t *entry = ramfs_create(fs, path, 0);
+    assert(entry != NULL);
+    ramfs_fh_t *fh = ramfs_open(fs, entry, O_WRONLY);
+    assert(fh != NULL);
+    assert(ramfs_write(fh, data, len) == len);
+    ramfs_close(fh);
+}
+
+int main(int argc, char *argv[])
+{
+    ramfs_store_t store;
+    ramfs_fs_t *fs;
+    ramfs_entry_t *entry;
+    ramfs_fh_t *fh;
+    ramfs_stat_t st;
+    char path[] = "/tmp/ramfs_journal_XXXXXX";
+    char big[3 * BUFFER];
+    off_t len;
+    int fd;
+
+    for (size_t i = 0; i < sizeof(big); i++) {
+        big[i] = 'a' + i % 26;
+    }
+
+    /* every kind of change comes back from a local file */
+    fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+    assert(ramfs_store_file_init(&store, path) == 0);
+    fs = reopen(NULL, &store);
+    assert(fs != NULL);
+
+    assert(ramfs_mkdir(fs, "a") != NULL);
+    assert(ramfs_mkdir(fs, "a/b") != NULL);
+    entry = ramfs_create(fs, "a/f", 0);
+    assert(entry != NULL);
+    fh = ramfs_open(fs, entry, O_RDWR);
+    assert(fh != NULL);
+    assert(ramfs_write(fh, "hello", 5) == 5);
+    assert(ramfs_pwrite(fh, "J", 1, 0) == 1);
+    struct iovec iov[] = {{" wor", 4}, {"ld", 2}};
+    assert(ramfs_writev(fh, iov, 2) == 6);
+    ramfs_close(fh);
+    assert(ramfs_rename(fs, "a/f", "a/b/g") == 0);
+
+    assert(ramfs_create_from_buffer(fs, "buf", big, sizeof(big), 0) != NULL);
+    write_file(fs, "short", big, 100);
+    assert(ramfs_truncate(fs, ramfs_get_entry(fs, "short"), 10) == 0);
+    write_file(fs, "empty", big, 100);
+    fh = ramfs_open(fs, ramfs_get_entry(fs, "empty"), O_WRONLY | O_TRUNC);
+    assert(fh != NULL);
+    ramfs_close(fh);
+
+    write_file(fs, "gone", "x", 1);
+    assert(ramfs_unlink(ramfs_get_entry(fs, "gone")) == 0);
+    assert(ramfs_mkdir(fs, "d") != NULL);
+    write_file(fs, "d/x", "x", 1);
+    ramfs_rmtree(ramfs_get_entry(fs, "d"));
+    assert(ramfs_mkdir(fs, "e") != NULL);
+    assert(ramfs_rmdir(ramfs_get_entry(fs, "e")) == 0);
+    assert(ramfs_sync(fs) == 0);
+
+    fs = reopen(fs, &store);
+    assert(fs != NULL);
+    check_file(fs, "a/b/g", "Jello world", 11);
+    assert(ramfs_get_entry(fs, "a/f") == NULL);
+    check_file(fs, "buf", big, sizeof(big));
+    check_file(fs, "short", big, 10);
+    check_file(fs, "empty", "", 0);
+    assert(ramfs_get_entry(fs, "gone") == NULL);
+    assert(ramfs_get_entry(fs, "d") == NULL);
+    assert(ramfs_get_entry(fs, "e") == NULL);
+    ramfs_stat(fs, ramfs_get_parent(fs, "/"), &st);
+    assert(st.size == 4);
+
+    /* new entries after a replay do not take ids already in the journal */
+    write_file(fs, "a/b/h", "new", 3);
+    assert(ramfs_rename(fs, "a/b/g", "g") == 0);
+    fs = reopen(fs, &store);
+    assert(fs != NULL);
+    check_file(fs, "a/b/h", "new", 3);
+    check_file(fs, "g", "Jello world", 11);
+
+    /* emptying the root is replayed too */
+    ramfs_rmtree(ramfs_get_parent(fs, "/"));
+    write_file(fs, "only", "1", 1);
+    fs = reopen(fs, &store);
+    assert(fs != NULL);
+    ramfs_stat(fs, ramfs_get_parent(fs, "/"), &st);
+    assert(st.size == 1);
+    check_file(fs, "only", "1", 1);
+    ramfs_deinit(fs);
+
+    /* records are batched until the buffer fills or ramfs_sync */
+    assert(truncate(path, 0) == 0);
+    fs = reopen(NULL, &store);
+    assert(fs != NULL);
+    assert(ramfs_mkdir(fs, "a") != NULL);
+    write_file(fs, "a/x", "x", 1);
+    assert(file_size(path) == 0);
+    assert(ramfs_sync(fs) == 0);
+    len = file_size(path);
+    assert(len > 0);
+
+    /* larger ones are written straight through */
+    write_file(fs, "a/big", big, sizeof(big));
+    assert(file_size(path) > len + (off_t) sizeof(big));
+    assert(ramfs_sync(fs) == 0);
+    ramfs_deinit(fs);
+
+    /* a torn record ends the journal, and is written over */
+    assert(truncate(path, file_size(path) - 10) == 0);
+    fs = reopen(NULL, &store);
+    assert(fs != NULL);
+    check_file(fs, "a/x", "x", 1);
+    ramfs_stat(fs, ramfs_get_entry(fs, "a/big"), &st);
+    assert(st.size == 0);
+    write_file(fs, "a/y", "y", 1);
+    fs = reopen(fs, &store);
+    assert(fs != NULL);
+    check_file(fs, "a/y", "y", 1);
+    ramfs_deinit(fs);
+
+    /* so does a damaged one, here the last byte of the write to z */
+    assert(truncate(path, 0) == 0);
+    fs = reopen(NULL, &store);
+    assert(fs != NULL);
+    write_file(fs, "y", "y", 1);
+    write_file(fs, "z", "z", 1);
+    ramfs_deinit(fs);
+    flip_byte(path, file_size(path) - 1);
+    fs = reopen(NULL, &store);
+    assert(fs != NULL);
+    check_file(fs, "y", "y", 1);
+    ramfs_stat(fs, ramfs_get_entry(fs, "z"), &st);
+    assert(st.size == 0);
+    ramfs_deinit(fs);
+
+    /* a journal that does not match the tree it builds fails, here with a
+     * truncate of a file that was never created */
+    ramfs_journal_record_t record = {
+        .magic = RAMFS_JOURNAL_MAGIC,
+        .op = RAMFS_JOURNAL_TRUNCATE,
+        .id = 5,
+    };
+    size_t skip = offsetof(ramfs_journal_record_t, op);
+    record.crc = ~ramfs_crc_update(0xffffffff, (const char *) &record + skip,
+            sizeof(record) - skip);
+    fd = open(path, O_RDWR | O_TRUNC);
+    assert(fd >= 0);
+    assert(write(fd, &record, sizeof(record)) == sizeof(record));
+    close(fd);
+    assert(reopen(NULL, &store) == NULL);
+    assert(errno == EINVAL);
+    ramfs_store_file_deinit(&store);
+    unlink(path);
+
+    return 0;
+}
@@ -9,6 +9,8 @@ int main(int argc, char *argv[])
 {
     ramfs_fs_t *fs;
     ramfs_entry_t *dir;
+    ramfs_stat_t st;
+    char path[32];
 
     fs = ramfs_init();
     assert(fs != NULL);
@@ -16,9 +18,21 @@ int main(int argc, char *argv[])
     dir = ramfs_mkdir(fs, "test");
     assert(dir != NULL);
 
+    /* a capacity hint is only a hint, the directory still grows past it */
+    dir = ramfs_mkdir_ex(fs, "hint", 10);
+    assert(dir != NULL);
+    for (int i = 0; i < 50; i++) {
+        snprintf(path, sizeof(path), "hint/%d", i);
+        assert(ramfs_create(fs, path, 0) != NULL);
+    }
+    ramfs_stat(fs, dir, &st);
+    assert(st.size == 50);
+
+    assert(ramfs_mkdir_ex(fs, "hint", 10) == NULL);
+
     ramfs_deinit(fs);
     fs = NULL;
 
     exit(EXIT_SUCCESS);
     return 0;
-}
\ No newline at end of file
+}
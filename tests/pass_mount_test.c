@@ -0,0 +1,166 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "ramfs/ramfs.h"
+#include "image_util.h"
+
+
+#define FILES 100
+
+int main(int argc, char *argv[])
+{
+    ramfs_fs_t *fs, *mounted;
+    ramfs_entry_t *entry;
+    ramfs_fh_t *fh;
+    ramfs_dh_t *dh;
+    ramfs_stat_t st;
+    const void *span;
+    char path[32], big[3000], buf[4096];
+    char *map, *p;
+    mem_t copy = {0};
+    ssize_t len;
+    FILE *f;
+
+    fs = ramfs_init();
+    assert(fs != NULL);
+    assert(ramfs_mkdir(fs, "a") != NULL);
+    assert(ramfs_mkdir(fs, "a/b") != NULL);
+    assert(ramfs_mkdir(fs, "empty") != NULL);
+    assert(ramfs_mkdir(fs, "many") != NULL);
+    assert(ramfs_create(fs, "zero", 0) != NULL);
+
+    for (size_t i = 0; i < sizeof(big); i++) {
+        big[i] = 'a' + i % 26;
+    }
+    entry = ramfs_create(fs, "a/b/big", 0);
+    assert(entry != NULL);
+    fh = ramfs_open(fs, entry, O_WRONLY);
+    assert(fh != NULL);
+    assert(ramfs_write(fh, big, sizeof(big)) == sizeof(big));
+    ramfs_close(fh);
+
+    for (int i = FILES - 1; i >= 0; i--) {
+        snprintf(path, sizeof(path), "many/f%03d", i);
+        entry = ramfs_create(fs, path, 0);
+        assert(entry != NULL);
+        fh = ramfs_open(fs, entry, O_WRONLY);
+        assert(fh != NULL);
+        assert(ramfs_write(fh, path, strlen(path)) == strlen(path));
+        ramfs_close(fh);
+    }
+
+    /* mapped read-only, so any write to the image would fault */
+    f = tmpfile();
+    assert(f != NULL);
+    len = ramfs_save_image(fs, write_stdio, f);
+    assert(len > 0);
+    assert(fflush(f) == 0);
+    map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+    assert(map != MAP_FAILED);
+
+    mounted = ramfs_mount_image(map, len, NULL);
+    assert(mounted != NULL);
+
+    /* directories not looked into yet are counted in the image */
+    ramfs_stat(mounted, ramfs_get_parent(mounted, "/"), &st);
+    assert(st.size == 4);
+
+    /* data and names are used in place */
+    entry = ramfs_get_entry(mounted, "a/b/big");
+    assert(entry != NULL);
+    assert(in_map(ramfs_get_name_ref(entry, NULL), map, len));
+    fh = ramfs_open(mounted, entry, O_RDONLY);
+    assert(fh != NULL);
+    assert(ramfs_access(fh, &span) == sizeof(big));
+    assert(in_map(span, map, len));
+    assert(memcmp(span, big, sizeof(big)) == 0);
+    assert(ramfs_read(fh, buf, sizeof(buf)) == sizeof(big));
+    assert(memcmp(buf, big, sizeof(big)) == 0);
+    ramfs_close(fh);
+
+    entry = ramfs_get_entry(mounted, "zero");
+    assert(entry != NULL);
+    ramfs_stat(mounted, entry, &st);
+    assert(st.type == RAMFS_ENTRY_TYPE_FILE);
+    assert(st.size == 0);
+    ramfs_stat(mounted, ramfs_get_entry(mounted, "empty"), &st);
+    assert(st.type == RAMFS_ENTRY_TYPE_DIR);
+    assert(st.size == 0);
+
+    dh = ramfs_opendir(mounted, ramfs_get_entry(mounted, "many"));
+    assert(dh != NULL);
+    for (int i = 0; i < FILES; i++) {
+        const ramfs_entry_t *child = ramfs_readdir(dh);
+        assert(child != NULL);
+        snprintf(path, sizeof(path), "f%03d", i);
+        assert(strcmp(ramfs_get_name_ref(child, NULL), path) == 0);
+        fh = ramfs_open(mounted, child, O_RDONLY);
+        assert(fh != NULL);
+        assert(ramfs_read(fh, buf, sizeof(buf)) == strlen(path) + 5);
+        assert(memcmp(buf + 5, path, strlen(path)) == 0);
+        ramfs_close(fh);
+    }
+    assert(ramfs_readdir(dh) == NULL);
+    ramfs_closedir(dh);
+    assert(ramfs_get_entry(mounted, "many/f100") == NULL);
+    assert(errno == ENOENT);
+    assert(ramfs_get_entry(mounted, "zero/x") == NULL);
+    assert(errno == ENOTDIR);
+
+    /* nothing changes */
+    entry = ramfs_get_entry(mounted, "many/f000");
+    assert(ramfs_create(mounted, "new", 0) == NULL);
+    assert(errno == EROFS);
+    assert(ramfs_mkdir(mounted, "new") == NULL);
+    assert(errno == EROFS);
+    assert(ramfs_open(mounted, entry, O_WRONLY) == NULL);
+    assert(errno == EROFS);
+    assert(ramfs_open(mounted, entry, O_RDONLY | O_TRUNC) == NULL);
+    assert(errno == EROFS);
+    assert(ramfs_truncate(mounted, entry, 0) == -1);
+    assert(errno == EROFS);
+    assert(ramfs_unlink(entry) == -1);
+    assert(errno == EROFS);
+    assert(ramfs_rename(mounted, "many", "other") == -1);
+    assert(errno == EROFS);
+    assert(ramfs_rmdir(ramfs_get_entry(mounted, "empty")) == -1);
+    assert(errno == EROFS);
+    ramfs_rmtree(ramfs_get_entry(mounted, "a"));
+    assert(ramfs_get_entry(mounted, "a/b/big") != NULL);
+
+    /* saved again, the image comes out the same */
+    assert(ramfs_save_image(mounted, write_mem, &copy) == len);
+    assert(copy.len == len);
+    assert(memcmp(copy.buf, map, len) == 0);
+    ramfs_deinit(mounted);
+
+    /* a damaged directory fails when it is looked into */
+    for (p = copy.buf; memcmp(p, "f050", 5) != 0; p++) {
+        assert(p < copy.buf + len - 5);
+    }
+    p[1] = '/';
+    mounted = ramfs_mount_image(copy.buf, len, NULL);
+    assert(mounted != NULL);
+    assert(ramfs_get_entry(mounted, "a/b/big") != NULL);
+    assert(ramfs_get_entry(mounted, "many/f000") == NULL);
+    assert(errno == EINVAL);
+    assert(ramfs_opendir(mounted, ramfs_get_entry(mounted, "many")) == NULL);
+    assert(errno == EINVAL);
+    ramfs_deinit(mounted);
+
+    copy.buf[0] = 'X';
+    assert(ramfs_mount_image(copy.buf, len, NULL) == NULL);
+    assert(errno == EINVAL);
+    free(copy.buf);
+
+    munmap(map, len);
+    fclose(f);
+    ramfs_deinit(fs);
+
+    return 0;
+}
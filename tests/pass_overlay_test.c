@@ -0,0 +1,174 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "ramfs/ramfs.h"
+#include "image_util.h"
+
+
+#define FILES 20
+#define EXTENT 512
+
+static int cmp_names(const void *a, const void *b)
+{
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/* readdir order depends on the directory index, so names are compared
+ * sorted */
+static void check_dir(ramfs_fs_t *fs, ramfs_entry_t *dir, const char **want,
+        size_t count)
+{
+    const char *names[FILES + 1];
+    const ramfs_entry_t *child;
+    size_t n = 0;
+
+    ramfs_dh_t *dh = ramfs_opendir(fs, dir);
+    assert(dh != NULL);
+    while ((child = ramfs_readdir(dh)) != NULL) {
+        assert(n < count);
+        names[n++] = ramfs_get_name_ref(child, NULL);
+    }
+    ramfs_closedir(dh);
+    assert(n == count);
+    qsort(names, n, sizeof(*names), cmp_names);
+    for (size_t i = 0; i < n; i++) {
+        assert(strcmp(names[i], want[i]) == 0);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    ramfs_fs_t *fs, *overlay;
+    ramfs_entry_t *entry;
+    ramfs_fh_t *fh;
+    ramfs_stat_t st;
+    const void *span;
+    char path[32], big[4 * EXTENT], buf[4 * EXTENT];
+    char *map;
+    mem_t copy = {0};
+    ssize_t map_len, len;
+    FILE *f;
+
+    fs = ramfs_init();
+    assert(fs != NULL);
+    assert(ramfs_mkdir(fs, "a") != NULL);
+    assert(ramfs_mkdir(fs, "a/b") != NULL);
+    assert(ramfs_mkdir(fs, "full") != NULL);
+    assert(ramfs_create(fs, "full/x", 0) != NULL);
+    assert(ramfs_mkdir(fs, "many") != NULL);
+
+    for (size_t i = 0; i < sizeof(big); i++) {
+        big[i] = 'a' + i % 26;
+    }
+    entry = ramfs_create(fs, "a/big", 0);
+    assert(entry != NULL);
+    fh = ramfs_open(fs, entry, O_WRONLY);
+    assert(fh != NULL);
+    assert(ramfs_write(fh, big, sizeof(big)) == sizeof(big));
+    ramfs_close(fh);
+
+    for (int i = 0; i < FILES; i++) {
+        snprintf(path, sizeof(path), "many/f%02d", i);
+        assert(ramfs_create(fs, path, 0) != NULL);
+    }
+
+    /* mapped read-only, so any write to the image would fault */
+    f = tmpfile();
+    assert(f != NULL);
+    map_len = ramfs_save_image(fs, write_stdio, f);
+    assert(map_len > 0);
+    assert(fflush(f) == 0);
+    map = mmap(NULL, map_len, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+    assert(map != MAP_FAILED);
+    ramfs_deinit(fs);
+
+    overlay = ramfs_overlay_image(map, map_len, NULL);
+    assert(overlay != NULL);
+
+    /* a write copies only the extent it touches */
+    entry = ramfs_get_entry(overlay, "a/big");
+    assert(entry != NULL);
+    fh = ramfs_open(overlay, entry, O_RDWR);
+    assert(fh != NULL);
+    assert(ramfs_pwrite(fh, "XYZ", 3, 2 * EXTENT + 10) == 3);
+    memcpy(big + 2 * EXTENT + 10, "XYZ", 3);
+    assert(ramfs_read(fh, buf, sizeof(buf)) == sizeof(big));
+    assert(memcmp(buf, big, sizeof(big)) == 0);
+    assert(ramfs_access_extent(fh, 0, &span) == EXTENT);
+    assert(in_map(span, map, map_len));
+    assert(ramfs_access_extent(fh, EXTENT, &span) == EXTENT);
+    assert(in_map(span, map, map_len));
+    assert(ramfs_access_extent(fh, 2 * EXTENT, &span) == EXTENT);
+    assert(!in_map(span, map, map_len));
+    assert(ramfs_access_extent(fh, 3 * EXTENT, &span) == EXTENT);
+    assert(in_map(span, map, map_len));
+    ramfs_close(fh);
+
+    /* removed entries stay removed, new ones show up next to the image's */
+    for (int i = 0; i < FILES; i += 2) {
+        snprintf(path, sizeof(path), "many/f%02d", i);
+        assert(ramfs_unlink(ramfs_get_entry(overlay, path)) == 0);
+        assert(ramfs_get_entry(overlay, path) == NULL);
+        assert(errno == ENOENT);
+    }
+    assert(ramfs_create(overlay, "many/f00", 0) != NULL);
+    assert(ramfs_create(overlay, "many/new", 0) != NULL);
+    assert(ramfs_create(overlay, "many/f01", 0) == NULL);
+    assert(errno == EEXIST);
+    const char *want[] = {
+        "f00", "f01", "f03", "f05", "f07", "f09", "f11", "f13", "f15", "f17",
+        "f19", "new",
+    };
+    check_dir(overlay, ramfs_get_entry(overlay, "many"), want,
+            sizeof(want) / sizeof(*want));
+    ramfs_stat(overlay, ramfs_get_entry(overlay, "many"), &st);
+    assert(st.size == sizeof(want) / sizeof(*want));
+
+    /* directories not looked into yet */
+    assert(ramfs_rmdir(ramfs_get_entry(overlay, "full")) == -1);
+    assert(errno == ENOTEMPTY);
+    assert(ramfs_rename(overlay, "a/b", "b") == 0);
+    assert(ramfs_rmdir(ramfs_get_entry(overlay, "b")) == 0);
+    assert(ramfs_truncate(overlay, ramfs_get_entry(overlay, "full/x"),
+            10) == 0);
+    assert(ramfs_rename(overlay, "full/x", "a/x") == 0);
+    assert(ramfs_rmdir(ramfs_get_entry(overlay, "full")) == 0);
+
+    /* the changes are saved along with what is left of the image */
+    len = ramfs_save_image(overlay, write_mem, &copy);
+    assert(len > 0 && (size_t) len == copy.len);
+    ramfs_rmtree(ramfs_get_parent(overlay, "/"));
+    assert(ramfs_get_entry(overlay, "a") == NULL);
+    assert(errno == ENOENT);
+    ramfs_stat(overlay, ramfs_get_parent(overlay, "/"), &st);
+    assert(st.size == 0);
+    ramfs_deinit(overlay);
+
+    fs = ramfs_mount_image(copy.buf, len, NULL);
+    assert(fs != NULL);
+    const char *root[] = {"a", "many"};
+    check_dir(fs, ramfs_get_parent(fs, "/"), root, 2);
+    const char *a[] = {"big", "x"};
+    check_dir(fs, ramfs_get_entry(fs, "a"), a, 2);
+    check_dir(fs, ramfs_get_entry(fs, "many"), want,
+            sizeof(want) / sizeof(*want));
+    fh = ramfs_open(fs, ramfs_get_entry(fs, "a/big"), O_RDONLY);
+    assert(fh != NULL);
+    assert(ramfs_read(fh, buf, sizeof(buf)) == sizeof(big));
+    assert(memcmp(buf, big, sizeof(big)) == 0);
+    ramfs_close(fh);
+    ramfs_stat(fs, ramfs_get_entry(fs, "a/x"), &st);
+    assert(st.size == 10);
+    ramfs_deinit(fs);
+    free(copy.buf);
+
+    munmap(map, map_len);
+    fclose(f);
+
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ramfs/ramfs.h"
+
+
+static size_t s_calls;
+
+static void *counting_malloc(void *ctx, size_t size)
+{
+    s_calls++;
+    return malloc(size);
+}
+
+static void *counting_realloc(void *ctx, void *ptr, size_t size)
+{
+    s_calls++;
+    return realloc(ptr, size);
+}
+
+static void counting_free(void *ctx, void *ptr)
+{
+    free(ptr);
+}
+
+int main(int argc, char *argv[])
+{
+    ramfs_allocator_t alloc = {
+        .malloc = counting_malloc,
+        .realloc = counting_realloc,
+        .free = counting_free,
+    };
+    ramfs_config_t config = {
+        .allocator = &alloc,
+    };
+    ramfs_fs_t *fs;
+    ramfs_entry_t *file, *entry;
+    char *path;
+
+    fs = ramfs_init_ex(&config);
+    assert(fs != NULL);
+
+    assert(ramfs_mkdir(fs, "a") != NULL);
+    assert(ramfs_mkdir(fs, "a/b") != NULL);
+    assert(ramfs_mkdir(fs, "a/b/c") != NULL);
+    assert(ramfs_mkdir(fs, "a/b/c/d") != NULL);
+    assert(ramfs_mkdir(fs, "a/bb") != NULL);
+    assert(ramfs_mkdir(fs, "a/b/") == NULL);
+    file = ramfs_create(fs, "a/b/c/d/file", 0);
+    assert(file != NULL);
+    assert(ramfs_create(fs, "a/b/c/d/file", 0) == NULL);
+    assert(errno == EEXIST);
+
+    /* lookups resolve components in place without allocating */
+    size_t calls = s_calls;
+    assert(ramfs_get_entry(fs, "a/b/c/d/file") == file);
+    assert(ramfs_get_entry(fs, "/a/b/c/d/file") == file);
+    assert(ramfs_get_entry(fs, "//a//b/c///d/file") == file);
+    assert(ramfs_get_entry(fs, "a/b/c/d/fil") == NULL);
+    assert(ramfs_get_entry(fs, "a/b/c/d/filex") == NULL);
+    assert(ramfs_get_entry(fs, "a/b/x/d/file") == NULL);
+    entry = ramfs_get_entry(fs, "a/bb");
+    assert(entry != NULL && ramfs_is_dir(entry));
+    assert(ramfs_get_entry(fs, "a/b/c/d/file/x") == NULL);
+    assert(errno == ENOTDIR);
+    assert(s_calls == calls);
+
+    path = ramfs_get_path(file);
+    assert(path != NULL);
+    assert(strcmp(path, "/a/b/c/d/file") == 0);
+    free(path);
+
+    path = ramfs_get_path(ramfs_get_parent(fs, "a"));
+    assert(path != NULL);
+    assert(strcmp(path, "/") == 0);
+    free(path);
+
+    assert(ramfs_rename(fs, "a/b/c/d/file", "a/bb/moved") == 0);
+    assert(ramfs_get_entry(fs, "a/b/c/d/file") == NULL);
+    assert(ramfs_get_entry(fs, "a/bb/moved") == file);
+    path = ramfs_get_path(file);
+    assert(strcmp(path, "/a/bb/moved") == 0);
+    free(path);
+
+    ramfs_deinit(fs);
+    fs = NULL;
+
+    exit(EXIT_SUCCESS);
+    return 0;
+}
@@ -0,0 +1,111 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include "ramfs/ramfs.h"
+
+
+int main(int argc, char *argv[])
+{
+    ramfs_fs_t *fs;
+    ramfs_entry_t *file;
+    ramfs_fh_t *fh, *rfh;
+    ramfs_stat_t st;
+    char buf[32];
+    static char big[3000];
+
+    fs = ramfs_init();
+    assert(fs != NULL);
+
+    file = ramfs_create(fs, "test", 0);
+    assert(file != NULL);
+
+    fh = ramfs_open(fs, file, O_RDWR);
+    assert(fh != NULL);
+
+    /* positional calls leave the file position alone */
+    assert(ramfs_pwrite(fh, "Hello World!", 12, 0) == 12);
+    assert(ramfs_tell(fh) == 0);
+    assert(ramfs_pwrite(fh, "ramfs", 5, 6) == 5);
+    assert(ramfs_tell(fh) == 0);
+    memset(buf, 0, sizeof(buf));
+    assert(ramfs_pread(fh, buf, sizeof(buf), 0) == 12);
+    assert(strcmp(buf, "Hello ramfs!") == 0);
+    assert(ramfs_pread(fh, buf, 5, 6) == 5);
+    assert(memcmp(buf, "ramfs", 5) == 0);
+    assert(ramfs_pread(fh, buf, sizeof(buf), 12) == 0);
+    assert(ramfs_tell(fh) == 0);
+    assert(ramfs_pwrite(fh, "x", 1, -1) == -1);
+    assert(errno == EINVAL);
+    assert(ramfs_pread(fh, buf, 1, -1) == -1);
+    assert(errno == EINVAL);
+
+    /* a gap left by a positional write reads back as zeros */
+    assert(ramfs_pwrite(fh, "!", 1, 20) == 1);
+    assert(ramfs_pread(fh, buf, sizeof(buf), 12) == 9);
+    assert(memcmp(buf, "\0\0\0\0\0\0\0\0!", 9) == 0);
+
+    /* vectored writes go in order and move the position once */
+    memset(big, 'b', sizeof(big));
+    struct iovec wiov[] = {
+        { .iov_base = "abc", .iov_len = 3 },
+        { .iov_base = NULL, .iov_len = 0 },
+        { .iov_base = big, .iov_len = sizeof(big) },
+        { .iov_base = "xyz", .iov_len = 3 },
+    };
+    assert(ramfs_seek(fh, 0, SEEK_SET) == 0);
+    assert(ramfs_writev(fh, wiov, 4) == 3006);
+    assert(ramfs_tell(fh) == 3006);
+    ramfs_stat(fs, file, &st);
+    assert(st.size == 3006);
+
+    char head[3], tail[4], mid[8];
+    struct iovec riov[] = {
+        { .iov_base = head, .iov_len = sizeof(head) },
+        { .iov_base = mid, .iov_len = sizeof(mid) },
+    };
+    assert(ramfs_seek(fh, 0, SEEK_SET) == 0);
+    assert(ramfs_readv(fh, riov, 2) == 11);
+    assert(memcmp(head, "abc", 3) == 0);
+    assert(memcmp(mid, "bbbbbbbb", 8) == 0);
+    assert(ramfs_tell(fh) == 11);
+
+    /* reads stop short at the end of the file */
+    struct iovec tiov[] = {
+        { .iov_base = mid, .iov_len = 1 },
+        { .iov_base = tail, .iov_len = sizeof(tail) },
+        { .iov_base = head, .iov_len = sizeof(head) },
+    };
+    assert(ramfs_seek(fh, -4, SEEK_END) == 3002);
+    assert(ramfs_readv(fh, tiov, 3) == 4);
+    assert(mid[0] == 'b');
+    assert(memcmp(tail, "xyz", 3) == 0);
+    assert(ramfs_tell(fh) == 3006);
+    assert(ramfs_readv(fh, tiov, 3) == 0);
+
+    assert(ramfs_writev(fh, wiov, -1) == -1);
+    assert(errno == EINVAL);
+
+    /* writing needs a handle opened for writing */
+    rfh = ramfs_open(fs, file, O_RDONLY);
+    assert(rfh != NULL);
+    assert(ramfs_pwrite(rfh, "x", 1, 0) == -1);
+    assert(errno == EBADF);
+    assert(ramfs_writev(rfh, wiov, 1) == -1);
+    assert(errno == EBADF);
+    assert(ramfs_pread(rfh, buf, 3, 0) == 3);
+    assert(memcmp(buf, "abc", 3) == 0);
+    ramfs_close(rfh);
+
+    ramfs_close(fh);
+
+    ramfs_deinit(fs);
+    fs = NULL;
+
+    exit(EXIT_SUCCESS);
+    return 0;
+}
@@ -0,0 +1,175 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ramfs/ramfs.h"
+
+
+#define COUNT 100
+
+int main(int argc, char *argv[])
+{
+    ramfs_fs_t *fs;
+    ramfs_entry_t *dir;
+    const ramfs_entry_t *entry;
+    ramfs_dh_t *dh;
+    char path[32];
+    int seen[COUNT];
+    long locs[COUNT];
+    const ramfs_entry_t *entries[COUNT];
+
+    fs = ramfs_init();
+    assert(fs != NULL);
+
+    dir = ramfs_mkdir(fs, "dir");
+    assert(dir != NULL);
+
+    dh = ramfs_opendir(fs, dir);
+    assert(dh != NULL);
+    assert(ramfs_readdir(dh) == NULL);
+    ramfs_closedir(dh);
+
+    for (int i = 0; i < COUNT; i++) {
+        snprintf(path, sizeof(path), "dir/%d", (i * 37) % COUNT);
+        assert(ramfs_create(fs, path, 0) != NULL);
+    }
+
+    /* every entry is returned exactly once */
+    memset(seen, 0, sizeof(seen));
+    dh = ramfs_opendir(fs, dir);
+    assert(dh != NULL);
+    for (int i = 0; i < COUNT; i++) {
+        locs[i] = ramfs_telldir(dh);
+        entries[i] = ramfs_readdir(dh);
+        assert(entries[i] != NULL);
+        size_t len;
+        const char *name = ramfs_get_name_ref(entries[i], &len);
+        assert(len == strlen(name));
+        seen[atoi(name)]++;
+    }
+    assert(ramfs_readdir(dh) == NULL);
+    for (int i = 0; i < COUNT; i++) {
+        assert(seen[i] == 1);
+    }
+
+    /* locations from telldir can be returned to in any order */
+    for (int i = COUNT - 1; i >= 0; i -= 7) {
+        ramfs_seekdir(dh, locs[i]);
+        assert(ramfs_telldir(dh) == locs[i]);
+        assert(ramfs_readdir(dh) == entries[i]);
+    }
+    for (int i = 3; i < COUNT; i += 11) {
+        ramfs_seekdir(dh, locs[i]);
+        assert(ramfs_readdir(dh) == entries[i]);
+    }
+
+    ramfs_seekdir(dh, 0);
+    assert(ramfs_readdir(dh) == entries[0]);
+    ramfs_closedir(dh);
+
+    /* seeking still lands right after entries have been removed */
+    for (int i = 0; i < COUNT; i += 3) {
+        snprintf(path, sizeof(path), "dir/%d", i);
+        entry = ramfs_get_entry(fs, path);
+        assert(ramfs_unlink((ramfs_entry_t *) entry) == 0);
+    }
+    ramfs_stat_t st;
+    ramfs_stat(fs, dir, &st);
+    assert(st.type == RAMFS_ENTRY_TYPE_DIR);
+    assert(st.size == COUNT - (COUNT + 2) / 3);
+
+    dh = ramfs_opendir(fs, dir);
+    assert(dh != NULL);
+    int n = 0;
+    do {
+        locs[n] = ramfs_telldir(dh);
+        entries[n] = ramfs_readdir(dh);
+    } while (entries[n++] != NULL);
+    assert(n - 1 == st.size);
+    for (int i = n - 1; i >= 0; i--) {
+        ramfs_seekdir(dh, locs[i]);
+        assert(ramfs_readdir(dh) == entries[i]);
+    }
+    ramfs_closedir(dh);
+
+    /* an empty directory reads as empty again after being emptied */
+    for (int i = 0; i < COUNT; i++) {
+        if (i % 3 == 0) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "dir/%d", i);
+        entry = ramfs_get_entry(fs, path);
+        assert(entry != NULL);
+        assert(ramfs_unlink((ramfs_entry_t *) entry) == 0);
+    }
+    dh = ramfs_opendir(fs, dir);
+    assert(dh != NULL);
+    assert(ramfs_readdir(dh) == NULL);
+    ramfs_closedir(dh);
+
+    assert(ramfs_create(fs, "dir/again", 0) != NULL);
+    assert(ramfs_rename(fs, "dir/again", "dir/moved") == 0);
+    dh = ramfs_opendir(fs, dir);
+    assert(dh != NULL);
+    entry = ramfs_readdir(dh);
+    assert(entry != NULL && entry == ramfs_get_entry(fs, "dir/moved"));
+    assert(ramfs_readdir(dh) == NULL);
+    ramfs_closedir(dh);
+
+    assert(ramfs_rmdir(dir) == -1);
+    assert(errno == ENOTEMPTY);
+
+    /* batches return the same entries as readdir, with their sizes */
+    assert(ramfs_mkdir(fs, "batch") != NULL);
+    assert(ramfs_mkdir(fs, "batch/sub") != NULL);
+    assert(ramfs_create(fs, "batch/sub/file", 0) != NULL);
+    for (int i = 0; i < COUNT - 2; i++) {
+        snprintf(path, sizeof(path), "batch/%d", i);
+        ramfs_entry_t *file = ramfs_create(fs, path, 0);
+        assert(file != NULL);
+        assert(ramfs_truncate(fs, file, i) == 0);
+    }
+    dir = ramfs_get_entry(fs, "batch");
+    dh = ramfs_opendir(fs, dir);
+    assert(dh != NULL);
+    n = 0;
+    while ((entries[n] = ramfs_readdir(dh)) != NULL) {
+        n++;
+    }
+    assert(n == COUNT - 1);
+    ramfs_seekdir(dh, 0);
+    ramfs_dirent_t ents[7];
+    size_t got;
+    int total = 0;
+    memset(seen, 0, sizeof(seen));
+    while ((got = ramfs_readdir_batch(dh, ents, 7)) > 0) {
+        assert(got <= 7);
+        for (size_t i = 0; i < got; i++, total++) {
+            size_t len;
+            const char *name = ramfs_get_name_ref(entries[total], &len);
+            assert(ents[i].name == name);
+            assert(ents[i].name_len == len);
+            if (strcmp(ents[i].name, "sub") == 0) {
+                assert(ents[i].type == RAMFS_ENTRY_TYPE_DIR);
+                assert(ents[i].size == 1);
+            } else {
+                assert(ents[i].type == RAMFS_ENTRY_TYPE_FILE);
+                assert(ents[i].size == (size_t) atoi(ents[i].name));
+                seen[atoi(ents[i].name)]++;
+            }
+        }
+    }
+    assert(total == COUNT - 1);
+    for (int i = 0; i < COUNT - 2; i++) {
+        assert(seen[i] == 1);
+    }
+    assert(ramfs_readdir_batch(dh, ents, 7) == 0);
+    ramfs_closedir(dh);
+    assert(*ramfs_get_name_ref(ramfs_get_parent(fs, "/"), NULL) == '\0');
+
+    ramfs_deinit(fs);
+
+    return 0;
+}
@@ -0,0 +1,35 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ramfs/ramfs.h"
+
+
+int main(int argc, char *argv[])
+{
+    ramfs_fs_t *fs;
+    ramfs_entry_t *entry;
+
+    fs = ramfs_init();
+    assert(fs != NULL);
+
+    assert(ramfs_mkdir(fs, "a") != NULL);
+    assert(ramfs_mkdir(fs, "b") != NULL);
+    assert(ramfs_create(fs, "a/f", 0) != NULL);
+
+    assert(ramfs_rename(fs, "a/f", "b/f") == 0);
+    assert(ramfs_get_entry(fs, "a/f") == NULL);
+
+    /* the entry now belongs to its new directory */
+    entry = ramfs_get_entry(fs, "b/f");
+    assert(entry != NULL);
+    assert(ramfs_unlink(entry) == 0);
+    assert(ramfs_get_entry(fs, "b/f") == NULL);
+    assert(ramfs_rmdir(ramfs_get_entry(fs, "b")) == 0);
+
+    ramfs_deinit(fs);
+    fs = NULL;
+
+    exit(EXIT_SUCCESS);
+    return 0;
+}
@@ -0,0 +1,116 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ramfs/ramfs.h"
+
+
+int main(int argc, char *argv[])
+{
+    ramfs_fs_t *fs;
+    ramfs_entry_t *file;
+    ramfs_fh_t *fh, *rfh;
+    ramfs_stat_t st;
+    void *buf, *other;
+    char data[64];
+    ssize_t n;
+
+    fs = ramfs_init();
+    assert(fs != NULL);
+
+    file = ramfs_create(fs, "test", 0);
+    assert(file != NULL);
+
+    fh = ramfs_open(fs, file, O_RDWR);
+    assert(fh != NULL);
+
+    /* fill in place, then commit what was written */
+    n = ramfs_write_reserve(fh, 12, &buf);
+    assert(n == 12);
+    memcpy(buf, "Hello World!", 12);
+    assert(ramfs_write_commit(fh, 12) == 12);
+    assert(ramfs_tell(fh) == 12);
+    ramfs_stat(fs, file, &st);
+    assert(st.size == 12);
+
+    /* one reservation at a time, and commits stay within it */
+    n = ramfs_write_reserve(fh, 10, &buf);
+    assert(n == 10);
+    assert(ramfs_write_reserve(fh, 10, &other) == -1);
+    assert(errno == EBUSY);
+    assert(ramfs_write_commit(fh, 11) == -1);
+    assert(errno == EINVAL);
+
+    /* a short commit leaves nothing behind past the end */
+    memcpy(buf, "0123456789", 10);
+    assert(ramfs_write_commit(fh, 4) == 4);
+    assert(ramfs_write_commit(fh, 0) == -1);
+    assert(errno == EINVAL);
+    ramfs_stat(fs, file, &st);
+    assert(st.size == 16);
+    assert(ramfs_truncate(fs, file, 20) == 0);
+    assert(ramfs_pread(fh, data, sizeof(data), 0) == 20);
+    assert(memcmp(data, "Hello World!0123\0\0\0\0", 20) == 0);
+
+    /* the space ends with the extent, the rest takes another round */
+    assert(ramfs_seek(fh, 0, SEEK_SET) == 0);
+    size_t total = 0;
+    while (total < 5000) {
+        n = ramfs_write_reserve(fh, 5000 - total, &buf);
+        assert(n > 0);
+        assert((size_t) n <= 5000 - total);
+        memset(buf, 'x', n);
+        assert(ramfs_write_commit(fh, n) == n);
+        total += n;
+    }
+    assert(ramfs_tell(fh) == 5000);
+    ramfs_stat(fs, file, &st);
+    assert(st.size == 5000);
+    assert(ramfs_pread(fh, data, 4, 4996) == 4);
+    assert(memcmp(data, "xxxx", 4) == 0);
+
+    /* a truncate in between wins, and the position stays put */
+    n = ramfs_write_reserve(fh, 10, &buf);
+    assert(n == 10);
+    assert(ramfs_truncate(fs, file, 0) == 0);
+    memcpy(buf, "discarded!", 10);
+    assert(ramfs_write_commit(fh, 10) == 0);
+    assert(ramfs_tell(fh) == 5000);
+    ramfs_stat(fs, file, &st);
+    assert(st.size == 0);
+
+    /* so does one that only cuts into the same extent */
+    assert(ramfs_truncate(fs, file, 200) == 0);
+    assert(ramfs_seek(fh, 100, SEEK_SET) == 100);
+    assert(ramfs_write_reserve(fh, 50, &buf) == 50);
+    memset(buf, 'y', 50);
+    assert(ramfs_truncate(fs, file, 50) == 0);
+    assert(ramfs_write_commit(fh, 50) == 0);
+    assert(ramfs_tell(fh) == 100);
+    ramfs_stat(fs, file, &st);
+    assert(st.size == 50);
+    assert(ramfs_truncate(fs, file, 0) == 0);
+
+    /* closing drops an open reservation */
+    assert(ramfs_seek(fh, 0, SEEK_SET) == 0);
+    assert(ramfs_write_reserve(fh, 10, &buf) == 10);
+    ramfs_close(fh);
+    ramfs_stat(fs, file, &st);
+    assert(st.size == 0);
+
+    /* writing needs a handle opened for writing */
+    rfh = ramfs_open(fs, file, O_RDONLY);
+    assert(rfh != NULL);
+    assert(ramfs_write_reserve(rfh, 10, &buf) == -1);
+    assert(errno == EBADF);
+    ramfs_close(rfh);
+
+    ramfs_deinit(fs);
+    fs = NULL;
+
+    exit(EXIT_SUCCESS);
+    return 0;
+}
@@ -18,6 +18,15 @@ int main(int argc, char *argv[])
 
     assert(ramfs_rmdir(dir) == 0);
 
+    /* emptying the root keeps the root */
+    assert(ramfs_mkdir(fs, "a") != NULL);
+    assert(ramfs_create(fs, "a/file", 0) != NULL);
+    assert(ramfs_create(fs, "file", 0) != NULL);
+    ramfs_rmtree(ramfs_get_parent(fs, "/"));
+    assert(ramfs_get_entry(fs, "a") == NULL);
+    assert(ramfs_get_entry(fs, "file") == NULL);
+    assert(ramfs_create(fs, "file", 0) != NULL);
+
     ramfs_deinit(fs);
     fs = NULL;
 
@@ -0,0 +1,37 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ramfs/ramfs.h"
+
+
+int main(int argc, char *argv[])
+{
+    ramfs_fs_t *fs;
+    ramfs_entry_t *entry;
+
+    fs = ramfs_init();
+    assert(fs != NULL);
+
+    assert(ramfs_mkdir(fs, "a") != NULL);
+    assert(ramfs_mkdir(fs, "a/b") != NULL);
+    assert(ramfs_create(fs, "a/b/f", 0) != NULL);
+    assert(ramfs_create(fs, "a/g", 0) != NULL);
+    assert(ramfs_create(fs, "h", 0) != NULL);
+
+    /* the tree leaves its parent along with everything in it */
+    entry = ramfs_get_entry(fs, "a");
+    assert(entry != NULL);
+    ramfs_rmtree(entry);
+    assert(ramfs_get_entry(fs, "a") == NULL);
+    assert(ramfs_get_entry(fs, "h") != NULL);
+
+    /* and the name can be used again */
+    assert(ramfs_mkdir(fs, "a") != NULL);
+
+    ramfs_deinit(fs);
+    fs = NULL;
+
+    exit(EXIT_SUCCESS);
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ramfs/ramfs.h"
+
+
+int main(int argc, char *argv[])
+{
+    ramfs_fs_t *fs;
+    ramfs_entry_t *file;
+    ramfs_fh_t *fh[40];
+    ramfs_dh_t *dh;
+    ramfs_slab_stats_t st;
+    char path[16];
+
+    fs = ramfs_init();
+    assert(fs != NULL);
+
+    assert(ramfs_mkdir(fs, "dir") != NULL);
+    for (int i = 0; i < 10; i++) {
+        snprintf(path, sizeof(path), "dir/%d", i);
+        assert(ramfs_create(fs, path, 0) != NULL);
+    }
+
+    ramfs_slab_stats(fs, RAMFS_SLAB_DIR, &st);
+    assert(st.in_use == 1);
+    ramfs_slab_stats(fs, RAMFS_SLAB_FILE, &st);
+    assert(st.in_use == 10);
+    assert(st.pages == 0 || st.capacity >= st.in_use);
+
+    file = ramfs_get_entry(fs, "dir/0");
+    assert(file != NULL);
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 40; i++) {
+            fh[i] = ramfs_open(fs, file, O_RDONLY);
+            assert(fh[i] != NULL);
+        }
+        ramfs_slab_stats(fs, RAMFS_SLAB_FH, &st);
+        assert(st.in_use == 40);
+        for (int i = 0; i < 40; i++) {
+            ramfs_close(fh[i]);
+        }
+    }
+
+    /* closed handles are recycled, not returned */
+    ramfs_slab_stats(fs, RAMFS_SLAB_FH, &st);
+    assert(st.in_use == 0);
+    assert(st.pages == 0 || st.capacity >= 40);
+
+    dh = ramfs_opendir(fs, ramfs_get_entry(fs, "dir"));
+    assert(dh != NULL);
+    ramfs_slab_stats(fs, RAMFS_SLAB_DH, &st);
+    assert(st.in_use == 1);
+    ramfs_closedir(dh);
+    ramfs_slab_stats(fs, RAMFS_SLAB_DH, &st);
+    assert(st.in_use == 0);
+
+    assert(ramfs_unlink(file) == 0);
+    ramfs_slab_stats(fs, RAMFS_SLAB_FILE, &st);
+    assert(st.in_use == 9);
+
+    ramfs_rmtree(ramfs_get_entry(fs, "dir"));
+    ramfs_slab_stats(fs, RAMFS_SLAB_FILE, &st);
+    assert(st.in_use == 0);
+    ramfs_slab_stats(fs, RAMFS_SLAB_DIR, &st);
+    assert(st.in_use == 0);
+
+    ramfs_deinit(fs);
+    fs = NULL;
+
+    exit(EXIT_SUCCESS);
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ramfs/ramfs.h"
+
+
+#define COUNT 40
+
+static ramfs_entry_t *lookup(ramfs_fs_t *fs, int i)
+{
+    char path[32];
+
+    snprintf(path, sizeof(path), "dir/%03d", i);
+    return ramfs_get_entry(fs, path);
+}
+
+static void check(ramfs_fs_t *fs, ramfs_entry_t *dir, int first, int last)
+{
+    const ramfs_entry_t *entry;
+    ramfs_dh_t *dh;
+    int count = 0;
+
+    for (int i = 0; i < COUNT; i++) {
+        assert((lookup(fs, i) != NULL) == (i >= first && i < last));
+    }
+
+    dh = ramfs_opendir(fs, dir);
+    assert(dh != NULL);
+    while ((entry = ramfs_readdir(dh)) != NULL) {
+        count++;
+    }
+    ramfs_closedir(dh);
+    assert(count == last - first);
+}
+
+int main(int argc, char *argv[])
+{
+    ramfs_config_t config = {
+        .small_dir_max = 8,
+        .small_dir_min = 4,
+    };
+    ramfs_fs_t *fs;
+    ramfs_entry_t *dir;
+    const ramfs_entry_t *entry;
+    ramfs_dh_t *dh;
+    char path[32];
+
+    config.small_dir_min = 8;
+    assert(ramfs_init_ex(&config) == NULL);
+    assert(errno == EINVAL);
+    config.small_dir_min = 4;
+
+    fs = ramfs_init_ex(&config);
+    assert(fs != NULL);
+
+    dir = ramfs_mkdir(fs, "dir");
+    assert(dir != NULL);
+
+    /* grow across the threshold one entry at a time */
+    for (int i = 0; i < COUNT; i++) {
+        snprintf(path, sizeof(path), "dir/%03d", i);
+        assert(ramfs_create(fs, path, 0) != NULL);
+        check(fs, dir, 0, i + 1);
+    }
+
+    /* a directory location survives the directory changing shape */
+    for (int i = COUNT - 1; i >= 6; i--) {
+        assert(ramfs_unlink(lookup(fs, i)) == 0);
+    }
+    dh = ramfs_opendir(fs, dir);
+    assert(dh != NULL);
+    for (int i = 0; i < 3; i++) {
+        assert(ramfs_readdir(dh) == lookup(fs, i));
+    }
+    long loc = ramfs_telldir(dh);
+    for (int i = 6; i < COUNT; i++) {
+        snprintf(path, sizeof(path), "dir/%03d", i);
+        assert(ramfs_create(fs, path, 0) != NULL);
+    }
+    ramfs_seekdir(dh, loc);
+    entry = ramfs_readdir(dh);
+    assert(entry == lookup(fs, 3));
+    for (int i = COUNT - 1; i >= 6; i--) {
+        assert(ramfs_unlink(lookup(fs, i)) == 0);
+    }
+    ramfs_seekdir(dh, loc);
+    assert(ramfs_readdir(dh) == entry);
+    ramfs_closedir(dh);
+
+    /* and shrink back across it */
+    for (int i = 0; i < 6; i++) {
+        assert(ramfs_unlink(lookup(fs, i)) == 0);
+        check(fs, dir, i + 1, 6);
+    }
+
+    ramfs_deinit(fs);
+
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ramfs/ramfs.h"
+
+
+static size_t s_reallocs;
+
+static void *counting_malloc(void *ctx, size_t size)
+{
+    return malloc(size);
+}
+
+static void *counting_realloc(void *ctx, void *ptr, size_t size)
+{
+    s_reallocs++;
+    return realloc(ptr, size);
+}
+
+static void counting_free(void *ctx, void *ptr)
+{
+    free(ptr);
+}
+
+/* Growth policy of the vector directory index, so this is only built
+ * against the vector index */
+int main(int argc, char *argv[])
+{
+    ramfs_allocator_t alloc = {
+        .malloc = counting_malloc,
+        .realloc = counting_realloc,
+        .free = counting_free,
+    };
+    ramfs_config_t config = {
+        .allocator = &alloc,
+    };
+    ramfs_fs_t *fs;
+    ramfs_entry_t *dir;
+    char path[32];
+
+    fs = ramfs_init_ex(&config);
+    assert(fs != NULL);
+
+    /* growing a directory resizes its index a logarithmic number of times */
+    assert(ramfs_mkdir(fs, "grow") != NULL);
+    s_reallocs = 0;
+    for (int i = 0; i < 1000; i++) {
+        snprintf(path, sizeof(path), "grow/%d", i);
+        assert(ramfs_create(fs, path, 0) != NULL);
+    }
+    assert(s_reallocs <= 20);
+
+    /* and so does emptying it again */
+    s_reallocs = 0;
+    for (int i = 0; i < 1000; i++) {
+        snprintf(path, sizeof(path), "grow/%d", i);
+        assert(ramfs_unlink(ramfs_get_entry(fs, path)) == 0);
+    }
+    assert(s_reallocs <= 20);
+
+    /* alternating around a resize point does not resize every time */
+    for (int i = 0; i < 8; i++) {
+        snprintf(path, sizeof(path), "grow/%d", i);
+        assert(ramfs_create(fs, path, 0) != NULL);
+    }
+    s_reallocs = 0;
+    for (int i = 0; i < 100; i++) {
+        assert(ramfs_create(fs, "grow/x", 0) != NULL);
+        assert(ramfs_unlink(ramfs_get_entry(fs, "grow/x")) == 0);
+    }
+    assert(s_reallocs <= 2);
+
+    /* a capacity hint covers all entries up front */
+    s_reallocs = 0;
+    dir = ramfs_mkdir_ex(fs, "hint", 500);
+    assert(dir != NULL);
+    for (int i = 0; i < 500; i++) {
+        snprintf(path, sizeof(path), "hint/%d", i);
+        assert(ramfs_create(fs, path, 0) != NULL);
+    }
+    assert(s_reallocs <= 2);
+
+    ramfs_deinit(fs);
+    fs = NULL;
+
+    exit(EXIT_SUCCESS);
+    return 0;
+}
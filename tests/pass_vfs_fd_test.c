@@ -0,0 +1,163 @@
+#include <assert.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ramfs/ramfs.h"
+#include "ramfs/vfs.h"
+#include "esp_vfs.h"
+
+
+#define COUNT 40
+
+/* vfs.c is linked in directly and registers with this stand-in, which keeps
+ * the ops so the test can call them itself */
+static esp_vfs_t s_ops;
+static void *s_ctx;
+static char s_base_path[ESP_VFS_PATH_MAX + 1];
+
+esp_err_t esp_vfs_register(const char *base_path, const esp_vfs_t *vfs,
+        void *ctx)
+{
+    size_t len = strlen(base_path);
+    if (len > ESP_VFS_PATH_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memcpy(s_base_path, base_path, len + 1);
+    s_ops = *vfs;
+    s_ctx = ctx;
+    return ESP_OK;
+}
+
+esp_err_t esp_vfs_unregister(const char *base_path)
+{
+    if (s_base_path[0] == '\0' || strcmp(s_base_path, base_path) != 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    s_base_path[0] = '\0';
+    return ESP_OK;
+}
+
+int main(int argc, char *argv[])
+{
+    ramfs_fs_t *fs;
+    int fds[COUNT];
+    int seen[COUNT];
+    char c;
+    int fd;
+
+    fs = ramfs_init();
+    assert(fs != NULL);
+
+    ramfs_vfs_conf_t conf = {
+        .base_path = "/ramfs",
+        .fs = fs,
+        .max_files = 2,
+    };
+    assert(ramfs_vfs_register(&conf) == ESP_OK);
+    assert(strcmp(s_base_path, "/ramfs") == 0);
+
+    /* the table grows past max_files and hands out each descriptor once */
+    memset(seen, 0, sizeof(seen));
+    for (int i = 0; i < COUNT; i++) {
+        fds[i] = s_ops.open_p(s_ctx, "/file", O_RDWR | O_CREAT, 0666);
+        assert(fds[i] >= 0 && fds[i] < COUNT);
+        assert(!seen[fds[i]]);
+        seen[fds[i]] = 1;
+    }
+
+    /* every descriptor keeps its own handle, in later segments too */
+    for (int i = 0; i < COUNT; i++) {
+        c = i;
+        assert(s_ops.pwrite_p(s_ctx, fds[0], &c, 1, i) == 1);
+    }
+    for (int i = 0; i < COUNT; i++) {
+        assert(s_ops.lseek_p(s_ctx, fds[i], i, SEEK_SET) == i);
+    }
+    for (int i = 0; i < COUNT; i++) {
+        assert(s_ops.read_p(s_ctx, fds[i], &c, 1) == 1);
+        assert(c == i);
+    }
+
+    /* files and directories report their type and all permissions */
+    struct stat st;
+    assert(s_ops.fstat_p(s_ctx, fds[1], &st) == 0);
+    assert(S_ISREG(st.st_mode));
+    assert((st.st_mode & 0777) == 0777);
+    assert(st.st_size == COUNT);
+    assert(s_ops.mkdir_p(s_ctx, "/dir", 0777) == 0);
+    assert(s_ops.mkdir_p(s_ctx, "/dir", 0777) == -1);
+    assert(s_ops.stat_p(s_ctx, "/dir", &st) == 0);
+    assert(S_ISDIR(st.st_mode));
+    assert(s_ops.stat_p(s_ctx, "/file", &st) == 0);
+    assert(S_ISREG(st.st_mode));
+
+    /* the mount point itself is the root directory */
+    assert(s_ops.stat_p(s_ctx, "", &st) == 0);
+    assert(S_ISDIR(st.st_mode));
+    assert(st.st_size == 2);
+    assert(s_ops.stat_p(s_ctx, "/", &st) == 0);
+    assert(S_ISDIR(st.st_mode));
+    assert(s_ops.access_p(s_ctx, "/", F_OK) == 0);
+    DIR *dir = s_ops.opendir_p(s_ctx, "/");
+    assert(dir != NULL);
+    assert(s_ops.closedir_p(s_ctx, dir) == 0);
+
+    /* only O_CREAT creates a file, and O_EXCL wants it not to exist */
+    assert(s_ops.open_p(s_ctx, "/new", O_RDWR | O_TRUNC, 0) == -1);
+    assert(errno == ENOENT);
+    assert(s_ops.stat_p(s_ctx, "/new", &st) == -1);
+    assert(s_ops.open_p(s_ctx, "/file", O_RDWR | O_CREAT | O_EXCL, 0666) ==
+            -1);
+    assert(errno == EEXIST);
+
+    /* closed descriptors are reused, the last one closed first */
+    assert(s_ops.close_p(s_ctx, fds[5]) == 0);
+    assert(s_ops.close_p(s_ctx, fds[30]) == 0);
+    assert(s_ops.read_p(s_ctx, fds[30], &c, 1) == -1);
+    assert(errno == EBADF);
+
+    /* an open that fails gives its descriptor back */
+    assert(s_ops.open_p(s_ctx, "/missing", O_RDONLY, 0) == -1);
+    assert(s_ops.open_p(s_ctx, "/file", O_RDWR, 0) == fds[30]);
+    assert(s_ops.open_p(s_ctx, "/file", O_RDWR, 0) == fds[5]);
+
+    /* closing twice fails and leaves the free list alone */
+    assert(s_ops.close_p(s_ctx, fds[7]) == 0);
+    assert(s_ops.close_p(s_ctx, fds[7]) == -1);
+    assert(errno == EBADF);
+    assert(s_ops.open_p(s_ctx, "/file", O_RDWR, 0) == fds[7]);
+    fd = s_ops.open_p(s_ctx, "/file", O_RDWR, 0);
+    assert(fd >= 0 && fd != fds[7]);
+    assert(s_ops.close_p(s_ctx, fd) == 0);
+
+    /* descriptors that were never handed out are rejected */
+    assert(s_ops.read_p(s_ctx, -1, &c, 1) == -1);
+    assert(s_ops.read_p(s_ctx, 1 << 20, &c, 1) == -1);
+    assert(errno == EBADF);
+    assert(s_ops.close_p(s_ctx, 1 << 20) == -1);
+
+    for (int i = 0; i < COUNT; i += 2) {
+        assert(s_ops.close_p(s_ctx, fds[i]) == 0);
+    }
+
+    /* unregistering closes the rest and frees the mount slot */
+    assert(ramfs_vfs_register(&conf) == ESP_ERR_INVALID_STATE);
+    assert(ramfs_vfs_unregister("/ramfs") == ESP_OK);
+    assert(s_base_path[0] == '\0');
+    assert(ramfs_vfs_unregister("/ramfs") == ESP_ERR_INVALID_STATE);
+    assert(ramfs_get_entry(fs, "file") != NULL);
+    assert(ramfs_vfs_register(&conf) == ESP_OK);
+    assert(ramfs_vfs_unregister("/ramfs") == ESP_OK);
+
+    ramfs_deinit(fs);
+
+    return 0;
+}
@@ -0,0 +1,153 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ramfs/ramfs.h"
+#include "ramfs/vfs.h"
+#include "vfs_shim.h"
+
+
+int main(int argc, char *argv[])
+{
+    ramfs_fs_t *fs;
+    struct stat st;
+    char buf[64];
+    int fd;
+
+    fs = ramfs_init();
+    assert(fs != NULL);
+
+    ramfs_vfs_conf_t conf = {
+        .base_path = "/ramfs",
+        .fs = fs,
+        .max_files = 2,
+    };
+    assert(ramfs_vfs_register(&conf) == ESP_OK);
+
+    /* files are only created with O_CREAT */
+    assert(vfs_open("/ramfs/file", O_RDWR, 0) == -1);
+    assert(errno == ENOENT);
+    assert(vfs_open("/ramfs/file", O_RDWR | O_TRUNC, 0) == -1);
+    assert(errno == ENOENT);
+    fd = vfs_open("/ramfs/file", O_RDWR | O_CREAT, 0666);
+    assert(fd >= 0);
+    assert(vfs_open("/ramfs/file", O_RDWR | O_CREAT | O_EXCL, 0666) == -1);
+    assert(errno == EEXIST);
+    assert(vfs_open("/other/file", O_RDWR | O_CREAT, 0666) == -1);
+    assert(errno == ENOENT);
+
+    assert(vfs_write(fd, "hello world", 11) == 11);
+    assert(vfs_lseek(fd, 0, SEEK_SET) == 0);
+    assert(vfs_read(fd, buf, sizeof(buf)) == 11);
+    assert(memcmp(buf, "hello world", 11) == 0);
+    assert(vfs_pwrite(fd, "W", 1, 6) == 1);
+    assert(vfs_pread(fd, buf, 5, 6) == 5);
+    assert(memcmp(buf, "World", 5) == 0);
+    assert(vfs_lseek(fd, 0, SEEK_CUR) == 11);
+
+    assert(vfs_fstat(fd, &st) == 0);
+    assert(S_ISREG(st.st_mode));
+    assert(st.st_size == 11);
+    assert(vfs_ftruncate(fd, 5) == 0);
+    assert(vfs_fstat(fd, &st) == 0);
+    assert(st.st_size == 5);
+    assert(vfs_close(fd) == 0);
+    assert(vfs_close(fd) == -1);
+    assert(errno == EBADF);
+    assert(vfs_read(fd, buf, 1) == -1);
+    assert(errno == EBADF);
+
+    /* O_TRUNC empties an existing file */
+    fd = vfs_open("/ramfs/file", O_RDWR | O_TRUNC, 0);
+    assert(fd >= 0);
+    assert(vfs_fstat(fd, &st) == 0);
+    assert(st.st_size == 0);
+    assert(vfs_close(fd) == 0);
+
+    /* directories */
+    assert(vfs_mkdir("/ramfs/dir", 0777) == 0);
+    assert(vfs_mkdir("/ramfs/dir", 0777) == -1);
+    assert(vfs_stat("/ramfs/dir", &st) == 0);
+    assert(S_ISDIR(st.st_mode));
+    assert(vfs_stat("/ramfs", &st) == 0);
+    assert(S_ISDIR(st.st_mode));
+    assert(st.st_size == 2);
+    assert(vfs_stat("/ramfs/file", &st) == 0);
+    assert(S_ISREG(st.st_mode));
+    assert(vfs_stat("/ramfs/missing", &st) == -1);
+    assert(vfs_access("/ramfs/dir", F_OK) == 0);
+    assert(vfs_access("/ramfs/missing", F_OK) == -1);
+
+    assert(vfs_rename("/ramfs/file", "/ramfs/dir/moved") == 0);
+    assert(vfs_stat("/ramfs/file", &st) == -1);
+    assert(vfs_truncate("/ramfs/dir/moved", 100) == 0);
+    assert(vfs_stat("/ramfs/dir/moved", &st) == 0);
+    assert(st.st_size == 100);
+    assert(vfs_rename("/ramfs/dir/moved", "/other/moved") == -1);
+    assert(errno == EXDEV);
+
+    /* descriptors outgrow max_files */
+    int fds[10];
+    for (int i = 0; i < 10; i++) {
+        snprintf(buf, sizeof(buf), "/ramfs/dir/f%d", i);
+        fds[i] = vfs_open(buf, O_WRONLY | O_CREAT, 0666);
+        assert(fds[i] >= 0);
+        for (int j = 0; j < i; j++) {
+            assert(fds[i] != fds[j]);
+        }
+        assert(vfs_write(fds[i], buf, strlen(buf)) == strlen(buf));
+    }
+    for (int i = 0; i < 10; i += 2) {
+        assert(vfs_close(fds[i]) == 0);
+    }
+
+    DIR *dir = vfs_opendir("/ramfs/dir");
+    assert(dir != NULL);
+    size_t seen = 0;
+    long second = -1;
+    struct dirent *ent;
+    while ((ent = vfs_readdir(dir)) != NULL) {
+        if (seen == 0) {
+            second = vfs_telldir(dir);
+        }
+        if (strcmp(ent->d_name, "moved") == 0) {
+            assert(ent->d_type == DT_REG);
+        } else {
+            assert(ent->d_name[0] == 'f');
+            assert(ent->d_type == DT_REG);
+        }
+        seen++;
+    }
+    assert(seen == 11);
+    vfs_seekdir(dir, second);
+    assert(vfs_readdir(dir) != NULL);
+    assert(vfs_closedir(dir) == 0);
+
+    dir = vfs_opendir("/ramfs");
+    assert(dir != NULL);
+    ent = vfs_readdir(dir);
+    assert(ent != NULL);
+    assert(strcmp(ent->d_name, "dir") == 0);
+    assert(ent->d_type == DT_DIR);
+    assert(vfs_readdir(dir) == NULL);
+    assert(vfs_closedir(dir) == 0);
+    assert(vfs_opendir("/ramfs/missing") == NULL);
+
+    assert(vfs_rmdir("/ramfs/dir") == -1);
+    assert(vfs_unlink("/ramfs/dir/moved") == 0);
+    assert(vfs_unlink("/ramfs/dir/moved") == -1);
+
+    /* the rest stay open until unregistering closes them */
+    assert(ramfs_vfs_unregister("/ramfs") == ESP_OK);
+    assert(ramfs_vfs_unregister("/ramfs") == ESP_ERR_INVALID_STATE);
+    assert(vfs_open("/ramfs/dir/f1", O_RDONLY, 0) == -1);
+    assert(ramfs_get_entry(fs, "dir/f1") != NULL);
+
+    ramfs_deinit(fs);
+
+    return 0;
+}
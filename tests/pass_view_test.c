@@ -0,0 +1,95 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ramfs/ramfs.h"
+
+
+int main(int argc, char *argv[])
+{
+    ramfs_fs_t *fs;
+    ramfs_entry_t *file;
+    ramfs_fh_t *fh, *tfh;
+    ramfs_span_t *spans, *other;
+    char buf[64];
+    size_t total;
+    ssize_t count;
+
+    fs = ramfs_init();
+    assert(fs != NULL);
+
+    file = ramfs_create(fs, "test", 0);
+    assert(file != NULL);
+
+    fh = ramfs_open(fs, file, O_RDWR);
+    assert(fh != NULL);
+
+    for (int i = 0; i < 1000; i++) {
+        snprintf(buf, sizeof(buf), "line %04d\n", i);
+        assert(ramfs_write(fh, buf, 10) == 10);
+    }
+
+    /* the spans cover the range in order, without copying */
+    count = ramfs_read_view(fh, 5, 20000, &spans);
+    assert(count > 1);
+    assert(memcmp(spans[0].buf, "0000\nline 0001\n", 15) == 0);
+    total = 0;
+    for (ssize_t i = 0; i < count; i++) {
+        assert(spans[i].len > 0);
+        total += spans[i].len;
+    }
+    assert(total == 9995);
+    assert(memcmp((const char *) spans[count - 1].buf +
+            spans[count - 1].len - 5, "0999\n", 5) == 0);
+    assert(ramfs_tell(fh) == 10000);
+
+    /* truncating does not free what a view still points at */
+    other = NULL;
+    assert(ramfs_read_view(fh, 9990, 100, &other) == 1);
+    assert(other[0].len == 10);
+    assert(ramfs_truncate(fs, file, 100) == 0);
+    assert(memcmp(other[0].buf, "line 0999\n", 10) == 0);
+    tfh = ramfs_open(fs, file, O_RDWR | O_TRUNC);
+    assert(tfh != NULL);
+    assert(memcmp(other[0].buf, "line 0999\n", 10) == 0);
+    ramfs_release_view(fh, other);
+    assert(memcmp((const char *) spans[count - 1].buf +
+            spans[count - 1].len - 5, "0999\n", 5) == 0);
+    ramfs_release_view(fh, spans);
+    ramfs_close(tfh);
+
+    /* nothing to see at or past the end */
+    assert(ramfs_read_view(fh, 0, 10, &spans) == 0);
+    assert(spans == NULL);
+    ramfs_release_view(fh, spans);
+    assert(ramfs_read_view(fh, -1, 10, &spans) == -1);
+    assert(errno == EINVAL);
+
+    /* holes read back as zeros */
+    assert(ramfs_truncate(fs, file, 2000) == 0);
+    assert(ramfs_pwrite(fh, "end", 3, 2000) == 3);
+    count = ramfs_read_view(fh, 0, 4096, &spans);
+    assert(count > 1);
+    total = 0;
+    for (ssize_t i = 0; i < count; i++) {
+        for (size_t j = 0; j < spans[i].len && total + j < 2000; j++) {
+            assert(((const char *) spans[i].buf)[j] == 0);
+        }
+        total += spans[i].len;
+    }
+    assert(total == 2003);
+    assert(memcmp((const char *) spans[count - 1].buf +
+            spans[count - 1].len - 3, "end", 3) == 0);
+    ramfs_release_view(fh, spans);
+
+    ramfs_close(fh);
+
+    ramfs_deinit(fs);
+    fs = NULL;
+
+    exit(EXIT_SUCCESS);
+    return 0;
+}